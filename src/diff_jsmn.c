@@ -0,0 +1,581 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "jsmn_tree.h"
+#include "json_diff_internal.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef MAX_JSON_DEPTH
+#define MAX_JSON_DEPTH 1024
+#endif
+
+#define ARRAY_MARKER "_t"
+#define ARRAY_MARKER_VALUE "a"
+
+/**
+ * struct jdiff - State of one diff_jsmn() call
+ * @l: left token tree
+ * @r: right token tree
+ * @opts: resolved options
+ * @arena: where delta nodes go (opts->arena)
+ * @depth: current recursion depth
+ */
+struct jdiff {
+	const jsmntree_t *l;
+	const jsmntree_t *r;
+	const struct json_diff_options *opts;
+	struct json_diff_arena *arena;
+	int depth;
+};
+
+/* Token reference: a tree and a token index in it */
+struct jref {
+	const jsmntree_t *t;
+	int i;
+};
+
+static bool jequal(const struct jdiff *jd, struct jref a, struct jref b)
+{
+	if (jd->opts->stats)
+		jd->opts->stats->equal_calls++;
+	return jsmntree_token_equal(a.t, a.i, b.t, b.i,
+	                            jd->opts->strict_equality);
+}
+
+/* Decoded key/string of token @idx; heap buffers beyond @stack_size */
+static char *jstring(const jsmntree_t *t, int idx, char *stack,
+                     size_t stack_size)
+{
+	size_t need = (size_t)(t->toks[idx].end - t->toks[idx].start) + 1;
+	char *buf = need <= stack_size ? stack : malloc(need);
+	if (buf)
+		jsmntree_string(t, idx, buf);
+	return buf;
+}
+
+/* Build an owned cJSON copy of a token subtree, in the arena if set */
+static cJSON *jvalue(const struct jdiff *jd, struct jref v)
+{
+	struct json_diff_arena *arena = jd->arena;
+	const jsmntok_t *tok = &v.t->toks[v.i];
+	char stack[256];
+	cJSON *res = NULL;
+
+	switch (jsmntree_cjson_type(v.t, v.i)) {
+	case cJSON_NULL:
+		return diff_new_null(arena);
+	case cJSON_True:
+		return diff_new_bool(arena, true);
+	case cJSON_False:
+		return diff_new_bool(arena, false);
+	case cJSON_Number:
+		return diff_new_number(arena, tok->num);
+	case cJSON_String: {
+		char *s = jstring(v.t, v.i, stack, sizeof(stack));
+		if (s)
+			res = diff_new_string(arena, s);
+		if (s != stack)
+			free(s);
+		return res;
+	}
+	case cJSON_Array:
+		res = diff_new_array(arena);
+		for (int i = 0, c = v.i + 1; res && i < tok->size; i++) {
+			cJSON *item = jvalue(jd, (struct jref){v.t, c});
+			if (!diff_add_item(arena, res, item)) {
+				diff_delete(arena, item);
+				diff_delete(arena, res);
+				return NULL;
+			}
+			c = jsmntree_next(v.t, c);
+		}
+		return res;
+	default:
+		res = diff_new_object(arena);
+		for (int i = 0, k = v.i + 1; res && i < tok->size; i++) {
+			cJSON *item = jvalue(jd, (struct jref){v.t, k + 1});
+			char *key = jstring(v.t, k, stack, sizeof(stack));
+			bool ok = key && diff_add_item_to_object(arena, res,
+			                                         key, item);
+			if (key != stack)
+				free(key);
+			if (!ok) {
+				diff_delete(arena, item);
+				diff_delete(arena, res);
+				return NULL;
+			}
+			k = jsmntree_next(v.t, k + 1);
+		}
+		return res;
+	}
+}
+
+/* Delta op: [a], [a, b] or [a, 0, 0]; an old a is null if forward only */
+static cJSON *jop(const struct jdiff *jd, struct jref a, const struct jref *b,
+                  int trailer)
+{
+	struct json_diff_arena *arena = jd->arena;
+	cJSON *op = diff_new_array(arena);
+	if (!op)
+		return NULL;
+	int n = 0;
+	bool old = b || trailer;
+	cJSON *items[4] = {old && jd->opts->forward_only ? diff_new_null(arena)
+	                                                 : jvalue(jd, a)};
+	if (b)
+		items[++n] = jvalue(jd, *b);
+	while (trailer-- > 0)
+		items[++n] = diff_new_number(arena, 0);
+	for (int i = 0; i <= n; i++) {
+		if (!diff_add_item(arena, op, items[i])) {
+			while (i <= n)
+				diff_delete(arena, items[i++]);
+			diff_delete(arena, op);
+			return NULL;
+		}
+	}
+	return op;
+}
+
+static void add_member(const struct jdiff *jd, cJSON *obj, const char *key,
+                       cJSON *val)
+{
+	if (val && !diff_add_item_to_object(jd->arena, obj, key, val))
+		diff_delete(jd->arena, val);
+}
+
+static void add_indexed(const struct jdiff *jd, cJSON *obj, const char *fmt,
+                        int index, cJSON *val)
+{
+	char key[32];
+	snprintf(key, sizeof(key), fmt, index);
+	add_member(jd, obj, key, val);
+}
+
+static cJSON *jdiff_value(struct jdiff *jd, struct jref a, struct jref b);
+
+/*
+ * Object delta: left keys in order, then keys only in right, looked up
+ * through a small open-addressed index of the right object's first
+ * occurrence of every key (cJSON_GetObjectItemCaseSensitive() semantics)
+ */
+struct jkey {
+	uint64_t hash;
+	int key;
+	bool matched;
+};
+
+static cJSON *jdiff_object(struct jdiff *jd, struct jref a, struct jref b)
+{
+	const jsmntree_t *lt = a.t, *rt = b.t;
+	struct json_diff_stats *st = jd->opts->stats;
+	uint64_t t0 = json_diff_stats_clock(st);
+	int n = rt->toks[b.i].size;
+	size_t cap = 8;
+	while (cap < (size_t)n * 2)
+		cap <<= 1;
+	struct jkey *idx = calloc(cap, sizeof(*idx));
+	cJSON *diff_obj = diff_new_object(jd->arena);
+	if (!idx || !diff_obj) {
+		free(idx);
+		diff_delete(jd->arena, diff_obj);
+		return NULL;
+	}
+	for (int i = 0, k = b.i + 1; i < n; i++) {
+		/* Slots hold key token + 1 so that 0 marks an empty slot */
+		uint64_t h = jsmntree_hash(rt, k, true);
+		size_t s = (size_t)h & (cap - 1);
+		while (idx[s].key && !jsmntree_token_equal(rt, idx[s].key - 1,
+		                                           rt, k, true))
+			s = (s + 1) & (cap - 1);
+		if (!idx[s].key) {
+			idx[s].hash = h;
+			idx[s].key = k + 1;
+		}
+		k = jsmntree_next(rt, k + 1);
+	}
+	if (st) {
+		st->index_ns += json_diff_stats_clock(st) - t0;
+		st->key_indexes++;
+		st->bytes_allocated += cap * sizeof(*idx);
+	}
+
+	char stack[256];
+	for (int i = 0, k = a.i + 1; i < lt->toks[a.i].size; i++) {
+		uint64_t h = jsmntree_hash(lt, k, true);
+		size_t s = (size_t)h & (cap - 1);
+		while (idx[s].key && (idx[s].hash != h ||
+		                      !jsmntree_token_equal(rt, idx[s].key - 1,
+		                                            lt, k, true)))
+			s = (s + 1) & (cap - 1);
+		struct jref lv = {lt, k + 1};
+		cJSON *d;
+		if (idx[s].key) {
+			idx[s].matched = true;
+			d = jdiff_value(jd, lv, (struct jref){rt, idx[s].key});
+		} else {
+			d = jop(jd, lv, NULL, 2);
+		}
+		if (d) {
+			char *key = jstring(lt, k, stack, sizeof(stack));
+			if (key)
+				add_member(jd, diff_obj, key, d);
+			else
+				diff_delete(jd->arena, d);
+			if (key != stack)
+				free(key);
+		}
+		k = jsmntree_next(lt, k + 1);
+	}
+	for (int i = 0, k = b.i + 1; i < n; i++) {
+		uint64_t h = jsmntree_hash(rt, k, true);
+		size_t s = (size_t)h & (cap - 1);
+		while (idx[s].key && (idx[s].hash != h ||
+		                      !jsmntree_token_equal(rt, idx[s].key - 1,
+		                                            rt, k, true)))
+			s = (s + 1) & (cap - 1);
+		if (idx[s].key == k + 1 && !idx[s].matched) {
+			char *key = jstring(rt, k, stack, sizeof(stack));
+			if (key)
+				add_member(jd, diff_obj, key,
+				           jop(jd, (struct jref){rt, k + 1}, NULL,
+				               0));
+			if (key != stack)
+				free(key);
+		}
+		k = jsmntree_next(rt, k + 1);
+	}
+	free(idx);
+	if (!diff_obj->child) {
+		diff_delete(jd->arena, diff_obj);
+		return NULL;
+	}
+	return diff_obj;
+}
+
+/* object_key identity of an array element, or the element itself */
+static struct jref jidentity(const struct jdiff *jd, struct jref v)
+{
+	const char *p = jd->opts->object_key;
+	int cur = v.i;
+	char part[256], stack[256];
+	if (v.t->toks[v.i].type != JSMN_OBJECT)
+		return v;
+	while (cur >= 0 && *p) {
+		const char *dot = strchr(p, '.');
+		size_t len = dot ? (size_t)(dot - p) : strlen(p);
+		if (len >= sizeof(part))
+			return v;
+		memcpy(part, p, len);
+		part[len] = '\0';
+		int found = -1;
+		if (v.t->toks[cur].type == JSMN_OBJECT) {
+			for (int i = 0, k = cur + 1; i < v.t->toks[cur].size;
+			     i++) {
+				char *key = jstring(v.t, k, stack, sizeof(stack));
+				bool hit = key && strcmp(key, part) == 0;
+				if (key != stack)
+					free(key);
+				if (hit) {
+					found = k + 1;
+					break;
+				}
+				k = jsmntree_next(v.t, k + 1);
+			}
+		}
+		cur = found;
+		p += len + (dot ? 1 : 0);
+	}
+	return cur >= 0 ? (struct jref){v.t, cur} : v;
+}
+
+/* Equivalence class representative for the SES input */
+struct jclass {
+	uint64_t hash;
+	struct jref rep;
+	int id;
+	int next; /* next representative in the same slot chain, -1 ends */
+};
+
+/*
+ * Give every element of @ea and @eb a class id so that equal elements,
+ * and only those, share an id. Elements are bucketed by structural hash
+ * and checked against each bucket's representatives.
+ */
+static int jclassify(const struct jdiff *jd, const struct jref *ea, int n,
+                     const struct jref *eb, int m, int *ia, int *ib)
+{
+	size_t total = (size_t)n + (size_t)m, cap = 16;
+	while (cap < total * 2)
+		cap <<= 1;
+	int *slots = malloc(cap * sizeof(*slots));
+	struct jclass *cls = malloc((total ? total : 1) * sizeof(*cls));
+	if (!slots || !cls) {
+		free(slots);
+		free(cls);
+		return 0;
+	}
+	for (size_t i = 0; i < cap; i++)
+		slots[i] = -1;
+	int ncls = 0;
+	for (size_t e = 0; e < total; e++) {
+		struct jref v = e < (size_t)n ? ea[e] : eb[e - (size_t)n];
+		uint64_t h = jsmntree_hash(v.t, v.i, jd->opts->strict_equality);
+		size_t s = (size_t)h & (cap - 1);
+		int c = slots[s];
+		while (c >= 0 && (cls[c].hash != h || !jequal(jd, cls[c].rep, v)))
+			c = cls[c].next;
+		if (c < 0) {
+			c = ncls++;
+			cls[c] = (struct jclass){h, v, c, slots[s]};
+			slots[s] = c;
+		}
+		if (e < (size_t)n)
+			ia[e] = cls[c].id;
+		else
+			ib[e - (size_t)n] = cls[c].id;
+	}
+	free(slots);
+	free(cls);
+	return 1;
+}
+
+/*
+ * Move pass over class ids: pair each insertion with the first unused
+ * deletion of the same class, as find_moves() does for cJSON elements
+ */
+static int jfind_moves(const int *ia, const int *ib, int n, int m,
+                       const struct myers_seg *segs, int nsegs, int *move_to,
+                       bool *moved_in)
+{
+	int nclass = 0;
+	for (int i = 0; i < n; i++)
+		nclass = ia[i] >= nclass ? ia[i] + 1 : nclass;
+	for (int j = 0; j < m; j++)
+		nclass = ib[j] >= nclass ? ib[j] + 1 : nclass;
+	/* Per class: a queue of deleted positions in ascending order */
+	int *head = malloc((size_t)(nclass ? nclass : 1) * sizeof(int));
+	int *tail = malloc((size_t)(nclass ? nclass : 1) * sizeof(int));
+	int *next = malloc((size_t)(n ? n : 1) * sizeof(int));
+	if (!head || !tail || !next) {
+		free(head);
+		free(tail);
+		free(next);
+		return 0;
+	}
+	for (int c = 0; c < nclass; c++)
+		head[c] = tail[c] = -1;
+	for (int s = 0; s < nsegs; s++) {
+		for (int j = 0; segs[s].type == MYERS_DEL && j < segs[s].len;
+		     j++) {
+			int a = segs[s].a_start + j, c = ia[a];
+			next[a] = -1;
+			if (tail[c] >= 0)
+				next[tail[c]] = a;
+			else
+				head[c] = a;
+			tail[c] = a;
+		}
+	}
+	for (int s = 0; s < nsegs; s++) {
+		for (int j = 0; segs[s].type == MYERS_INS && j < segs[s].len;
+		     j++) {
+			int b = segs[s].b_start + j, c = ib[b];
+			if (head[c] < 0)
+				continue;
+			move_to[head[c]] = b;
+			moved_in[b] = true;
+			head[c] = next[head[c]];
+		}
+	}
+	free(head);
+	free(tail);
+	free(next);
+	return 1;
+}
+
+/* Array delta: the same script and emission rules as emit_array_diff() */
+static cJSON *jdiff_array(struct jdiff *jd, struct jref a, struct jref b)
+{
+	struct json_diff_arena *arena = jd->arena;
+	const struct json_diff_options *opts = jd->opts;
+	int n = a.t->toks[a.i].size, m = b.t->toks[b.i].size;
+	bool keyed = opts->object_key && *opts->object_key;
+	size_t nn = n ? (size_t)n : 1, mm = m ? (size_t)m : 1;
+	struct jref *ea = malloc(nn * sizeof(*ea)), *eb = malloc(mm * sizeof(*eb));
+	struct jref *ka = malloc(nn * sizeof(*ka)), *kb = malloc(mm * sizeof(*kb));
+	int *ia = malloc(nn * sizeof(int)), *ib = malloc(mm * sizeof(int));
+	int *left_rest = malloc(nn * sizeof(int));
+	int *right_rest = malloc(mm * sizeof(int));
+	int *move_to = NULL;
+	bool *moved_in = NULL;
+	struct myers_seg *segs = NULL;
+	int nsegs = 0;
+	cJSON *diff_obj = NULL;
+
+	if (!ea || !eb || !ka || !kb || !ia || !ib || !left_rest || !right_rest)
+		goto out;
+	for (int i = 0, c = a.i + 1; i < n; i++, c = jsmntree_next(a.t, c)) {
+		ea[i] = (struct jref){a.t, c};
+		ka[i] = keyed ? jidentity(jd, ea[i]) : ea[i];
+	}
+	for (int j = 0, c = b.i + 1; j < m; j++, c = jsmntree_next(b.t, c)) {
+		eb[j] = (struct jref){b.t, c};
+		kb[j] = keyed ? jidentity(jd, eb[j]) : eb[j];
+	}
+	if (!jclassify(jd, ka, n, kb, m, ia, ib) ||
+	    !json_myers_script_ids(ia, n, ib, m, opts, &segs, &nsegs))
+		goto out;
+	if (opts->detect_moves && n && m) {
+		move_to = malloc(nn * sizeof(int));
+		moved_in = calloc(mm, sizeof(bool));
+		if (!move_to || !moved_in)
+			goto out;
+		for (int i = 0; i < n; i++)
+			move_to[i] = -1;
+		if (!jfind_moves(ia, ib, n, m, segs, nsegs, move_to, moved_in))
+			goto out;
+	}
+	if (!(diff_obj = diff_new_object(arena)))
+		goto out;
+
+	for (int si = 0; si < nsegs;) {
+		if (segs[si].type == MYERS_EQUAL) {
+			for (int j = 0; keyed && j < segs[si].len; j++) {
+				int x = segs[si].a_start + j;
+				int y = segs[si].b_start + j;
+				if (!jequal(jd, ea[x], eb[y]))
+					add_indexed(jd, diff_obj, "%d", y,
+					            jdiff_value(jd, ea[x], eb[y]));
+			}
+			si++;
+			continue;
+		}
+		int dl = 0, il = 0;
+		for (; si < nsegs && segs[si].type != MYERS_EQUAL; si++) {
+			for (int j = 0; j < segs[si].len; j++) {
+				if (segs[si].type == MYERS_INS) {
+					int y = segs[si].b_start + j;
+					if (!moved_in || !moved_in[y])
+						right_rest[il++] = y;
+					continue;
+				}
+				int x = segs[si].a_start + j;
+				if (!move_to || move_to[x] < 0) {
+					left_rest[dl++] = x;
+					continue;
+				}
+				int to = move_to[x];
+				cJSON *mv = diff_move_array(
+				    &(struct json_diff_ctx){.opts = opts}, to);
+				add_indexed(jd, diff_obj, "_%d", x, mv);
+				if (keyed && !jequal(jd, ea[x], eb[to]))
+					add_indexed(jd, diff_obj, "%d", to,
+					            jdiff_value(jd, ea[x], eb[to]));
+			}
+		}
+		int paired = dl < il ? dl : il;
+		for (int j = 0; j < paired; j++) {
+			int x = left_rest[j], y = right_rest[j];
+			bool both_keyed = keyed && ka[x].i != ea[x].i &&
+			                  kb[y].i != eb[y].i;
+			if (a.t->toks[ea[x].i].type == JSMN_OBJECT &&
+			    b.t->toks[eb[y].i].type == JSMN_OBJECT && !both_keyed) {
+				if (!jequal(jd, ea[x], eb[y]))
+					add_indexed(jd, diff_obj, "%d", y,
+					            jdiff_value(jd, ea[x], eb[y]));
+				continue;
+			}
+			add_indexed(jd, diff_obj, "_%d", x, jop(jd, ea[x], NULL, 2));
+			add_indexed(jd, diff_obj, "%d", y, jop(jd, eb[y], NULL, 0));
+		}
+		for (int j = paired; j < dl; j++)
+			add_indexed(jd, diff_obj, "_%d", left_rest[j],
+			            jop(jd, ea[left_rest[j]], NULL, 2));
+		for (int j = paired; j < il; j++)
+			add_indexed(jd, diff_obj, "%d", right_rest[j],
+			            jop(jd, eb[right_rest[j]], NULL, 0));
+	}
+	if (!diff_obj->child) {
+		diff_delete(arena, diff_obj);
+		diff_obj = NULL;
+	} else {
+		add_member(jd, diff_obj, ARRAY_MARKER,
+		           diff_new_string(arena, ARRAY_MARKER_VALUE));
+	}
+
+out:
+	free(ea);
+	free(eb);
+	free(ka);
+	free(kb);
+	free(ia);
+	free(ib);
+	free(left_rest);
+	free(right_rest);
+	free(move_to);
+	free(moved_in);
+	free(segs);
+	return diff_obj;
+}
+
+/* Text diff op of two long string tokens, NULL to write [a, b] instead */
+static cJSON *jtext(const struct jdiff *jd, struct jref a, struct jref b)
+{
+	size_t min = jd->opts->text_diff_min_length;
+	if (!min || (size_t)(a.t->toks[a.i].end - a.t->toks[a.i].start) < min ||
+	    (size_t)(b.t->toks[b.i].end - b.t->toks[b.i].start) < min)
+		return NULL;
+	char *l = jstring(a.t, a.i, NULL, 0), *r = jstring(b.t, b.i, NULL, 0);
+	char *patch = l && r ? json_text_diff(l, r, jd->opts) : NULL;
+	cJSON *res = patch ? diff_text_array(jd->arena, patch) : NULL;
+	free(l);
+	free(r);
+	free(patch);
+	return res;
+}
+
+/* do_json_diff() on tokens */
+static cJSON *jdiff_value(struct jdiff *jd, struct jref a, struct jref b)
+{
+	cJSON *res = NULL;
+	if (++jd->depth > MAX_JSON_DEPTH || jequal(jd, a, b))
+		goto out;
+	int type = jsmntree_cjson_type(a.t, a.i);
+	if (type == cJSON_String && jsmntree_cjson_type(b.t, b.i) == type &&
+	    (res = jtext(jd, a, b)))
+		goto out;
+	if (type != jsmntree_cjson_type(b.t, b.i) ||
+	    !(type & (cJSON_Object | cJSON_Array)))
+		res = jop(jd, a, &b, 0);
+	else if (type == cJSON_Array)
+		res = jdiff_array(jd, a, b);
+	else
+		res = jdiff_object(jd, a, b);
+out:
+	jd->depth--;
+	return res;
+}
+
+bool jsmn_diff_supported(const struct json_diff_options *opts)
+{
+	return !opts || (!opts->object_hash && !json_diff_filtering(opts));
+}
+
+cJSON *diff_jsmn(const jsmntree_t *tree1, int idx1, const jsmntree_t *tree2,
+                 int idx2, const struct json_diff_options *opts)
+{
+	struct json_diff_options default_opts = {.strict_equality = true};
+	if (!opts)
+		opts = &default_opts;
+	if (!tree1 || !tree2 || idx1 < 0 || idx1 >= tree1->count || idx2 < 0 ||
+	    idx2 >= tree2->count || !jsmn_diff_supported(opts))
+		return NULL;
+	struct jdiff jd = {.l = tree1,
+	                   .r = tree2,
+	                   .opts = opts,
+	                   .arena = opts->arena};
+	return jdiff_value(&jd, (struct jref){tree1, idx1},
+	                   (struct jref){tree2, idx2});
+}
@@ -0,0 +1,550 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "jsmn_tree.h"
+#include "json_hash.h"
+#include "json_simd.h"
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Same nesting limit as cJSON_Parse() */
+#ifndef JSMN_NESTING_LIMIT
+#define JSMN_NESTING_LIMIT 1000
+#endif
+
+struct jsmn_parser {
+	jsmntree_t *tree;
+	int depth;
+};
+
+static const char *skip_ws(const char *p)
+{
+	while (*p && (unsigned char)*p <= 32)
+		p++;
+	return p;
+}
+
+static int new_token(struct jsmn_parser *ps, jsmntype_t type, int start)
+{
+	jsmntree_t *t = ps->tree;
+	if (t->count == t->cap) {
+		if (t->cap > INT_MAX / 2)
+			return -1;
+		int cap = t->cap ? t->cap * 2 : 64;
+		jsmntok_t *toks = realloc(t->toks, (size_t)cap * sizeof(*toks));
+		if (!toks)
+			return -1;
+		t->toks = toks;
+		t->cap = cap;
+	}
+	jsmntok_t *tok = &t->toks[t->count];
+	tok->type = type;
+	tok->start = start;
+	tok->end = start;
+	tok->size = 0;
+	tok->skip = 1;
+	tok->flags = 0;
+	tok->num = 0;
+	return t->count++;
+}
+
+static int hex4(const char *p)
+{
+	int v = 0;
+	for (int i = 0; i < 4; i++) {
+		char c = p[i];
+		v <<= 4;
+		if (c >= '0' && c <= '9')
+			v |= c - '0';
+		else if (c >= 'a' && c <= 'f')
+			v |= c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			v |= c - 'A' + 10;
+		else
+			return -1;
+	}
+	return v;
+}
+
+/*
+ * Decode one \u escape (and its low surrogate) at @p, which points at the
+ * 'u'. Writes UTF-8 to @dst when non-NULL.
+ *
+ * Return: escape characters consumed after the backslash, 0 if invalid
+ */
+static int decode_utf16(const char *p, char *dst, int *out_len)
+{
+	int first = hex4(p + 1);
+	if (first < 0 || (first >= 0xDC00 && first <= 0xDFFF))
+		return 0;
+	unsigned long cp = (unsigned long)first;
+	int used = 5;
+	if (first >= 0xD800 && first <= 0xDBFF) {
+		if (p[5] != '\\' || p[6] != 'u')
+			return 0;
+		int second = hex4(p + 7);
+		if (second < 0xDC00 || second > 0xDFFF)
+			return 0;
+		cp = 0x10000 + (((unsigned long)first & 0x3FF) << 10) +
+		     ((unsigned long)second & 0x3FF);
+		used = 11;
+	}
+	int n = cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+	if (dst) {
+		static const unsigned char lead[] = {0, 0, 0xC0, 0xE0, 0xF0};
+		for (int i = n - 1; i > 0; i--) {
+			dst[i] = (char)(0x80 | (cp & 0x3F));
+			cp >>= 6;
+		}
+		dst[0] = (char)(lead[n] | cp);
+	}
+	*out_len = n;
+	return used;
+}
+
+/* Parse a string body at @p (after the quote) into token @idx */
+static const char *parse_string(struct jsmn_parser *ps, const char *p,
+                                int idx)
+{
+	const char *js = ps->tree->js;
+	const char *q = p;
+	int flags = 0;
+	while (*q != '"') {
+		if (!*q)
+			return NULL;
+		if (*q != '\\') {
+			q++;
+			continue;
+		}
+		flags = JSMN_ESCAPED;
+		int used, len;
+		switch (q[1]) {
+		case 'b': case 'f': case 'n': case 'r': case 't':
+		case '"': case '\\': case '/':
+			q += 2;
+			break;
+		case 'u':
+			used = decode_utf16(q + 1, NULL, &len);
+			if (!used)
+				return NULL;
+			q += 1 + used;
+			break;
+		default:
+			return NULL;
+		}
+	}
+	jsmntok_t *tok = &ps->tree->toks[idx];
+	tok->start = (int)(p - js);
+	tok->end = (int)(q - js);
+	tok->flags = flags;
+	return q + 1;
+}
+
+/* Number: what strtod() takes of the first 63 number characters */
+static const char *parse_number(struct jsmn_parser *ps, const char *p,
+                                int idx)
+{
+	char buf[64];
+	size_t n = 0;
+	while (n < sizeof(buf) - 1 && p[n] && strchr("0123456789+-eE.", p[n]))
+		n++;
+	memcpy(buf, p, n);
+	buf[n] = '\0';
+	char *end = NULL;
+	double d = strtod(buf, &end);
+	if (end == buf)
+		return NULL;
+	jsmntok_t *tok = &ps->tree->toks[idx];
+	tok->start = (int)(p - ps->tree->js);
+	tok->end = tok->start + (int)(end - buf);
+	tok->num = d;
+	return p + (end - buf);
+}
+
+static const char *parse_value(struct jsmn_parser *ps, const char *p);
+
+static const char *parse_container(struct jsmn_parser *ps, const char *p,
+                                   bool object)
+{
+	if (++ps->depth > JSMN_NESTING_LIMIT)
+		return NULL;
+	int idx = new_token(ps, object ? JSMN_OBJECT : JSMN_ARRAY,
+	                    (int)(p - ps->tree->js));
+	if (idx < 0)
+		return NULL;
+	char close = object ? '}' : ']';
+	int size = 0;
+	p = skip_ws(p + 1);
+	if (*p != close) {
+		for (;;) {
+			p = skip_ws(p);
+			if (object) {
+				if (*p != '"')
+					return NULL;
+				int key = new_token(ps, JSMN_STRING, 0);
+				if (key < 0 || !(p = parse_string(ps, p + 1, key)))
+					return NULL;
+				ps->tree->toks[key].size = 1;
+				p = skip_ws(p);
+				if (*p != ':')
+					return NULL;
+				p = skip_ws(p + 1);
+			}
+			if (!(p = parse_value(ps, p)))
+				return NULL;
+			size++;
+			p = skip_ws(p);
+			if (*p == ',') {
+				p++;
+				continue;
+			}
+			if (*p != close)
+				return NULL;
+			break;
+		}
+	}
+	jsmntok_t *tok = &ps->tree->toks[idx];
+	tok->end = (int)(p + 1 - ps->tree->js);
+	tok->size = size;
+	tok->skip = ps->tree->count - idx;
+	ps->depth--;
+	return p + 1;
+}
+
+static const char *parse_literal(struct jsmn_parser *ps, const char *p,
+                                 const char *lit)
+{
+	size_t n = strlen(lit);
+	if (strncmp(p, lit, n) != 0)
+		return NULL;
+	int idx = new_token(ps, JSMN_PRIMITIVE, (int)(p - ps->tree->js));
+	if (idx < 0)
+		return NULL;
+	ps->tree->toks[idx].end = ps->tree->toks[idx].start + (int)n;
+	return p + n;
+}
+
+static const char *parse_value(struct jsmn_parser *ps, const char *p)
+{
+	int idx;
+	switch (*p) {
+	case 'n':
+		return parse_literal(ps, p, "null");
+	case 'f':
+		return parse_literal(ps, p, "false");
+	case 't':
+		return parse_literal(ps, p, "true");
+	case '"':
+		idx = new_token(ps, JSMN_STRING, 0);
+		return idx < 0 ? NULL : parse_string(ps, p + 1, idx);
+	case '{':
+		return parse_container(ps, p, true);
+	case '[':
+		return parse_container(ps, p, false);
+	default:
+		if (*p != '-' && (*p < '0' || *p > '9'))
+			return NULL;
+		idx = new_token(ps, JSMN_PRIMITIVE, 0);
+		return idx < 0 ? NULL : parse_number(ps, p, idx);
+	}
+}
+
+int jsmntree_init(jsmntree_t *tree, const char *js)
+{
+	memset(tree, 0, sizeof(*tree));
+	if (!js)
+		return -1;
+	tree->js = js;
+	struct jsmn_parser ps = {.tree = tree};
+	const char *p = js;
+	if (strncmp(p, "\xEF\xBB\xBF", 3) == 0)
+		p += 3;
+	if (!parse_value(&ps, skip_ws(p))) {
+		jsmntree_free(tree);
+		return -1;
+	}
+	return 0;
+}
+
+void jsmntree_free(jsmntree_t *tree)
+{
+	free(tree->toks);
+	tree->toks = NULL;
+	tree->count = tree->cap = 0;
+}
+
+int jsmntree_num_children(const jsmntree_t *tree, int idx)
+{
+	const jsmntok_t *tok = &tree->toks[idx];
+	return tok->type & (JSMN_OBJECT | JSMN_ARRAY) ? tok->size : 0;
+}
+
+int jsmntree_child(const jsmntree_t *tree, int parent, int n)
+{
+	if (n < 0 || n >= jsmntree_num_children(tree, parent))
+		return -1;
+	int idx = parent + 1;
+	bool object = tree->toks[parent].type == JSMN_OBJECT;
+	for (int i = 0; i < n; i++) {
+		/* A member is the key token plus its value subtree */
+		idx = object ? jsmntree_next(tree, idx + 1)
+		             : jsmntree_next(tree, idx);
+	}
+	return idx;
+}
+
+int jsmntree_cjson_type(const jsmntree_t *tree, int idx)
+{
+	const jsmntok_t *tok = &tree->toks[idx];
+	switch (tok->type) {
+	case JSMN_OBJECT:
+		return cJSON_Object;
+	case JSMN_ARRAY:
+		return cJSON_Array;
+	case JSMN_STRING:
+		return cJSON_String;
+	default:
+		break;
+	}
+	switch (tree->js[tok->start]) {
+	case 'n':
+		return cJSON_NULL;
+	case 't':
+		return cJSON_True;
+	case 'f':
+		return cJSON_False;
+	default:
+		return cJSON_Number;
+	}
+}
+
+size_t jsmntree_string(const jsmntree_t *tree, int idx, char *dst)
+{
+	const jsmntok_t *tok = &tree->toks[idx];
+	const char *p = tree->js + tok->start;
+	const char *end = tree->js + tok->end;
+	size_t n = 0;
+	if (!(tok->flags & JSMN_ESCAPED)) {
+		n = (size_t)(end - p);
+		memcpy(dst, p, n);
+		dst[n] = '\0';
+		return strlen(dst);
+	}
+	while (p < end) {
+		if (*p != '\\') {
+			dst[n++] = *p++;
+			continue;
+		}
+		int len;
+		switch (p[1]) {
+		case 'b': dst[n++] = '\b'; break;
+		case 'f': dst[n++] = '\f'; break;
+		case 'n': dst[n++] = '\n'; break;
+		case 'r': dst[n++] = '\r'; break;
+		case 't': dst[n++] = '\t'; break;
+		case 'u':
+			p += decode_utf16(p + 1, dst + n, &len) - 1;
+			n += (size_t)len;
+			break;
+		default: dst[n++] = p[1]; break;
+		}
+		p += 2;
+	}
+	dst[n] = '\0';
+	return strlen(dst);
+}
+
+/* Decoded string of token @idx in @stack or, if too long, a heap buffer */
+static char *string_of(const jsmntree_t *tree, int idx, char *stack,
+                       size_t stack_size, size_t *len)
+{
+	const jsmntok_t *tok = &tree->toks[idx];
+	size_t need = (size_t)(tok->end - tok->start) + 1;
+	char *buf = need <= stack_size ? stack : malloc(need);
+	if (buf)
+		*len = jsmntree_string(tree, idx, buf);
+	return buf;
+}
+
+static bool string_equal(const jsmntree_t *t1, int i1, const jsmntree_t *t2,
+                         int i2)
+{
+	const jsmntok_t *a = &t1->toks[i1], *b = &t2->toks[i2];
+	if (!((a->flags | b->flags) & JSMN_ESCAPED)) {
+		/*
+		 * Raw bytes are the value; only an embedded NUL, which
+		 * cannot appear unescaped, could make cJSON cut them short
+		 */
+		size_t la = (size_t)(a->end - a->start);
+		return la == (size_t)(b->end - b->start) &&
+		       json_simd_mem_equal(t1->js + a->start,
+		                           t2->js + b->start, la);
+	}
+	char sa[256], sb[256];
+	size_t la = 0, lb = 0;
+	char *da = string_of(t1, i1, sa, sizeof(sa), &la);
+	char *db = string_of(t2, i2, sb, sizeof(sb), &lb);
+	bool eq = da && db && la == lb && json_simd_mem_equal(da, db, la);
+	if (da != sa)
+		free(da);
+	if (db != sb)
+		free(db);
+	return eq;
+}
+
+/*
+ * Arrays @a1 of @t1 and @a2 of @t2 of the same size whose elements are all
+ * scalars, so each element is a single token. Number tokens already carry
+ * their value; runs of them are gathered and compared in bulk.
+ */
+static bool flat_equal(const jsmntree_t *t1, int a1, const jsmntree_t *t2,
+                       int a2, int size, bool strict)
+{
+	double x[JSON_SIMD_NUM_RUN], y[JSON_SIMD_NUM_RUN];
+	int i = 0;
+	while (i < size) {
+		size_t n = 0;
+		while (n < JSON_SIMD_NUM_RUN && i < size &&
+		       jsmntree_cjson_type(t1, a1 + 1 + i) == cJSON_Number &&
+		       jsmntree_cjson_type(t2, a2 + 1 + i) == cJSON_Number) {
+			x[n] = t1->toks[a1 + 1 + i].num;
+			y[n++] = t2->toks[a2 + 1 + i].num;
+			i++;
+		}
+		if (n) {
+			if (json_simd_num_mismatch(x, y, n, strict) < n)
+				return false;
+			continue;
+		}
+		if (!jsmntree_token_equal(t1, a1 + 1 + i, t2, a2 + 1 + i,
+		                          strict))
+			return false;
+		i++;
+	}
+	return true;
+}
+
+/* First member of object @obj whose key equals key token @key of @kt */
+static int find_member(const jsmntree_t *tree, int obj, const jsmntree_t *kt,
+                       int key)
+{
+	int idx = obj + 1;
+	for (int i = 0; i < tree->toks[obj].size; i++) {
+		if (string_equal(tree, idx, kt, key))
+			return idx + 1;
+		idx = jsmntree_next(tree, idx + 1);
+	}
+	return -1;
+}
+
+bool jsmntree_token_equal(const jsmntree_t *tree1, int idx1,
+                          const jsmntree_t *tree2, int idx2, bool strict)
+{
+	if (tree1 == tree2 && idx1 == idx2)
+		return true;
+	int type = jsmntree_cjson_type(tree1, idx1);
+	if (type != jsmntree_cjson_type(tree2, idx2))
+		return false;
+	const jsmntok_t *a = &tree1->toks[idx1], *b = &tree2->toks[idx2];
+
+	switch (type) {
+	case cJSON_Number:
+		if (strict)
+			return a->num == b->num;
+		return fabs(a->num - b->num) < 1e-9;
+	case cJSON_String:
+		return string_equal(tree1, idx1, tree2, idx2);
+	case cJSON_Array: {
+		if (a->size != b->size)
+			return false;
+		if (a->skip == a->size + 1 && b->skip == b->size + 1)
+			return flat_equal(tree1, idx1, tree2, idx2, a->size,
+			                  strict);
+		int c1 = idx1 + 1, c2 = idx2 + 1;
+		for (int i = 0; i < a->size; i++) {
+			if (!jsmntree_token_equal(tree1, c1, tree2, c2, strict))
+				return false;
+			c1 = jsmntree_next(tree1, c1);
+			c2 = jsmntree_next(tree2, c2);
+		}
+		return true;
+	}
+	case cJSON_Object: {
+		if (a->size != b->size)
+			return false;
+		int key = idx1 + 1;
+		for (int i = 0; i < a->size; i++) {
+			int val = find_member(tree2, idx2, tree1, key);
+			if (val < 0 ||
+			    !jsmntree_token_equal(tree1, key + 1, tree2, val,
+			                          strict))
+				return false;
+			key = jsmntree_next(tree1, key + 1);
+		}
+		return true;
+	}
+	default:
+		return true;
+	}
+}
+
+static uint64_t string_hash(const jsmntree_t *tree, int idx)
+{
+	const jsmntok_t *tok = &tree->toks[idx];
+	if (!(tok->flags & JSMN_ESCAPED))
+		return json_hash_bytes(tree->js + tok->start,
+		                       (size_t)(tok->end - tok->start));
+	char stack[256];
+	size_t len = 0;
+	char *s = string_of(tree, idx, stack, sizeof(stack), &len);
+	uint64_t h = s ? json_hash_bytes(s, len) : 0;
+	if (s != stack)
+		free(s);
+	return h;
+}
+
+uint64_t jsmntree_hash(const jsmntree_t *tree, int idx, bool strict)
+{
+	int type = jsmntree_cjson_type(tree, idx);
+	const jsmntok_t *tok = &tree->toks[idx];
+	uint64_t h = json_hash_mix((uint64_t)(unsigned)type + 1);
+
+	switch (type) {
+	case cJSON_Number:
+		if (strict) {
+			double d = tok->num;
+			uint64_t bits;
+			if (d == 0)
+				d = 0; /* -0.0 == 0.0 */
+			memcpy(&bits, &d, sizeof(bits));
+			h = json_hash_mix(h ^ bits);
+		}
+		break;
+	case cJSON_String:
+		h ^= string_hash(tree, idx);
+		break;
+	case cJSON_Array: {
+		int c = idx + 1;
+		for (int i = 0; i < tok->size; i++) {
+			h = json_hash_mix(h + jsmntree_hash(tree, c, strict));
+			c = jsmntree_next(tree, c);
+		}
+		h = json_hash_mix(h ^ (uint64_t)tok->size);
+		break;
+	}
+	case cJSON_Object: {
+		uint64_t sum = 0;
+		int key = idx + 1;
+		for (int i = 0; i < tok->size; i++) {
+			sum += json_hash_mix(string_hash(tree, key) ^
+			                     jsmntree_hash(tree, key + 1, strict));
+			key = jsmntree_next(tree, key + 1);
+		}
+		h = json_hash_mix(h ^ sum ^ ((uint64_t)tok->size << 32));
+		break;
+	}
+	default:
+		break;
+	}
+	return h;
+}
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+#ifndef JSMN_TREE_H
+#define JSMN_TREE_H
+
+#include "json_diff.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Token types, as in JSMN; primitives are told apart by their first byte */
+typedef enum {
+	JSMN_UNDEFINED = 0,
+	JSMN_OBJECT = 1 << 0,
+	JSMN_ARRAY = 1 << 1,
+	JSMN_STRING = 1 << 2,
+	JSMN_PRIMITIVE = 1 << 3
+} jsmntype_t;
+
+/* Longest text a tree can index: token offsets are ints */
+#define JSMN_MAX_TEXT ((size_t)INT_MAX - 1)
+
+/* jsmntok_t.flags: string contains escape sequences */
+#define JSMN_ESCAPED 1
+
+/**
+ * typedef jsmntok_t - One token of the flat token array
+ * @type: token type
+ * @start: offset of the first byte (strings: after the opening quote)
+ * @end: offset one past the last byte (strings: the closing quote)
+ * @size: members of an object (its key tokens), elements of an array,
+ *	1 for an object key
+ * @skip: tokens in this subtree including itself, so the next sibling
+ *	of token i is token i + skip
+ * @flags: JSMN_ESCAPED for strings that need decoding
+ * @num: value of a number primitive
+ *
+ * Tokens are stored in document order. An object member is its key token
+ * immediately followed by the value's subtree.
+ */
+typedef struct {
+	jsmntype_t type;
+	int start;
+	int end;
+	int size;
+	int skip;
+	int flags;
+	double num;
+} jsmntok_t;
+
+/**
+ * typedef jsmntree_t - Token array plus the source text it points into
+ * @js: source text, not copied; must outlive the tree
+ * @toks: tokens, @toks[0] is the root value
+ * @count: number of tokens
+ * @cap: allocated tokens
+ */
+typedef struct {
+	const char *js;
+	jsmntok_t *toks;
+	int count;
+	int cap;
+} jsmntree_t;
+
+/**
+ * jsmntree_init - Tokenize a JSON document
+ * @tree: tree to fill (released with jsmntree_free())
+ * @js: NUL-terminated JSON text of at most JSMN_MAX_TEXT bytes
+ *
+ * Accepts what cJSON_Parse() accepts: one value, optionally after a UTF-8
+ * BOM, with anything after it ignored.
+ *
+ * Return: 0 on success, -1 on malformed input or allocation failure
+ */
+int jsmntree_init(jsmntree_t *tree, const char *js);
+
+/**
+ * jsmntree_free - Release the token array
+ * @tree: tree to release
+ */
+void jsmntree_free(jsmntree_t *tree);
+
+/**
+ * jsmntree_num_children - Members of an object or elements of an array
+ * @tree: token tree
+ * @idx: container token
+ *
+ * Return: number of children, 0 for scalars
+ */
+int jsmntree_num_children(const jsmntree_t *tree, int idx);
+
+/**
+ * jsmntree_child - Find the @n-th child of a container
+ * @tree: token tree
+ * @parent: container token
+ * @n: zero-based child index
+ *
+ * For objects the child is the member's key token; its value follows it.
+ *
+ * Return: token index, or -1 if @n is out of range
+ */
+int jsmntree_child(const jsmntree_t *tree, int parent, int n);
+
+/**
+ * jsmntree_next - Next sibling of a token
+ * @tree: token tree
+ * @idx: token
+ *
+ * Return: index of the token after @idx's subtree
+ */
+static inline int jsmntree_next(const jsmntree_t *tree, int idx)
+{
+	return idx + tree->toks[idx].skip;
+}
+
+/**
+ * jsmntree_cjson_type - cJSON type a token would parse to
+ * @tree: token tree
+ * @idx: token
+ *
+ * Return: cJSON_Object, cJSON_Array, cJSON_String, cJSON_Number,
+ * cJSON_True, cJSON_False or cJSON_NULL
+ */
+int jsmntree_cjson_type(const jsmntree_t *tree, int idx);
+
+/**
+ * jsmntree_string - Decode a string token
+ * @tree: token tree
+ * @idx: string token
+ * @dst: buffer of at least end - start + 1 bytes
+ *
+ * Return: decoded length up to the first NUL, as cJSON would keep it
+ */
+size_t jsmntree_string(const jsmntree_t *tree, int idx, char *dst);
+
+/**
+ * jsmntree_token_equal - Compare two subtrees
+ * @tree1: first tree
+ * @idx1: token in @tree1
+ * @tree2: second tree
+ * @idx2: token in @tree2
+ * @strict: compare numbers exactly instead of within 1e-9
+ *
+ * Same result as json_value_equal() on the parsed values. Unescaped
+ * strings compare their byte spans directly.
+ *
+ * Return: true if the values are equal
+ */
+bool jsmntree_token_equal(const jsmntree_t *tree1, int idx1,
+                          const jsmntree_t *tree2, int idx2, bool strict);
+
+/**
+ * jsmntree_hash - Structural hash of a subtree
+ * @tree: token tree
+ * @idx: token
+ * @strict: hash numbers by value (without it they only hash their type)
+ *
+ * Equal subtrees hash the same; object members combine order-independently.
+ *
+ * Return: 64-bit hash
+ */
+uint64_t jsmntree_hash(const jsmntree_t *tree, int idx, bool strict);
+
+/**
+ * diff_jsmn - Diff two token subtrees
+ * @tree1: first tree
+ * @idx1: token in @tree1
+ * @tree2: second tree
+ * @idx2: token in @tree2
+ * @opts: diff options (can be NULL); see jsmn_diff_supported()
+ *
+ * Computes the delta json_diff() would produce for the parsed values,
+ * without building cJSON trees of the inputs. Only the values the delta
+ * carries are materialized, owned, in opts->arena when set.
+ *
+ * Return: diff object or NULL if the values are equal or on error
+ */
+cJSON *diff_jsmn(const jsmntree_t *tree1, int idx1, const jsmntree_t *tree2,
+                 int idx2, const struct json_diff_options *opts);
+
+/**
+ * jsmn_diff_supported - Whether diff_jsmn() honours @opts
+ * @opts: diff options (can be NULL)
+ *
+ * The element identity callback (object_hash) takes cJSON nodes, so it
+ * needs the cJSON backend, and so do path filters and max_depth, which
+ * only the cJSON walk tracks.
+ *
+ * Return: true if diff_jsmn() can run with @opts
+ */
+bool jsmn_diff_supported(const struct json_diff_options *opts);
+
+#endif /* JSMN_TREE_H */
@@ -0,0 +1,1182 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "json_diff_internal.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_MARKER "_t"
+#define ARRAY_MARKER_VALUE "a"
+
+#ifndef MAX_JSON_DEPTH
+#define MAX_JSON_DEPTH 1024
+#endif
+
+/*
+ * Binary delta layout; every integer is an unsigned LEB128 varint:
+ *
+ *	'J' 'D' 'B' version flags
+ *	nkeys { len bytes }		interned object keys, by first use
+ *	delta
+ *
+ * A delta is an OP_ tag and its operands:
+ *
+ *	OP_ADD value			[new]
+ *	OP_CHANGE [value] value		[old, new]
+ *	OP_DELETE [value]		[old, 0, 0]
+ *	OP_MOVE dest			["", dest, 3]
+ *	OP_TEXT value			[patch, 0, 2]
+ *	OP_OBJECT n { key delta }	{key: delta}
+ *	OP_ARRAY n { slot delta }	{"_t": "a", index: delta}
+ *
+ * where the bracketed old values are left out under
+ * JSON_DIFF_BINARY_OMIT_OLD, keys are indices into the key table and an
+ * array slot is index << 1, plus 1 for the "_index" (old side) entries.
+ * Values are a VAL_ tag: integral numbers are zigzag varints, others the
+ * 8 IEEE 754 bytes in little-endian order, strings a length and bytes,
+ * containers a count and their members.
+ */
+#define BIN_MAGIC "JDB"
+#define BIN_VERSION 1
+
+enum {
+	OP_ADD = 1,
+	OP_CHANGE,
+	OP_DELETE,
+	OP_MOVE,
+	OP_OBJECT,
+	OP_ARRAY,
+	OP_TEXT
+};
+
+enum {
+	VAL_NULL = 1,
+	VAL_FALSE,
+	VAL_TRUE,
+	VAL_INT,
+	VAL_DOUBLE,
+	VAL_STRING,
+	VAL_ARRAY,
+	VAL_OBJECT
+};
+
+/* Integers past 2^53 are not exact doubles; keep them as raw bytes */
+#define BIN_INT_LIMIT 9007199254740992.0
+
+/**
+ * struct bin_buf - Growable output buffer
+ * @data: bytes written so far
+ * @len: number of bytes in @data
+ * @cap: allocated size of @data
+ * @failed: an allocation failed; further output is dropped
+ */
+struct bin_buf {
+	unsigned char *data;
+	size_t len;
+	size_t cap;
+	bool failed;
+};
+
+static void buf_put(struct bin_buf *b, const void *p, size_t n)
+{
+	if (b->failed)
+		return;
+	if (n > b->cap - b->len) {
+		size_t cap = b->cap ? b->cap : 256;
+		while (n > cap - b->len) {
+			if (cap > SIZE_MAX / 2) {
+				b->failed = true;
+				return;
+			}
+			cap *= 2;
+		}
+		unsigned char *data = realloc(b->data, cap);
+		if (!data) {
+			b->failed = true;
+			return;
+		}
+		b->data = data;
+		b->cap = cap;
+	}
+	memcpy(b->data + b->len, p, n);
+	b->len += n;
+}
+
+static void buf_byte(struct bin_buf *b, unsigned int c)
+{
+	unsigned char v = (unsigned char)c;
+	buf_put(b, &v, 1);
+}
+
+static void buf_varint(struct bin_buf *b, uint64_t v)
+{
+	unsigned char tmp[10];
+	size_t n = 0;
+	do {
+		tmp[n] = (unsigned char)(v & 0x7F);
+		v >>= 7;
+		if (v)
+			tmp[n] |= 0x80;
+		n++;
+	} while (v);
+	buf_put(b, tmp, n);
+}
+
+/**
+ * struct key_table - Object keys interned while encoding
+ * @keys: keys by id, pointing into the encoded tree
+ * @count: number of keys
+ * @cap: allocated entries of @keys
+ * @slots: open addressing table of id + 1, 0 for empty
+ * @mask: number of @slots minus one
+ */
+struct key_table {
+	const char **keys;
+	size_t count;
+	size_t cap;
+	size_t *slots;
+	size_t mask;
+};
+
+static size_t key_hash(const char *s)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (; *s; s++)
+		h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+	return (size_t)h;
+}
+
+static bool key_grow(struct key_table *t)
+{
+	size_t n = t->slots ? (t->mask + 1) * 2 : 64;
+	size_t *slots = calloc(n, sizeof(*slots));
+	const char **keys = realloc(t->keys, n / 2 * sizeof(*keys));
+	if (!slots || !keys) {
+		free(slots);
+		if (keys)
+			t->keys = keys;
+		return false;
+	}
+	t->keys = keys;
+	t->cap = n / 2;
+	t->slots = slots;
+	t->mask = n - 1;
+	for (size_t id = 0; id < t->count; id++) {
+		size_t i = key_hash(keys[id]) & t->mask;
+		while (slots[i])
+			i = (i + 1) & t->mask;
+		slots[i] = id + 1;
+	}
+	return true;
+}
+
+/* Id of @key, added on first use; SIZE_MAX if memory runs out */
+static size_t key_intern(struct key_table *t, const char *key)
+{
+	if (t->count == t->cap) {
+		size_t *old = t->slots;
+		if (!key_grow(t))
+			return SIZE_MAX;
+		free(old);
+	}
+	size_t i = key_hash(key) & t->mask;
+	for (; t->slots[i]; i = (i + 1) & t->mask) {
+		size_t id = t->slots[i] - 1;
+		if (strcmp(t->keys[id], key) == 0)
+			return id;
+	}
+	t->keys[t->count] = key;
+	t->slots[i] = ++t->count;
+	return t->count - 1;
+}
+
+/**
+ * struct bin_enc - State of one json_diff_encode_binary() call
+ * @body: encoded delta, without the header and key table
+ * @keys: interned keys
+ * @flags: JSON_DIFF_BINARY_* flags
+ * @depth: nesting of the value or delta being encoded
+ * @failed: the delta is malformed or nests too deep
+ */
+struct bin_enc {
+	struct bin_buf body;
+	struct key_table keys;
+	unsigned int flags;
+	int depth;
+	bool failed;
+};
+
+static void enc_key(struct bin_enc *e, const char *key)
+{
+	size_t id = key_intern(&e->keys, key ? key : "");
+	if (id == SIZE_MAX)
+		e->failed = true;
+	else
+		buf_varint(&e->body, id);
+}
+
+static void enc_count(struct bin_enc *e, const cJSON *node)
+{
+	uint64_t n = 0;
+	for (const cJSON *c = node->child; c; c = c->next)
+		n++;
+	buf_varint(&e->body, n);
+}
+
+static void enc_number(struct bin_enc *e, double d)
+{
+	if (d > -BIN_INT_LIMIT && d < BIN_INT_LIMIT &&
+	    d == (double)(int64_t)d && !(d == 0 && 1 / d < 0)) {
+		int64_t v = (int64_t)d;
+		buf_byte(&e->body, VAL_INT);
+		buf_varint(&e->body,
+		           ((uint64_t)v << 1) ^ (uint64_t)(v < 0 ? -1 : 0));
+		return;
+	}
+	uint64_t bits;
+	unsigned char le[8];
+	memcpy(&bits, &d, sizeof(bits));
+	for (int i = 0; i < 8; i++)
+		le[i] = (unsigned char)(bits >> (8 * i));
+	buf_byte(&e->body, VAL_DOUBLE);
+	buf_put(&e->body, le, sizeof(le));
+}
+
+static void enc_value(struct bin_enc *e, const cJSON *v)
+{
+	if (++e->depth > MAX_JSON_DEPTH) {
+		e->failed = true;
+		goto out;
+	}
+	switch (v->type & 0xFF) {
+	case cJSON_NULL:
+	case cJSON_Raw: /* printed as null in text deltas too */
+		buf_byte(&e->body, VAL_NULL);
+		break;
+	case cJSON_False:
+		buf_byte(&e->body, VAL_FALSE);
+		break;
+	case cJSON_True:
+		buf_byte(&e->body, VAL_TRUE);
+		break;
+	case cJSON_Number:
+		enc_number(e, v->valuedouble);
+		break;
+	case cJSON_String: {
+		const char *s = v->valuestring ? v->valuestring : "";
+		size_t n = strlen(s);
+		buf_byte(&e->body, VAL_STRING);
+		buf_varint(&e->body, n);
+		buf_put(&e->body, s, n);
+		break;
+	}
+	case cJSON_Array:
+		buf_byte(&e->body, VAL_ARRAY);
+		enc_count(e, v);
+		for (const cJSON *c = v->child; c && !e->failed; c = c->next)
+			enc_value(e, c);
+		break;
+	case cJSON_Object:
+		buf_byte(&e->body, VAL_OBJECT);
+		enc_count(e, v);
+		for (const cJSON *c = v->child; c && !e->failed; c = c->next) {
+			enc_key(e, c->string);
+			enc_value(e, c);
+		}
+		break;
+	default:
+		e->failed = true;
+		break;
+	}
+out:
+	--e->depth;
+}
+
+/* Array delta index: "12", or "_12" for the old side; -1 if neither */
+static int64_t array_slot(const char *key)
+{
+	bool old = key && key[0] == '_';
+	const char *s = key ? key + old : "";
+	int64_t v = 0;
+	if (!*s)
+		return -1;
+	for (; *s; s++) {
+		if (*s < '0' || *s > '9' || v > (INT_MAX - 9) / 10)
+			return -1;
+		v = v * 10 + (*s - '0');
+	}
+	return v * 2 + old;
+}
+
+static bool is_zero(const cJSON *v)
+{
+	return cJSON_IsNumber(v) && v->valuedouble == 0;
+}
+
+static void enc_delta(struct bin_enc *e, const cJSON *d);
+
+static void enc_op(struct bin_enc *e, const cJSON *d)
+{
+	const cJSON *a = d->child, *b = a ? a->next : NULL;
+	const cJSON *c = b ? b->next : NULL;
+	bool old = !(e->flags & JSON_DIFF_BINARY_OMIT_OLD);
+
+	if (a && !b) {
+		buf_byte(&e->body, OP_ADD);
+		enc_value(e, a);
+	} else if (b && !c) {
+		buf_byte(&e->body, OP_CHANGE);
+		if (old)
+			enc_value(e, a);
+		enc_value(e, b);
+	} else if (c && !c->next && is_zero(b) && is_zero(c)) {
+		buf_byte(&e->body, OP_DELETE);
+		if (old)
+			enc_value(e, a);
+	} else if (c && !c->next && cJSON_IsString(a) && cJSON_IsNumber(b) &&
+	           cJSON_IsNumber(c) && c->valuedouble == 3 &&
+	           b->valuedouble >= 0 && b->valuedouble <= INT_MAX &&
+	           b->valuedouble == (int)b->valuedouble) {
+		buf_byte(&e->body, OP_MOVE);
+		buf_varint(&e->body, (uint64_t)b->valuedouble);
+	} else if (diff_is_text_op(d)) {
+		buf_byte(&e->body, OP_TEXT);
+		enc_value(e, a);
+	} else {
+		e->failed = true;
+	}
+}
+
+static void enc_array_delta(struct bin_enc *e, const cJSON *d)
+{
+	uint64_t n = 0;
+	for (const cJSON *c = d->child; c; c = c->next)
+		if (!c->string || strcmp(c->string, ARRAY_MARKER) != 0)
+			n++;
+	buf_byte(&e->body, OP_ARRAY);
+	buf_varint(&e->body, n);
+	for (const cJSON *c = d->child; c && !e->failed; c = c->next) {
+		if (c->string && strcmp(c->string, ARRAY_MARKER) == 0)
+			continue;
+		int64_t slot = array_slot(c->string);
+		if (slot < 0) {
+			e->failed = true;
+			break;
+		}
+		buf_varint(&e->body, (uint64_t)slot);
+		enc_delta(e, c);
+	}
+}
+
+static void enc_delta(struct bin_enc *e, const cJSON *d)
+{
+	if (++e->depth > MAX_JSON_DEPTH) {
+		e->failed = true;
+		goto out;
+	}
+	if (cJSON_IsArray(d)) {
+		enc_op(e, d);
+	} else if (!cJSON_IsObject(d)) {
+		e->failed = true;
+	} else if (cJSON_GetObjectItemCaseSensitive(d, ARRAY_MARKER)) {
+		enc_array_delta(e, d);
+	} else {
+		buf_byte(&e->body, OP_OBJECT);
+		enc_count(e, d);
+		for (const cJSON *c = d->child; c && !e->failed; c = c->next) {
+			enc_key(e, c->string);
+			enc_delta(e, c);
+		}
+	}
+out:
+	--e->depth;
+}
+
+int json_diff_encode_binary(const cJSON *diff, unsigned int flags,
+                            unsigned char **out, size_t *len)
+{
+	if (!out || !len)
+		return -1;
+	*out = NULL;
+	*len = 0;
+	if (!diff || (flags & ~(unsigned int)JSON_DIFF_BINARY_OMIT_OLD))
+		return -1;
+
+	struct bin_enc e = {.flags = flags};
+	enc_delta(&e, diff);
+
+	struct bin_buf res = {0};
+	if (!e.failed && !e.body.failed) {
+		buf_put(&res, BIN_MAGIC, 3);
+		buf_byte(&res, BIN_VERSION);
+		buf_varint(&res, flags);
+		buf_varint(&res, e.keys.count);
+		for (size_t i = 0; i < e.keys.count; i++) {
+			size_t n = strlen(e.keys.keys[i]);
+			buf_varint(&res, n);
+			buf_put(&res, e.keys.keys[i], n);
+		}
+		buf_put(&res, e.body.data, e.body.len);
+	}
+	bool failed = e.failed || e.body.failed || res.failed;
+	free(e.body.data);
+	free(e.keys.keys);
+	free(e.keys.slots);
+	if (failed) {
+		free(res.data);
+		return -1;
+	}
+	*out = res.data;
+	*len = res.len;
+	return 0;
+}
+
+/**
+ * struct bin_dec - Reader over an encoded delta
+ * @p: next byte to read
+ * @end: end of the input
+ * @keys: NUL-terminated key table
+ * @nkeys: entries in @keys
+ * @flags: flags from the header
+ * @depth: nesting of the value or delta being read
+ * @failed: the input is malformed or memory ran out
+ */
+struct bin_dec {
+	const unsigned char *p;
+	const unsigned char *end;
+	char **keys;
+	size_t nkeys;
+	unsigned int flags;
+	int depth;
+	bool failed;
+};
+
+static unsigned int get_byte(struct bin_dec *d)
+{
+	if (d->p == d->end) {
+		d->failed = true;
+		return 0;
+	}
+	return *d->p++;
+}
+
+static uint64_t get_varint(struct bin_dec *d)
+{
+	uint64_t v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		unsigned int c = get_byte(d);
+		v |= (uint64_t)(c & 0x7F) << shift;
+		if (!(c & 0x80))
+			return v;
+	}
+	d->failed = true;
+	return 0;
+}
+
+/* Element count; every element takes a byte at least */
+static size_t get_count(struct bin_dec *d)
+{
+	uint64_t n = get_varint(d);
+	if (n > (uint64_t)(d->end - d->p)) {
+		d->failed = true;
+		return 0;
+	}
+	return (size_t)n;
+}
+
+static const char *get_key(struct bin_dec *d)
+{
+	uint64_t id = get_varint(d);
+	if (d->failed || id >= d->nkeys) {
+		d->failed = true;
+		return NULL;
+	}
+	return d->keys[id];
+}
+
+static bool string_span(struct bin_dec *d, const unsigned char **s,
+                        size_t *n)
+{
+	*n = get_count(d);
+	*s = d->p;
+	if (d->failed || memchr(*s, '\0', *n)) {
+		d->failed = true;
+		return false;
+	}
+	d->p += *n;
+	return true;
+}
+
+static double get_double(struct bin_dec *d)
+{
+	uint64_t bits = 0;
+	double v;
+	if (d->end - d->p < 8) {
+		d->failed = true;
+		return 0;
+	}
+	for (int i = 0; i < 8; i++)
+		bits |= (uint64_t)d->p[i] << (8 * i);
+	d->p += 8;
+	memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+static int64_t get_int(struct bin_dec *d)
+{
+	uint64_t z = get_varint(d);
+	return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+static cJSON *dec_value(struct bin_dec *d)
+{
+	cJSON *v = NULL;
+	if (++d->depth > MAX_JSON_DEPTH) {
+		d->failed = true;
+		goto out;
+	}
+	switch (get_byte(d)) {
+	case VAL_NULL:
+		v = cJSON_CreateNull();
+		break;
+	case VAL_FALSE:
+		v = cJSON_CreateFalse();
+		break;
+	case VAL_TRUE:
+		v = cJSON_CreateTrue();
+		break;
+	case VAL_INT:
+		v = cJSON_CreateNumber((double)get_int(d));
+		break;
+	case VAL_DOUBLE:
+		v = cJSON_CreateNumber(get_double(d));
+		break;
+	case VAL_STRING: {
+		const unsigned char *s;
+		size_t n;
+		if (!string_span(d, &s, &n) || !(v = cJSON_CreateString("")))
+			break;
+		char *str = cJSON_malloc(n + 1);
+		if (!str) {
+			cJSON_Delete(v);
+			v = NULL;
+			break;
+		}
+		memcpy(str, s, n);
+		str[n] = '\0';
+		cJSON_free(v->valuestring);
+		v->valuestring = str;
+		break;
+	}
+	case VAL_ARRAY: {
+		size_t n = get_count(d);
+		if (d->failed || !(v = cJSON_CreateArray()))
+			break;
+		for (size_t i = 0; i < n && !d->failed; i++) {
+			cJSON *c = dec_value(d);
+			if (c && !cJSON_AddItemToArray(v, c)) {
+				cJSON_Delete(c);
+				d->failed = true;
+			}
+		}
+		break;
+	}
+	case VAL_OBJECT: {
+		size_t n = get_count(d);
+		if (d->failed || !(v = cJSON_CreateObject()))
+			break;
+		for (size_t i = 0; i < n && !d->failed; i++) {
+			const char *key = get_key(d);
+			cJSON *c = key ? dec_value(d) : NULL;
+			if (c && !cJSON_AddItemToObject(v, key, c)) {
+				cJSON_Delete(c);
+				d->failed = true;
+			}
+		}
+		break;
+	}
+	default:
+		d->failed = true;
+		break;
+	}
+	if (!v)
+		d->failed = true;
+out:
+	--d->depth;
+	if (d->failed) {
+		cJSON_Delete(v);
+		return NULL;
+	}
+	return v;
+}
+
+static void skip_value(struct bin_dec *d)
+{
+	if (++d->depth > MAX_JSON_DEPTH) {
+		d->failed = true;
+		goto out;
+	}
+	switch (get_byte(d)) {
+	case VAL_NULL:
+	case VAL_FALSE:
+	case VAL_TRUE:
+		break;
+	case VAL_INT:
+		get_varint(d);
+		break;
+	case VAL_DOUBLE:
+		get_double(d);
+		break;
+	case VAL_STRING: {
+		const unsigned char *s;
+		size_t n;
+		string_span(d, &s, &n);
+		break;
+	}
+	case VAL_ARRAY:
+	case VAL_OBJECT: {
+		bool keyed = d->p[-1] == VAL_OBJECT;
+		size_t n = get_count(d);
+		for (size_t i = 0; i < n && !d->failed; i++) {
+			if (keyed)
+				get_key(d);
+			skip_value(d);
+		}
+		break;
+	}
+	default:
+		d->failed = true;
+		break;
+	}
+out:
+	--d->depth;
+}
+
+/* Old value of a change or deletion, or the null that stands in for it */
+static cJSON *dec_old(struct bin_dec *d)
+{
+	if (d->flags & JSON_DIFF_BINARY_OMIT_OLD) {
+		cJSON *v = cJSON_CreateNull();
+		if (!v)
+			d->failed = true;
+		return v;
+	}
+	return dec_value(d);
+}
+
+static void skip_old(struct bin_dec *d)
+{
+	if (!(d->flags & JSON_DIFF_BINARY_OMIT_OLD))
+		skip_value(d);
+}
+
+/* Array of the first @n items, which it takes over even on failure */
+static cJSON *op_array(struct bin_dec *d, size_t n, cJSON *a, cJSON *b,
+                       cJSON *c)
+{
+	cJSON *items[] = {a, b, c};
+	cJSON *arr = d->failed ? NULL : cJSON_CreateArray();
+	for (size_t i = 0; i < n; i++)
+		if (!items[i])
+			d->failed = true;
+	if (d->failed) {
+		cJSON_Delete(arr);
+		arr = NULL;
+	}
+	for (size_t i = 0; i < 3; i++) {
+		if (!items[i])
+			continue;
+		if (arr && !cJSON_AddItemToArray(arr, items[i])) {
+			cJSON_Delete(arr);
+			arr = NULL;
+		}
+		if (!arr)
+			cJSON_Delete(items[i]);
+	}
+	if (!arr)
+		d->failed = true;
+	return arr;
+}
+
+static cJSON *dec_delta(struct bin_dec *d);
+
+/* Add @child under @key, releasing it on failure */
+static void dec_member(struct bin_dec *d, cJSON *obj, const char *key,
+                       cJSON *child)
+{
+	if (child && !cJSON_AddItemToObject(obj, key, child)) {
+		cJSON_Delete(child);
+		d->failed = true;
+	}
+}
+
+static cJSON *dec_delta(struct bin_dec *d)
+{
+	cJSON *r = NULL;
+	if (++d->depth > MAX_JSON_DEPTH) {
+		d->failed = true;
+		goto out;
+	}
+	switch (get_byte(d)) {
+	case OP_ADD:
+		r = op_array(d, 1, dec_value(d), NULL, NULL);
+		break;
+	case OP_CHANGE: {
+		cJSON *old = dec_old(d);
+		r = op_array(d, 2, old, dec_value(d), NULL);
+		break;
+	}
+	case OP_DELETE: {
+		cJSON *old = dec_old(d);
+		r = op_array(d, 3, old, cJSON_CreateNumber(0),
+		             cJSON_CreateNumber(0));
+		break;
+	}
+	case OP_MOVE: {
+		uint64_t dest = get_varint(d);
+		if (dest > INT_MAX)
+			d->failed = true;
+		r = op_array(d, 3, cJSON_CreateString(""),
+		             cJSON_CreateNumber((double)dest),
+		             cJSON_CreateNumber(3));
+		break;
+	}
+	case OP_TEXT: {
+		cJSON *patch = dec_value(d);
+		if (patch && !cJSON_IsString(patch))
+			d->failed = true;
+		r = op_array(d, 3, patch, cJSON_CreateNumber(0),
+		             cJSON_CreateNumber(2));
+		break;
+	}
+	case OP_OBJECT: {
+		size_t n = get_count(d);
+		if (d->failed || !(r = cJSON_CreateObject()))
+			break;
+		for (size_t i = 0; i < n && !d->failed; i++) {
+			const char *key = get_key(d);
+			if (key)
+				dec_member(d, r, key, dec_delta(d));
+		}
+		break;
+	}
+	case OP_ARRAY: {
+		size_t n = get_count(d);
+		if (d->failed || !(r = cJSON_CreateObject()))
+			break;
+		char key[16];
+		for (size_t i = 0; i < n && !d->failed; i++) {
+			uint64_t slot = get_varint(d);
+			if (slot >> 1 > INT_MAX) {
+				d->failed = true;
+				break;
+			}
+			snprintf(key, sizeof(key), "%s%d", slot & 1 ? "_" : "",
+			         (int)(slot >> 1));
+			dec_member(d, r, key, dec_delta(d));
+		}
+		if (!d->failed)
+			dec_member(d, r, ARRAY_MARKER,
+			           cJSON_CreateString(ARRAY_MARKER_VALUE));
+		break;
+	}
+	default:
+		break;
+	}
+	if (!r)
+		d->failed = true;
+out:
+	--d->depth;
+	if (d->failed) {
+		cJSON_Delete(r);
+		return NULL;
+	}
+	return r;
+}
+
+static void skip_delta(struct bin_dec *d)
+{
+	if (++d->depth > MAX_JSON_DEPTH) {
+		d->failed = true;
+		goto out;
+	}
+	switch (get_byte(d)) {
+	case OP_ADD:
+		skip_value(d);
+		break;
+	case OP_CHANGE:
+		skip_old(d);
+		skip_value(d);
+		break;
+	case OP_DELETE:
+		skip_old(d);
+		break;
+	case OP_MOVE:
+		if (get_varint(d) > INT_MAX)
+			d->failed = true;
+		break;
+	case OP_TEXT:
+		skip_value(d);
+		break;
+	case OP_OBJECT:
+	case OP_ARRAY: {
+		bool keyed = d->p[-1] == OP_OBJECT;
+		size_t n = get_count(d);
+		for (size_t i = 0; i < n && !d->failed; i++) {
+			if (keyed)
+				get_key(d);
+			else if (get_varint(d) >> 1 > INT_MAX)
+				d->failed = true;
+			skip_delta(d);
+		}
+		break;
+	}
+	default:
+		d->failed = true;
+		break;
+	}
+out:
+	--d->depth;
+}
+
+/* Parse the header and key table, leaving @d at the root delta */
+static bool dec_open(struct bin_dec *d, const unsigned char *buf, size_t len)
+{
+	*d = (struct bin_dec){.p = buf, .end = buf + len};
+	if (len < 4 || memcmp(buf, BIN_MAGIC, 3) != 0 || buf[3] != BIN_VERSION)
+		return false;
+	d->p += 4;
+	uint64_t flags = get_varint(d);
+	if (flags & ~(uint64_t)JSON_DIFF_BINARY_OMIT_OLD)
+		return false;
+	d->flags = (unsigned int)flags;
+
+	/* Every key takes a length byte at least, so n is bounded by len */
+	size_t n = get_count(d);
+	if (d->failed)
+		return false;
+	const unsigned char *start = d->p;
+	size_t bytes = 0;
+	for (size_t i = 0; i < n && !d->failed; i++) {
+		const unsigned char *s;
+		size_t klen;
+		string_span(d, &s, &klen);
+		bytes += klen + 1;
+	}
+	if (d->failed || !(d->keys = malloc(n * sizeof(*d->keys) + bytes + 1)))
+		return false;
+	d->nkeys = n;
+	char *mem = (char *)(d->keys + n);
+	d->p = start;
+	for (size_t i = 0; i < n; i++) {
+		size_t klen = (size_t)get_varint(d);
+		memcpy(mem, d->p, klen);
+		mem[klen] = '\0';
+		d->keys[i] = mem;
+		mem += klen + 1;
+		d->p += klen;
+	}
+	return true;
+}
+
+cJSON *json_diff_decode_binary(const unsigned char *buf, size_t len)
+{
+	struct bin_dec d = {0};
+	if (!buf || !dec_open(&d, buf, len)) {
+		free(d.keys);
+		return NULL;
+	}
+	cJSON *diff = dec_delta(&d);
+	if (diff && d.p != d.end) {
+		cJSON_Delete(diff);
+		diff = NULL;
+	}
+	free(d.keys);
+	return diff;
+}
+
+/*
+ * Patching straight from the encoding follows json_patch_inplace() step
+ * for step, reading each value where the delta stores it instead of from
+ * a decoded tree; only the values that end up in the document are built.
+ */
+
+static cJSON *apply(struct bin_dec *d, cJSON *target);
+
+static void apply_object(struct bin_dec *d, cJSON *object)
+{
+	struct json_patch_members members;
+	json_patch_members_init(&members, object);
+	size_t n = get_count(d);
+	for (size_t i = 0; i < n && !d->failed; i++) {
+		const char *key = get_key(d);
+		if (!key || d->p == d->end) {
+			d->failed = true;
+			break;
+		}
+		cJSON *cur = json_patch_members_get(&members, key);
+		cJSON *val = NULL;
+		switch (*d->p) {
+		case OP_ADD:
+			d->p++;
+			val = dec_value(d);
+			break;
+		case OP_CHANGE:
+			d->p++;
+			skip_old(d);
+			val = dec_value(d);
+			break;
+		case OP_DELETE:
+		case OP_MOVE:
+			skip_delta(d);
+			if (cur && !d->failed)
+				json_patch_members_delete(&members, cur);
+			continue;
+		default:
+			if (!cur) {
+				skip_delta(d);
+				continue;
+			}
+			val = apply(d, cur);
+			if (val != cur)
+				json_patch_members_replace(&members, cur, val);
+			continue;
+		}
+		if (!val)
+			continue;
+		if (cur) {
+			json_patch_members_replace(&members, cur, val);
+		} else if (!cJSON_AddItemToObject(object, key, val)) {
+			cJSON_Delete(val);
+			d->failed = true;
+		}
+	}
+	json_patch_members_free(&members);
+}
+
+/**
+ * struct bin_entry - Array delta entry located in the encoding
+ * @at: its delta
+ * @index: array index the entry names
+ * @old: whether @index is on the old side ("_index")
+ */
+struct bin_entry {
+	const unsigned char *at;
+	int index;
+	bool old;
+};
+
+/* Delta at @at read with @d's key table, advancing nothing in @d */
+static struct bin_dec bin_at(const struct bin_dec *d,
+                             const unsigned char *at)
+{
+	struct bin_dec sub = *d;
+	sub.p = at;
+	return sub;
+}
+
+/* Same steps as patch_array_inplace(), see there */
+static void apply_array(struct bin_dec *d, cJSON *array)
+{
+	size_t n = 0, k = get_count(d);
+	for (const cJSON *ch = array->child; ch; ch = ch->next)
+		n++;
+	if (d->failed)
+		return;
+
+	struct bin_entry *ents = malloc((k + 1) * sizeof(*ents));
+	cJSON **orig = malloc((n + 1) * sizeof(*orig));
+	cJSON **final = malloc((n + k + 1) * sizeof(*final));
+	int *place = malloc((n + k + 1) * sizeof(*place));
+	unsigned char *gone = calloc(n + 1, 1);
+	struct json_array_insert *ins = malloc((k + 1) * sizeof(*ins));
+	if (!ents || !orig || !final || !place || !gone || !ins) {
+		d->failed = true;
+		goto out;
+	}
+	for (size_t i = 0; i < k && !d->failed; i++) {
+		uint64_t slot = get_varint(d);
+		ents[i].index = (int)(slot >> 1);
+		ents[i].old = slot & 1;
+		ents[i].at = d->p;
+		if (slot >> 1 > INT_MAX)
+			d->failed = true;
+		skip_delta(d);
+	}
+	if (d->failed)
+		goto out;
+	size_t i = 0;
+	for (cJSON *ch = array->child; ch; ch = ch->next)
+		orig[i++] = ch;
+
+	/* Removals and insertions; @seq leads back to the entry */
+	size_t nins = 0;
+	for (size_t e = 0; e < k; e++) {
+		struct bin_dec sub = bin_at(d, ents[e].at);
+		int index = ents[e].index;
+		unsigned int op = get_byte(&sub);
+		struct json_array_insert in = {.index = index, .seq = (int)e,
+		                               .from = -1};
+		if (ents[e].old) {
+			if ((size_t)index >= n || gone[index])
+				continue;
+			if (op != OP_MOVE) {
+				gone[index] = JSON_ARRAY_DELETE;
+				continue;
+			}
+			gone[index] = JSON_ARRAY_MOVE;
+			in.index = (int)get_varint(&sub);
+			in.from = index;
+		} else if (op != OP_ADD) {
+			continue;
+		}
+		ins[nins++] = in;
+	}
+
+	size_t nf = json_array_place(gone, n, ins, nins, place), f = 0;
+	for (i = 0; i < nf; i++) {
+		cJSON *node;
+		if (place[i] >= 0) {
+			node = orig[place[i]];
+		} else if (ins[-1 - place[i]].from >= 0) {
+			node = orig[ins[-1 - place[i]].from];
+		} else {
+			struct bin_dec sub =
+			    bin_at(d, ents[ins[-1 - place[i]].seq].at);
+			sub.p++;
+			node = dec_value(&sub);
+		}
+		if (!node) {
+			d->failed = true;
+			continue;
+		}
+		final[f++] = node;
+	}
+	nf = f;
+
+	/* Replacements and nested diffs against the final indices */
+	for (size_t e = 0; e < k && !d->failed; e++) {
+		int index = ents[e].index;
+		if (ents[e].old || (size_t)index >= nf)
+			continue;
+		struct bin_dec sub = bin_at(d, ents[e].at);
+		cJSON *cur = final[index];
+		cJSON *val = cur;
+		if (*sub.p == OP_CHANGE) {
+			sub.p++;
+			skip_old(&sub);
+			val = dec_value(&sub);
+		} else if (*sub.p == OP_OBJECT || *sub.p == OP_ARRAY ||
+		           *sub.p == OP_TEXT) {
+			val = apply(&sub, cur);
+		}
+		if (sub.failed)
+			d->failed = true;
+		if (val && val != cur) {
+			/* Unlink first: cJSON_Delete() follows ->next */
+			cur->next = cur->prev = NULL;
+			cJSON_Delete(cur);
+			final[index] = val;
+		}
+	}
+
+	json_array_relink(array, orig, gone, n, final, nf);
+
+out:
+	free(ents);
+	free(orig);
+	free(final);
+	free(place);
+	free(gone);
+	free(ins);
+}
+
+/* json_patch_node() over the encoded delta at @d; consumes it either way */
+static cJSON *apply(struct bin_dec *d, cJSON *target)
+{
+	cJSON *result = target;
+	if (++d->depth > MAX_JSON_DEPTH) {
+		d->failed = true;
+		goto out;
+	}
+	if (d->p == d->end) {
+		d->failed = true;
+		goto out;
+	}
+	switch (*d->p) {
+	case OP_CHANGE: {
+		d->p++;
+		skip_old(d);
+		cJSON *v = dec_value(d);
+		if (v)
+			result = v;
+		break;
+	}
+	case OP_OBJECT:
+		/* Object deltas on non-objects patch an empty object */
+		if (!cJSON_IsObject(target) &&
+		    !(result = cJSON_CreateObject())) {
+			d->failed = true;
+			result = target;
+			break;
+		}
+		d->p++;
+		apply_object(d, result);
+		break;
+	case OP_ARRAY:
+		if (!cJSON_IsArray(target)) {
+			skip_delta(d);
+			break;
+		}
+		d->p++;
+		apply_array(d, target);
+		break;
+	case OP_TEXT: {
+		d->p++;
+		cJSON *patch = dec_value(d);
+		if (patch && (!cJSON_IsString(patch) ||
+		              !json_text_patch_node(target, patch->valuestring)))
+			d->failed = true;
+		cJSON_Delete(patch);
+		break;
+	}
+	default:
+		/* Not a delta: the value is unchanged */
+		skip_delta(d);
+		break;
+	}
+out:
+	--d->depth;
+	return result;
+}
+
+cJSON *json_patch_binary(const cJSON *original, const unsigned char *buf,
+                         size_t len)
+{
+	struct bin_dec d = {0};
+	if (!original || !buf || !dec_open(&d, buf, len)) {
+		free(d.keys);
+		return NULL;
+	}
+
+	cJSON *result = NULL;
+	if (d.p < d.end && *d.p == OP_CHANGE) {
+		/* A root replacement does not need a copy of the original */
+		d.p++;
+		skip_old(&d);
+		result = dec_value(&d);
+	} else {
+		cJSON *copy = cJSON_Duplicate(original, 1);
+		if (!copy)
+			d.failed = true;
+		else if ((result = apply(&d, copy)) != copy)
+			cJSON_Delete(copy);
+	}
+	if (d.failed || d.p != d.end) {
+		cJSON_Delete(result);
+		result = NULL;
+	}
+	free(d.keys);
+	return result;
+}
@@ -0,0 +1,971 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "json_diff.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_MARKER "_t"
+#define ARRAY_MARKER_VALUE "a"
+
+#ifndef MAX_JSON_DEPTH
+#define MAX_JSON_DEPTH 1024
+#endif
+
+/*
+ * Deltas are composed and reversed without the documents they apply to.
+ * Every value a result needs is in the deltas themselves: a change
+ * carries the old value, a deletion the removed one, and a value only
+ * known after a nested delta is recovered by patching what the other
+ * delta recorded, which costs the size of that value, not the document.
+ */
+
+/**
+ * struct compose_state - State of one json_diff_compose() call
+ * @failed: set on allocation failure or a delta that does not apply
+ * @depth: nesting of the deltas being walked
+ */
+struct compose_state {
+	bool failed;
+	int depth;
+};
+
+enum delta_kind {
+	DELTA_NONE,
+	DELTA_ADD,    /* [new] */
+	DELTA_CHANGE, /* [old, new] */
+	DELTA_DELETE, /* [old, 0, 0] */
+	DELTA_MOVE,   /* ["", dest, 3], array members only */
+	DELTA_OBJECT, /* {key: delta} */
+	DELTA_ARRAY,  /* {"_t": "a", index: delta} */
+	DELTA_BAD
+};
+
+static enum delta_kind delta_kind(const cJSON *d)
+{
+	if (!d)
+		return DELTA_NONE;
+	if (cJSON_IsObject(d)) {
+		const cJSON *t =
+		    cJSON_GetObjectItemCaseSensitive(d, ARRAY_MARKER);
+		return cJSON_IsString(t) &&
+		               strcmp(t->valuestring, ARRAY_MARKER_VALUE) == 0
+		           ? DELTA_ARRAY
+		           : DELTA_OBJECT;
+	}
+	if (!cJSON_IsArray(d))
+		return DELTA_BAD;
+	const cJSON *a = d->child, *b = a ? a->next : NULL;
+	const cJSON *c = b ? b->next : NULL;
+	if (!a)
+		return DELTA_BAD;
+	if (!b)
+		return DELTA_ADD;
+	if (!c)
+		return DELTA_CHANGE;
+	if (c->next || !cJSON_IsNumber(b) || !cJSON_IsNumber(c))
+		return DELTA_BAD;
+	if (c->valuedouble == 0 && b->valuedouble == 0)
+		return DELTA_DELETE;
+	if (c->valuedouble == 3 && cJSON_IsString(a) && b->valuedouble >= 0 &&
+	    b->valuedouble <= INT_MAX)
+		return DELTA_MOVE;
+	return DELTA_BAD;
+}
+
+/* Array of the first @n of @a, @b, @c; consumes all three */
+static cJSON *tuple(int n, cJSON *a, cJSON *b, cJSON *c)
+{
+	cJSON *items[3] = {a, b, c};
+	cJSON *arr = cJSON_CreateArray();
+	for (int i = 0; i < n; i++) {
+		if (!items[i]) {
+			cJSON_Delete(arr);
+			arr = NULL;
+		}
+	}
+	for (int i = 0; i < 3; i++) {
+		if (arr && i < n)
+			cJSON_AddItemToArray(arr, items[i]);
+		else
+			cJSON_Delete(items[i]);
+	}
+	return arr;
+}
+
+/* [@v] */
+static cJSON *make_add(cJSON *v)
+{
+	return tuple(1, v, NULL, NULL);
+}
+
+/* [@old, @v] */
+static cJSON *make_change(cJSON *old, cJSON *v)
+{
+	return tuple(2, old, v, NULL);
+}
+
+/* [@old, 0, 0] */
+static cJSON *make_delete(cJSON *old)
+{
+	return tuple(3, old, cJSON_CreateNumber(0), cJSON_CreateNumber(0));
+}
+
+/* ["", @dest, 3] */
+static cJSON *make_move(int dest)
+{
+	return tuple(3, cJSON_CreateString(""), cJSON_CreateNumber(dest),
+	             cJSON_CreateNumber(3));
+}
+
+static cJSON *copy(const cJSON *v)
+{
+	return cJSON_Duplicate(v, true);
+}
+
+/* Fail the call if building @d ran out of memory */
+static cJSON *built(cJSON *d, struct compose_state *st)
+{
+	if (!d)
+		st->failed = true;
+	return d;
+}
+
+static cJSON *reverse(const cJSON *d, struct compose_state *st);
+static cJSON *compose(const cJSON *d1, const cJSON *d2,
+                      struct compose_state *st);
+
+/* The value @v had before the nested delta @d turned it into @v */
+static cJSON *unpatch(const cJSON *v, const cJSON *d, struct compose_state *st)
+{
+	if (!d)
+		return copy(v);
+	cJSON *r = reverse(d, st);
+	cJSON *old = r ? json_patch(v, r) : copy(v);
+	cJSON_Delete(r);
+	if (!old)
+		st->failed = true;
+	return old;
+}
+
+/* @v with the nested delta @d applied */
+static cJSON *patch(const cJSON *v, const cJSON *d, struct compose_state *st)
+{
+	cJSON *nv = d ? json_patch(v, d) : copy(v);
+	if (!nv)
+		st->failed = true;
+	return nv;
+}
+
+/*
+ * Array deltas as three index-sorted lists: removals at old indices
+ * (deletions and move sources), insertions at new indices (additions and
+ * move targets) and nested deltas at new indices. Patching removes, then
+ * inserts, then applies the nested deltas; every element neither removed
+ * nor inserted keeps its rank among the survivors.
+ */
+struct arr_rm {
+	int index;
+	int dest;           /* move target, -1 for a deletion */
+	const cJSON *value; /* deleted value */
+};
+
+struct arr_ins {
+	int index;
+	int src;            /* move source, -1 for an addition */
+	const cJSON *value; /* added value */
+};
+
+struct arr_mod {
+	int index;
+	const cJSON *delta;
+};
+
+struct arr_delta {
+	struct arr_rm *rm;
+	struct arr_ins *ins;
+	struct arr_mod *mod;
+	int nrm, nins, nmod;
+};
+
+static int parse_index(const char *key)
+{
+	char *ep = NULL;
+	long v = strtol(key, &ep, 10);
+	if (ep == key || *ep != '\0' || v < 0 || v > INT_MAX)
+		return -1;
+	return (int)v;
+}
+
+static int cmp_index(const void *a, const void *b)
+{
+	int x = *(const int *)a, y = *(const int *)b;
+	return (x > y) - (x < y);
+}
+
+static bool arr_parse(const cJSON *d, struct arr_delta *ad)
+{
+	int k = 0;
+	for (const cJSON *it = d->child; it; it = it->next)
+		k++;
+	memset(ad, 0, sizeof(*ad));
+	ad->rm = malloc(((size_t)k + 1) * sizeof(*ad->rm));
+	ad->ins = malloc(((size_t)k + 1) * sizeof(*ad->ins));
+	ad->mod = malloc(((size_t)k + 1) * sizeof(*ad->mod));
+	if (!ad->rm || !ad->ins || !ad->mod)
+		return false;
+
+	for (const cJSON *it = d->child; it; it = it->next) {
+		const char *key = it->string;
+		if (!key || strcmp(key, ARRAY_MARKER) == 0)
+			continue;
+		enum delta_kind kind = delta_kind(it);
+		int index = parse_index(key[0] == '_' ? key + 1 : key);
+		if (index < 0)
+			return false;
+		if (key[0] == '_') {
+			if (kind == DELTA_DELETE)
+				ad->rm[ad->nrm++] =
+				    (struct arr_rm){index, -1, it->child};
+			else if (kind == DELTA_MOVE)
+				ad->rm[ad->nrm++] = (struct arr_rm){
+				    index, (int)it->child->next->valuedouble,
+				    NULL};
+			else
+				return false;
+		} else if (kind == DELTA_ADD) {
+			ad->ins[ad->nins++] =
+			    (struct arr_ins){index, -1, it->child};
+		} else if (kind == DELTA_CHANGE || kind == DELTA_OBJECT ||
+		           kind == DELTA_ARRAY) {
+			ad->mod[ad->nmod++] = (struct arr_mod){index, it};
+		} else {
+			return false;
+		}
+	}
+	for (int i = 0; i < ad->nrm; i++) {
+		if (ad->rm[i].dest >= 0)
+			ad->ins[ad->nins++] = (struct arr_ins){
+			    ad->rm[i].dest, ad->rm[i].index, NULL};
+	}
+	/* The index leads each entry, so plain int ordering sorts them */
+	qsort(ad->rm, (size_t)ad->nrm, sizeof(*ad->rm), cmp_index);
+	qsort(ad->ins, (size_t)ad->nins, sizeof(*ad->ins), cmp_index);
+	qsort(ad->mod, (size_t)ad->nmod, sizeof(*ad->mod), cmp_index);
+	for (int i = 1; i < ad->nrm; i++)
+		if (ad->rm[i].index == ad->rm[i - 1].index)
+			return false;
+	for (int i = 1; i < ad->nins; i++)
+		if (ad->ins[i].index == ad->ins[i - 1].index)
+			return false;
+	return true;
+}
+
+static void arr_free(struct arr_delta *ad)
+{
+	free(ad->rm);
+	free(ad->ins);
+	free(ad->mod);
+}
+
+/* Leading int index of entry @i */
+static int entry_index(const void *base, size_t stride, int i)
+{
+	return *(const int *)((const char *)base + (size_t)i * stride);
+}
+
+/*
+ * Entries are sorted by their leading int index; @stride is the entry
+ * size. Number of entries with index below @index.
+ */
+static int count_below(const void *base, int n, size_t stride, int index)
+{
+	int lo = 0, hi = n;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		int v = entry_index(base, stride, mid);
+		if (v < index)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static bool has_index(const void *base, int n, size_t stride, int index)
+{
+	int i = count_below(base, n, stride, index);
+	return i < n && entry_index(base, stride, i) == index;
+}
+
+/*
+ * Position of the @rank-th index not taken by the sorted entries: the
+ * answer is @rank plus the number of entries e with e.index - pos(e) <=
+ * @rank, which grows monotonically with pos(e).
+ */
+static int nth_free(const void *base, int n, size_t stride, int rank)
+{
+	int lo = 0, hi = n;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		int v = entry_index(base, stride, mid);
+		if (v - mid <= rank)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return rank + lo;
+}
+
+/* New index of the surviving old element @i */
+static int arr_forward(const struct arr_delta *ad, int i)
+{
+	int rank = i - count_below(ad->rm, ad->nrm, sizeof(*ad->rm), i);
+	return nth_free(ad->ins, ad->nins, sizeof(*ad->ins), rank);
+}
+
+/* Old index of the element that survived to new index @j */
+static int arr_backward(const struct arr_delta *ad, int j)
+{
+	int rank = j - count_below(ad->ins, ad->nins, sizeof(*ad->ins), j);
+	return nth_free(ad->rm, ad->nrm, sizeof(*ad->rm), rank);
+}
+
+static const cJSON *arr_mod_at(const struct arr_delta *ad, int j)
+{
+	int i = count_below(ad->mod, ad->nmod, sizeof(*ad->mod), j);
+	return i < ad->nmod && ad->mod[i].index == j ? ad->mod[i].delta : NULL;
+}
+
+static const struct arr_rm *arr_rm_at(const struct arr_delta *ad, int i)
+{
+	int k = count_below(ad->rm, ad->nrm, sizeof(*ad->rm), i);
+	return k < ad->nrm && ad->rm[k].index == i ? &ad->rm[k] : NULL;
+}
+
+/* Add @d under "@prefix@index" to @out; a NULL @d is nothing to add */
+static void put(cJSON *out, const char *prefix, int index, cJSON *d,
+                struct compose_state *st)
+{
+	char key[16];
+	if (!d)
+		return;
+	snprintf(key, sizeof(key), "%s%d", prefix, index);
+	if (!cJSON_AddItemToObject(out, key, d)) {
+		cJSON_Delete(d);
+		st->failed = true;
+	}
+}
+
+/* Close an array delta: NULL if it ended up empty */
+static cJSON *arr_finish(cJSON *out, struct compose_state *st)
+{
+	if (st->failed || !out->child) {
+		cJSON_Delete(out);
+		return NULL;
+	}
+	if (!cJSON_AddStringToObject(out, ARRAY_MARKER, ARRAY_MARKER_VALUE)) {
+		cJSON_Delete(out);
+		st->failed = true;
+		return NULL;
+	}
+	return out;
+}
+
+/*
+ * Reversed array delta: additions become deletions of the value as the
+ * nested delta left it, deletions additions, moves run backwards and
+ * nested deltas move from new to old indices.
+ */
+static cJSON *reverse_array(const cJSON *d, struct compose_state *st)
+{
+	struct arr_delta ad = {0};
+	cJSON *out = cJSON_CreateObject();
+	if (!out || !arr_parse(d, &ad)) {
+		arr_free(&ad);
+		cJSON_Delete(out);
+		st->failed = true;
+		return NULL;
+	}
+	for (int k = 0; k < ad.nins && !st->failed; k++) {
+		const struct arr_ins *in = &ad.ins[k];
+		const cJSON *mod = arr_mod_at(&ad, in->index);
+		if (in->src < 0) {
+			put(out, "_", in->index,
+			    make_delete(patch(in->value, mod, st)), st);
+		} else {
+			put(out, "_", in->index, make_move(in->src), st);
+			put(out, "", in->src, reverse(mod, st), st);
+		}
+	}
+	for (int k = 0; k < ad.nrm && !st->failed; k++) {
+		if (ad.rm[k].dest < 0)
+			put(out, "", ad.rm[k].index,
+			    make_add(copy(ad.rm[k].value)), st);
+	}
+	for (int k = 0; k < ad.nmod && !st->failed; k++) {
+		int j = ad.mod[k].index;
+		if (has_index(ad.ins, ad.nins, sizeof(*ad.ins), j))
+			continue;
+		put(out, "", arr_backward(&ad, j),
+		    reverse(ad.mod[k].delta, st), st);
+	}
+	arr_free(&ad);
+	return arr_finish(out, st);
+}
+
+static cJSON *reverse_values(const cJSON *d, struct compose_state *st)
+{
+	switch (delta_kind(d)) {
+	case DELTA_NONE:
+		return NULL;
+	case DELTA_ADD:
+		return make_delete(copy(d->child));
+	case DELTA_DELETE:
+		return make_add(copy(d->child));
+	case DELTA_CHANGE:
+		return make_change(copy(d->child->next), copy(d->child));
+	case DELTA_OBJECT: {
+		cJSON *out = cJSON_CreateObject();
+		if (!out) {
+			st->failed = true;
+			return NULL;
+		}
+		for (const cJSON *it = d->child; it && !st->failed;
+		     it = it->next) {
+			cJSON *r = reverse(it, st);
+			if (r && !cJSON_AddItemToObject(out, it->string, r)) {
+				cJSON_Delete(r);
+				st->failed = true;
+			}
+		}
+		if (st->failed) {
+			cJSON_Delete(out);
+			return NULL;
+		}
+		return out;
+	}
+	case DELTA_ARRAY:
+		return reverse_array(d, st);
+	default:
+		st->failed = true;
+		return NULL;
+	}
+}
+
+static cJSON *reverse(const cJSON *d, struct compose_state *st)
+{
+	if (++st->depth > MAX_JSON_DEPTH || st->failed) {
+		st->failed = true;
+		--st->depth;
+		return NULL;
+	}
+	cJSON *r = reverse_values(d, st);
+	--st->depth;
+	return r;
+}
+
+/*
+ * Combined array delta under construction. Removals and insertions use
+ * @other for the move partner (-1 for deletions and additions) and own
+ * @value: the deleted value, the added value or the nested delta.
+ */
+struct out_entry {
+	int index;
+	int other;
+	cJSON *value;
+	bool dead;
+};
+
+struct arr_out {
+	struct out_entry *rm, *ins, *mod;
+	int nrm, nins, nmod;
+};
+
+static void out_add(struct out_entry *list, int *n, int index, int other,
+                    cJSON *value)
+{
+	list[(*n)++] = (struct out_entry){index, other, value, false};
+}
+
+/*
+ * Element moved from @src to @dest, then changed by @m. A move whose
+ * value is replaced outright is a deletion plus an addition, which
+ * out_drop_idle() can match against equal values.
+ */
+static void out_move(struct arr_out *o, int src, int dest, cJSON *m)
+{
+	if (m && cJSON_IsArray(m) && m->child && m->child->next &&
+	    !m->child->next->next) {
+		cJSON *old = cJSON_DetachItemViaPointer(m, m->child);
+		cJSON *v = cJSON_DetachItemViaPointer(m, m->child);
+		cJSON_Delete(m);
+		out_add(o->rm, &o->nrm, src, -1, old);
+		out_add(o->ins, &o->nins, dest, -1, v);
+		return;
+	}
+	out_add(o->rm, &o->nrm, src, dest, NULL);
+	out_add(o->ins, &o->nins, dest, src, NULL);
+	if (m)
+		out_add(o->mod, &o->nmod, dest, -1, m);
+}
+
+/* Fenwick tree over list positions counting the live entries */
+static void bit_add(int *bit, int n, int pos, int delta)
+{
+	for (pos++; pos <= n; pos += pos & -pos)
+		bit[pos] += delta;
+}
+
+static int bit_sum(const int *bit, int pos)
+{
+	int sum = 0;
+	for (; pos > 0; pos -= pos & -pos)
+		sum += bit[pos];
+	return sum;
+}
+
+/* Free-index rank of insertion @t with only the live ones counted */
+static int ins_rank(const struct arr_out *o, const int *ibit, int t)
+{
+	return o->ins[t].index - bit_sum(ibit, t);
+}
+
+/* Live addition of a value equal to @v at free-index rank @rank, or -1 */
+static int find_idle_add(const struct arr_out *o, const int *ibit, int rank,
+                         const cJSON *v)
+{
+	int lo = 0, hi = o->nins;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (ins_rank(o, ibit, mid) < rank)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < o->nins && ins_rank(o, ibit, lo) == rank; lo++) {
+		const struct out_entry *e = &o->ins[lo];
+		if (!e->dead && e->other < 0 &&
+		    json_value_equal(e->value, v, true))
+			return lo;
+	}
+	return -1;
+}
+
+/*
+ * A removal whose element comes back where a survivor of the same rank
+ * would land, moved there or deleted and added again as an equal value,
+ * is dropped with its insertion. Dropping one shifts the ranks of the
+ * others, so passes repeat until none is left: elements shuffled and put
+ * back vanish from the delta.
+ */
+static bool out_drop_idle(struct arr_out *o)
+{
+	int *rbit = calloc((size_t)o->nrm + 1, sizeof(*rbit));
+	int *ibit = calloc((size_t)o->nins + 1, sizeof(*ibit));
+	if (!rbit || !ibit) {
+		free(rbit);
+		free(ibit);
+		return false;
+	}
+	for (int k = 0; k < o->nrm; k++)
+		bit_add(rbit, o->nrm, k, 1);
+	for (int k = 0; k < o->nins; k++)
+		bit_add(ibit, o->nins, k, 1);
+
+	for (bool dropped = true; dropped;) {
+		dropped = false;
+		for (int k = 0; k < o->nrm; k++) {
+			struct out_entry *rm = &o->rm[k];
+			if (rm->dead)
+				continue;
+			int rank = rm->index - bit_sum(rbit, k);
+			int t;
+			if (rm->other >= 0) {
+				t = count_below(o->ins, o->nins,
+				                sizeof(*o->ins), rm->other);
+				if (ins_rank(o, ibit, t) != rank)
+					continue;
+			} else if ((t = find_idle_add(o, ibit, rank,
+			                              rm->value)) < 0) {
+				continue;
+			}
+			rm->dead = o->ins[t].dead = true;
+			bit_add(rbit, o->nrm, k, -1);
+			bit_add(ibit, o->nins, t, -1);
+			dropped = true;
+		}
+	}
+	free(rbit);
+	free(ibit);
+	return true;
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+	const struct out_entry *x = a, *y = b;
+	return (x->index > y->index) - (x->index < y->index);
+}
+
+/* Emit @o as a delta, releasing its values; NULL if nothing is left */
+static cJSON *out_finish(struct arr_out *o, struct compose_state *st)
+{
+	qsort(o->rm, (size_t)o->nrm, sizeof(*o->rm), cmp_entry);
+	qsort(o->ins, (size_t)o->nins, sizeof(*o->ins), cmp_entry);
+	qsort(o->mod, (size_t)o->nmod, sizeof(*o->mod), cmp_entry);
+	if (!st->failed && !out_drop_idle(o))
+		st->failed = true;
+
+	cJSON *out = st->failed ? NULL : cJSON_CreateObject();
+	if (!st->failed && !out)
+		st->failed = true;
+	for (int k = 0; k < o->nrm; k++) {
+		struct out_entry *e = &o->rm[k];
+		cJSON *d = NULL;
+		if (out && !e->dead)
+			d = e->other < 0 ? make_delete(e->value)
+			                 : make_move(e->other);
+		else
+			cJSON_Delete(e->value);
+		if (out && !e->dead)
+			put(out, "_", e->index, built(d, st), st);
+	}
+	for (int k = 0; k < o->nins; k++) {
+		struct out_entry *e = &o->ins[k];
+		if (out && !e->dead && e->other < 0)
+			put(out, "", e->index, built(make_add(e->value), st),
+			    st);
+		else
+			cJSON_Delete(e->value);
+	}
+	for (int k = 0; k < o->nmod; k++) {
+		if (out)
+			put(out, "", o->mod[k].index, o->mod[k].value, st);
+		else
+			cJSON_Delete(o->mod[k].value);
+	}
+	free(o->rm);
+	free(o->ins);
+	free(o->mod);
+	return out ? arr_finish(out, st) : NULL;
+}
+
+/*
+ * Array deltas in sequence. Elements of the middle version are either
+ * added or moved there by @d1 or survivors of the first; each is followed
+ * to where @d2 takes it. Elements neither delta touches stay implicit:
+ * both rank maps preserve order, so they fill exactly the indices the
+ * combined delta leaves free.
+ */
+static cJSON *compose_array(const cJSON *d1, const cJSON *d2,
+                            struct compose_state *st)
+{
+	struct arr_delta a = {0}, b = {0};
+	struct arr_out o = {0};
+	if (!arr_parse(d1, &a) || !arr_parse(d2, &b)) {
+		arr_free(&a);
+		arr_free(&b);
+		st->failed = true;
+		return NULL;
+	}
+	size_t cap = (size_t)a.nrm + a.nins + a.nmod + b.nrm + b.nins +
+	             b.nmod + 1;
+	o.rm = malloc(cap * sizeof(*o.rm));
+	o.ins = malloc(cap * sizeof(*o.ins));
+	o.mod = malloc(cap * sizeof(*o.mod));
+	if (!o.rm || !o.ins || !o.mod)
+		st->failed = true;
+
+	/* Added or moved by @d1 */
+	for (int k = 0; k < a.nins && !st->failed; k++) {
+		const struct arr_ins *in = &a.ins[k];
+		int p = in->index;
+		const cJSON *m1 = arr_mod_at(&a, p);
+		const struct arr_rm *gone = arr_rm_at(&b, p);
+		if (gone && gone->dest < 0) {
+			/* Added then deleted cancels; moved then deleted */
+			if (in->src >= 0)
+				out_add(o.rm, &o.nrm, in->src, -1,
+				        unpatch(gone->value, m1, st));
+			continue;
+		}
+		int q = gone ? gone->dest : arr_forward(&b, p);
+		const cJSON *m2 = arr_mod_at(&b, q);
+		if (in->src < 0) {
+			cJSON *v = patch(in->value, m1, st);
+			cJSON *nv = v && m2 ? patch(v, m2, st) : v;
+			if (nv != v)
+				cJSON_Delete(v);
+			out_add(o.ins, &o.nins, q, -1, nv);
+		} else {
+			out_move(&o, in->src, q, compose(m1, m2, st));
+		}
+	}
+	/* Deleted by @d1 */
+	for (int k = 0; k < a.nrm && !st->failed; k++) {
+		if (a.rm[k].dest < 0)
+			out_add(o.rm, &o.nrm, a.rm[k].index, -1,
+			        copy(a.rm[k].value));
+	}
+	/* Survivors of @d1 that @d2 deletes or moves */
+	for (int k = 0; k < b.nrm && !st->failed; k++) {
+		const struct arr_rm *rm = &b.rm[k];
+		int p = rm->index;
+		if (has_index(a.ins, a.nins, sizeof(*a.ins), p))
+			continue;
+		int i = arr_backward(&a, p);
+		const cJSON *m1 = arr_mod_at(&a, p);
+		if (rm->dest < 0) {
+			out_add(o.rm, &o.nrm, i, -1,
+			        unpatch(rm->value, m1, st));
+		} else {
+			out_move(&o, i, rm->dest,
+			         compose(m1, arr_mod_at(&b, rm->dest), st));
+		}
+	}
+	/* Added by @d2 */
+	for (int k = 0; k < b.nins && !st->failed; k++) {
+		const struct arr_ins *in = &b.ins[k];
+		if (in->src < 0)
+			out_add(o.ins, &o.nins, in->index, -1,
+			        patch(in->value, arr_mod_at(&b, in->index),
+			              st));
+	}
+	/* Nested deltas on elements both keep in place */
+	for (int k = 0; k < a.nmod && !st->failed; k++) {
+		int p = a.mod[k].index;
+		if (has_index(a.ins, a.nins, sizeof(*a.ins), p) ||
+		    has_index(b.rm, b.nrm, sizeof(*b.rm), p))
+			continue;
+		int q = arr_forward(&b, p);
+		cJSON *m = compose(a.mod[k].delta, arr_mod_at(&b, q), st);
+		if (m)
+			out_add(o.mod, &o.nmod, q, -1, m);
+	}
+	for (int k = 0; k < b.nmod && !st->failed; k++) {
+		int q = b.mod[k].index;
+		if (has_index(b.ins, b.nins, sizeof(*b.ins), q))
+			continue;
+		int p = arr_backward(&b, q);
+		if (has_index(a.ins, a.nins, sizeof(*a.ins), p) ||
+		    arr_mod_at(&a, p))
+			continue;
+		out_add(o.mod, &o.nmod, q, -1, built(copy(b.mod[k].delta), st));
+	}
+	arr_free(&a);
+	arr_free(&b);
+	if (!o.rm || !o.ins || !o.mod) {
+		free(o.rm);
+		free(o.ins);
+		free(o.mod);
+		return NULL;
+	}
+	return out_finish(&o, st);
+}
+
+/* Object delta members sorted by key, document order among equal keys */
+struct member {
+	const cJSON *item;
+	size_t pos;
+};
+
+static int cmp_member(const void *a, const void *b)
+{
+	const struct member *x = a, *y = b;
+	int c = strcmp(x->item->string, y->item->string);
+	if (c)
+		return c;
+	return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+static struct member *members_sorted(const cJSON *d, size_t *count)
+{
+	size_t n = 0;
+	for (const cJSON *it = d->child; it; it = it->next)
+		n++;
+	struct member *m = malloc((n + 1) * sizeof(*m));
+	if (!m)
+		return NULL;
+	n = 0;
+	for (const cJSON *it = d->child; it; it = it->next) {
+		if (it->string) {
+			m[n] = (struct member){it, n};
+			n++;
+		}
+	}
+	qsort(m, n, sizeof(*m), cmp_member);
+	*count = n;
+	return m;
+}
+
+/* First member called @key, or NULL */
+static const struct member *members_find(const struct member *m, size_t n,
+                                         const char *key)
+{
+	size_t lo = 0, hi = n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (strcmp(m[mid].item->string, key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < n && strcmp(m[lo].item->string, key) == 0 ? &m[lo] : NULL;
+}
+
+/*
+ * Object deltas in sequence: members of @d1 in order, composed with the
+ * first @d2 member of the same key, then members only @d2 has. With
+ * duplicate keys, as in json_patch(), only the first one pairs up.
+ */
+static cJSON *compose_object(const cJSON *d1, const cJSON *d2,
+                             struct compose_state *st)
+{
+	size_t n1 = 0, n2 = 0;
+	struct member *m1 = members_sorted(d1, &n1);
+	struct member *m2 = members_sorted(d2, &n2);
+	cJSON *out = cJSON_CreateObject();
+	if (!m1 || !m2 || !out) {
+		st->failed = true;
+		goto done;
+	}
+
+	for (const cJSON *it = d1->child; it && !st->failed; it = it->next) {
+		if (!it->string)
+			continue;
+		const struct member *first = members_find(m1, n1, it->string);
+		const struct member *other = members_find(m2, n2, it->string);
+		cJSON *c = compose(it, first->item == it && other ? other->item
+		                                                  : NULL,
+		                   st);
+		if (c && !cJSON_AddItemToObject(out, it->string, c)) {
+			cJSON_Delete(c);
+			st->failed = true;
+		}
+	}
+	for (const cJSON *it = d2->child; it && !st->failed; it = it->next) {
+		if (!it->string || members_find(m1, n1, it->string))
+			continue;
+		cJSON *c = copy(it);
+		if (!c || !cJSON_AddItemToObject(out, it->string, c)) {
+			cJSON_Delete(c);
+			st->failed = true;
+		}
+	}
+
+done:
+	free(m1);
+	free(m2);
+	if (st->failed || !out->child) {
+		cJSON_Delete(out);
+		return NULL;
+	}
+	return out;
+}
+
+/* Change from @old to @v, or nothing when they are equal */
+static cJSON *change_or_none(cJSON *old, cJSON *v, struct compose_state *st)
+{
+	if (!old || !v) {
+		cJSON_Delete(old);
+		cJSON_Delete(v);
+		st->failed = true;
+		return NULL;
+	}
+	if (json_value_equal(old, v, true)) {
+		cJSON_Delete(old);
+		cJSON_Delete(v);
+		return NULL;
+	}
+	return make_change(old, v);
+}
+
+
+static cJSON *compose_values(const cJSON *d1, const cJSON *d2,
+                             struct compose_state *st)
+{
+	enum delta_kind k1 = delta_kind(d1), k2 = delta_kind(d2);
+
+	if (k1 == DELTA_BAD || k2 == DELTA_BAD || k1 == DELTA_MOVE ||
+	    k2 == DELTA_MOVE)
+		goto mismatch;
+	if (k2 == DELTA_NONE)
+		return d1 ? built(copy(d1), st) : NULL;
+	if (k1 == DELTA_NONE)
+		return built(copy(d2), st);
+
+	switch (k1) {
+	case DELTA_ADD:
+		if (k2 == DELTA_DELETE)
+			return NULL;
+		if (k2 == DELTA_CHANGE)
+			return built(make_add(copy(d2->child->next)), st);
+		if (k2 == DELTA_OBJECT || k2 == DELTA_ARRAY)
+			return built(make_add(patch(d1->child, d2, st)), st);
+		break;
+	case DELTA_DELETE:
+		if (k2 == DELTA_ADD)
+			return change_or_none(copy(d1->child), copy(d2->child),
+			                      st);
+		break;
+	case DELTA_CHANGE:
+		if (k2 == DELTA_DELETE)
+			return built(make_delete(copy(d1->child)), st);
+		if (k2 == DELTA_CHANGE)
+			return change_or_none(copy(d1->child),
+			                      copy(d2->child->next), st);
+		if (k2 == DELTA_OBJECT || k2 == DELTA_ARRAY)
+			return change_or_none(copy(d1->child),
+			                      patch(d1->child->next, d2, st),
+			                      st);
+		break;
+	case DELTA_OBJECT:
+	case DELTA_ARRAY:
+		if (k2 == DELTA_DELETE)
+			return built(make_delete(unpatch(d2->child, d1, st)),
+			             st);
+		if (k2 == DELTA_CHANGE)
+			return change_or_none(unpatch(d2->child, d1, st),
+			                      copy(d2->child->next), st);
+		if (k1 == DELTA_OBJECT && k2 == DELTA_OBJECT)
+			return compose_object(d1, d2, st);
+		if (k1 == DELTA_ARRAY && k2 == DELTA_ARRAY)
+			return compose_array(d1, d2, st);
+		break;
+	default:
+		break;
+	}
+mismatch:
+	/* @d2 cannot apply to what @d1 leaves */
+	st->failed = true;
+	return NULL;
+}
+
+/* One delta for @d1 followed by @d2 at the same place */
+static cJSON *compose(const cJSON *d1, const cJSON *d2,
+                      struct compose_state *st)
+{
+	if (++st->depth > MAX_JSON_DEPTH || st->failed) {
+		st->failed = true;
+		--st->depth;
+		return NULL;
+	}
+	cJSON *r = compose_values(d1, d2, st);
+	--st->depth;
+	return r;
+}
+
+int json_diff_compose(const cJSON *d1, const cJSON *d2, cJSON **out)
+{
+	if (!out)
+		return -1;
+	struct compose_state st = {.failed = false};
+	cJSON *r = compose(d1, d2, &st);
+	if (st.failed) {
+		cJSON_Delete(r);
+		*out = NULL;
+		return -1;
+	}
+	*out = r;
+	return 0;
+}
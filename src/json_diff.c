@@ -1,23 +1,26 @@
 // SPDX-License-Identifier: Apache-2.0
 #define __STDC_WANT_LIB_EXT1__ 1
 #include "json_diff.h"
+#include "jsmn_tree.h"
+#include "json_diff_internal.h"
+#include "json_simd.h"
 #include "myers.h"
 #include <errno.h>
 #include <limits.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-/* Arena-based allocation hooks for diff trees */
+#ifdef JSON_DIFF_THREADS
 #include <pthread.h>
+#include <stdatomic.h>
+#endif
 
 #ifndef MAX_JSON_DEPTH
 #define MAX_JSON_DEPTH 1024
 #endif
-/* Arena-based allocation hooks for diff trees */
-static __thread struct json_diff_arena *current_arena = NULL;
 static __thread int json_diff_depth = 0;
 static __thread int json_patch_depth = 0;
 
@@ -27,1176 +30,3215 @@ static __thread int json_patch_depth = 0;
 #ifndef MAX_JSON_INPUT_SIZE
 #define MAX_JSON_INPUT_SIZE (1024 * 1024)
 #endif
+/* Objects with fewer members are never split across threads */
+#ifndef JSON_DIFF_PARALLEL_MIN_KEYS
+#define JSON_DIFF_PARALLEL_MIN_KEYS 64
+#endif
+/* Members a worker claims at a time */
+#ifndef JSON_DIFF_PARALLEL_BATCH
+#define JSON_DIFF_PARALLEL_BATCH 8
+#endif
+/* Member lookups on one object after which patching indexes its keys */
+#ifndef JSON_PATCH_INDEX_MIN
+#define JSON_PATCH_INDEX_MIN 8
+#endif
+/* Out-of-order lookups in one object after which equality indexes it */
+#ifndef JSON_EQUAL_INDEX_MIN
+#define JSON_EQUAL_INDEX_MIN 8
+#endif
 
-/* Simple object key index for faster lookups during object diff */
-struct key_item {
-	const char *key;
-	cJSON *item;
+/*
+ * Arena allocation for diff trees. Small requests are carved from a chain of
+ * fixed-size chunks with a bump pointer; requests above a quarter chunk get
+ * their own block so they do not waste the tail of the current chunk.
+ * Nothing is ever moved, so nodes stay valid until json_diff_arena_reset()
+ * or json_diff_arena_cleanup().
+ */
+struct json_diff_arena_chunk {
+	struct json_diff_arena_chunk *next;
+	size_t size;
+	size_t used;
+	max_align_t data[];
 };
 
-static int cmp_key_item(const void *a, const void *b)
-{
-	const struct key_item *ka = (const struct key_item *)a;
-	const struct key_item *kb = (const struct key_item *)b;
-	if (ka->key == kb->key)
-		return 0;
-	if (!ka->key)
-		return -1;
-	if (!kb->key)
-		return 1;
-	return strcmp(ka->key, kb->key);
-}
+#define ARENA_ALIGN _Alignof(max_align_t)
+#define ARENA_MIN_CHUNK 1024
 
-static int build_key_index(const cJSON *obj, struct key_item **out)
+static struct json_diff_arena_chunk *arena_new_chunk(size_t size)
 {
-	int n = cJSON_GetArraySize(obj);
-	if (n <= 0) {
-		*out = NULL;
-		return 0;
-	}
-	struct key_item *arr =
-	    (struct key_item *)malloc((size_t)n * sizeof(*arr));
-	if (!arr) {
-		*out = NULL;
-		return 0;
-	}
-	int i = 0;
-	for (const cJSON *ch = obj->child; ch && i < n; ch = ch->next) {
-		arr[i].key = ch->string;
-		arr[i].item = (cJSON *)ch;
-		i++;
+	if (size > SIZE_MAX - sizeof(struct json_diff_arena_chunk))
+		return NULL;
+	struct json_diff_arena_chunk *c =
+	    malloc(sizeof(struct json_diff_arena_chunk) + size);
+	if (c) {
+		c->next = NULL;
+		c->size = size;
+		c->used = 0;
 	}
-	qsort(arr, (size_t)i, sizeof(*arr), cmp_key_item);
-	*out = arr;
-	return i;
+	return c;
 }
 
-static cJSON *index_get(struct key_item *arr, int n, const char *key)
+static void *arena_alloc(struct json_diff_arena *arena, size_t size)
 {
-	if (!arr || n <= 0 || !key)
+	/* Prevent overflow in size rounding */
+	if (size > SIZE_MAX - (ARENA_ALIGN - 1))
 		return NULL;
-	int lo = 0, hi = n - 1;
-	while (lo <= hi) {
-		int mid = lo + (hi - lo) / 2;
-		int cmp = strcmp(key, arr[mid].key);
-		if (cmp == 0)
-			return arr[mid].item;
-		if (cmp < 0)
-			hi = mid - 1;
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	if (!arena->chunk_size)
+		arena->chunk_size = JSON_DIFF_ARENA_CHUNK_SIZE;
+
+	/* Oversized: separate block, released on reset */
+	if (size > arena->chunk_size / 4) {
+		struct json_diff_arena_chunk *b = arena_new_chunk(size);
+		if (!b)
+			return NULL;
+		b->used = size;
+		b->next = arena->large;
+		arena->large = b;
+		arena->large_count++;
+		arena->capacity += size;
+		arena->offset += size;
+		if (arena->offset > arena->high_water)
+			arena->high_water = arena->offset;
+		return b->data;
+	}
+
+	/* Walk forward through chunks kept from before the last reset */
+	struct json_diff_arena_chunk *c = arena->cur, *prev = NULL;
+	while (c && c->size - c->used < size) {
+		prev = c;
+		c = c->next;
+	}
+	if (!c) {
+		c = arena_new_chunk(arena->chunk_size);
+		if (!c)
+			return NULL;
+		if (prev)
+			prev->next = c;
 		else
-			lo = mid + 1;
+			arena->head = c;
+		arena->chunk_count++;
+		arena->capacity += c->size;
 	}
-	return NULL;
+	arena->cur = c;
+
+	void *ptr = (char *)c->data + c->used;
+	c->used += size;
+	arena->offset += size;
+	if (arena->offset > arena->high_water)
+		arena->high_water = arena->offset;
+	return ptr;
 }
 
-/* arrays-of-objects post-transform moved to myers.c */
-/* Create a shallow clone of a value:
- * - Objects/arrays: new container with children added as references
- * - Primitives: new primitive with same value
- */
-static cJSON *clone_shallow(const cJSON *v)
+void json_diff_arena_init(struct json_diff_arena *arena,
+                          size_t initial_capacity)
 {
-	if (!v)
-		return cJSON_CreateNull();
-	if (cJSON_IsObject(v)) {
-		cJSON *o = cJSON_CreateObject();
-		if (!o)
-			return NULL;
-		for (const cJSON *ch = v->child; ch; ch = ch->next) {
-			cJSON *val = NULL;
-			if (cJSON_IsObject(ch))
-				val = cJSON_CreateObjectReference(ch);
-			else if (cJSON_IsArray(ch))
-				val = cJSON_CreateArrayReference(ch);
-			else if (cJSON_IsString(ch))
-				val = cJSON_CreateString(ch->valuestring);
-			else if (cJSON_IsNumber(ch))
-				val = cJSON_CreateNumber(ch->valuedouble);
-			else if (cJSON_IsBool(ch))
-				val = cJSON_CreateBool(cJSON_IsTrue(ch));
-			else
-				val = cJSON_CreateNull();
-			if (!val) {
-				cJSON_Delete(o);
-				return NULL;
-			}
-			cJSON_AddItemToObject(o, ch->string ? ch->string : "",
-			                      val);
-		}
-		return o;
-	}
-	if (cJSON_IsArray(v)) {
-		cJSON *a = cJSON_CreateArray();
-		if (!a)
-			return NULL;
-		for (const cJSON *ch = v->child; ch; ch = ch->next) {
-			cJSON *val = NULL;
-			if (cJSON_IsObject(ch))
-				val = cJSON_CreateObjectReference(ch);
-			else if (cJSON_IsArray(ch))
-				val = cJSON_CreateArrayReference(ch);
-			else if (cJSON_IsString(ch))
-				val = cJSON_CreateString(ch->valuestring);
-			else if (cJSON_IsNumber(ch))
-				val = cJSON_CreateNumber(ch->valuedouble);
-			else if (cJSON_IsBool(ch))
-				val = cJSON_CreateBool(cJSON_IsTrue(ch));
-			else
-				val = cJSON_CreateNull();
-			if (!val) {
-				cJSON_Delete(a);
-				return NULL;
-			}
-			cJSON_AddItemToArray(a, val);
-		}
-		return a;
+	memset(arena, 0, sizeof(*arena));
+	arena->chunk_size = initial_capacity ? initial_capacity
+	                                     : JSON_DIFF_ARENA_CHUNK_SIZE;
+	if (arena->chunk_size < ARENA_MIN_CHUNK)
+		arena->chunk_size = ARENA_MIN_CHUNK;
+	/* First chunk up front; on failure it is retried on first use */
+	arena->head = arena_new_chunk(arena->chunk_size);
+	if (arena->head) {
+		arena->cur = arena->head;
+		arena->chunk_count = 1;
+		arena->capacity = arena->head->size;
 	}
-	if (cJSON_IsString(v))
-		return cJSON_CreateString(v->valuestring);
-	if (cJSON_IsNumber(v))
-		return cJSON_CreateNumber(v->valuedouble);
-	if (cJSON_IsBool(v))
-		return cJSON_CreateBool(cJSON_IsTrue(v));
-	return cJSON_CreateNull();
 }
 
-static void *arena_malloc(size_t size)
+static void arena_free_large(struct json_diff_arena *arena)
 {
-	if (!current_arena)
-		return NULL;
-	/* Prevent overflow in offset rounding */
-	if (current_arena->offset > SIZE_MAX - (sizeof(void *) - 1))
-		return NULL;
-	size_t off = (current_arena->offset + sizeof(void *) - 1) &
-	             ~(sizeof(void *) - 1);
-	/* Prevent overflow in allocation size */
-	if (off > SIZE_MAX - size)
-		return NULL;
-	if (off + size > current_arena->capacity) {
-		size_t newcap = current_arena->capacity
-		                    ? current_arena->capacity * 2
-		                    : size * 2;
-		if (newcap < size)
-			newcap = size * 2;
-		/* Prevent excessive memory usage */
-		if (newcap > MAX_ARENA_SIZE)
-			return NULL;
-		while (newcap < off + size) {
-			if (newcap > SIZE_MAX / 2 || newcap > MAX_ARENA_SIZE)
-				return NULL;
-			newcap *= 2;
-			if (newcap > MAX_ARENA_SIZE)
-				return NULL;
-		}
-		char *newbuf = realloc(current_arena->buf, newcap);
-		if (!newbuf)
-			return NULL;
-		current_arena->buf = newbuf;
-		current_arena->capacity = newcap;
+	while (arena->large) {
+		struct json_diff_arena_chunk *next = arena->large->next;
+		arena->capacity -= arena->large->size;
+		free(arena->large);
+		arena->large = next;
 	}
-	void *ptr = current_arena->buf + off;
-	current_arena->offset = off + size;
-	return ptr;
+	arena->large_count = 0;
 }
 
-static void arena_free(void *ptr) { (void)ptr; }
+void json_diff_arena_reset(struct json_diff_arena *arena)
+{
+	arena_free_large(arena);
+	for (struct json_diff_arena_chunk *c = arena->head; c; c = c->next)
+		c->used = 0;
+	arena->cur = arena->head;
+	arena->offset = 0;
+}
 
-void json_diff_arena_init(struct json_diff_arena *arena,
-                          size_t initial_capacity)
+void json_diff_arena_cleanup(struct json_diff_arena *arena)
 {
-	arena->buf = malloc(initial_capacity);
-	if (!arena->buf) {
-		arena->capacity = arena->offset = 0;
-	} else {
-		arena->capacity = initial_capacity;
-		arena->offset = 0;
+	arena_free_large(arena);
+	while (arena->head) {
+		struct json_diff_arena_chunk *next = arena->head->next;
+		free(arena->head);
+		arena->head = next;
 	}
+	memset(arena, 0, sizeof(*arena));
 }
 
-void json_diff_arena_cleanup(struct json_diff_arena *arena)
+#ifdef JSON_DIFF_THREADS
+/* Hand every allocation of @child to @parent, leaving @child empty */
+static void arena_adopt(struct json_diff_arena *parent,
+                        struct json_diff_arena *child)
 {
-	free(arena->buf);
-	arena->buf = NULL;
-	arena->capacity = arena->offset = 0;
+	if (child->head) {
+		struct json_diff_arena_chunk **tail = &parent->head;
+		while (*tail)
+			tail = &(*tail)->next;
+		*tail = child->head;
+		if (!parent->cur)
+			parent->cur = parent->head;
+	}
+	if (child->large) {
+		struct json_diff_arena_chunk *last = child->large;
+		while (last->next)
+			last = last->next;
+		last->next = parent->large;
+		parent->large = child->large;
+	}
+	parent->chunk_count += child->chunk_count;
+	parent->large_count += child->large_count;
+	parent->capacity += child->capacity;
+	parent->offset += child->offset;
+	if (parent->offset > parent->high_water)
+		parent->high_water = parent->offset;
+	memset(child, 0, sizeof(*child));
 }
+#endif
 
-#define ARRAY_MARKER "_t"
-#define ARRAY_MARKER_VALUE "a"
+/* Scratch allocations are released in LIFO order with mark/rewind */
+struct arena_mark {
+	struct json_diff_arena_chunk *cur;
+	struct json_diff_arena_chunk *large;
+	size_t used;
+	size_t offset;
+};
 
-/**
- * json_value_equal - Compare two cJSON values for equality (optimized)
- * @left: first value
- * @right: second value
- * @strict: use strict equality for numbers
- *
- * Return: true if equal, false otherwise
- */
-bool json_value_equal(const cJSON *left, const cJSON *right, bool strict)
+static struct arena_mark arena_mark(const struct json_diff_arena *arena)
 {
-	/* Fast pointer equality check */
-	if (left == right)
-		return true;
+	struct arena_mark m = {arena->cur, arena->large,
+	                       arena->cur ? arena->cur->used : 0,
+	                       arena->offset};
+	return m;
+}
 
-	if (!left || !right)
-		return false;
+static void arena_rewind(struct json_diff_arena *arena,
+                         const struct arena_mark *m)
+{
+	while (arena->large != m->large) {
+		struct json_diff_arena_chunk *next = arena->large->next;
+		arena->capacity -= arena->large->size;
+		arena->large_count--;
+		free(arena->large);
+		arena->large = next;
+	}
+	/* Chunks filled since the mark were appended after m->cur */
+	struct json_diff_arena_chunk *c = m->cur ? m->cur : arena->head;
+	if (!c)
+		return;
+	if (m->cur) {
+		c->used = m->used;
+		c = c->next;
+	}
+	for (; c; c = c->next) {
+		if (!c->used)
+			break;
+		c->used = 0;
+	}
+	arena->cur = m->cur ? m->cur : arena->head;
+	arena->offset = m->offset;
+}
 
-	if (left->type != right->type)
-		return false;
+/*
+ * Object key index: open-addressing table over the members of one object,
+ * kept in member order in @entries so unmatched keys can be walked in
+ * document order. Allocated from the per-call scratch arena.
+ */
+struct key_entry {
+	const char *key;
+	uint64_t hash;
+	cJSON *item;
+	bool matched;
+};
 
-	switch (left->type) {
-	case cJSON_NULL:
-		return true;
-	case cJSON_False:
-	case cJSON_True:
-		return true; /* Same type already checked */
-	case cJSON_Number:
-		if (strict)
-			return left->valuedouble == right->valuedouble;
-		else
-			return fabs(left->valuedouble - right->valuedouble) <
-			       1e-9;
-	case cJSON_String:
-		/* Fast pointer and length check first */
-		if (left->valuestring == right->valuestring)
-			return true;
-		if (!left->valuestring || !right->valuestring)
-			return false;
-		/* Quick length check before strcmp */
-		size_t left_len = strlen(left->valuestring);
-		size_t right_len = strlen(right->valuestring);
-		if (left_len != right_len)
-			return false;
-		return memcmp(left->valuestring, right->valuestring,
-		              left_len) == 0;
-	case cJSON_Array: {
-		int left_size = cJSON_GetArraySize(left);
-		int right_size = cJSON_GetArraySize(right);
-		if (left_size != right_size)
-			return false;
+struct key_index {
+	struct key_entry *entries;
+	int *slots; /* entry index + 1, 0 for empty */
+	size_t mask;
+	int count;
+};
 
-		/* Use direct child iteration for better performance */
-		cJSON *left_item = left->child;
-		cJSON *right_item = right->child;
-		while (left_item && right_item) {
-			if (!json_value_equal(left_item, right_item, strict))
-				return false;
-			left_item = left_item->next;
-			right_item = right_item->next;
-		}
-		return left_item == NULL && right_item == NULL;
-	}
-	case cJSON_Object: {
-		int left_size = cJSON_GetArraySize(left);
-		int right_size = cJSON_GetArraySize(right);
-		if (left_size != right_size)
+static bool key_index_build(struct json_diff_arena *scratch, const cJSON *obj,
+                            struct key_index *idx)
+{
+	size_t n = 0;
+	for (const cJSON *ch = obj->child; ch; ch = ch->next)
+		n++;
+	size_t cap = 8;
+	while (cap < n * 2) {
+		if (cap > (size_t)INT_MAX)
 			return false;
-
-		cJSON *left_item = left->child;
-		while (left_item) {
-			cJSON *right_item =
-			    cJSON_GetObjectItem(right, left_item->string);
-			if (!right_item ||
-			    !json_value_equal(left_item, right_item, strict))
-				return false;
-			left_item = left_item->next;
+		cap <<= 1;
+	}
+	idx->entries = arena_alloc(scratch, n * sizeof(*idx->entries) + 1);
+	idx->slots = arena_alloc(scratch, cap * sizeof(*idx->slots));
+	if (!idx->entries || !idx->slots)
+		return false;
+	memset(idx->slots, 0, cap * sizeof(*idx->slots));
+	idx->mask = cap - 1;
+	idx->count = 0;
+	for (cJSON *ch = obj->child; ch; ch = ch->next) {
+		if (!ch->string)
+			continue;
+		uint64_t h = json_hash_key(ch->string);
+		size_t i = (size_t)h & idx->mask;
+		bool dup = false;
+		while (idx->slots[i]) {
+			const struct key_entry *e =
+			    &idx->entries[idx->slots[i] - 1];
+			if (e->hash == h && strcmp(e->key, ch->string) == 0) {
+				dup = true;
+				break;
+			}
+			i = (i + 1) & idx->mask;
 		}
-		return true;
+		/* First occurrence wins, as with cJSON_GetObjectItem() */
+		if (dup)
+			continue;
+		idx->entries[idx->count] =
+		    (struct key_entry){ch->string, h, ch, false};
+		idx->slots[i] = ++idx->count;
 	}
+	return true;
+}
+
+static struct key_entry *key_index_get(const struct key_index *idx,
+                                       const char *key)
+{
+	uint64_t h = json_hash_key(key);
+	size_t i = (size_t)h & idx->mask;
+	while (idx->slots[i]) {
+		struct key_entry *e = &idx->entries[idx->slots[i] - 1];
+		if (e->hash == h && strcmp(e->key, key) == 0)
+			return e;
+		i = (i + 1) & idx->mask;
 	}
+	return NULL;
+}
 
-	return false;
+/* key_index_build() on the scratch arena, timed into the stats */
+static bool ctx_index_build(const struct json_diff_ctx *ctx, const cJSON *obj,
+                            struct key_index *idx)
+{
+	struct json_diff_stats *st = ctx->opts->stats;
+	uint64_t t0 = json_diff_stats_clock(st);
+	bool ok = key_index_build(ctx->scratch, obj, idx);
+	if (st) {
+		st->index_ns += json_diff_stats_clock(st) - t0;
+		st->key_indexes++;
+	}
+	return ok;
 }
 
-/**
- * create_change_array - Create a change array [old_value, new_value]
- * @old_val: old value
- * @new_val: new value
- *
- * Return: cJSON array or NULL on failure
+/*
+ * One member of an object delta: a nested diff, a deletion (no @right) or
+ * an addition (no @left). Walks that collect their members first, the
+ * prepared and the parallel ones, run them through member_jobs_run().
  */
-cJSON *create_change_array(const cJSON *old_val, const cJSON *new_val)
+struct member_job {
+	const cJSON *left;
+	const cJSON *right;
+	cJSON *diff;
+};
+
+/*
+ * Prepared baseline (json_diff_prepare()): the left document laid out
+ * flat, every node once in breadth-first order so that the children of a
+ * container are the contiguous range [child, child + count). Element
+ * vectors of arrays are slices of @nodes and, with object_key/object_hash,
+ * of @ids; objects keep a key index and each member the entry it resolves
+ * to. Per-node facts live in parallel arrays so a pass only touches what
+ * it reads, and nodes are found by address in one open-addressed table.
+ */
+struct flat_node {
+	int child; /* first child */
+	int count; /* children */
+	int type;  /* cJSON type without flag bits */
+	int index; /* key index of an object, -1 otherwise */
+	int entry; /* key index entry of an object member, -1 if none */
+};
+
+struct json_diff_prepared {
+	const cJSON *left;
+	struct json_diff_options opts;
+	int count;
+	struct flat_node *flat;
+	cJSON **nodes;
+	cJSON **ids;       /* element identities, NULL unless keyed */
+	uint64_t *hashes;  /* subtree hashes, NULL unless hash_cache */
+	size_t *lengths;   /* string lengths, alongside @hashes */
+	struct key_index *indexes;
+	int *slots; /* node + 1, 0 for empty */
+	size_t mask;
+	struct json_diff_arena mem;
+};
+
+static size_t prep_slot(const cJSON *node, size_t mask)
 {
-	cJSON *array = cJSON_CreateArray();
-	if (!array)
-		return NULL;
+	return (size_t)json_hash_mix((uint64_t)(uintptr_t)node) & mask;
+}
 
-	/* Use references for objects/arrays/strings, copy scalars */
-	cJSON *old_item = NULL;
-	if (!old_val) {
-		old_item = cJSON_CreateNull();
-	} else if (cJSON_IsObject(old_val)) {
-		old_item = clone_shallow(old_val);
-	} else if (cJSON_IsArray(old_val)) {
-		old_item = clone_shallow(old_val);
-	} else if (cJSON_IsString(old_val)) {
-		old_item = cJSON_CreateString(old_val->valuestring);
-	} else if (cJSON_IsNumber(old_val)) {
-		old_item = cJSON_CreateNumber(old_val->valuedouble);
-	} else if (cJSON_IsBool(old_val)) {
-		old_item = cJSON_CreateBool(cJSON_IsTrue(old_val));
-	} else {
-		old_item = cJSON_CreateNull();
-	}
-	cJSON *new_item = NULL;
-	if (!new_val) {
-		new_item = cJSON_CreateNull();
-	} else if (cJSON_IsObject(new_val)) {
-		new_item = clone_shallow(new_val);
-	} else if (cJSON_IsArray(new_val)) {
-		new_item = clone_shallow(new_val);
-	} else if (cJSON_IsString(new_val)) {
-		new_item = cJSON_CreateString(new_val->valuestring);
-	} else if (cJSON_IsNumber(new_val)) {
-		new_item = cJSON_CreateNumber(new_val->valuedouble);
-	} else if (cJSON_IsBool(new_val)) {
-		new_item = cJSON_CreateBool(cJSON_IsTrue(new_val));
-	} else {
-		new_item = cJSON_CreateNull();
-	}
-	if (!old_item || !new_item) {
-		cJSON_Delete(array);
-		cJSON_Delete(old_item);
-		cJSON_Delete(new_item);
-		return NULL;
+/* Flat index of @node, -1 if it is not part of the prepared document */
+static int prep_find(const struct json_diff_prepared *p, const cJSON *node)
+{
+	for (size_t i = prep_slot(node, p->mask); p->slots[i];
+	     i = (i + 1) & p->mask) {
+		int k = p->slots[i] - 1;
+		if (p->nodes[k] == node)
+			return k;
 	}
-	cJSON_AddItemToArray(array, old_item);
-	cJSON_AddItemToArray(array, new_item);
-	return array;
+	return -1;
 }
 
-/**
- * create_addition_array - Create an addition array [new_value]
- * @new_val: new value
- *
- * Return: cJSON array or NULL on failure
- */
-cJSON *create_addition_array(const cJSON *new_val)
+/* Nodes and objects under @node, SIZE_MAX past the nesting limit */
+static size_t prep_count(const cJSON *node, int depth, size_t *objects)
 {
-	cJSON *array = cJSON_CreateArray();
-	if (!array)
-		return NULL;
+	if (depth > MAX_JSON_DEPTH)
+		return SIZE_MAX;
+	if (cJSON_IsObject(node))
+		(*objects)++;
+	size_t n = 1;
+	for (const cJSON *ch = node->child; ch; ch = ch->next) {
+		size_t c = prep_count(ch, depth + 1, objects);
+		if (c == SIZE_MAX)
+			return SIZE_MAX;
+		n += c;
+	}
+	return n;
+}
 
-	/* Reference new value to avoid deep copy */
-	cJSON *new_item = NULL;
-	if (cJSON_IsObject(new_val)) {
-		new_item = clone_shallow(new_val);
-	} else if (cJSON_IsArray(new_val)) {
-		new_item = clone_shallow(new_val);
-	} else if (cJSON_IsString(new_val)) {
-		new_item = cJSON_CreateString(new_val->valuestring);
-	} else if (cJSON_IsNumber(new_val)) {
-		new_item = cJSON_CreateNumber(new_val->valuedouble);
-	} else if (cJSON_IsBool(new_val)) {
-		new_item = cJSON_CreateBool(cJSON_IsTrue(new_val));
-	} else {
-		new_item = cJSON_CreateNull();
+/* Lay the document out level by level, then index and hash it */
+static bool prep_build(struct json_diff_prepared *p)
+{
+	bool keyed = p->ids != NULL;
+	int tail = 1, objects = 0;
+	p->nodes[0] = (cJSON *)p->left;
+	p->flat[0].entry = -1;
+	for (int i = 0; i < p->count; i++) {
+		cJSON *node = p->nodes[i];
+		struct flat_node *f = &p->flat[i];
+		f->child = tail;
+		f->count = 0;
+		f->type = node->type & 0xFF;
+		f->index = -1;
+		if (f->type != cJSON_Array && f->type != cJSON_Object)
+			continue;
+		for (cJSON *ch = node->child; ch; ch = ch->next) {
+			p->nodes[tail] = ch;
+			p->flat[tail++].entry = -1;
+			f->count++;
+		}
+		cJSON **elems = &p->nodes[f->child];
+		if (f->type == cJSON_Array) {
+			if (keyed)
+				json_myers_element_ids(&p->opts, elems, f->count,
+				                       &p->ids[f->child]);
+			continue;
+		}
+		struct key_index *idx = &p->indexes[objects];
+		if (!key_index_build(&p->mem, node, idx))
+			return false;
+		f->index = objects++;
+		for (int m = f->child; m < f->child + f->count; m++) {
+			const char *key = p->nodes[m]->string;
+			const struct key_entry *e =
+			    key ? key_index_get(idx, key) : NULL;
+			p->flat[m].entry = e ? (int)(e - idx->entries) : -1;
+		}
 	}
-	if (!new_item) {
-		cJSON_Delete(array);
-		return NULL;
+
+	for (int i = 0; i < p->count; i++) {
+		size_t s = prep_slot(p->nodes[i], p->mask);
+		while (p->slots[s])
+			s = (s + 1) & p->mask;
+		p->slots[s] = i + 1;
 	}
-	cJSON_AddItemToArray(array, new_item);
-	return array;
+	/* Children follow their parent, so a backward pass hashes bottom-up */
+	for (int i = p->count - 1; p->hashes && i >= 0; i--)
+		p->hashes[i] = json_hash_node(p->nodes[i],
+		                              &p->hashes[p->flat[i].child],
+		                              p->opts.strict_equality,
+		                              &p->lengths[i]);
+	return true;
 }
 
-/**
- * create_deletion_array - Create a deletion array [old_value, 0, 0]
- * @old_val: old value
- *
- * Return: cJSON array or NULL on failure
+/* Hash and string length of @node if it belongs to @p */
+static bool prep_hash(const struct json_diff_prepared *p, const cJSON *node,
+                      uint64_t *hash, size_t *len)
+{
+	if (!p->hashes)
+		return false;
+	int k = prep_find(p, node);
+	if (k < 0)
+		return false;
+	*hash = p->hashes[k];
+	*len = p->lengths[k];
+	return true;
+}
+
+bool json_diff_prepared_array(const struct json_diff_prepared *prep,
+                              const cJSON *array, cJSON ***elems,
+                              cJSON ***ids, int *count)
+{
+	int k = prep_find(prep, array);
+	if (k < 0 || prep->flat[k].type != cJSON_Array)
+		return false;
+	const struct flat_node *f = &prep->flat[k];
+	*elems = &prep->nodes[f->child];
+	*ids = prep->ids ? &prep->ids[f->child] : *elems;
+	*count = f->count;
+	return true;
+}
+
+/*
+ * Member jobs of a prepared left object against @right, in the order of
+ * the serial walk: every right member is looked up once in the prepared
+ * index, then left members are listed with their first match and right
+ * members without a left counterpart follow in document order.
  */
-cJSON *create_deletion_array(const cJSON *old_val)
+static struct member_job *
+member_jobs_prepared(struct json_diff_arena *scratch,
+                     const struct json_diff_prepared *p, int k,
+                     const cJSON *right, int *count)
 {
-	cJSON *array = cJSON_CreateArray();
-	if (!array)
+	const struct flat_node *f = &p->flat[k];
+	const struct key_index *idx = &p->indexes[f->index];
+	size_t nr = 0;
+	for (const cJSON *ri = right->child; ri; ri = ri->next)
+		nr++;
+	size_t n = (size_t)f->count + nr;
+	if (n > (size_t)INT_MAX)
 		return NULL;
+	struct member_job *jobs = arena_alloc(scratch, (n + 1) * sizeof(*jobs));
+	const cJSON **match = arena_alloc(
+	    scratch, ((size_t)idx->count + 1) * sizeof(*match));
+	const cJSON **only = arena_alloc(scratch, (nr + 1) * sizeof(*only));
+	if (!jobs || !match || !only)
+		return NULL;
+	memset(match, 0, ((size_t)idx->count + 1) * sizeof(*match));
 
-	/* Reference old value and add zeros for deletion */
-	cJSON *old_item = NULL;
-	if (cJSON_IsObject(old_val)) {
-		old_item = cJSON_Duplicate(old_val, 1);
-	} else if (cJSON_IsArray(old_val)) {
-		old_item = cJSON_Duplicate(old_val, 1);
-	} else if (cJSON_IsString(old_val)) {
-		old_item = cJSON_CreateString(old_val->valuestring);
-	} else if (cJSON_IsNumber(old_val)) {
-		old_item = cJSON_CreateNumber(old_val->valuedouble);
-	} else if (cJSON_IsBool(old_val)) {
-		old_item = cJSON_CreateBool(cJSON_IsTrue(old_val));
-	} else {
-		old_item = cJSON_CreateNull();
+	size_t nonly = 0;
+	for (const cJSON *ri = right->child; ri; ri = ri->next) {
+		if (!ri->string)
+			continue;
+		const struct key_entry *e = key_index_get(idx, ri->string);
+		if (!e)
+			only[nonly++] = ri;
+		else if (!match[e - idx->entries])
+			match[e - idx->entries] = ri;
 	}
-	cJSON *zero1 = cJSON_CreateNumber(0);
-	cJSON *zero2 = cJSON_CreateNumber(0);
-	if (!old_item || !zero1 || !zero2) {
-		cJSON_Delete(array);
-		cJSON_Delete(old_item);
-		cJSON_Delete(zero1);
-		cJSON_Delete(zero2);
+
+	int c = 0;
+	for (int m = f->child; m < f->child + f->count; m++) {
+		int entry = p->flat[m].entry;
+		if (entry >= 0)
+			jobs[c++] = (struct member_job){p->nodes[m],
+			                                match[entry], NULL};
+	}
+
+	/* Keys only in right: first occurrence, as the serial walk adds */
+	size_t cap = 8;
+	while (cap < nonly * 2)
+		cap <<= 1;
+	const char **seen =
+	    nonly > 1 ? arena_alloc(scratch, cap * sizeof(*seen)) : NULL;
+	if (nonly > 1 && !seen)
 		return NULL;
+	if (seen)
+		memset(seen, 0, cap * sizeof(*seen));
+	for (size_t i = 0; i < nonly; i++) {
+		if (seen) {
+			size_t slot = (size_t)json_hash_key(only[i]->string) &
+			              (cap - 1);
+			while (seen[slot] &&
+			       strcmp(seen[slot], only[i]->string))
+				slot = (slot + 1) & (cap - 1);
+			if (seen[slot])
+				continue;
+			seen[slot] = only[i]->string;
+		}
+		jobs[c++] = (struct member_job){NULL, only[i], NULL};
 	}
-	cJSON_AddItemToArray(array, old_item);
-	cJSON_AddItemToArray(array, zero1);
-	cJSON_AddItemToArray(array, zero2);
-	return array;
+	*count = c;
+	return jobs;
 }
 
-/**
- * myers_diff_arrays - Fast array diff using simple linear comparison
- * @left: first array
- * @right: second array
- * @opts: diff options
- *
- * Return: diff object or NULL if arrays are equal
+/*
+ * Diff node builders. With an arena the node, its key and its string value
+ * all live in the arena (keys are flagged cJSON_StringIsConst); without one
+ * they come from the regular cJSON allocator.
  */
-/* legacy myers implementation moved to src/myers.c */
+static cJSON *arena_node(struct json_diff_arena *arena, int type)
+{
+	cJSON *n = arena_alloc(arena, sizeof(*n));
+	if (n) {
+		memset(n, 0, sizeof(*n));
+		n->type = type;
+	}
+	return n;
+}
 
-/**
- * diff_arrays - Create diff for two cJSON arrays
- * @left: first array
- * @right: second array
- * @opts: diff options
- *
- * Return: diff object or NULL if arrays are equal
- */
-static cJSON *diff_arrays(const cJSON *left, const cJSON *right,
-                          const struct json_diff_options *opts)
+static char *arena_strdup(struct json_diff_arena *arena, const char *s)
 {
-	return json_myers_array_diff(left, right, opts);
+	size_t len = strlen(s) + 1;
+	char *c = arena_alloc(arena, len);
+	if (c)
+		memcpy(c, s, len);
+	return c;
 }
 
-/**
- * do_json_diff - Core implementation of diff without arena setup
- * @left: first JSON value
- * @right: second JSON value
- * @opts: diff options (must not be NULL)
- *
- * Return: diff object or NULL if values are equal or on error
- */
-static cJSON *do_json_diff(const cJSON *left, const cJSON *right,
-                           const struct json_diff_options *opts)
+cJSON *diff_new_object(struct json_diff_arena *arena)
 {
-	cJSON *result = NULL;
-	struct json_diff_options default_opts = {.strict_equality = true};
-	if (!opts)
-		opts = &default_opts;
+	return arena ? arena_node(arena, cJSON_Object) : cJSON_CreateObject();
+}
 
-	/* Recursion depth guard */
-	if (++json_diff_depth > MAX_JSON_DEPTH)
-		return NULL;
+cJSON *diff_new_array(struct json_diff_arena *arena)
+{
+	return arena ? arena_node(arena, cJSON_Array) : cJSON_CreateArray();
+}
 
-	/* Fast path for identical pointers or equal values */
-	if (left == right ||
-	    json_value_equal(left, right, opts->strict_equality))
-		goto finish;
+cJSON *diff_new_null(struct json_diff_arena *arena)
+{
+	return arena ? arena_node(arena, cJSON_NULL) : cJSON_CreateNull();
+}
 
-	/* Simple type or null mismatch */
-	if (!left || !right || left->type != right->type) {
-		result = create_change_array(left, right);
-		goto finish;
-	}
+cJSON *diff_new_bool(struct json_diff_arena *arena, bool value)
+{
+	if (!arena)
+		return cJSON_CreateBool(value);
+	return arena_node(arena, value ? cJSON_True : cJSON_False);
+}
 
-	/* Simple non-container types */
-	if (left->type != cJSON_Object && left->type != cJSON_Array) {
-		result = create_change_array(left, right);
-		goto finish;
+cJSON *diff_new_number(struct json_diff_arena *arena, double value)
+{
+	if (!arena)
+		return cJSON_CreateNumber(value);
+	cJSON *n = arena_node(arena, cJSON_Number);
+	if (n) {
+		n->valuedouble = value;
+		if (value >= INT_MAX)
+			n->valueint = INT_MAX;
+		else if (value <= (double)INT_MIN)
+			n->valueint = INT_MIN;
+		else
+			n->valueint = (int)value;
 	}
+	return n;
+}
 
-	/* Array diff */
-	if (left->type == cJSON_Array) {
-		result = diff_arrays(left, right, opts);
-		goto finish;
+cJSON *diff_new_string(struct json_diff_arena *arena, const char *value)
+{
+	if (!arena)
+		return cJSON_CreateString(value);
+	if (!value)
+		return NULL;
+	cJSON *n = arena_node(arena, cJSON_String);
+	if (n) {
+		n->valuestring = arena_strdup(arena, value);
+		if (!n->valuestring)
+			return NULL;
 	}
+	return n;
+}
 
-	/* Object diff with indexed lookups for better performance */
-	cJSON *diff_obj = cJSON_CreateObject();
-	if (!diff_obj)
-		goto finish;
-	{
-		bool has_changes = false;
-		struct key_item *right_index = NULL, *left_index = NULL;
-		int right_n = build_key_index(right, &right_index);
-		int left_n = build_key_index(left, &left_index);
+/*
+ * Borrowing node: a container whose child chain is @target's, or a string
+ * sharing @target's buffer. cJSON_IsReference keeps cJSON_Delete() from
+ * freeing what it points at.
+ */
+static cJSON *diff_new_reference(struct json_diff_arena *arena,
+                                 const cJSON *target)
+{
+	if (!arena) {
+		if (cJSON_IsString(target))
+			return cJSON_CreateStringReference(target->valuestring);
+		return cJSON_IsObject(target)
+		           ? cJSON_CreateObjectReference(target->child)
+		           : cJSON_CreateArrayReference(target->child);
+	}
+	cJSON *n = arena_node(arena, (target->type & 0xFF) | cJSON_IsReference);
+	if (n) {
+		n->child = target->child;
+		n->valuestring = target->valuestring;
+	}
+	return n;
+}
+
+bool diff_add_item(struct json_diff_arena *arena, cJSON *parent, cJSON *item)
+{
+	if (!arena)
+		return cJSON_AddItemToArray(parent, item);
+	if (!parent || !item)
+		return false;
+	if (!parent->child) {
+		parent->child = item;
+		item->prev = item;
+	} else {
+		cJSON *tail = parent->child->prev;
+		tail->next = item;
+		item->prev = tail;
+		parent->child->prev = item;
+	}
+	item->next = NULL;
+	return true;
+}
+
+bool diff_add_item_to_object(struct json_diff_arena *arena, cJSON *parent,
+                             const char *key, cJSON *item)
+{
+	if (!arena)
+		return cJSON_AddItemToObject(parent, key, item);
+	if (!item || !key)
+		return false;
+	item->string = arena_strdup(arena, key);
+	if (!item->string)
+		return false;
+	item->type |= cJSON_StringIsConst;
+	return diff_add_item(arena, parent, item);
+}
+
+void diff_delete(struct json_diff_arena *arena, cJSON *item)
+{
+	if (!arena)
+		cJSON_Delete(item);
+}
+
+static cJSON *diff_scalar(struct json_diff_arena *arena, const cJSON *v)
+{
+	if (cJSON_IsString(v))
+		return diff_new_string(arena, v->valuestring);
+	if (cJSON_IsNumber(v))
+		return diff_new_number(arena, v->valuedouble);
+	if (cJSON_IsBool(v))
+		return diff_new_bool(arena, cJSON_IsTrue(v));
+	return diff_new_null(arena);
+}
+
+/* Containers the copy sits in before its stack moves to the heap */
+#define DUP_LOCAL_DEPTH 32
+
+struct dup_frame {
+	const cJSON *next; /* next source child to copy */
+	cJSON *dst;
+};
+
+/*
+ * Deep copy of @v into the arena (or the heap without one). Unlike
+ * cJSON_Duplicate() every key is copied, so the result never points into
+ * @v, even when @v is itself an arena diff with constant keys. The open
+ * containers live on an explicit stack, so any depth copies.
+ */
+static cJSON *diff_duplicate(struct json_diff_arena *arena, const cJSON *v)
+{
+	if (!v)
+		return diff_new_null(arena);
+	if (!cJSON_IsObject(v) && !cJSON_IsArray(v))
+		return diff_scalar(arena, v);
+	cJSON *root = cJSON_IsObject(v) ? diff_new_object(arena)
+	                                : diff_new_array(arena);
+	if (!root)
+		return NULL;
+	struct dup_frame local[DUP_LOCAL_DEPTH], *stack = local;
+	size_t depth = 0, cap = DUP_LOCAL_DEPTH;
+	stack[depth++] = (struct dup_frame){v->child, root};
+	while (depth) {
+		struct dup_frame *f = &stack[depth - 1];
+		const cJSON *ch = f->next;
+		if (!ch) {
+			depth--;
+			continue;
+		}
+		f->next = ch->next;
+		bool container = cJSON_IsObject(ch) || cJSON_IsArray(ch);
+		cJSON *val = !container ? diff_scalar(arena, ch)
+		             : cJSON_IsObject(ch) ? diff_new_object(arena)
+		                                  : diff_new_array(arena);
+		bool ok = cJSON_IsObject(f->dst)
+		              ? diff_add_item_to_object(arena, f->dst,
+		                                        ch->string ? ch->string
+		                                                   : "",
+		                                        val)
+		              : diff_add_item(arena, f->dst, val);
+		if (ok && container && ch->child && depth == cap) {
+			struct dup_frame *grown =
+			    malloc(cap * 2 * sizeof(*grown));
+			if (grown) {
+				memcpy(grown, stack, cap * sizeof(*grown));
+				if (stack != local)
+					free(stack);
+				stack = grown;
+				cap *= 2;
+			} else {
+				ok = false;
+				val = NULL; /* already linked into f->dst */
+			}
+		}
+		if (!ok) {
+			diff_delete(arena, val);
+			diff_delete(arena, root);
+			root = NULL;
+			break;
+		}
+		if (container && ch->child)
+			stack[depth++] = (struct dup_frame){ch->child, val};
+	}
+	if (stack != local)
+		free(stack);
+	return root;
+}
+
+/* Old value slot of a change or deletion: @v, or null when forward only */
+static const cJSON *diff_old(const struct json_diff_ctx *ctx, const cJSON *v)
+{
+	static const cJSON placeholder = {.type = cJSON_NULL};
+	return ctx->opts->forward_only ? &placeholder : v;
+}
+
+cJSON *diff_value(const struct json_diff_ctx *ctx, const cJSON *v)
+{
+	struct json_diff_arena *arena = ctx->opts->arena;
+	if (ctx->opts->output != JSON_DIFF_OUTPUT_BORROWED || !v)
+		return diff_duplicate(arena, v);
+	if (cJSON_IsObject(v) || cJSON_IsArray(v) || cJSON_IsString(v))
+		return diff_new_reference(arena, v);
+	return diff_scalar(arena, v);
+}
+
+#define ARRAY_MARKER "_t"
+#define ARRAY_MARKER_VALUE "a"
+
+/*
+ * Equality walk. The containers being compared, innermost last, live on an
+ * explicit stack (inline while shallow, on the heap beyond that) so deep
+ * documents cost no native recursion, and the walk can stop after a given
+ * amount of work and carry on later. An array frame steps @a and @b
+ * through both element lists together, gathering runs of numbers for the
+ * vector kernel. An object frame steps @a and @b through both member
+ * lists together while their keys line up; once they do not, the rest of
+ * the left members are looked up in the right object @obj, through a key
+ * index on the walk's scratch arena when there are more than a few.
+ */
+#define EQ_LOCAL_DEPTH 32
+
+enum { EQ_DIFFERENT, EQ_EQUAL, EQ_PENDING };
+
+struct eq_frame {
+	const cJSON *a, *b;
+	bool object;
+	const cJSON *obj;       /* right object of an object frame */
+	int lookups;            /* members looked up in @obj so far */
+	struct key_index *keys; /* index of @obj, released at @mark */
+	struct arena_mark mark;
+};
+
+struct eq_walk {
+	struct eq_frame *frames;
+	size_t depth, cap;
+	bool strict;
+	struct json_diff_arena scratch;
+	struct eq_frame local[EQ_LOCAL_DEPTH];
+};
+
+static void eq_walk_init(struct eq_walk *w, bool strict)
+{
+	w->frames = w->local;
+	w->depth = 0;
+	w->cap = EQ_LOCAL_DEPTH;
+	w->strict = strict;
+	w->scratch = (struct json_diff_arena){.head = NULL};
+}
+
+static void eq_walk_free(struct eq_walk *w)
+{
+	if (w->frames != w->local)
+		free(w->frames);
+	w->frames = w->local;
+	w->depth = 0;
+	w->cap = EQ_LOCAL_DEPTH;
+	json_diff_arena_cleanup(&w->scratch);
+}
+
+/* Compare one pair as far as it goes without visiting children */
+static inline int eq_pair(const cJSON *left, const cJSON *right, bool strict)
+{
+	if (left == right)
+		return EQ_EQUAL;
+	if (!left || !right)
+		return EQ_DIFFERENT;
+	/* Ignore cJSON_IsReference / cJSON_StringIsConst flag bits */
+	if ((left->type & 0xFF) != (right->type & 0xFF))
+		return EQ_DIFFERENT;
+
+	switch (left->type & 0xFF) {
+	case cJSON_NULL:
+	case cJSON_False:
+	case cJSON_True:
+		return EQ_EQUAL; /* Same type already checked */
+	case cJSON_Number:
+		if (strict)
+			return left->valuedouble == right->valuedouble
+			           ? EQ_EQUAL
+			           : EQ_DIFFERENT;
+		return fabs(left->valuedouble - right->valuedouble) < 1e-9
+		           ? EQ_EQUAL
+		           : EQ_DIFFERENT;
+	case cJSON_String: {
+		if (left->valuestring == right->valuestring)
+			return EQ_EQUAL;
+		if (!left->valuestring || !right->valuestring)
+			return EQ_DIFFERENT;
+		size_t left_len = strlen(left->valuestring);
+		if (left_len != strlen(right->valuestring))
+			return EQ_DIFFERENT;
+		return json_simd_mem_equal(left->valuestring,
+		                           right->valuestring, left_len)
+		           ? EQ_EQUAL
+		           : EQ_DIFFERENT;
+	}
+	case cJSON_Array: {
+		/*
+		 * Counting first only pays off before deep comparisons;
+		 * scalars compare as fast as they are counted
+		 */
+		const cJSON *first = left->child;
+		if (first && (first->type & (cJSON_Array | cJSON_Object)) &&
+		    cJSON_GetArraySize(left) != cJSON_GetArraySize(right))
+			return EQ_DIFFERENT;
+		return EQ_PENDING;
+	}
+	case cJSON_Object:
+		if (cJSON_GetArraySize(left) != cJSON_GetArraySize(right))
+			return EQ_DIFFERENT;
+		return EQ_PENDING;
+	}
+	return EQ_DIFFERENT;
+}
+
+static bool eq_push(struct eq_walk *w, const cJSON *left, const cJSON *right)
+{
+	if (w->depth == w->cap) {
+		struct eq_frame *f = malloc(w->cap * 2 * sizeof(*f));
+		if (!f)
+			return false;
+		memcpy(f, w->frames, w->cap * sizeof(*f));
+		if (w->frames != w->local)
+			free(w->frames);
+		w->frames = f;
+		w->cap *= 2;
+	}
+	bool object = cJSON_IsObject(left);
+	w->frames[w->depth++] = (struct eq_frame){
+	    .a = left->child,
+	    .b = right->child,
+	    .object = object,
+	    .obj = object ? right : NULL,
+	    .mark = arena_mark(&w->scratch),
+	};
+	return true;
+}
+
+/* Member @a's counterpart in the right object, members out of step */
+static const cJSON *eq_member(struct eq_walk *w, struct eq_frame *f,
+                              const cJSON *a)
+{
+	if (!a->string)
+		return NULL;
+	if (!f->keys && ++f->lookups == JSON_EQUAL_INDEX_MIN) {
+		struct key_index *idx = arena_alloc(&w->scratch, sizeof(*idx));
+		if (idx && key_index_build(&w->scratch, f->obj, idx))
+			f->keys = idx;
+	}
+	if (!f->keys)
+		return cJSON_GetObjectItemCaseSensitive(f->obj, a->string);
+	const struct key_entry *e = key_index_get(f->keys, a->string);
+	return e ? e->item : NULL;
+}
+
+/*
+ * Run the walk until it has an answer or used up @budget pairs (without
+ * a budget, to the end). Return: EQ_EQUAL, EQ_DIFFERENT or EQ_PENDING
+ */
+static int eq_walk_run(struct eq_walk *w, long *budget)
+{
+	double x[JSON_SIMD_NUM_RUN], y[JSON_SIMD_NUM_RUN];
+	while (w->depth) {
+		struct eq_frame *f = &w->frames[w->depth - 1];
+		const cJSON *a = f->a, *b = f->b, *ca = NULL, *cb = NULL;
+		if (f->object) {
+			/* Members until one needs its children compared */
+			for (; a; a = a->next) {
+				if (budget && (*budget)-- <= 0) {
+					f->a = a;
+					f->b = b;
+					return EQ_PENDING;
+				}
+				const cJSON *m;
+				if (b && a->string && b->string &&
+				    strcmp(a->string, b->string) == 0) {
+					m = b;
+					b = b->next;
+				} else {
+					/* Out of step for the rest */
+					b = NULL;
+					m = eq_member(w, f, a);
+				}
+				int r = eq_pair(a, m, w->strict);
+				if (r == EQ_DIFFERENT)
+					return r;
+				if (r == EQ_PENDING) {
+					ca = a;
+					cb = m;
+					a = a->next;
+					break;
+				}
+			}
+			f->a = a;
+			f->b = b;
+		} else {
+			while (a && b) {
+				if (budget && *budget <= 0) {
+					f->a = a;
+					f->b = b;
+					return EQ_PENDING;
+				}
+				size_t n = 0;
+				while (n < JSON_SIMD_NUM_RUN && a && b &&
+				       cJSON_IsNumber(a) && cJSON_IsNumber(b)) {
+					x[n] = a->valuedouble;
+					y[n++] = b->valuedouble;
+					a = a->next;
+					b = b->next;
+				}
+				if (n) {
+					if (budget)
+						*budget -= (long)n;
+					if (json_simd_num_mismatch(x, y, n,
+					                           w->strict) < n)
+						return EQ_DIFFERENT;
+					continue;
+				}
+				if (budget)
+					(*budget)--;
+				int r = eq_pair(a, b, w->strict);
+				if (r == EQ_DIFFERENT)
+					return r;
+				if (r == EQ_PENDING) {
+					ca = a;
+					cb = b;
+					a = a->next;
+					b = b->next;
+					break;
+				}
+				a = a->next;
+				b = b->next;
+			}
+			if (!ca && (a || b))
+				return EQ_DIFFERENT;
+			f->a = a;
+			f->b = b;
+		}
+		if (!ca) {
+			if (f->object)
+				arena_rewind(&w->scratch, &f->mark);
+			w->depth--;
+			continue;
+		}
+		/* Out of memory for the stack: compare that pair apart */
+		if (!eq_push(w, ca, cb) && !json_value_equal(ca, cb, w->strict))
+			return EQ_DIFFERENT;
+	}
+	return EQ_EQUAL;
+}
+
+/**
+ * json_value_equal - Compare two cJSON values for equality (optimized)
+ * @left: first value
+ * @right: second value
+ * @strict: use strict equality for numbers
+ *
+ * Return: true if equal, false otherwise
+ */
+bool json_value_equal(const cJSON *left, const cJSON *right, bool strict)
+{
+	int r = eq_pair(left, right, strict);
+	if (r != EQ_PENDING)
+		return r == EQ_EQUAL;
+	struct eq_walk w;
+	eq_walk_init(&w, strict);
+	eq_push(&w, left, right);
+	r = eq_walk_run(&w, NULL);
+	eq_walk_free(&w);
+	return r == EQ_EQUAL;
+}
+
+/* Hash and string length of @node from either cache */
+static bool ctx_lookup(const struct json_diff_ctx *ctx, const cJSON *node,
+                       uint64_t *hash, size_t *len)
+{
+	if (json_hash_cache_lookup(ctx->hashes, node, hash, len))
+		return true;
+	return ctx->prep && prep_hash(ctx->prep, node, hash, len);
+}
+
+bool json_diff_ctx_hash(const struct json_diff_ctx *ctx, const cJSON *node,
+                        uint64_t *hash)
+{
+	size_t len;
+	return ctx_lookup(ctx, node, hash, &len);
+}
+
+/* Hash-based answer for two values, EQ_PENDING when they must be compared */
+static int ctx_equal_quick(const struct json_diff_ctx *ctx, const cJSON *left,
+                           const cJSON *right)
+{
+	/* Scalars other than strings are cheaper to compare than to look up */
+	if (ctx->hashes && left && right && left != right &&
+	    (left->type & (cJSON_Object | cJSON_Array | cJSON_String))) {
+		uint64_t hl, hr;
+		size_t ll, lr;
+		if (ctx_lookup(ctx, left, &hl, &ll) &&
+		    ctx_lookup(ctx, right, &hr, &lr)) {
+			if (hl != hr)
+				return EQ_DIFFERENT;
+			/* Cached lengths: one length check, one byte compare */
+			if (ll != SIZE_MAX && lr != SIZE_MAX)
+				return ll == lr && json_simd_mem_equal(
+				                       left->valuestring,
+				                       right->valuestring, ll)
+				           ? EQ_EQUAL
+				           : EQ_DIFFERENT;
+		}
+	}
+	return EQ_PENDING;
+}
+
+bool json_diff_ctx_equal(const struct json_diff_ctx *ctx, const cJSON *left,
+                         const cJSON *right)
+{
+	if (ctx->opts->stats)
+		ctx->opts->stats->equal_calls++;
+	int r = ctx_equal_quick(ctx, left, right);
+	if (r != EQ_PENDING)
+		return r == EQ_EQUAL;
+	return json_value_equal(left, right, ctx->opts->strict_equality);
+}
+
+/* Two objects or two arrays, whose diff walks their members */
+static bool container_pair(const cJSON *left, const cJSON *right)
+{
+	return left && right && (left->type & 0xFF) == (right->type & 0xFF) &&
+	       (cJSON_IsObject(left) || cJSON_IsArray(left));
+}
+
+/* The value sits at max_depth: compared whole, never walked */
+static bool ctx_cut(const struct json_diff_ctx *ctx)
+{
+	return ctx->filter && ctx->filter->max_depth &&
+	       ctx->scope.depth >= ctx->filter->max_depth;
+}
+
+const struct json_diff_ctx *json_diff_ctx_enter(const struct json_diff_ctx *ctx,
+                                                const char *key,
+                                                struct json_diff_ctx *buf)
+{
+	if (!ctx->filter)
+		return ctx;
+	*buf = *ctx;
+	if (!json_diff_scope_step(ctx->filter, &ctx->scope, key, &buf->scope))
+		return NULL;
+	/* Everything below is kept and nothing is cut off: a plain diff */
+	if (!ctx->filter->max_depth && json_diff_scope_whole(&buf->scope))
+		buf->filter = NULL;
+	return buf;
+}
+
+bool json_diff_ctx_pruned(const struct json_diff_ctx *ctx)
+{
+	return ctx->filter && !json_diff_scope_whole(&ctx->scope);
+}
+
+bool json_diff_scoped_equal(const struct json_diff_ctx *ctx,
+                            const cJSON *left, const cJSON *right)
+{
+	if (left == right)
+		return true;
+	if (!json_diff_ctx_pruned(ctx) || !container_pair(left, right))
+		return json_diff_ctx_equal(ctx, left, right);
+
+	/* Recursion ends where the patterns do, a few levels down */
+	struct json_diff_ctx buf;
+	const struct json_diff_ctx *sub;
+	if (cJSON_IsArray(left)) {
+		const cJSON *l = left->child, *r = right->child;
+		char key[16];
+		for (int i = 0; l || r; i++) {
+			if (!l || !r)
+				return false;
+			snprintf(key, sizeof(key), "%d", i);
+			sub = json_diff_ctx_enter(ctx, key, &buf);
+			if (sub && !json_diff_scoped_equal(sub, l, r))
+				return false;
+			l = l->next;
+			r = r->next;
+		}
+		return true;
+	}
+	for (const cJSON *li = left->child; li; li = li->next) {
+		if (!li->string || !(sub = json_diff_ctx_enter(ctx, li->string,
+		                                              &buf)))
+			continue;
+		const cJSON *ri =
+		    cJSON_GetObjectItemCaseSensitive(right, li->string);
+		if (!ri || !json_diff_scoped_equal(sub, li, ri))
+			return false;
+	}
+	for (const cJSON *ri = right->child; ri; ri = ri->next) {
+		if (ri->string && json_diff_ctx_enter(ctx, ri->string, &buf) &&
+		    !cJSON_GetObjectItemCaseSensitive(left, ri->string))
+			return false;
+	}
+	return true;
+}
+
+cJSON *diff_change_array(const struct json_diff_ctx *ctx, const cJSON *old_val,
+                         const cJSON *new_val)
+{
+	if (ctx->sink) {
+		ctx->sink->change(ctx->sink, old_val, new_val);
+		return NULL;
+	}
+	char *patch = NULL;
+	if (ctx->opts->text_diff_min_length && cJSON_IsString(old_val) &&
+	    cJSON_IsString(new_val))
+		patch = json_text_diff(old_val->valuestring,
+		                       new_val->valuestring, ctx->opts);
+	if (patch) {
+		cJSON *array = NULL;
+		if (ctx->out) {
+			cJSON text = {.type = cJSON_String, .valuestring = patch};
+			json_write_raw(ctx->out, "[", 1);
+			json_write_value(ctx->out, &text);
+			json_write_raw(ctx->out, ",0,2]", 5);
+		} else {
+			array = diff_text_array(ctx->opts->arena, patch);
+		}
+		free(patch);
+		return array;
+	}
+
+	old_val = diff_old(ctx, old_val);
+	if (ctx->out) {
+		json_write_raw(ctx->out, "[", 1);
+		json_write_value(ctx->out, old_val);
+		json_write_raw(ctx->out, ",", 1);
+		json_write_value(ctx->out, new_val);
+		json_write_raw(ctx->out, "]", 1);
+		return NULL;
+	}
+
+	struct json_diff_arena *arena = ctx->opts->arena;
+	cJSON *array = diff_new_array(arena);
+	if (!array)
+		return NULL;
+
+	cJSON *old_item = diff_value(ctx, old_val);
+	cJSON *new_item = diff_value(ctx, new_val);
+	if (!old_item || !new_item) {
+		diff_delete(arena, array);
+		diff_delete(arena, old_item);
+		diff_delete(arena, new_item);
+		return NULL;
+	}
+	diff_add_item(arena, array, old_item);
+	diff_add_item(arena, array, new_item);
+	return array;
+}
+
+cJSON *diff_addition_array(const struct json_diff_ctx *ctx,
+                           const cJSON *new_val)
+{
+	if (ctx->sink) {
+		ctx->sink->change(ctx->sink, NULL, new_val);
+		return NULL;
+	}
+	if (ctx->out) {
+		json_write_raw(ctx->out, "[", 1);
+		json_write_value(ctx->out, new_val);
+		json_write_raw(ctx->out, "]", 1);
+		return NULL;
+	}
+
+	struct json_diff_arena *arena = ctx->opts->arena;
+	cJSON *array = diff_new_array(arena);
+	if (!array)
+		return NULL;
+
+	cJSON *new_item = diff_value(ctx, new_val);
+	if (!new_item) {
+		diff_delete(arena, array);
+		return NULL;
+	}
+	diff_add_item(arena, array, new_item);
+	return array;
+}
+
+cJSON *diff_deletion_array(const struct json_diff_ctx *ctx,
+                           const cJSON *old_val)
+{
+	if (ctx->sink) {
+		ctx->sink->change(ctx->sink, old_val, NULL);
+		return NULL;
+	}
+	old_val = diff_old(ctx, old_val);
+	if (ctx->out) {
+		json_write_raw(ctx->out, "[", 1);
+		json_write_value(ctx->out, old_val);
+		json_write_raw(ctx->out, ",0,0]", 5);
+		return NULL;
+	}
+
+	struct json_diff_arena *arena = ctx->opts->arena;
+	cJSON *array = diff_new_array(arena);
+	if (!array)
+		return NULL;
+
+	/* Old value followed by the two zeros of the deletion marker */
+	cJSON *old_item = diff_value(ctx, old_val);
+	cJSON *zero1 = diff_new_number(arena, 0);
+	cJSON *zero2 = diff_new_number(arena, 0);
+	if (!old_item || !zero1 || !zero2) {
+		diff_delete(arena, array);
+		diff_delete(arena, old_item);
+		diff_delete(arena, zero1);
+		diff_delete(arena, zero2);
+		return NULL;
+	}
+	diff_add_item(arena, array, old_item);
+	diff_add_item(arena, array, zero1);
+	diff_add_item(arena, array, zero2);
+	return array;
+}
+
+cJSON *diff_move_array(const struct json_diff_ctx *ctx, int dest)
+{
+	if (ctx->out) {
+		json_write_raw(ctx->out, "[\"\",", 4);
+		json_write_number(ctx->out, dest);
+		json_write_raw(ctx->out, ",3]", 3);
+		return NULL;
+	}
+
+	struct json_diff_arena *arena = ctx->opts->arena;
+	cJSON *array = diff_new_array(arena);
+	if (!array)
+		return NULL;
+	if (!diff_add_item(arena, array, diff_new_string(arena, "")) ||
+	    !diff_add_item(arena, array, diff_new_number(arena, dest)) ||
+	    !diff_add_item(arena, array, diff_new_number(arena, 3))) {
+		diff_delete(arena, array);
+		return NULL;
+	}
+	return array;
+}
+
+cJSON *diff_text_array(struct json_diff_arena *arena, const char *patch)
+{
+	cJSON *array = diff_new_array(arena);
+	if (!array)
+		return NULL;
+	if (!diff_add_item(arena, array, diff_new_string(arena, patch)) ||
+	    !diff_add_item(arena, array, diff_new_number(arena, 0)) ||
+	    !diff_add_item(arena, array, diff_new_number(arena, 2))) {
+		diff_delete(arena, array);
+		return NULL;
+	}
+	return array;
+}
+
+/* Context for the standalone create_*_array() helpers: owned heap values */
+static const struct json_diff_options heap_opts = {.strict_equality = true};
+static const struct json_diff_ctx heap_ctx = {.opts = &heap_opts};
+
+/**
+ * create_change_array - Create a change array [old_value, new_value]
+ * @old_val: old value
+ * @new_val: new value
+ *
+ * Return: cJSON array or NULL on failure
+ */
+cJSON *create_change_array(const cJSON *old_val, const cJSON *new_val)
+{
+	return diff_change_array(&heap_ctx, old_val, new_val);
+}
+
+/**
+ * create_addition_array - Create an addition array [new_value]
+ * @new_val: new value
+ *
+ * Return: cJSON array or NULL on failure
+ */
+cJSON *create_addition_array(const cJSON *new_val)
+{
+	return diff_addition_array(&heap_ctx, new_val);
+}
+
+/**
+ * create_deletion_array - Create a deletion array [old_value, 0, 0]
+ * @old_val: old value
+ *
+ * Return: cJSON array or NULL on failure
+ */
+cJSON *create_deletion_array(const cJSON *old_val)
+{
+	return diff_deletion_array(&heap_ctx, old_val);
+}
+
+/**
+ * myers_diff_arrays - Fast array diff using simple linear comparison
+ * @left: first array
+ * @right: second array
+ * @opts: diff options
+ *
+ * Return: diff object or NULL if arrays are equal
+ */
+/* legacy myers implementation moved to src/myers.c */
+
+/**
+ * diff_arrays - Create diff for two cJSON arrays
+ * @left: first array
+ * @right: second array
+ * @ctx: diff context
+ *
+ * Return: diff object or NULL if arrays are equal
+ */
+static cJSON *diff_arrays(const cJSON *left, const cJSON *right,
+                          const struct json_diff_ctx *ctx)
+{
+	return json_myers_array_diff_ctx(left, right, ctx);
+}
+
+/*
+ * Sink mode: the array delta is built as usual, without the sink, and
+ * handed over whole; it only lives until the sink is done with it
+ */
+static void diff_arrays_sink(const struct json_diff_ctx *ctx,
+                             const cJSON *left, const cJSON *right)
+{
+	struct json_diff_arena *arena = ctx->opts->arena;
+	struct arena_mark mark = {0};
+	if (arena)
+		mark = arena_mark(arena);
+	struct json_diff_ctx sub = *ctx;
+	sub.sink = NULL;
+	cJSON *delta = diff_arrays(left, right, &sub);
+	if (delta)
+		ctx->sink->array(ctx->sink, ctx, left, right, delta);
+	if (arena)
+		arena_rewind(arena, &mark);
+	else
+		diff_delete(NULL, delta);
+}
+
+static cJSON *do_json_diff(const struct json_diff_ctx *ctx, const cJSON *left,
+                           const cJSON *right);
+
+static void member_job_run(const struct json_diff_ctx *ctx,
+                           struct member_job *j)
+{
+	if (!j->right)
+		j->diff = diff_deletion_array(ctx, j->left);
+	else if (!j->left)
+		j->diff = diff_addition_array(ctx, j->right);
+	else
+		j->diff = do_json_diff(ctx, j->left, j->right);
+}
+
+#ifdef JSON_DIFF_THREADS
+/*
+ * Parallel object diff. Workers claim batches of jobs from a shared cursor
+ * until none are left, so a thread that draws cheap members simply takes
+ * more. Every worker builds into its own arena and scratch; the results
+ * are linked in job order afterwards, so the delta is the serial one.
+ * Nested objects are diffed serially.
+ */
+struct par_state {
+	const struct json_diff_ctx *ctx;
+	struct member_job *jobs;
+	int count;
+	atomic_int next;
+	int depth;
+};
+
+struct par_worker {
+	struct par_state *st;
+	struct json_diff_options opts;
+	struct json_diff_arena arena;
+	struct json_diff_arena scratch;
+	bool inexact;
+	struct json_diff_stats stats;
+	pthread_t thread;
+	bool started;
+};
+
+static void par_run(struct par_state *st, const struct json_diff_ctx *ctx)
+{
+	for (;;) {
+		int i = atomic_fetch_add(&st->next, JSON_DIFF_PARALLEL_BATCH);
+		if (i >= st->count)
+			break;
+		int end = st->count - i < JSON_DIFF_PARALLEL_BATCH
+		              ? st->count
+		              : i + JSON_DIFF_PARALLEL_BATCH;
+		for (; i < end; i++)
+			member_job_run(ctx, &st->jobs[i]);
+	}
+}
+
+static void *par_thread(void *arg)
+{
+	struct par_worker *w = arg;
+	struct json_diff_ctx ctx = *w->st->ctx;
+	ctx.opts = &w->opts;
+	ctx.scratch = &w->scratch;
+	/* Depth limit counts from where the object sits in the document */
+	json_diff_depth = w->st->depth;
+	par_run(w->st, &ctx);
+	return NULL;
+}
+
+/**
+ * member_jobs_parallel - Run member jobs on opts->threads threads
+ * @ctx: diff context, not in writer mode
+ * @jobs: jobs to run
+ * @count: number of jobs
+ *
+ * Return: 0 when every job ran, -1 if no worker could be set up and the
+ * caller should run the jobs itself
+ */
+static int member_jobs_parallel(const struct json_diff_ctx *ctx,
+                                struct member_job *jobs, int count)
+{
+	int nworkers = ctx->opts->threads - 1;
+	int batches = (count + JSON_DIFF_PARALLEL_BATCH - 1) /
+	              JSON_DIFF_PARALLEL_BATCH;
+	if (nworkers > batches - 1)
+		nworkers = batches - 1;
+	if (nworkers < 1)
+		return -1;
+	struct par_worker *workers = calloc((size_t)nworkers, sizeof(*workers));
+	if (!workers)
+		return -1;
+
+	struct par_state st = {.ctx = ctx,
+	                       .jobs = jobs,
+	                       .count = count,
+	                       .depth = json_diff_depth};
+	atomic_init(&st.next, 0);
+	struct json_diff_arena *arena = ctx->opts->arena;
+	for (int i = 0; i < nworkers; i++) {
+		struct par_worker *w = &workers[i];
+		w->st = &st;
+		w->opts = *ctx->opts;
+		w->opts.threads = 0;
+		if (arena) {
+			json_diff_arena_init(&w->arena, arena->chunk_size);
+			w->opts.arena = &w->arena;
+		}
+		if (w->opts.inexact)
+			w->opts.inexact = &w->inexact;
+		if (w->opts.stats)
+			w->opts.stats = &w->stats;
+		w->started =
+		    pthread_create(&w->thread, NULL, par_thread, w) == 0;
+	}
+
+	/* The calling thread works too, in the caller's arena */
+	struct json_diff_options self_opts = *ctx->opts;
+	self_opts.threads = 0;
+	struct json_diff_ctx self = *ctx;
+	self.opts = &self_opts;
+	par_run(&st, &self);
+
+	for (int i = 0; i < nworkers; i++) {
+		struct par_worker *w = &workers[i];
+		if (w->started)
+			pthread_join(w->thread, NULL);
+		if (arena)
+			arena_adopt(arena, &w->arena);
+		if (w->inexact)
+			*ctx->opts->inexact = true;
+		if (ctx->opts->stats) {
+			w->stats.bytes_allocated += w->scratch.high_water;
+			json_diff_stats_add(ctx->opts->stats, &w->stats);
+		}
+		json_diff_arena_cleanup(&w->scratch);
+	}
+	free(workers);
+	return 0;
+}
+#endif
+
+/* Run @jobs and link their deltas into @diff_obj in job order */
+static bool member_jobs_run(const struct json_diff_ctx *ctx,
+                            struct member_job *jobs, int count,
+                            cJSON *diff_obj)
+{
+	struct json_diff_arena *arena = ctx->opts->arena;
+	bool done = false;
+#ifdef JSON_DIFF_THREADS
+	done = ctx->opts->threads > 1 && count >= JSON_DIFF_PARALLEL_MIN_KEYS &&
+	       member_jobs_parallel(ctx, jobs, count) == 0;
+#endif
+	for (int i = 0; !done && i < count; i++)
+		member_job_run(ctx, &jobs[i]);
+
+	bool changed = false;
+	for (int i = 0; i < count; i++) {
+		const cJSON *member =
+		    jobs[i].left ? jobs[i].left : jobs[i].right;
+		if (!jobs[i].diff)
+			continue;
+		if (diff_add_item_to_object(arena, diff_obj, member->string,
+		                            jobs[i].diff))
+			changed = true;
+		else
+			diff_delete(arena, jobs[i].diff);
+	}
+	return changed;
+}
+
+/*
+ * Members of @left and @right as jobs, in the order of the serial walk:
+ * left members, then members only in @right
+ */
+static struct member_job *
+member_jobs_indexed(struct json_diff_arena *scratch, const cJSON *left,
+                    struct key_index *right_index, int *count)
+{
+	size_t n = (size_t)right_index->count;
+	for (const cJSON *li = left->child; li; li = li->next)
+		n++;
+	if (n > (size_t)INT_MAX)
+		return NULL;
+	struct member_job *jobs = arena_alloc(scratch, (n + 1) * sizeof(*jobs));
+	if (!jobs)
+		return NULL;
+
+	int c = 0;
+	for (const cJSON *li = left->child; li; li = li->next) {
+		if (!li->string)
+			continue;
+		struct key_entry *e = key_index_get(right_index, li->string);
+		if (e)
+			e->matched = true;
+		jobs[c++] = (struct member_job){li, e ? e->item : NULL, NULL};
+	}
+	for (int i = 0; i < right_index->count; i++) {
+		if (!right_index->entries[i].matched)
+			jobs[c++] = (struct member_job){
+			    NULL, right_index->entries[i].item, NULL};
+	}
+	*count = c;
+	return jobs;
+}
+
+/**
+ * do_json_diff - Core implementation of diff without depth accounting
+ * @ctx: diff context (must not be NULL)
+ * @left: first JSON value
+ * @right: second JSON value
+ *
+ * In writer mode the caller has already found @left and @right unequal
+ * and written the member key; the delta goes to ctx->out instead. In
+ * sink mode the caller has found them unequal and pushed the key.
+ *
+ * Return: diff object or NULL if values are equal or on error
+ */
+static cJSON *do_json_diff(const struct json_diff_ctx *ctx, const cJSON *left,
+                           const cJSON *right)
+{
+	struct json_diff_arena *arena = ctx->opts->arena;
+	cJSON *result = NULL;
+
+	/* Recursion depth guard */
+	if (++json_diff_depth > MAX_JSON_DEPTH) {
+		--json_diff_depth;
+		if (ctx->out)
+			ctx->out->failed = true;
+		if (ctx->sink)
+			ctx->sink->failed = true;
+		return NULL;
+	}
+
+	/*
+	 * Under path filters a value at max_depth is compared whole, and one
+	 * with members left out is walked without comparing it whole first
+	 */
+	bool pruned = json_diff_ctx_pruned(ctx);
+	if (ctx->filter && (ctx_cut(ctx) || !container_pair(left, right))) {
+		if (ctx->out || ctx->sink ||
+		    (left != right && !json_diff_scoped_equal(ctx, left, right)))
+			result = diff_change_array(ctx, left, right);
+		goto finish;
+	}
+
+	/* Fast path for identical pointers or equal values */
+	if (!ctx->out && !ctx->sink &&
+	    (left == right ||
+	     (!pruned && json_diff_ctx_equal(ctx, left, right))))
+		goto finish;
+
+	/* Simple type or null mismatch */
+	if (!left || !right || (left->type & 0xFF) != (right->type & 0xFF)) {
+		result = diff_change_array(ctx, left, right);
+		goto finish;
+	}
+
+	/* Simple non-container types */
+	if (!cJSON_IsObject(left) && !cJSON_IsArray(left)) {
+		result = diff_change_array(ctx, left, right);
+		goto finish;
+	}
+
+	/* Array diff */
+	if (cJSON_IsArray(left)) {
+		if (ctx->sink)
+			diff_arrays_sink(ctx, left, right);
+		else
+			result = diff_arrays(left, right, ctx);
+		goto finish;
+	}
+
+	/* Object diff: left keys in order, then keys only in right */
+	cJSON *diff_obj = NULL;
+	if (ctx->out)
+		json_write_raw(ctx->out, "{", 1);
+	else if (!ctx->sink && !(diff_obj = diff_new_object(arena)))
+		goto finish;
+	{
+		bool has_changes = false;
+		struct arena_mark mark = arena_mark(ctx->scratch);
+		/* Jobs carry no scope, so filtered objects walk serially */
+		int pk = ctx->prep && !ctx->filter ? prep_find(ctx->prep, left)
+		                                   : -1;
+		struct key_index right_index;
+		bool indexed =
+		    pk < 0 && ctx_index_build(ctx, right, &right_index);
+
+		struct member_job *jobs = NULL;
+		int njobs = 0;
+		if (pk >= 0)
+			jobs = member_jobs_prepared(ctx->scratch, ctx->prep, pk,
+			                            right, &njobs);
+		else if (indexed && !ctx->out && !ctx->sink && !ctx->filter &&
+		         ctx->opts->threads > 1 &&
+		         right_index.count >= JSON_DIFF_PARALLEL_MIN_KEYS)
+			jobs = member_jobs_indexed(ctx->scratch, left,
+			                           &right_index, &njobs);
+		if (jobs) {
+			has_changes =
+			    member_jobs_run(ctx, jobs, njobs, diff_obj);
+			goto object_done;
+		}
 
 		/* Keys present in left: diff or deletion */
-		for (int i = 0; i < left_n; i++) {
-			const char *key = left_index[i].key;
-			cJSON *li = left_index[i].item;
-			cJSON *ri = index_get(right_index, right_n, key);
-			if (!ri) {
-				cJSON *d = create_deletion_array(li);
-				if (d) {
-					cJSON_AddItemToObject(diff_obj, key, d);
-					has_changes = true;
+		for (cJSON *li = left->child; li; li = li->next) {
+			const char *key = li->string;
+			if (!key)
+				continue;
+			cJSON *ri = NULL;
+			if (indexed) {
+				struct key_entry *e =
+				    key_index_get(&right_index, key);
+				if (e) {
+					e->matched = true;
+					ri = e->item;
 				}
 			} else {
-				cJSON *sd = json_diff(li, ri, opts);
-				if (sd) {
-					cJSON_AddItemToObject(diff_obj, key,
-					                      sd);
-					has_changes = true;
-				}
+				ri = cJSON_GetObjectItemCaseSensitive(right,
+				                                      key);
+			}
+			struct json_diff_ctx buf;
+			const struct json_diff_ctx *sub =
+			    json_diff_ctx_enter(ctx, key, &buf);
+			if (!sub)
+				continue;
+			if (ctx->out || ctx->sink) {
+				if (ri && json_diff_scoped_equal(sub, li, ri))
+					continue;
+				if (ctx->out)
+					json_write_key(ctx->out, key);
+				else
+					ctx->sink->push(ctx->sink, key);
+			}
+			cJSON *d = ri ? do_json_diff(sub, li, ri)
+			              : diff_deletion_array(sub, li);
+			if (ctx->sink)
+				ctx->sink->pop(ctx->sink);
+			if (d) {
+				diff_add_item_to_object(arena, diff_obj, key,
+				                        d);
+				has_changes = true;
 			}
 		}
 		/* Keys present only in right: additions */
-		for (int i = 0; i < right_n; i++) {
-			const char *key = right_index[i].key;
-			if (!index_get(left_index, left_n, key)) {
-				cJSON *ri = right_index[i].item;
-				cJSON *a = create_addition_array(ri);
-				if (a) {
-					cJSON_AddItemToObject(diff_obj, key, a);
-					has_changes = true;
-				}
+		for (cJSON *ri = right->child; ri; ri = ri->next) {
+			const char *key = ri->string;
+			if (!key)
+				continue;
+			if (indexed) {
+				struct key_entry *e =
+				    key_index_get(&right_index, key);
+				if (e->item != ri || e->matched)
+					continue;
+			} else if (cJSON_GetObjectItemCaseSensitive(left,
+			                                            key) ||
+			           cJSON_GetObjectItemCaseSensitive(right,
+			                                            key) !=
+			               ri) {
+				continue;
+			}
+			struct json_diff_ctx buf;
+			const struct json_diff_ctx *sub =
+			    json_diff_ctx_enter(ctx, key, &buf);
+			if (!sub)
+				continue;
+			if (ctx->out)
+				json_write_key(ctx->out, key);
+			else if (ctx->sink)
+				ctx->sink->push(ctx->sink, key);
+			cJSON *a = diff_addition_array(sub, ri);
+			if (ctx->sink)
+				ctx->sink->pop(ctx->sink);
+			if (a) {
+				diff_add_item_to_object(arena, diff_obj, key,
+				                        a);
+				has_changes = true;
 			}
 		}
-		free(right_index);
-		free(left_index);
+	object_done:
+		arena_rewind(ctx->scratch, &mark);
 
-		if (has_changes)
+		if (ctx->out)
+			json_write_raw(ctx->out, "}", 1);
+		else if (has_changes)
 			result = diff_obj;
 		else
-			cJSON_Delete(diff_obj);
+			diff_delete(arena, diff_obj);
+	}
+
+finish:
+	--json_diff_depth;
+	return result;
+}
+
+static int cmp_array_insert(const void *a, const void *b)
+{
+	const struct json_array_insert *ia = a, *ib = b;
+	if (ia->index != ib->index)
+		return (ia->index > ib->index) - (ia->index < ib->index);
+	return (ia->seq > ib->seq) - (ia->seq < ib->seq);
+}
+
+/* jsondiffpatch move: "_src": ["", dest, 3] */
+static bool is_move_op(const cJSON *d)
+{
+	if (!cJSON_IsArray(d) || cJSON_GetArraySize(d) != 3)
+		return false;
+	const cJSON *v0 = d->child, *v1 = v0->next, *v2 = v1->next;
+	return cJSON_IsString(v0) && cJSON_IsNumber(v1) && cJSON_IsNumber(v2) &&
+	       (int)v2->valuedouble == 3;
+}
+
+int json_array_delta_index(const char *key, int skip)
+{
+	char *ep = NULL;
+	long v = strtol(key + skip, &ep, 10);
+	if (ep == key + skip || *ep != '\0' || v < 0 || v > INT_MAX)
+		return -1;
+	return (int)v;
+}
+
+size_t json_array_delta_scan(const cJSON *diff, size_t n, unsigned char *gone,
+                             struct json_array_insert *ins)
+{
+	size_t nins = 0;
+	for (const cJSON *it = diff->child; it; it = it->next) {
+		const char *key = it->string;
+		if (!key || strcmp(key, ARRAY_MARKER) == 0)
+			continue;
+		struct json_array_insert e = {.seq = (int)nins, .from = -1};
+		if (key[0] == '_') {
+			int index = json_array_delta_index(key, 1);
+			if (index < 0 || (size_t)index >= n || gone[index])
+				continue;
+			if (!is_move_op(it)) {
+				gone[index] = JSON_ARRAY_DELETE;
+				continue;
+			}
+			gone[index] = JSON_ARRAY_MOVE;
+			e.index = (int)it->child->next->valuedouble;
+			e.from = index;
+		} else {
+			if (!cJSON_IsArray(it) || cJSON_GetArraySize(it) != 1)
+				continue;
+			e.index = json_array_delta_index(key, 0);
+			if (e.index < 0)
+				continue;
+			e.entry = it;
+		}
+		ins[nins++] = e;
+	}
+	return nins;
+}
+
+size_t json_array_place(const unsigned char *gone, size_t n,
+                        struct json_array_insert *ins, size_t nins,
+                        int *place)
+{
+	if (nins > 1)
+		qsort(ins, nins, sizeof(*ins), cmp_array_insert);
+
+	/* Merge survivors with insertions at their final indices */
+	size_t nf = 0, i = 0, j = 0;
+	while (i < n || j < nins) {
+		if (i < n && gone[i]) {
+			i++;
+			continue;
+		}
+		if (j < nins && (i == n || ins[j].index <= (int)nf))
+			place[nf++] = -1 - (int)j++;
+		else
+			place[nf++] = (int)i++;
+	}
+	return nf;
+}
+
+void json_array_relink(cJSON *array, cJSON *const *orig,
+                       const unsigned char *gone, size_t n,
+                       cJSON *const *final, size_t nf)
+{
+	/* Release deleted elements and relink everything in one sweep */
+	for (size_t i = 0; i < n; i++) {
+		if (gone[i] == JSON_ARRAY_DELETE) {
+			orig[i]->next = orig[i]->prev = NULL;
+			cJSON_Delete(orig[i]);
+		}
+	}
+	array->child = nf ? final[0] : NULL;
+	for (size_t i = 0; i < nf; i++) {
+		final[i]->prev = i ? final[i - 1] : final[nf - 1];
+		final[i]->next = i + 1 < nf ? final[i + 1] : NULL;
+	}
+}
+
+/**
+ * patch_array_inplace - Apply an array delta to @array in place
+ * @array: array to modify
+ * @diff: array diff object
+ * @failed: set when an allocation fails
+ *
+ * The children are loaded into a pointer vector, placed in jsondiffpatch
+ * order by json_array_place() and relinked in a single sweep, so the cost
+ * is O(n + k log k) for k delta entries.
+ */
+static void patch_array_inplace(cJSON *array, const cJSON *diff, bool *failed)
+{
+	size_t n = 0, k = 0;
+	for (const cJSON *ch = array->child; ch; ch = ch->next)
+		n++;
+	for (const cJSON *it = diff->child; it; it = it->next)
+		k++;
+
+	cJSON **orig = malloc((n + 1) * sizeof(*orig));
+	cJSON **final = malloc((n + k + 1) * sizeof(*final));
+	int *place = malloc((n + k + 1) * sizeof(*place));
+	unsigned char *gone = calloc(n + 1, 1);
+	struct json_array_insert *ins = malloc((k + 1) * sizeof(*ins));
+	if (!orig || !final || !place || !gone || !ins) {
+		*failed = true;
+		goto out;
+	}
+	size_t i = 0;
+	for (cJSON *ch = array->child; ch; ch = ch->next)
+		orig[i++] = ch;
+
+	size_t nins = json_array_delta_scan(diff, n, gone, ins);
+	size_t nf = json_array_place(gone, n, ins, nins, place), f = 0;
+	for (i = 0; i < nf; i++) {
+		cJSON *node;
+		if (place[i] >= 0) {
+			node = orig[place[i]];
+		} else {
+			const struct json_array_insert *e = &ins[-1 - place[i]];
+			/* Additions are copied out of the delta */
+			if (e->from >= 0)
+				node = orig[e->from];
+			else
+				node = diff_duplicate(NULL, e->entry->child);
+		}
+		if (!node) {
+			*failed = true;
+			continue;
+		}
+		final[f++] = node;
+	}
+	nf = f;
+
+	/* Replacements and nested diffs against the final indices */
+	for (const cJSON *it = diff->child; it; it = it->next) {
+		const char *key = it->string;
+		if (!key || key[0] == '_')
+			continue;
+		int index = json_array_delta_index(key, 0);
+		if (index < 0 || (size_t)index >= nf)
+			continue;
+		cJSON *cur = final[index];
+		cJSON *val = cur;
+		if (diff_is_text_op(it)) {
+			if (!json_text_patch_node(cur, it->child->valuestring))
+				*failed = true;
+		} else if (cJSON_IsArray(it)) {
+			if (cJSON_GetArraySize(it) != 2)
+				continue;
+			val = diff_duplicate(NULL, cJSON_GetArrayItem(it, 1));
+			if (!val) {
+				*failed = true;
+				continue;
+			}
+		} else if (cJSON_IsObject(it)) {
+			val = json_patch_node(cur, it, failed);
+		}
+		if (val != cur) {
+			/* Unlink first: cJSON_Delete() follows ->next */
+			cur->next = cur->prev = NULL;
+			cJSON_Delete(cur);
+			final[index] = val;
+		}
+	}
+
+	json_array_relink(array, orig, gone, n, final, nf);
+
+out:
+	free(orig);
+	free(final);
+	free(place);
+	free(gone);
+	free(ins);
+}
+
+/* Swap @val in for member @cur, handing over cur's key without a copy */
+static void replace_member(cJSON *object, cJSON *cur, cJSON *val)
+{
+	val->string = cur->string;
+	val->type = (val->type & ~cJSON_StringIsConst) |
+	            (cur->type & cJSON_StringIsConst);
+	cur->string = NULL;
+	cJSON_ReplaceItemViaPointer(object, cur, val);
+}
+
+void json_patch_members_init(struct json_patch_members *m, cJSON *object)
+{
+	*m = (struct json_patch_members){.object = object};
+}
+
+cJSON *json_patch_members_get(struct json_patch_members *m, const char *key)
+{
+	if (!m->keys && ++m->lookups == JSON_PATCH_INDEX_MIN) {
+		struct key_index *idx = arena_alloc(&m->mem, sizeof(*idx));
+		if (idx && key_index_build(&m->mem, m->object, idx))
+			m->keys = idx;
+	}
+	if (!m->keys)
+		return cJSON_GetObjectItemCaseSensitive(m->object, key);
+	struct key_entry *e = key_index_get(m->keys, key);
+	return e ? e->item : NULL;
+}
+
+/* Index entry of member @cur, NULL when not indexed */
+static struct key_entry *members_entry(const struct json_patch_members *m,
+                                       const cJSON *cur)
+{
+	struct key_entry *e =
+	    m->keys && cur->string ? key_index_get(m->keys, cur->string)
+	                           : NULL;
+	return e && e->item == cur ? e : NULL;
+}
+
+void json_patch_members_replace(struct json_patch_members *m, cJSON *cur,
+                                cJSON *val)
+{
+	struct key_entry *e = members_entry(m, cur);
+	/* The key moves to @val, so the entry's key pointer stays valid */
+	replace_member(m->object, cur, val);
+	if (e)
+		e->item = val;
+}
+
+void json_patch_members_delete(struct json_patch_members *m, cJSON *cur)
+{
+	struct key_entry *e = members_entry(m, cur);
+	if (e) {
+		/* Its key is freed with @cur; lookups compare "" instead */
+		e->key = "";
+		e->item = NULL;
+	}
+	cJSON_Delete(cJSON_DetachItemViaPointer(m->object, cur));
+}
+
+void json_patch_members_free(struct json_patch_members *m)
+{
+	json_diff_arena_cleanup(&m->mem);
+}
+
+/**
+ * patch_object_inplace - Apply an object delta to @object in place
+ * @object: object to modify
+ * @diff: object delta
+ * @failed: set when an allocation fails
+ *
+ * Members keep their position; added keys are appended in delta order.
+ */
+static void patch_object_inplace(cJSON *object, const cJSON *diff,
+                                 bool *failed)
+{
+	struct json_patch_members members;
+	json_patch_members_init(&members, object);
+	for (const cJSON *d = diff->child; d; d = d->next) {
+		const char *key = d->string;
+		if (!key)
+			continue;
+		cJSON *cur = json_patch_members_get(&members, key);
+		if (cJSON_IsArray(d)) {
+			int n = cJSON_GetArraySize(d);
+			if (diff_is_text_op(d)) {
+				if (cur && !json_text_patch_node(
+				               cur, d->child->valuestring))
+					*failed = true;
+				continue;
+			}
+			if (n == 3) {
+				/* Deletion - remove key */
+				if (cur)
+					json_patch_members_delete(&members,
+					                          cur);
+				continue;
+			}
+			if (n != 1 && n != 2)
+				continue;
+			/* Addition or replacement: take the new value */
+			cJSON *new_val =
+			    diff_duplicate(NULL, cJSON_GetArrayItem(d, n - 1));
+			if (!new_val) {
+				*failed = true;
+			} else if (cur) {
+				json_patch_members_replace(&members, cur,
+				                           new_val);
+			} else if (!cJSON_AddItemToObject(object, key,
+			                                  new_val)) {
+				cJSON_Delete(new_val);
+				*failed = true;
+			}
+		} else if (cJSON_IsObject(d) && cur) {
+			/* Nested diff */
+			cJSON *patched = json_patch_node(cur, d, failed);
+			if (patched != cur)
+				json_patch_members_replace(&members, cur,
+				                           patched);
+		}
+	}
+	json_patch_members_free(&members);
+}
+
+cJSON *json_patch_node(cJSON *target, const cJSON *diff, bool *failed)
+{
+	cJSON *result = target;
+
+	if (++json_patch_depth > MAX_JSON_DEPTH) {
+		*failed = true;
+		goto out;
+	}
+
+	/* Handle simple value replacement (type changes) */
+	if (cJSON_IsArray(diff) && cJSON_GetArraySize(diff) == 2) {
+		result = diff_duplicate(NULL, cJSON_GetArrayItem(diff, 1));
+		if (!result) {
+			*failed = true;
+			result = target;
+		}
+		goto out;
+	}
+
+	/* Text diff of a long string, patched in place */
+	if (diff_is_text_op(diff)) {
+		if (!json_text_patch_node(target, diff->child->valuestring))
+			*failed = true;
+		goto out;
+	}
+
+	/* Not a delta: the value is unchanged */
+	if (!cJSON_IsObject(diff))
+		goto out;
+
+	/* Check if this is an array diff */
+	if (cJSON_GetObjectItem(diff, ARRAY_MARKER)) {
+		if (cJSON_IsArray(target))
+			patch_array_inplace(target, diff, failed);
+		goto out;
+	}
+
+	/* Object deltas on non-objects patch an empty object */
+	if (!cJSON_IsObject(target)) {
+		result = cJSON_CreateObject();
+		if (!result) {
+			*failed = true;
+			result = target;
+			goto out;
+		}
+	}
+	patch_object_inplace(result, diff, failed);
+
+out:
+	--json_patch_depth;
+	return result;
+}
+
+cJSON *json_diff_ctx_diff(const struct json_diff_ctx *ctx, const cJSON *left,
+                          const cJSON *right)
+{
+	return do_json_diff(ctx, left, right);
+}
+
+/**
+ * ctx_filter_begin - Set up the path filters of a top-level call
+ * @ctx: context of the call; gets @f and the root scope when they matter
+ * @f: filter to compile into, zeroed; json_diff_filter_free() it after
+ *
+ * Return: 1 to run the diff, 0 if the filters leave out the root (the
+ * values count as equal), -1 on allocation failure
+ */
+static int ctx_filter_begin(struct json_diff_ctx *ctx,
+                            struct json_diff_filter *f)
+{
+	if (!json_diff_filtering(ctx->opts))
+		return 1;
+	if (!json_diff_filter_init(f, ctx->opts))
+		return -1;
+	if (!json_diff_filter_root(f, &ctx->scope))
+		return 0;
+	if (f->max_depth || !json_diff_scope_whole(&ctx->scope))
+		ctx->filter = f;
+	return 1;
+}
+
+/* json_hash_cache_build() for a top-level call, timed into the stats */
+static bool ctx_hashes_build(const struct json_diff_options *opts,
+                             struct json_hash_cache *hashes,
+                             const cJSON *left, const cJSON *right)
+{
+	struct json_diff_stats *st = opts->stats;
+	uint64_t t0 = json_diff_stats_clock(st);
+	bool ok = json_hash_cache_build(hashes, left, right,
+	                                opts->strict_equality) == 0;
+	if (st) {
+		st->hash_ns += json_diff_stats_clock(st) - t0;
+		if (ok)
+			st->bytes_allocated +=
+			    (hashes->mask + 1) *
+			    (sizeof(*hashes->nodes) + sizeof(*hashes->hashes) +
+			     sizeof(*hashes->lengths));
+	}
+	return ok;
+}
+
+/* Nodes of @d and its siblings, walked with a stack of pending siblings */
+static uint64_t delta_nodes(const cJSON *d)
+{
+	const cJSON *local[DUP_LOCAL_DEPTH], **stack = local;
+	size_t depth = 0, cap = DUP_LOCAL_DEPTH;
+	uint64_t n = 0;
+	while (d || depth) {
+		if (!d) {
+			d = stack[--depth];
+			continue;
+		}
+		n++;
+		/* Borrowed values belong to the inputs */
+		const cJSON *child = d->type & cJSON_IsReference ? NULL : d->child;
+		if (!child) {
+			d = d->next;
+			continue;
+		}
+		if (d->next && depth == cap) {
+			const cJSON **grown = malloc(cap * 2 * sizeof(*grown));
+			if (!grown) {
+				/* Count the siblings apart */
+				n += delta_nodes(d->next);
+			} else {
+				memcpy(grown, stack, cap * sizeof(*grown));
+				if (stack != local)
+					free(stack);
+				stack = grown;
+				cap *= 2;
+			}
+		}
+		if (d->next && depth < cap)
+			stack[depth++] = d->next;
+		d = child;
+	}
+	if (stack != local)
+		free(stack);
+	return n;
+}
+
+/* What a top-level call looked like when it started */
+struct stats_start {
+	uint64_t t0;
+	size_t arena_offset;
+};
+
+static struct stats_start stats_begin(const struct json_diff_options *opts)
+{
+	struct stats_start b = {0, 0};
+	if (opts->stats) {
+		b.t0 = json_diff_stats_clock(opts->stats);
+		b.arena_offset = opts->arena ? opts->arena->offset : 0;
+	}
+	return b;
+}
+
+/*
+ * Close the stats of a top-level call that returned @res. @ctx->scratch
+ * may be NULL for backends without one.
+ */
+static void stats_end(const struct json_diff_ctx *ctx,
+                      const struct stats_start *b, const cJSON *res)
+{
+	struct json_diff_stats *st = ctx->opts->stats;
+	if (!st)
+		return;
+	st->calls++;
+	st->total_ns += json_diff_stats_clock(st) - b->t0;
+	if (ctx->scratch)
+		st->bytes_allocated += ctx->scratch->high_water;
+	const struct json_diff_arena *arena = ctx->opts->arena;
+	if (arena) {
+		if (arena->offset > b->arena_offset)
+			st->bytes_allocated += arena->offset - b->arena_offset;
+		if (arena->high_water > st->arena_high_water)
+			st->arena_high_water = arena->high_water;
+	}
+	/* Siblings of the root are not part of the delta */
+	if (res)
+		st->nodes_emitted += 1 + delta_nodes(res->child);
+	if (ctx->out)
+		st->bytes_written += ctx->out->total;
+}
+
+/**
+ * json_diff - Public diff entry point
+ * @left: first JSON value
+ * @right: second JSON value
+ * @opts: diff options (can be NULL for defaults, opts->arena may be used)
+ *
+ * Return: diff object or NULL if values are equal
+ */
+cJSON *json_diff(const cJSON *left, const cJSON *right,
+                 const struct json_diff_options *opts)
+{
+	if (++json_diff_depth > MAX_JSON_DEPTH) {
+		--json_diff_depth;
+		return NULL;
+	}
+	struct json_diff_options default_opts = {.strict_equality = true,
+	                                         .arena = NULL};
+	if (!opts)
+		opts = &default_opts;
+
+	struct stats_start start = stats_begin(opts);
+	struct json_hash_cache hashes;
+	struct json_diff_arena scratch = {.head = NULL};
+	struct json_diff_ctx ctx = {
+	    .opts = opts, .hashes = NULL, .scratch = &scratch};
+	struct json_diff_filter filter = {.mem = NULL};
+	int run = ctx_filter_begin(&ctx, &filter);
+	/* Hashing both inputs up front would visit what the filters skip */
+	if (run > 0 && opts->hash_cache && !json_diff_ctx_pruned(&ctx) &&
+	    ctx_hashes_build(opts, &hashes, left, right))
+		ctx.hashes = &hashes;
+
+	cJSON *res = run > 0 ? do_json_diff(&ctx, left, right) : NULL;
+
+	stats_end(&ctx, &start, res);
+	if (ctx.hashes)
+		json_hash_cache_free(&hashes);
+	json_diff_filter_free(&filter);
+	json_diff_arena_cleanup(&scratch);
+
+	--json_diff_depth;
+	return res;
+}
+
+/*
+ * Resumable diff (json_diff_begin()). The values being diffed, innermost
+ * last, are frames on a heap stack, so depth costs no native stack. A
+ * frame starts as STEP_VALUE, waits in STEP_EQUAL while its equality walk
+ * is resumed, and if the values differ becomes an object or array frame
+ * that owns its delta until done. A finished frame hands its delta on: a
+ * member of the object frame below it adds it under its key, an element
+ * queued by json_diff_task_defer() fills its placeholder in the array
+ * delta. Scratch allocations follow the stack, so they stay LIFO.
+ */
+enum {
+	STEP_VALUE,
+	STEP_EQUAL,
+	STEP_OBJECT_LEFT,
+	STEP_OBJECT_RIGHT,
+	STEP_ARRAY,
+};
+
+struct step_frame {
+	const cJSON *left, *right;
+	const char *key; /* member key in the object delta below */
+	cJSON *array;    /* array delta holding @slot */
+	cJSON *slot;     /* placeholder member, NULL for object members */
+	cJSON *delta;
+	const struct json_diff_filter *filter; /* ctx->filter and ->scope */
+	struct json_diff_scope scope;          /* for the values */
+	const cJSON *cursor; /* next member of an object frame */
+	struct arena_mark mark;
+	struct key_index index;
+	bool indexed;
+	bool changed;
+	int state;
+};
+
+struct json_diff_task {
+	struct json_diff_options opts;
+	struct json_diff_ctx ctx;
+	struct json_diff_arena scratch;
+	struct json_hash_cache hashes;
+	struct json_diff_filter filter;
+	struct stats_start start;
+	struct eq_walk eq;
+	struct step_frame *frames;
+	size_t depth, cap;
+	cJSON *result;
+	bool started, done, failed;
+};
+
+/* Push a frame for @left and @right, diffed in the scope of @at */
+static bool step_push(struct json_diff_task *t, const struct json_diff_ctx *at,
+                      const cJSON *left, const cJSON *right, const char *key,
+                      cJSON *array, cJSON *slot)
+{
+	if (t->depth == t->cap) {
+		size_t cap = t->cap ? t->cap * 2 : 16;
+		struct step_frame *f = realloc(t->frames, cap * sizeof(*f));
+		if (!f)
+			return false;
+		t->frames = f;
+		t->cap = cap;
+	}
+	t->frames[t->depth++] = (struct step_frame){.left = left,
+	                                            .right = right,
+	                                            .key = key,
+	                                            .array = array,
+	                                            .slot = slot,
+	                                            .filter = at->filter,
+	                                            .scope = at->scope,
+	                                            .state = STEP_VALUE};
+	return true;
+}
+
+void json_diff_task_defer(const struct json_diff_ctx *ctx, cJSON *diff_obj,
+                          const char *key, const cJSON *left,
+                          const cJSON *right)
+{
+	struct json_diff_task *t = ctx->task;
+	struct json_diff_arena *arena = ctx->opts->arena;
+	cJSON *slot = diff_new_null(arena);
+	if (!slot || !diff_add_item_to_object(arena, diff_obj, key, slot)) {
+		diff_delete(arena, slot);
+		t->failed = true;
+		return;
+	}
+	if (!step_push(t, ctx, left, right, NULL, diff_obj, slot))
+		t->failed = true;
+}
+
+/* Put @item in place of the member @slot of @parent, or drop @slot */
+static void step_fill(struct json_diff_arena *arena, cJSON *parent,
+                      cJSON *slot, cJSON *item)
+{
+	if (!item) {
+		cJSON_DetachItemViaPointer(parent, slot);
+		diff_delete(arena, slot);
+		return;
+	}
+	cJSON *last = parent->child->prev;
+	item->string = slot->string;
+	item->type |= slot->type & cJSON_StringIsConst;
+	item->next = slot->next;
+	if (slot == parent->child) {
+		item->prev = last == slot ? item : last;
+		parent->child = item;
+	} else {
+		item->prev = slot->prev;
+		slot->prev->next = item;
+	}
+	if (slot->next)
+		slot->next->prev = item;
+	else
+		parent->child->prev = item;
+	slot->string = NULL;
+	slot->type &= ~cJSON_StringIsConst;
+	slot->next = slot->prev = NULL;
+	diff_delete(arena, slot);
+}
+
+/* Pop the finished top frame and hand @delta to whoever waits for it */
+static void step_pop(struct json_diff_task *t, cJSON *delta)
+{
+	struct json_diff_arena *arena = t->opts.arena;
+	const struct step_frame *f = &t->frames[--t->depth];
+	if (f->slot) {
+		step_fill(arena, f->array, f->slot, delta);
+	} else if (!t->depth) {
+		t->result = delta;
+	} else if (delta) {
+		struct step_frame *below = &t->frames[t->depth - 1];
+		diff_add_item_to_object(arena, below->delta, f->key, delta);
+		below->changed = true;
 	}
-
-finish:
-	--json_diff_depth;
-	return result;
 }
 
-/**
- * patch_array - Apply array diff to an array (following Elixir logic)
- * @original: original array
- * @diff: array diff object
- *
- * Return: patched array or NULL on failure
- */
-static cJSON *patch_array(const cJSON *original, const cJSON *diff)
-{
-	/* Defensive: if we were accidentally handed an object whose only child
-	 * value is an array, unwrap it so we operate on the array itself. */
-	if (!cJSON_IsArray(original) && cJSON_IsObject(original) &&
-	    original->child && original->child->next == NULL &&
-	    cJSON_IsArray(original->child)) {
-		original = original->child;
-	}
-
-	/* Unwrap array-reference style wrapper: sometimes an array reference is
-	 * represented as an array whose single element is the target array. */
-	if (cJSON_IsArray(original) && cJSON_GetArraySize(original) == 1) {
-		cJSON *only = cJSON_GetArrayItem(original, 0);
-		if (only && cJSON_IsArray(only)) {
-			original = only;
+/* Compare the values of the top frame, then diff them or start a walk */
+static void step_value(struct json_diff_task *t, long *budget)
+{
+	struct json_diff_ctx *ctx = &t->ctx;
+	struct step_frame *f = &t->frames[t->depth - 1];
+	const cJSON *left = f->left, *right = f->right;
+	ctx->filter = f->filter;
+	ctx->scope = f->scope;
+	if (f->state == STEP_VALUE && ctx->filter &&
+	    (ctx_cut(ctx) || !container_pair(left, right))) {
+		(*budget)--;
+		step_pop(t, json_diff_scoped_equal(ctx, left, right)
+		                ? NULL
+		                : diff_change_array(ctx, left, right));
+		return;
+	}
+	int r = EQ_PENDING;
+	if (f->state == STEP_VALUE) {
+		(*budget)--;
+		if (left == right)
+			r = EQ_EQUAL;
+		else if (json_diff_ctx_pruned(ctx))
+			r = EQ_DIFFERENT; /* walked; the delta may still be empty */
+		else if (t->opts.stats)
+			t->opts.stats->equal_calls++;
+		if (r == EQ_PENDING)
+			r = ctx_equal_quick(ctx, left, right);
+		if (r == EQ_PENDING)
+			r = eq_pair(left, right, t->opts.strict_equality);
+		if (r == EQ_PENDING) {
+			eq_walk_init(&t->eq, t->opts.strict_equality);
+			eq_push(&t->eq, left, right);
+			f->state = STEP_EQUAL;
 		}
 	}
+	if (f->state == STEP_EQUAL) {
+		r = eq_walk_run(&t->eq, budget);
+		if (r == EQ_PENDING)
+			return;
+		eq_walk_free(&t->eq);
+	}
+	if (r == EQ_EQUAL) {
+		step_pop(t, NULL);
+		return;
+	}
+	if (!left || !right || (left->type & 0xFF) != (right->type & 0xFF) ||
+	    (!cJSON_IsObject(left) && !cJSON_IsArray(left))) {
+		step_pop(t, diff_change_array(ctx, left, right));
+		return;
+	}
 
-	cJSON *result = cJSON_CreateArray();
-	int i;
-
-	if (!result)
-		return NULL;
+	if (cJSON_IsArray(left)) {
+		/* Nested diffs of matched elements land above this frame */
+		size_t depth = t->depth;
+		cJSON *d = json_myers_array_diff_ctx(left, right, ctx);
+		*budget -= cJSON_GetArraySize(left) + cJSON_GetArraySize(right);
+		if (!d) {
+			t->depth = depth;
+			step_pop(t, NULL);
+			return;
+		}
+		f = &t->frames[depth - 1];
+		f->delta = d;
+		f->state = STEP_ARRAY;
+		return;
+	}
 
-	/* Start from a deep copy of the original array to avoid aliasing */
-	cJSON *working_array = cJSON_Duplicate(original, 1);
-	if (!working_array) {
-		cJSON_Delete(result);
-		return NULL;
+	if (!(f->delta = diff_new_object(t->opts.arena))) {
+		t->failed = true;
+		return;
 	}
+	f->mark = arena_mark(ctx->scratch);
+	f->indexed = ctx_index_build(ctx, right, &f->index);
+	f->cursor = left->child;
+	f->state = STEP_OBJECT_LEFT;
+}
 
-	/* First pass: record indices that are additions with a single value.
-	 * These are replacements when paired with a deletion of the same index.
-	 */
-	int *replace_indices = NULL;
-	int replace_count = 0;
-	/* Collect jsondiffpatch move ops: _src: ["", dest, 3] */
-	struct move_op {
-		int src;
-		int dest;
-	};
-	struct move_op *moves = NULL;
-	int moves_count = 0;
-	int moves_cap = 0;
-	for (cJSON *it = diff->child; it; it = it->next) {
-		const char *k = it->string;
-		if (!k || strcmp(k, ARRAY_MARKER) == 0)
+/*
+ * Walk the members of the top object frame as do_json_diff() does: left
+ * members in order, each a nested frame or a deletion, then right-only
+ * additions
+ */
+static void step_object(struct json_diff_task *t, long *budget)
+{
+	struct json_diff_ctx *ctx = &t->ctx;
+	struct json_diff_arena *arena = t->opts.arena;
+	struct step_frame *f = &t->frames[t->depth - 1];
+	ctx->filter = f->filter;
+	ctx->scope = f->scope;
+	while (f->state == STEP_OBJECT_LEFT && f->cursor) {
+		if ((*budget)-- <= 0)
+			return;
+		const cJSON *li = f->cursor;
+		f->cursor = li->next;
+		if (!li->string)
 			continue;
-		if (k[0] == '_') {
-			/* Maybe a move op */
-			if (cJSON_IsArray(it) && cJSON_GetArraySize(it) == 3) {
-				cJSON *v0 = cJSON_GetArrayItem(it, 0);
-				cJSON *v1 = cJSON_GetArrayItem(it, 1);
-				cJSON *v2 = cJSON_GetArrayItem(it, 2);
-				if (v0 && cJSON_IsString(v0) && v1 &&
-				    cJSON_IsNumber(v1) && v2 &&
-				    cJSON_IsNumber(v2) &&
-				    (int)v2->valuedouble == 3) {
-					long s = strtol(k + 1, NULL, 10);
-					if (s >= 0 && s <= INT_MAX) {
-						if (moves_count == moves_cap) {
-							int newcap =
-							    moves_cap
-							        ? moves_cap * 2
-							        : 8;
-							struct move_op *nm =
-							    (struct move_op *)realloc(
-							        moves,
-							        (size_t)newcap *
-							            sizeof(
-							                *moves));
-							if (!nm) {
-								free(moves);
-								moves = NULL;
-								moves_count =
-								    moves_cap =
-								        0;
-							} else {
-								moves = nm;
-								moves_cap =
-								    newcap;
-							}
-						}
-						if (moves_cap > 0) {
-							moves[moves_count].src =
-							    (int)s;
-							moves[moves_count]
-							    .dest =
-							    (int)
-							        v1->valuedouble;
-							moves_count++;
-						}
-					}
-				}
+		cJSON *ri = NULL;
+		if (f->indexed) {
+			struct key_entry *e = key_index_get(&f->index, li->string);
+			if (e) {
+				e->matched = true;
+				ri = e->item;
 			}
+		} else {
+			ri = cJSON_GetObjectItemCaseSensitive(f->right,
+			                                      li->string);
+		}
+		struct json_diff_ctx buf;
+		const struct json_diff_ctx *sub =
+		    json_diff_ctx_enter(ctx, li->string, &buf);
+		if (!sub)
 			continue;
+		if (ri) {
+			if (!step_push(t, sub, li, ri, li->string, NULL, NULL))
+				t->failed = true;
+			return;
+		}
+		cJSON *d = diff_deletion_array(sub, li);
+		if (d) {
+			diff_add_item_to_object(arena, f->delta, li->string, d);
+			f->changed = true;
 		}
-		if (!cJSON_IsArray(it) || cJSON_GetArraySize(it) != 1)
+	}
+	if (f->state == STEP_OBJECT_LEFT) {
+		f->state = STEP_OBJECT_RIGHT;
+		f->cursor = f->right->child;
+	}
+	while (f->cursor) {
+		if ((*budget)-- <= 0)
+			return;
+		const cJSON *ri = f->cursor;
+		f->cursor = ri->next;
+		const char *key = ri->string;
+		if (!key)
 			continue;
-		char *ep = NULL;
-		long idx = strtol(k, &ep, 10);
-		if (ep == k || *ep != '\0' || idx < 0 || idx > INT_MAX)
+		if (f->indexed) {
+			struct key_entry *e = key_index_get(&f->index, key);
+			if (e->item != ri || e->matched)
+				continue;
+		} else if (cJSON_GetObjectItemCaseSensitive(f->left, key) ||
+		           cJSON_GetObjectItemCaseSensitive(f->right, key) !=
+		               ri) {
 			continue;
-		int *tmp =
-		    realloc(replace_indices, (replace_count + 1) * sizeof(int));
-		if (!tmp) {
-			free(replace_indices);
-			cJSON_Delete(working_array);
-			cJSON_Delete(result);
-			return NULL;
 		}
-		replace_indices = tmp;
-		replace_indices[replace_count++] = (int)idx;
-	}
-
-	/* Apply deletions first (in reverse order to maintain indices) */
-	cJSON *diff_item = diff->child;
-	int *delete_indices = NULL;
-	int delete_count = 0;
-
-	/* Collect deletion indices */
-	while (diff_item) {
-		const char *key = diff_item->string;
-		if (key[0] == '_' && strcmp(key, ARRAY_MARKER) != 0) {
-			char *endptr = NULL;
-			long index_long = strtol(key + 1, &endptr, 10);
-			if (endptr == key + 1 || *endptr != '\0' ||
-			    index_long < 0 || index_long > INT_MAX) {
-				diff_item = diff_item->next;
-				continue;
-			}
-			/* Safe cast after bounds check */
-			int index = (int)index_long;
-			/* Skip move ops encoded as ["", dest, 3] */
-			if (cJSON_IsArray(diff_item) &&
-			    cJSON_GetArraySize(diff_item) == 3) {
-				cJSON *v0 = cJSON_GetArrayItem(diff_item, 0);
-				cJSON *v2 = cJSON_GetArrayItem(diff_item, 2);
-				if (v0 && cJSON_IsString(v0) && v2 &&
-				    cJSON_IsNumber(v2) &&
-				    (int)v2->valuedouble == 3) {
-					diff_item = diff_item->next;
-					continue;
-				}
-			}
-			/* Skip deletion if we also have a single-element
-			 * addition at same index */
-			bool skip = false;
-			for (int r = 0; r < replace_count; r++) {
-				if (replace_indices[r] == index) {
-					skip = true;
-					break;
-				}
-			}
-			if (skip) {
-				diff_item = diff_item->next;
-				continue;
-			}
-			int *new_indices =
-			    realloc(delete_indices,
-			            ((size_t)delete_count + 1) * sizeof(int));
-			if (!new_indices) {
-				free(delete_indices);
-				cJSON_Delete(working_array);
-				cJSON_Delete(result);
-				return NULL;
-			}
-			delete_indices = new_indices;
-			delete_indices[delete_count] = index;
-			delete_count++;
+		struct json_diff_ctx buf;
+		const struct json_diff_ctx *sub =
+		    json_diff_ctx_enter(ctx, key, &buf);
+		if (!sub)
+			continue;
+		cJSON *a = diff_addition_array(sub, ri);
+		if (a) {
+			diff_add_item_to_object(arena, f->delta, key, a);
+			f->changed = true;
 		}
-		diff_item = diff_item->next;
 	}
+	arena_rewind(ctx->scratch, &f->mark);
+	cJSON *d = f->delta;
+	f->delta = NULL;
+	if (!f->changed) {
+		diff_delete(arena, d);
+		d = NULL;
+	}
+	step_pop(t, d);
+}
 
-	/* Sort deletion indices in descending order */
-	for (i = 0; i < delete_count - 1; i++) {
-		for (int j = i + 1; j < delete_count; j++) {
-			if (delete_indices[i] < delete_indices[j]) {
-				int temp = delete_indices[i];
-				delete_indices[i] = delete_indices[j];
-				delete_indices[j] = temp;
-			}
-		}
+/* All nested element diffs of the top array frame are in */
+static void step_array(struct json_diff_task *t)
+{
+	struct step_frame *f = &t->frames[t->depth - 1];
+	cJSON *d = f->delta;
+	f->delta = NULL;
+	/* The marker comes last, so alone it means every member dropped */
+	if (d->child && d->child->string &&
+	    strcmp(d->child->string, ARRAY_MARKER) == 0) {
+		diff_delete(t->opts.arena, d);
+		d = NULL;
 	}
+	step_pop(t, d);
+}
 
-	/* Apply deletions */
-	for (i = 0; i < delete_count; i++) {
-		int index = delete_indices[i];
-		if (index >= 0 && index < cJSON_GetArraySize(working_array)) {
-			cJSON_DeleteItemFromArray(working_array, index);
-		}
+struct json_diff_task *json_diff_begin(const cJSON *left, const cJSON *right,
+                                       const struct json_diff_options *opts)
+{
+	struct json_diff_task *t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+	if (opts)
+		t->opts = *opts;
+	else
+		t->opts.strict_equality = true;
+	t->ctx = (struct json_diff_ctx){
+	    .opts = &t->opts, .scratch = &t->scratch, .task = t};
+	t->start = stats_begin(&t->opts);
+	eq_walk_init(&t->eq, t->opts.strict_equality);
+	int run = ctx_filter_begin(&t->ctx, &t->filter);
+	if (run < 0 || (run > 0 && !step_push(t, &t->ctx, left, right, NULL,
+	                                      NULL, NULL))) {
+		json_diff_filter_free(&t->filter);
+		free(t);
+		return NULL;
 	}
-	free(delete_indices);
-	free(replace_indices);
-
-	/* Apply moves: sort by dest ascending and move value-matching nodes */
-	if (moves_count > 0) {
-		/* simple insertion sort */
-		for (int a = 1; a < moves_count; a++) {
-			struct move_op key = moves[a];
-			int b = a - 1;
-			while (b >= 0 && moves[b].dest > key.dest) {
-				moves[b + 1] = moves[b];
-				b--;
-			}
-			moves[b + 1] = key;
-		}
-		for (int mi = 0; mi < moves_count; mi++) {
-			int src = moves[mi].src;
-			int dest = moves[mi].dest;
-			if (src < 0)
-				continue;
-			cJSON *src_item = cJSON_GetArrayItem(original, src);
-			if (!src_item)
-				continue;
-			int cur = -1;
-			int wsz = cJSON_GetArraySize(working_array);
-			for (int t = 0; t < wsz; t++) {
-				cJSON *cand =
-				    cJSON_GetArrayItem(working_array, t);
-				if (json_value_equal(cand, src_item, true)) {
-					cur = t;
-					break;
-				}
-			}
-			if (cur < 0)
-				continue;
-			cJSON *node =
-			    cJSON_DetachItemFromArray(working_array, cur);
-			if (!node)
-				continue;
-			if (dest < 0)
-				dest = 0;
-			int nsz = cJSON_GetArraySize(working_array);
-			if (dest >= nsz) {
-				cJSON_AddItemToArray(working_array, node);
-			} else {
-				cJSON_InsertItemInArray(working_array, dest,
-				                        node);
-			}
+	/* Nothing to diff: the first step finds the stack empty */
+	return t;
+}
+
+int json_diff_step(struct json_diff_task *t, size_t budget)
+{
+	if (!t || t->failed)
+		return -1;
+	if (t->done)
+		return 0;
+	struct json_diff_stats *st = t->opts.stats;
+	uint64_t t0 = json_diff_stats_clock(st);
+	long left = budget && budget < LONG_MAX ? (long)budget : LONG_MAX;
+	if (!t->started) {
+		const struct step_frame *root = t->frames;
+		t->started = true;
+		if (t->depth && t->opts.hash_cache &&
+		    !json_diff_ctx_pruned(&t->ctx) &&
+		    ctx_hashes_build(&t->opts, &t->hashes, root->left,
+		                     root->right))
+			t->ctx.hashes = &t->hashes;
+		left--;
+	}
+	while (t->depth && left > 0 && !t->failed) {
+		switch (t->frames[t->depth - 1].state) {
+		case STEP_VALUE:
+		case STEP_EQUAL:
+			step_value(t, &left);
+			break;
+		case STEP_ARRAY:
+			step_array(t);
+			break;
+		default:
+			step_object(t, &left);
+			break;
 		}
-		free(moves);
 	}
+	if (t->failed || t->depth) {
+		if (st)
+			st->total_ns += json_diff_stats_clock(st) - t0;
+		return t->failed ? -1 : 1;
+	}
+	t->done = true;
+	t->start.t0 = t0;
+	stats_end(&t->ctx, &t->start, t->result);
+	return 0;
+}
 
-	/* Now apply additions and modifications */
-	diff_item = diff->child;
-	while (diff_item) {
-		const char *key = diff_item->string;
+cJSON *json_diff_end(struct json_diff_task *t)
+{
+	if (!t)
+		return NULL;
+	struct json_diff_arena *arena = t->opts.arena;
+	cJSON *res = t->result;
+	if (!t->done || t->failed) {
+		diff_delete(arena, res);
+		res = NULL;
+	}
+	/* Unfinished deltas are not linked anywhere yet */
+	for (size_t i = 0; i < t->depth; i++)
+		diff_delete(arena, t->frames[i].delta);
+	eq_walk_free(&t->eq);
+	if (t->ctx.hashes)
+		json_hash_cache_free(&t->hashes);
+	json_diff_filter_free(&t->filter);
+	json_diff_arena_cleanup(&t->scratch);
+	free(t->frames);
+	free(t);
+	return res;
+}
 
-		if (strcmp(key, ARRAY_MARKER) == 0 || key[0] == '_') {
-			diff_item = diff_item->next;
-			continue;
-		}
+struct json_diff_prepared *
+json_diff_prepare(const cJSON *left, const struct json_diff_options *opts)
+{
+	if (!left)
+		return NULL;
+	size_t objects = 0;
+	size_t n = prep_count(left, 0, &objects);
+	if (n > (size_t)INT_MAX - 1 || n > SIZE_MAX / 4 / sizeof(int))
+		return NULL;
+	struct json_diff_prepared *p = calloc(1, sizeof(*p));
+	if (!p)
+		return NULL;
+	p->left = left;
+	p->opts = opts ? *opts
+	               : (struct json_diff_options){.strict_equality = true};
+	p->count = (int)n;
+	json_diff_arena_init(&p->mem, 0);
+
+	bool keyed = p->opts.object_hash ||
+	             (p->opts.object_key && *p->opts.object_key);
+	size_t cap = 8;
+	while (cap < n * 2)
+		cap <<= 1;
+	p->mask = cap - 1;
+	p->slots = calloc(cap, sizeof(*p->slots));
+	p->flat = malloc(n * sizeof(*p->flat));
+	p->nodes = malloc(n * sizeof(*p->nodes));
+	p->indexes = malloc((objects + 1) * sizeof(*p->indexes));
+	p->ids = keyed ? calloc(n, sizeof(*p->ids)) : NULL;
+	if (p->opts.hash_cache) {
+		p->hashes = malloc(n * sizeof(*p->hashes));
+		p->lengths = malloc(n * sizeof(*p->lengths));
+	}
+	if (!p->slots || !p->flat || !p->nodes || !p->indexes ||
+	    (keyed && !p->ids) ||
+	    (p->opts.hash_cache && (!p->hashes || !p->lengths)) ||
+	    !prep_build(p)) {
+		json_diff_prepared_free(p);
+		return NULL;
+	}
+	return p;
+}
 
-		char *endptr = NULL;
-		long index_long = strtol(key, &endptr, 10);
-		if (endptr == key || *endptr != '\0' || index_long < 0 ||
-		    index_long > INT_MAX) {
-			diff_item = diff_item->next;
-			continue;
-		}
-		/* Safe cast after bounds check */
-		int index = (int)index_long;
-		if (cJSON_IsArray(diff_item)) {
-			int array_size = cJSON_GetArraySize(diff_item);
-			if (array_size == 1) {
-				/* Addition */
-				cJSON *src_val =
-				    cJSON_GetArrayItem(diff_item, 0);
-				cJSON *new_val;
-				if (cJSON_IsObject(src_val)) {
-					new_val = cJSON_Duplicate(src_val, 1);
-				} else if (cJSON_IsArray(src_val)) {
-					new_val = cJSON_Duplicate(src_val, 1);
-				} else if (cJSON_IsString(src_val)) {
-					new_val = cJSON_CreateString(
-					    src_val->valuestring);
-				} else if (cJSON_IsNumber(src_val)) {
-					new_val = cJSON_CreateNumber(
-					    src_val->valuedouble);
-				} else if (cJSON_IsBool(src_val)) {
-					new_val = cJSON_CreateBool(
-					    cJSON_IsTrue(src_val));
-				} else {
-					new_val = cJSON_CreateNull();
-				}
-				if (new_val) {
-					int current_size =
-					    cJSON_GetArraySize(working_array);
-					if (index >= 0 &&
-					    index < current_size) {
-						/* Treat as replacement if
-						 * within bounds */
-						cJSON_ReplaceItemInArray(
-						    working_array, index,
-						    new_val);
-					} else if (index >= current_size) {
-						cJSON_AddItemToArray(
-						    working_array, new_val);
-					} else {
-						cJSON_Delete(new_val);
-					}
-				}
-			} else if (array_size == 2) {
-				/* Replacement */
-				cJSON *src_val =
-				    cJSON_GetArrayItem(diff_item, 1);
-				cJSON *new_val;
-				if (cJSON_IsObject(src_val)) {
-					new_val = cJSON_Duplicate(src_val, 1);
-				} else if (cJSON_IsArray(src_val)) {
-					new_val = cJSON_Duplicate(src_val, 1);
-				} else if (cJSON_IsString(src_val)) {
-					new_val = cJSON_CreateString(
-					    src_val->valuestring);
-				} else if (cJSON_IsNumber(src_val)) {
-					new_val = cJSON_CreateNumber(
-					    src_val->valuedouble);
-				} else if (cJSON_IsBool(src_val)) {
-					new_val = cJSON_CreateBool(
-					    cJSON_IsTrue(src_val));
-				} else {
-					new_val = cJSON_CreateNull();
-				}
-				if (new_val && index >= 0 &&
-				    index < cJSON_GetArraySize(working_array)) {
-					cJSON_ReplaceItemInArray(
-					    working_array, index, new_val);
-				} else if (new_val) {
-					cJSON_Delete(new_val);
-				}
-			}
-		} else {
-			/* Nested diff */
-			if (index >= 0 &&
-			    index < cJSON_GetArraySize(working_array)) {
-				cJSON *orig_val =
-				    cJSON_GetArrayItem(working_array, index);
-				if (orig_val) {
-					cJSON *patched =
-					    json_patch(orig_val, diff_item);
-					if (patched) {
-						cJSON_ReplaceItemInArray(
-						    working_array, index,
-						    patched);
-					}
-				}
-			}
-		}
-		diff_item = diff_item->next;
+static cJSON *prepared_diff(const struct json_diff_prepared *p,
+                            const struct json_diff_options *opts,
+                            const cJSON *right)
+{
+	if (++json_diff_depth > MAX_JSON_DEPTH) {
+		--json_diff_depth;
+		return NULL;
 	}
+	struct stats_start start = stats_begin(opts);
+	struct json_hash_cache hashes;
+	struct json_diff_arena scratch = {.head = NULL};
+	struct json_diff_ctx ctx = {
+	    .opts = opts, .hashes = NULL, .scratch = &scratch, .prep = p};
+	struct json_diff_filter filter = {.mem = NULL};
+	int run = ctx_filter_begin(&ctx, &filter);
+	if (run > 0 && p->hashes && !json_diff_ctx_pruned(&ctx) &&
+	    ctx_hashes_build(opts, &hashes, NULL, right))
+		ctx.hashes = &hashes;
+
+	cJSON *res = run > 0 ? do_json_diff(&ctx, p->left, right) : NULL;
+
+	stats_end(&ctx, &start, res);
+	if (ctx.hashes)
+		json_hash_cache_free(&hashes);
+	json_diff_filter_free(&filter);
+	json_diff_arena_cleanup(&scratch);
+	--json_diff_depth;
+	return res;
+}
 
-	/* We can return the working array directly */
-	cJSON_Delete(result);
-	return working_array;
+cJSON *json_diff_prepared(const struct json_diff_prepared *prep,
+                          const cJSON *right)
+{
+	if (!prep || !right)
+		return NULL;
+	return prepared_diff(prep, &prep->opts, right);
 }
 
-/**
- * json_diff - Public wrapper that sets up optional arena before diff
- * @left: first JSON value
- * @right: second JSON value
- * @opts: diff options (can be NULL for defaults, opts->arena may be used)
- *
- * Return: diff object or NULL if values are equal
+#ifdef JSON_DIFF_THREADS
+/*
+ * Batch workers claim documents one at a time; each diffs serially into an
+ * arena of its own, adopted by the prepared arena after the join.
  */
-cJSON *json_diff(const cJSON *left, const cJSON *right,
-                 const struct json_diff_options *opts)
+struct batch_state {
+	const struct json_diff_prepared *prep;
+	const cJSON *const *rights;
+	cJSON **diffs;
+	size_t count;
+	atomic_size_t next;
+};
+
+struct batch_worker {
+	struct batch_state *st;
+	struct json_diff_options opts;
+	struct json_diff_arena arena;
+	bool inexact;
+	struct json_diff_stats stats;
+	pthread_t thread;
+	bool started;
+};
+
+static void batch_run(struct batch_state *st,
+                      const struct json_diff_options *opts)
+{
+	for (;;) {
+		size_t i = atomic_fetch_add(&st->next, 1);
+		if (i >= st->count)
+			break;
+		const cJSON *right = st->rights[i];
+		st->diffs[i] =
+		    right ? prepared_diff(st->prep, opts, right) : NULL;
+	}
+}
+
+static void *batch_thread(void *arg)
+{
+	struct batch_worker *w = arg;
+	batch_run(w->st, &w->opts);
+	return NULL;
+}
+
+static int prepared_batch_parallel(const struct json_diff_prepared *prep,
+                                   const cJSON *const *rights, size_t count,
+                                   cJSON **diffs)
+{
+	size_t nworkers = (size_t)prep->opts.threads - 1;
+	if (nworkers > count - 1)
+		nworkers = count - 1;
+	struct batch_worker *workers = calloc(nworkers, sizeof(*workers));
+	if (!workers)
+		return -1;
+
+	struct batch_state st = {
+	    .prep = prep, .rights = rights, .diffs = diffs, .count = count};
+	atomic_init(&st.next, 0);
+	struct json_diff_arena *arena = prep->opts.arena;
+	for (size_t i = 0; i < nworkers; i++) {
+		struct batch_worker *w = &workers[i];
+		w->st = &st;
+		w->opts = prep->opts;
+		w->opts.threads = 0;
+		if (arena) {
+			json_diff_arena_init(&w->arena, arena->chunk_size);
+			w->opts.arena = &w->arena;
+		}
+		if (w->opts.inexact)
+			w->opts.inexact = &w->inexact;
+		if (w->opts.stats)
+			w->opts.stats = &w->stats;
+		w->started =
+		    pthread_create(&w->thread, NULL, batch_thread, w) == 0;
+	}
+
+	struct json_diff_options self_opts = prep->opts;
+	self_opts.threads = 0;
+	batch_run(&st, &self_opts);
+
+	for (size_t i = 0; i < nworkers; i++) {
+		struct batch_worker *w = &workers[i];
+		if (w->started)
+			pthread_join(w->thread, NULL);
+		if (arena)
+			arena_adopt(arena, &w->arena);
+		if (w->inexact)
+			*prep->opts.inexact = true;
+		if (prep->opts.stats)
+			json_diff_stats_add(prep->opts.stats, &w->stats);
+	}
+	free(workers);
+	return 0;
+}
+#endif
+
+int json_diff_prepared_batch(const struct json_diff_prepared *prep,
+                             const cJSON *const *rights, size_t count,
+                             cJSON **diffs)
+{
+	if (!prep || (count && (!rights || !diffs)))
+		return -1;
+#ifdef JSON_DIFF_THREADS
+	if (prep->opts.threads > 1 && count > 1 &&
+	    prepared_batch_parallel(prep, rights, count, diffs) == 0)
+		return 0;
+#endif
+	for (size_t i = 0; i < count; i++)
+		diffs[i] = json_diff_prepared(prep, rights[i]);
+	return 0;
+}
+
+void json_diff_prepared_free(struct json_diff_prepared *prep)
+{
+	if (!prep)
+		return;
+	json_diff_arena_cleanup(&prep->mem);
+	free(prep->slots);
+	free(prep->flat);
+	free(prep->nodes);
+	free(prep->indexes);
+	free(prep->ids);
+	free(prep->hashes);
+	free(prep->lengths);
+	free(prep);
+}
+
+int json_diff_write(const cJSON *left, const cJSON *right,
+                    const struct json_diff_options *opts,
+                    json_diff_write_fn fn, void *user)
 {
+	if (!fn)
+		return -1;
 	if (++json_diff_depth > MAX_JSON_DEPTH) {
 		--json_diff_depth;
-		return NULL;
+		return -1;
 	}
-	struct json_diff_options default_opts = {.strict_equality = true,
-	                                         .arena = NULL};
+	struct json_diff_options default_opts = {.strict_equality = true};
 	if (!opts)
 		opts = &default_opts;
-	if (opts->arena) {
-		current_arena = opts->arena;
-		opts->arena->offset = 0;
-		cJSON_Hooks h = {arena_malloc, arena_free};
-		cJSON_InitHooks(&h);
-	}
 
-	cJSON *res = do_json_diff(left, right, opts);
+	struct stats_start start = stats_begin(opts);
+	struct json_writer out;
+	json_writer_init(&out, fn, user);
+	struct json_hash_cache hashes;
+	struct json_diff_arena scratch = {.head = NULL};
+	struct json_diff_ctx ctx = {
+	    .opts = opts, .hashes = NULL, .scratch = &scratch, .out = &out};
+	struct json_diff_filter filter = {.mem = NULL};
+	int run = ctx_filter_begin(&ctx, &filter);
+	if (run > 0 && opts->hash_cache && !json_diff_ctx_pruned(&ctx) &&
+	    ctx_hashes_build(opts, &hashes, left, right))
+		ctx.hashes = &hashes;
+
+	int ret = run < 0 ? -1 : 0;
+	if (run > 0 && !json_diff_scoped_equal(&ctx, left, right)) {
+		do_json_diff(&ctx, left, right);
+		ret = 1;
+	}
+	if (json_writer_flush(&out) != 0)
+		ret = -1;
+	stats_end(&ctx, &start, NULL);
+
+	if (ctx.hashes)
+		json_hash_cache_free(&hashes);
+	json_diff_filter_free(&filter);
+	json_diff_arena_cleanup(&scratch);
+	--json_diff_depth;
+	return ret;
+}
 
-	if (opts->arena) {
-		cJSON_Hooks h = {malloc, free};
-		cJSON_InitHooks(&h);
-		current_arena = NULL;
+int json_diff_sink_run(const cJSON *left, const cJSON *right,
+                       const struct json_diff_options *opts,
+                       struct json_diff_sink *sink)
+{
+	if (++json_diff_depth > MAX_JSON_DEPTH) {
+		--json_diff_depth;
+		return -1;
 	}
+	struct stats_start start = stats_begin(opts);
+	struct json_hash_cache hashes;
+	struct json_diff_arena scratch = {.head = NULL};
+	struct json_diff_ctx ctx = {
+	    .opts = opts, .hashes = NULL, .scratch = &scratch, .sink = sink};
+	struct json_diff_filter filter = {.mem = NULL};
+	int run = ctx_filter_begin(&ctx, &filter);
+	if (run > 0 && opts->hash_cache && !json_diff_ctx_pruned(&ctx) &&
+	    ctx_hashes_build(opts, &hashes, left, right))
+		ctx.hashes = &hashes;
+
+	int ret = run < 0 ? -1 : 0;
+	if (run > 0 && !json_diff_scoped_equal(&ctx, left, right)) {
+		do_json_diff(&ctx, left, right);
+		ret = 1;
+	}
+	stats_end(&ctx, &start, NULL);
+
+	if (ctx.hashes)
+		json_hash_cache_free(&hashes);
+	json_diff_filter_free(&filter);
+	json_diff_arena_cleanup(&scratch);
 	--json_diff_depth;
-	return res;
+	return ret;
 }
-/**
- * json_patch - Apply a diff to a cJSON value
- * @original: original JSON value
- * @diff: diff to apply
- *
- * Return: patched JSON value or NULL on failure
- */
-/// Apply a diff; bail out on excessive recursion
-cJSON *json_patch(const cJSON *original, const cJSON *diff)
+
+void json_diff_sink_value(const struct json_diff_ctx *ctx, const char *key,
+                          const cJSON *left, const cJSON *right)
 {
-	if (++json_patch_depth > MAX_JSON_DEPTH)
-		return NULL;
-	cJSON *result = NULL;
+	struct json_diff_ctx buf;
+	const struct json_diff_ctx *sub = json_diff_ctx_enter(ctx, key, &buf);
+	if (sub && !json_diff_scoped_equal(sub, left, right))
+		do_json_diff(sub, left, right);
+}
 
-	if (!original || !diff)
-		goto out;
+/* json_diff_write_buf() sink: fill the buffer, keep counting past its end */
+struct buf_sink {
+	char *buf;
+	size_t size;
+	size_t len;
+};
 
-	/* Handle simple value replacement (type changes) */
-	if (cJSON_IsArray(diff) && cJSON_GetArraySize(diff) == 2) {
-		/* This is a change array [old_value, new_value] */
-		cJSON *new_val = cJSON_GetArrayItem(diff, 1);
-		if (cJSON_IsObject(new_val)) {
-			/* Handle object reference wrapper - if it has only one
-			 * child with empty key, unwrap it */
-			if (new_val->child && !new_val->child->next &&
-			    new_val->child->string &&
-			    strlen(new_val->child->string) == 0) {
-				return cJSON_CreateObjectReference(
-				    new_val->child);
-			}
-			return cJSON_CreateObjectReference(new_val);
-		} else if (cJSON_IsArray(new_val)) {
-			return cJSON_CreateArrayReference(new_val);
-		} else if (cJSON_IsString(new_val)) {
-			return cJSON_CreateString(new_val->valuestring);
-		} else if (cJSON_IsNumber(new_val)) {
-			return cJSON_CreateNumber(new_val->valuedouble);
-		} else if (cJSON_IsBool(new_val)) {
-			return cJSON_CreateBool(cJSON_IsTrue(new_val));
-		} else {
-			return cJSON_CreateNull();
-		}
+static int buf_sink_write(const char *data, size_t len, void *user)
+{
+	struct buf_sink *sink = user;
+	if (sink->len < sink->size) {
+		size_t room = sink->size - sink->len;
+		memcpy(sink->buf + sink->len, data, len < room ? len : room);
 	}
+	sink->len += len;
+	return 0;
+}
 
-	if (!cJSON_IsObject(diff)) {
-		if (cJSON_IsObject(original)) {
-			return cJSON_CreateObjectReference(original);
-		} else if (cJSON_IsArray(original)) {
-			return cJSON_CreateArrayReference(original);
-		} else if (cJSON_IsString(original)) {
-			return cJSON_CreateString(original->valuestring);
-		} else if (cJSON_IsNumber(original)) {
-			return cJSON_CreateNumber(original->valuedouble);
-		} else if (cJSON_IsBool(original)) {
-			return cJSON_CreateBool(cJSON_IsTrue(original));
-		} else {
-			return cJSON_CreateNull();
-		}
-	}
+int json_diff_write_buf(const cJSON *left, const cJSON *right,
+                        const struct json_diff_options *opts, char *buf,
+                        size_t size, size_t *needed)
+{
+	/* Last byte of @buf is reserved for the terminator */
+	struct buf_sink sink = {.buf = buf, .size = size ? size - 1 : 0};
+	int ret = json_diff_write(left, right, opts, buf_sink_write, &sink);
+	if (size)
+		buf[sink.len < sink.size ? sink.len : sink.size] = '\0';
+	if (needed)
+		*needed = sink.len;
+	return ret;
+}
 
-	/* Check if this is an array diff */
-	if (cJSON_GetObjectItem(diff, ARRAY_MARKER)) {
-		if (cJSON_IsArray(original)) {
-			return patch_array(original, diff);
-		} else {
-			if (cJSON_IsObject(original)) {
-				return cJSON_CreateObjectReference(original);
-			} else if (cJSON_IsArray(original)) {
-				return cJSON_CreateArrayReference(original);
-			} else if (cJSON_IsString(original)) {
-				return cJSON_CreateString(
-				    original->valuestring);
-			} else if (cJSON_IsNumber(original)) {
-				return cJSON_CreateNumber(
-				    original->valuedouble);
-			} else if (cJSON_IsBool(original)) {
-				return cJSON_CreateBool(cJSON_IsTrue(original));
-			} else {
-				return cJSON_CreateNull();
-			}
-		}
-	}
+void json_diff_free(cJSON *diff, const struct json_diff_options *opts)
+{
+	/* Arena diffs go away with the arena; reference nodes skip targets */
+	if (opts && opts->arena)
+		return;
+	cJSON_Delete(diff);
+}
 
-	/* For non-object originals with object diffs, create new object */
-	if (!cJSON_IsObject(original)) {
-		result = cJSON_CreateObject();
-	} else {
-		/* Copy original object structure */
-		result = cJSON_CreateObject();
-		cJSON *orig_item = original->child;
-		while (orig_item) {
-			cJSON *copy_item;
-			if (cJSON_IsObject(orig_item)) {
-				copy_item =
-				    cJSON_CreateObjectReference(orig_item);
-			} else if (cJSON_IsArray(orig_item)) {
-				copy_item =
-				    cJSON_CreateArrayReference(orig_item);
-			} else if (cJSON_IsString(orig_item)) {
-				copy_item =
-				    cJSON_CreateString(orig_item->valuestring);
-			} else if (cJSON_IsNumber(orig_item)) {
-				copy_item =
-				    cJSON_CreateNumber(orig_item->valuedouble);
-			} else if (cJSON_IsBool(orig_item)) {
-				copy_item =
-				    cJSON_CreateBool(cJSON_IsTrue(orig_item));
-			} else {
-				copy_item = cJSON_CreateNull();
-			}
-			if (copy_item) {
-				cJSON_AddItemToObject(result, orig_item->string,
-				                      copy_item);
-			}
-			orig_item = orig_item->next;
-		}
-	}
-	if (!result)
+cJSON *json_patch(const cJSON *original, const cJSON *diff)
+{
+	if (!original || !diff)
 		return NULL;
 
-	/* Apply all changes from diff */
-	cJSON *diff_item = diff->child;
-	while (diff_item) {
-		const char *key = diff_item->string;
-
-		if (cJSON_IsArray(diff_item)) {
-			int array_size = cJSON_GetArraySize(diff_item);
-			if (array_size == 1) {
-				/* Addition or replacement */
-				cJSON *src_val =
-				    cJSON_GetArrayItem(diff_item, 0);
-				cJSON *new_val;
-				if (cJSON_IsObject(src_val)) {
-					new_val = cJSON_Duplicate(src_val, 1);
-				} else if (cJSON_IsArray(src_val)) {
-					new_val = cJSON_Duplicate(src_val, 1);
-				} else if (cJSON_IsString(src_val)) {
-					new_val = cJSON_CreateString(
-					    src_val->valuestring);
-				} else if (cJSON_IsNumber(src_val)) {
-					new_val = cJSON_CreateNumber(
-					    src_val->valuedouble);
-				} else if (cJSON_IsBool(src_val)) {
-					new_val = cJSON_CreateBool(
-					    cJSON_IsTrue(src_val));
-				} else {
-					new_val = cJSON_CreateNull();
-				}
-				if (new_val) {
-					cJSON_DeleteItemFromObject(result, key);
-					cJSON_AddItemToObject(result, key,
-					                      new_val);
-				}
-			} else if (array_size == 3) {
-				/* Deletion - remove key */
-				cJSON_DeleteItemFromObject(result, key);
-			} else if (array_size == 2) {
-				/* Replacement */
-				cJSON *src_val =
-				    cJSON_GetArrayItem(diff_item, 1);
-				cJSON *new_val;
-				if (cJSON_IsObject(src_val)) {
-					new_val = cJSON_Duplicate(src_val, 1);
-				} else if (cJSON_IsArray(src_val)) {
-					new_val = cJSON_Duplicate(src_val, 1);
-				} else if (cJSON_IsString(src_val)) {
-					new_val = cJSON_CreateString(
-					    src_val->valuestring);
-				} else if (cJSON_IsNumber(src_val)) {
-					new_val = cJSON_CreateNumber(
-					    src_val->valuedouble);
-				} else if (cJSON_IsBool(src_val)) {
-					new_val = cJSON_CreateBool(
-					    cJSON_IsTrue(src_val));
-				} else {
-					new_val = cJSON_CreateNull();
-				}
-				if (new_val) {
-					cJSON_DeleteItemFromObject(result, key);
-					cJSON_AddItemToObject(result, key,
-					                      new_val);
-				}
-			}
-		} else {
-			/* Nested diff */
-			cJSON *orig_val = cJSON_GetObjectItem(result, key);
-			/* Unwrap cJSON reference wrapper objects to real item
-			 * when present */
-			if (orig_val && (orig_val->type & cJSON_IsReference) &&
-			    orig_val->child) {
-				orig_val = orig_val->child;
-			}
-			if (orig_val) {
-				cJSON *patched =
-				    json_patch(orig_val, diff_item);
-				if (patched) {
-					cJSON_DeleteItemFromObject(result, key);
-					cJSON_AddItemToObject(result, key,
-					                      patched);
-				}
-			}
-		}
-		diff_item = diff_item->next;
+	/* A root replacement does not need a copy of the original */
+	if (cJSON_IsArray(diff) && cJSON_GetArraySize(diff) == 2)
+		return diff_duplicate(NULL, cJSON_GetArrayItem(diff, 1));
+
+	cJSON *copy = diff_duplicate(NULL, original);
+	if (!copy)
+		return NULL;
+	return json_patch_inplace(copy, diff);
+}
+
+cJSON *json_patch_inplace(cJSON *target, const cJSON *diff)
+{
+	if (!target || !diff) {
+		cJSON_Delete(target);
+		return NULL;
 	}
 
-out:
-	--json_patch_depth;
+	bool failed = false;
+	cJSON *result = json_patch_node(target, diff, &failed);
+	if (result != target)
+		cJSON_Delete(target);
+	if (failed) {
+		cJSON_Delete(result);
+		return NULL;
+	}
 	return result;
 }
 
-cJSON *json_diff_str(const char *left, const char *right,
-                     const struct json_diff_options *opts)
+int json_diff_text(const char *left, const char *right,
+                   const struct json_diff_options *opts, cJSON **out)
 {
-	/* Reject excessively large inputs to avoid DoS */
-	if (!left || !right || strlen(left) > MAX_JSON_INPUT_SIZE ||
-	    strlen(right) > MAX_JSON_INPUT_SIZE)
-		return NULL;
+	*out = NULL;
+
+	/* The inputs die below, so the diff must not borrow from them */
+	struct json_diff_options owned = {.strict_equality = true};
+	if (opts)
+		owned = *opts;
+	owned.output = JSON_DIFF_OUTPUT_OWNED;
+
+	struct json_diff_stats *st = owned.stats;
+	uint64_t t0 = json_diff_stats_clock(st);
+
+	/* Token path: no cJSON trees for the inputs, only for the delta */
+	if (jsmn_diff_supported(&owned)) {
+		jsmntree_t lt, rt;
+		if (jsmntree_init(&lt, left) != 0)
+			return -1;
+		if (jsmntree_init(&rt, right) != 0) {
+			jsmntree_free(&lt);
+			return -1;
+		}
+		uint64_t t1 = json_diff_stats_clock(st);
+		size_t arena_offset = owned.arena ? owned.arena->offset : 0;
+		*out = diff_jsmn(&lt, 0, &rt, 0, &owned);
+		if (st) {
+			struct json_diff_ctx ctx = {.opts = &owned};
+			struct stats_start start = {t0, arena_offset};
+			st->parse_ns += t1 - t0;
+			size_t tokens = (size_t)lt.cap + (size_t)rt.cap;
+			st->bytes_allocated += tokens * sizeof(jsmntok_t);
+			stats_end(&ctx, &start, *out);
+		}
+		jsmntree_free(&rt);
+		jsmntree_free(&lt);
+		return 0;
+	}
 
 	cJSON *left_json = cJSON_Parse(left);
 	if (!left_json)
-		return NULL;
+		return -1;
 
 	cJSON *right_json = cJSON_Parse(right);
 	if (!right_json) {
 		cJSON_Delete(left_json);
-		return NULL;
+		return -1;
+	}
+	if (st) {
+		/* json_diff() below adds the rest of the call */
+		uint64_t parse = json_diff_stats_clock(st) - t0;
+		st->parse_ns += parse;
+		st->total_ns += parse;
 	}
 
-	cJSON *diff = json_diff(left_json, right_json, opts);
+	*out = json_diff(left_json, right_json, &owned);
 
 	cJSON_Delete(left_json);
 	cJSON_Delete(right_json);
+	return 0;
+}
+
+cJSON *json_diff_str(const char *left, const char *right,
+                     const struct json_diff_options *opts)
+{
+	size_t limit = opts && opts->max_input_size ? opts->max_input_size
+	                                            : MAX_JSON_INPUT_SIZE;
+	if (limit > JSMN_MAX_TEXT)
+		limit = JSMN_MAX_TEXT;
+
+	/* Reject excessively large inputs to avoid DoS */
+	if (!left || !right || strlen(left) > limit || strlen(right) > limit)
+		return NULL;
 
-	return diff;
+	cJSON *diff;
+	return json_diff_text(left, right, opts, &diff) == 0 ? diff : NULL;
 }
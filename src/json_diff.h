@@ -4,34 +4,242 @@
 
 #include <cjson/cJSON.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-#ifndef MAX_ARENA_SIZE
-#define MAX_ARENA_SIZE (16 * 1024 * 1024)
+#ifndef JSON_DIFF_ARENA_CHUNK_SIZE
+#define JSON_DIFF_ARENA_CHUNK_SIZE (64 * 1024)
 #endif
 
+/* Patterns per list of json_diff_options that are honoured */
+#define JSON_DIFF_MAX_PATHS 64
+
+struct json_diff_arena_chunk;
+
 /**
- * struct json_diff_arena - Arena for diff allocations
- * @buf: internal buffer for allocations
- * @capacity: total buffer capacity in bytes
- * @offset: current used bytes (bump pointer)
+ * struct json_diff_arena - Chunked arena for diff allocations
+ * @head: first chunk of the chain (chunks are kept across resets)
+ * @cur: chunk currently being carved from
+ * @large: oversized allocations, one block each (freed on reset)
+ * @chunk_size: usable bytes per chunk
+ * @capacity: bytes currently reserved by chunks and large blocks
+ * @offset: bytes handed out since the last reset
+ * @high_water: largest @offset seen over the arena's lifetime
+ * @chunk_count: chunks in the chain
+ * @large_count: live large blocks
+ *
+ * The arena grows by linking new chunks, never by moving memory, so every
+ * node handed out stays valid until the arena is reset. Fields other than
+ * the statistics (@capacity through @large_count) are private.
  */
 struct json_diff_arena {
-	char *buf;
+	struct json_diff_arena_chunk *head;
+	struct json_diff_arena_chunk *cur;
+	struct json_diff_arena_chunk *large;
+	size_t chunk_size;
 	size_t capacity;
 	size_t offset;
+	size_t high_water;
+	size_t chunk_count;
+	size_t large_count;
 };
 
+/**
+ * struct json_diff_stats - Where diff calls spent their time and memory
+ * @calls: top-level diff calls that recorded here
+ * @total_ns: wall time of those calls
+ * @parse_ns: parsing or tokenizing JSON text (json_diff_str(),
+ *	json_diff_files())
+ * @hash_ns: hashing subtrees for hash_cache
+ * @index_ns: building object key indexes
+ * @script_ns: searching array edit scripts, with the element comparisons
+ *	that search makes
+ * @equal_calls: value comparisons made by the diff; each may recurse
+ * @key_indexes: object key indexes built
+ * @arrays: array edit scripts searched
+ * @fallbacks: arrays whose search hit max_edit_cost
+ * @max_d: largest edit distance (elements deleted plus inserted) of an
+ *	array script
+ * @bytes_allocated: work memory taken: scratch tables at their peak,
+ *	hash and token tables, edit search vectors and what the delta took
+ *	from the options' arena. Heap delta nodes are in @nodes_emitted
+ * @arena_high_water: largest high-water mark of the options' arena
+ * @nodes_emitted: nodes of the returned deltas
+ * @bytes_written: text produced by json_diff_write()
+ *
+ * Timings are monotonic nanoseconds. Counters add up across calls, so one
+ * struct can collect a batch or a session; zero it to measure a single
+ * call. @max_d and @arena_high_water keep the maximum. The phases exclude
+ * each other, but together they do not cover @total_ns, and with threads
+ * each worker's phase times are added separately.
+ */
+struct json_diff_stats {
+	uint64_t calls;
+	uint64_t total_ns;
+	uint64_t parse_ns;
+	uint64_t hash_ns;
+	uint64_t index_ns;
+	uint64_t script_ns;
+	uint64_t equal_calls;
+	uint64_t key_indexes;
+	uint64_t arrays;
+	uint64_t fallbacks;
+	uint64_t max_d;
+	uint64_t bytes_allocated;
+	uint64_t arena_high_water;
+	uint64_t nodes_emitted;
+	uint64_t bytes_written;
+};
+
+/**
+ * enum json_diff_array_engine - Edit script engine used for array diffs
+ * @JSON_DIFF_ARRAY_TRACE: Myers O(ND) keeping every V snapshot for the
+ *	backtrack; memory grows as O(D * (N + M))
+ * @JSON_DIFF_ARRAY_LINEAR: Myers divide-and-conquer (middle snake);
+ *	O(N + M) memory at roughly twice the comparisons
+ *
+ * Both engines emit the same jsondiffpatch array delta format.
+ */
+enum json_diff_array_engine {
+	JSON_DIFF_ARRAY_TRACE = 0,
+	JSON_DIFF_ARRAY_LINEAR,
+};
+
+/**
+ * enum json_diff_output - Who owns the values inside a diff
+ * @JSON_DIFF_OUTPUT_OWNED: old/new values are deep copies; the diff is
+ *	independent of the inputs
+ * @JSON_DIFF_OUTPUT_BORROWED: containers and strings are cJSON reference
+ *	nodes into the inputs; no subtree is copied. The diff is only valid
+ *	while both inputs are alive and unmodified
+ *
+ * Either way the diff is released with json_diff_free().
+ */
+enum json_diff_output {
+	JSON_DIFF_OUTPUT_OWNED = 0,
+	JSON_DIFF_OUTPUT_BORROWED,
+};
+
+/**
+ * typedef json_diff_object_hash_fn - Identity of an array element
+ * @item: array element
+ * @data: json_diff_options.object_hash_data
+ *
+ * Return: a node inside @item whose value identifies it (e.g. its "id"
+ * member), or NULL to match @item by its whole value
+ */
+typedef const cJSON *(*json_diff_object_hash_fn)(const cJSON *item,
+                                                 void *data);
+
+/**
+ * typedef json_diff_write_fn - Output callback of json_diff_write()
+ * @data: next chunk of delta text (not NUL-terminated)
+ * @len: length of @data
+ * @user: the pointer given to json_diff_write()
+ *
+ * Return: 0 to continue, non-zero to abort the write
+ */
+typedef int (*json_diff_write_fn)(const char *data, size_t len, void *user);
+
+/**
+ * typedef json_patch_read_fn - Input callback of json_patch_stream()
+ * @buf: where to store the next chunk of delta text
+ * @size: capacity of @buf
+ * @user: the pointer given to json_patch_stream()
+ *
+ * Return: number of bytes stored (at most @size), 0 at the end of the
+ * text, negative on error
+ */
+typedef ptrdiff_t (*json_patch_read_fn)(char *buf, size_t size, void *user);
+
 /**
  * struct json_diff_options - Options for JSON diffing
  * @strict_equality: use strict equality comparison for numbers
+ * @arena: optional arena for diff allocations (NULL for heap alloc); diff
+ *	nodes are built directly in the arena and must not be passed to
+ *	cJSON_Delete(). Each call appends to the arena, so one arena may only
+ *	be used by one thread at a time
+ * @array_engine: edit script engine for arrays (default trace)
+ * @hash_cache: hash every subtree of both inputs up front so equality
+ *	checks reject mismatching values without recursing
+ * @output: copy values into the diff or borrow them from the inputs
+ * @object_key: dot-separated key path (e.g. "id" or "meta.id") identifying
+ *	object elements of arrays, like jsondiffpatch's objectHash; elements
+ *	with the same identity are matched and diffed field by field. Elements
+ *	without the key match by value. NULL or "" disables
+ * @object_hash: callback computing element identities; overrides
+ *	@object_key
+ * @object_hash_data: opaque pointer handed to @object_hash
+ * @detect_moves: turn array deletions and insertions of equal elements
+ *	(equal identities with @object_key/@object_hash) into jsondiffpatch
+ *	moves, so reordering costs O(count) instead of O(payload)
+ * @max_input_size: largest JSON text json_diff_str() and json_diff_files()
+ *	accept, in bytes. 0 keeps the defaults: 1 MiB for strings, the 2 GiB
+ *	token offset limit for files
+ * @threads: diff the members of large objects (JSON_DIFF_PARALLEL_MIN_KEYS
+ *	and up) on this many threads, the caller's included; 0 or 1 runs
+ *	serially. The delta is the same either way. With @arena set each
+ *	worker fills an arena of its own that is merged into @arena before
+ *	returning. Ignored by json_diff_write() and in builds without threads
+ * @forward_only: put null in place of the old value of every change and
+ *	deletion, so no old subtree is copied or printed. The delta still
+ *	patches forward with json_patch(), but cannot be reversed or handed
+ *	to json_diff_compose()
+ * @max_edit_cost: largest edit distance (elements deleted plus inserted)
+ *	the Myers engines search for in one array; 0 for no limit. An array
+ *	that needs more is diffed by matching the elements that occur once
+ *	on each side instead, in O((N + M) log(N + M)). That delta is valid
+ *	but not minimal
+ * @inexact: if non-NULL, set to true when @max_edit_cost cut an array
+ *	diff short; never cleared. Like @arena it may only be used by one
+ *	call at a time
+ * @stats: if non-NULL, every call adds its counters and timings here (see
+ *	struct json_diff_stats); one call at a time, as with @arena. NULL
+ *	costs nothing beyond a pointer test
+ * @text_diff_min_length: when both sides of a string change are at least
+ *	this many bytes, write the change as a text diff [patch, 0, 2] like
+ *	jsondiffpatch's textDiff (diff-match-patch patch text) instead of
+ *	[old, new], provided the patch comes out shorter than the new
+ *	string. 0 disables. Such deltas patch with json_patch() but cannot
+ *	be reversed or handed to json_diff_compose()
+ * @include_paths: only diff what lies at or below these paths, given as
+ *	dot-separated patterns ("data.*.prices") whose segments match one
+ *	object key or array index each, '*' matching any run of characters
+ *	within a segment. Members off every pattern are never compared,
+ *	hashed or copied. Arrays on the way to a pattern pair their elements
+ *	by position (by identity with @object_key/@object_hash); a member or
+ *	element added or removed there is reported whole. NULL or no patterns
+ *	include everything; at most JSON_DIFF_MAX_PATHS are used
+ * @include_count: number of @include_paths
+ * @exclude_paths: leave out what lies at or below these paths, same
+ *	patterns as @include_paths; an exclusion wins over an inclusion
+ * @exclude_count: number of @exclude_paths
+ * @max_depth: levels of objects and arrays walked, the root being level
+ *	0; a container at level @max_depth that differs is reported whole as
+ *	[old, new]. 0 for no limit
  */
 struct json_diff_options {
-	/**
-	 * strict_equality - use strict equality comparison for numbers
-	 * arena: optional arena for diff allocations (NULL for heap alloc)
-	 */
 	bool strict_equality;
 	struct json_diff_arena *arena;
+	enum json_diff_array_engine array_engine;
+	bool hash_cache;
+	enum json_diff_output output;
+	const char *object_key;
+	json_diff_object_hash_fn object_hash;
+	void *object_hash_data;
+	bool detect_moves;
+	size_t max_input_size;
+	int threads;
+	bool forward_only;
+	int max_edit_cost;
+	bool *inexact;
+	struct json_diff_stats *stats;
+	size_t text_diff_min_length;
+	const char *const *include_paths;
+	size_t include_count;
+	const char *const *exclude_paths;
+	size_t exclude_count;
+	int max_depth;
 };
 
 #ifdef __cplusplus
@@ -41,11 +249,23 @@ extern "C" {
 /**
  * json_diff_arena_init - Initialize a diff allocation arena
  * @arena: arena struct to initialize
- * @initial_capacity: initial buffer size in bytes
+ * @initial_capacity: chunk size in bytes (0 for JSON_DIFF_ARENA_CHUNK_SIZE)
+ *
+ * The first chunk is allocated up front; further ones as the arena fills.
  */
 void json_diff_arena_init(struct json_diff_arena *arena,
                           size_t initial_capacity);
 
+/**
+ * json_diff_arena_reset - Release every diff allocated from an arena
+ * @arena: arena to rewind
+ *
+ * Keeps the chunk chain so the next json_diff() call reuses it without
+ * touching the allocator; only large blocks are returned to the heap.
+ * Diffs previously built in @arena become invalid.
+ */
+void json_diff_arena_reset(struct json_diff_arena *arena);
+
 /**
  * json_diff_arena_cleanup - Free resources held by a diff arena
  * @arena: arena struct to cleanup
@@ -60,30 +280,448 @@ void json_diff_arena_cleanup(struct json_diff_arena *arena);
  * @right: second JSON value (must not be NULL)
  * @opts: diff options (can be NULL for defaults)
  *
+ * The diff is released with json_diff_free() using the same @opts. With
+ * JSON_DIFF_OUTPUT_BORROWED it must be released before @left or @right
+ * are freed or modified.
+ *
  * Return: diff object or NULL if values are equal
  */
 cJSON *json_diff(const cJSON *left, const cJSON *right,
                  const struct json_diff_options *opts);
 
+/**
+ * json_diff_free - Release a diff returned by json_diff()
+ * @diff: diff to release (may be NULL)
+ * @opts: options the diff was created with (can be NULL for defaults)
+ *
+ * Frees only what the diff owns: borrowed input nodes are left alone, and
+ * arena diffs are left to json_diff_arena_reset().
+ */
+void json_diff_free(cJSON *diff, const struct json_diff_options *opts);
+
+/* Opaque state of a diff run a bounded amount of work at a time */
+struct json_diff_task;
+
+/**
+ * json_diff_begin - Start a diff that runs in steps
+ * @left: first JSON value
+ * @right: second JSON value
+ * @opts: diff options (can be NULL for defaults), copied into the task;
+ *	pointers in them, such as @opts->arena and @opts->stats, are kept
+ *
+ * The values must stay alive and unmodified until json_diff_end(). The
+ * task keeps its place in both documents on an explicit stack instead of
+ * the native one, so unlike json_diff() it has no nesting limit.
+ *
+ * Return: task to drive with json_diff_step() and release with
+ * json_diff_end(), or NULL if memory runs out
+ */
+struct json_diff_task *json_diff_begin(const cJSON *left, const cJSON *right,
+                                       const struct json_diff_options *opts);
+
+/**
+ * json_diff_step - Run a resumable diff for a bounded amount of work
+ * @task: task from json_diff_begin()
+ * @budget: units of work to run, roughly one per value compared or
+ *	member visited; 0 runs the diff to the end
+ *
+ * A step stops once @budget is used up, but does not split a few units
+ * that run whole: building the hash cache, building the key index of an
+ * object, aligning the elements of an array (its edit script and move
+ * pass) and copying a value into the delta. Nested diffs of the matched
+ * elements are ordinary steps again. Object members are diffed on the
+ * calling thread whatever @opts->threads says.
+ *
+ * Return: 1 if work remains, 0 when the diff is complete, -1 if @task is
+ * NULL or the diff failed (out of memory)
+ */
+int json_diff_step(struct json_diff_task *task, size_t budget);
+
+/**
+ * json_diff_end - Finish a resumable diff and release the task
+ * @task: task from json_diff_begin() (may be NULL)
+ *
+ * A task ended before json_diff_step() returned 0 drops what it built.
+ * The delta is the json_diff() one, released the same way: with
+ * json_diff_free() and the task's options. cJSON_Delete() itself still
+ * recurses, so a delta thousands of levels deep is best built in an arena.
+ *
+ * Return: the delta, or NULL if the values are equal, the diff did not
+ * complete or it failed
+ */
+cJSON *json_diff_end(struct json_diff_task *task);
+
+/**
+ * json_diff_write - Diff two values straight to JSON text
+ * @left: first JSON value
+ * @right: second JSON value
+ * @opts: diff options (can be NULL for defaults); arena and output are
+ *	ignored since no diff nodes are built
+ * @fn: receives the delta text in order, in chunks of up to a few KiB
+ * @user: opaque pointer handed to @fn
+ *
+ * Prints what cJSON_PrintUnformatted(json_diff(...)) would, but emits the
+ * text while the diff is computed instead of building a tree first.
+ *
+ * Return: 1 if a delta was written, 0 if the values are equal (nothing is
+ * written), -1 if @fn failed, an allocation failed or the input nests too
+ * deep; output already handed to @fn is then incomplete
+ */
+int json_diff_write(const cJSON *left, const cJSON *right,
+                    const struct json_diff_options *opts,
+                    json_diff_write_fn fn, void *user);
+
+/**
+ * json_diff_write_buf - Diff two values into a caller-supplied buffer
+ * @left: first JSON value
+ * @right: second JSON value
+ * @opts: diff options (can be NULL for defaults)
+ * @buf: destination, NUL-terminated on return when @size > 0 (may be NULL
+ *	when @size is 0)
+ * @size: capacity of @buf in bytes
+ * @needed: if non-NULL, receives the full text length without the NUL
+ *
+ * Like snprintf(), output that does not fit is cut off and @needed tells
+ * how large @buf would have had to be.
+ *
+ * Return: 1 if a delta was produced, 0 if the values are equal (@buf is
+ * empty), -1 on error
+ */
+int json_diff_write_buf(const cJSON *left, const cJSON *right,
+                        const struct json_diff_options *opts, char *buf,
+                        size_t size, size_t *needed);
+
 /**
  * json_patch - Apply a diff to a cJSON value
  * @original: original JSON value (must not be NULL)
  * @diff: diff to apply (must not be NULL)
  *
+ * The result is a new tree that shares nothing with @original or @diff;
+ * release it with cJSON_Delete().
+ *
  * Return: patched JSON value or NULL on failure
  */
 cJSON *json_patch(const cJSON *original, const cJSON *diff);
 
+/**
+ * json_patch_inplace - Apply a diff by modifying the target
+ * @target: JSON value to patch; ownership passes to the call
+ * @diff: diff to apply (must not be NULL)
+ *
+ * Only the paths @diff touches are rewritten; everything else in @target
+ * is kept as is. An object @diff names more than a few members of has its
+ * keys indexed once, so the cost is the size of the diff plus one pass
+ * over each such object. New values are copied out of @diff, which is
+ * left untouched and may be an arena or borrowed diff.
+ *
+ * Return: the patched value (@target itself unless the diff replaces the
+ * root, in which case @target is freed), or NULL on failure, in which case
+ * @target has been freed as well
+ */
+cJSON *json_patch_inplace(cJSON *target, const cJSON *diff);
+
+/**
+ * json_patch_str - Apply a delta given as JSON text, in place
+ * @target: JSON value to patch; ownership passes to the call
+ * @delta: NUL-terminated delta text, such as json_diff_write() prints;
+ *	empty or only whitespace for equal values
+ *
+ * Same as json_patch_inplace() with cJSON_Parse(@delta), but the text is
+ * read once, front to back, without building a tree of the delta: each
+ * member of an object delta is applied as soon as it is read, and only
+ * the values that end up in @target are built. See json_patch_stream()
+ * for what is still gathered first.
+ *
+ * Return: as json_patch_inplace(); NULL as well (with @target freed) if
+ * @delta does not parse
+ */
+cJSON *json_patch_str(cJSON *target, const char *delta);
+
+/**
+ * json_patch_stream - Apply delta text read from a callback, in place
+ * @target: JSON value to patch; ownership passes to the call
+ * @fn: supplies the delta text in chunks of any size until it returns 0
+ * @user: opaque pointer handed to @fn
+ *
+ * json_patch_str() over text that need not be in memory at once: extra
+ * memory follows the largest value the delta carries rather than the
+ * delta itself. Of an operation, the first element is built before its
+ * length shows whether it was an old value, so deltas without old values
+ * (forward_only) apply leanest. Array deltas, and deltas aimed at a value
+ * of another type, are gathered into a tree before they apply, since
+ * jsondiffpatch removes array elements before it inserts or changes any.
+ *
+ * Return: as json_patch_str(); NULL as well if @fn fails
+ */
+cJSON *json_patch_stream(cJSON *target, json_patch_read_fn fn, void *user);
+
+/**
+ * json_diff_rfc6902 - Compute the difference as a JSON Patch (RFC 6902)
+ * @left: first JSON value
+ * @right: second JSON value
+ * @opts: diff options (can be NULL for defaults); @opts->arena and
+ *	@opts->output decide where the operations and their values live, as
+ *	for json_diff(). @opts->forward_only is implied and
+ *	@opts->text_diff_min_length ignored
+ *
+ * The operations are "add", "remove", "replace" and, with
+ * @opts->detect_moves, "move". They apply in order, as RFC 6902
+ * requires: an array change becomes its removals from the highest index
+ * down, then the insertions by ascending final index, then the changes
+ * to elements in place.
+ *
+ * Return: array of operations, empty if the values are equal; NULL on
+ * error. Release with json_diff_free()
+ */
+cJSON *json_diff_rfc6902(const cJSON *left, const cJSON *right,
+                         const struct json_diff_options *opts);
+
+/**
+ * json_patch_rfc6902_inplace - Apply a JSON Patch (RFC 6902) in place
+ * @target: JSON value to patch; ownership passes to the call
+ * @patch: array of operations; all six of RFC 6902 are supported
+ *
+ * Paths are JSON Pointers (RFC 6901). A failed "test", a path that does
+ * not resolve or a malformed operation fails the whole patch.
+ *
+ * Return: the patched value (possibly a new root, if an operation
+ * targets ""), NULL on failure, in which case @target has been freed
+ */
+cJSON *json_patch_rfc6902_inplace(cJSON *target, const cJSON *patch);
+
+/**
+ * json_patch_rfc6902 - Apply a JSON Patch (RFC 6902) to a copy
+ * @original: JSON value to patch; left untouched
+ * @patch: array of operations
+ *
+ * Return: new patched value or NULL on failure
+ */
+cJSON *json_patch_rfc6902(const cJSON *original, const cJSON *patch);
+
 /**
  * json_diff_str - Parse two JSON strings and diff them in one call
  * @left: NUL-terminated JSON text (first)
  * @right: NUL-terminated JSON text (second)
  * @opts: diff options (can be NULL for defaults)
  *
+ * The parsed inputs are freed before returning, so the diff is always
+ * built with JSON_DIFF_OUTPUT_OWNED whatever @opts->output says.
+ *
  * Return: diff object or NULL if values are equal or on error
  */
 cJSON *json_diff_str(const char *left, const char *right,
                      const struct json_diff_options *opts);
+
+/**
+ * json_diff_files - Diff two JSON files without reading them into memory
+ * @path_a: first JSON file
+ * @path_b: second JSON file
+ * @opts: diff options (can be NULL for defaults); see @max_input_size
+ * @out: receives the diff (owned, as for json_diff_str()), NULL when the
+ *	files are equal or on error
+ *
+ * Both files are mapped read-only and tokenized in place, so no copy of
+ * the text is made; only the delta is allocated. The files must not be
+ * truncated while the call runs.
+ *
+ * Return: 1 if the files differ, 0 if they are equal, -1 if a file cannot
+ * be mapped (errno is set, EFBIG above @opts->max_input_size) or does not
+ * parse (errno is EINVAL). As with json_diff(), running out of memory
+ * while building the delta is not told apart from equality
+ */
+int json_diff_files(const char *path_a, const char *path_b,
+                    const struct json_diff_options *opts, cJSON **out);
+
+/* Opaque handle of a left document prepared for repeated diffs */
+struct json_diff_prepared;
+
+/**
+ * json_diff_prepare - Index a left document for diffing against many
+ * @left: baseline document; must stay alive and unmodified while the
+ *	handle is in use
+ * @opts: diff options (can be NULL for defaults), copied into the handle;
+ *	@opts->object_key, @opts->arena and @opts->object_hash_data are kept
+ *	as pointers
+ *
+ * Does once what every json_diff() against @left would redo: builds the
+ * key index of each object and the element and identity vectors of each
+ * array, and with @opts->hash_cache hashes every subtree of @left. The
+ * nodes are laid out in one contiguous array, level by level, so element
+ * vectors and sizes are read off without walking the linked lists.
+ *
+ * Return: handle released with json_diff_prepared_free(), or NULL if
+ * @left is NULL, nests too deep, has INT_MAX nodes or more, or memory
+ * runs out
+ */
+struct json_diff_prepared *
+json_diff_prepare(const cJSON *left, const struct json_diff_options *opts);
+
+/**
+ * json_diff_prepared - Diff a prepared left document against @right
+ * @prep: handle from json_diff_prepare()
+ * @right: second JSON value
+ *
+ * Same delta as json_diff(left, @right, opts) with the prepared options,
+ * released with json_diff_free() using those options. Calls on one handle
+ * may run concurrently as long as the options name no arena.
+ *
+ * Return: diff object or NULL if the values are equal
+ */
+cJSON *json_diff_prepared(const struct json_diff_prepared *prep,
+                          const cJSON *right);
+
+/**
+ * json_diff_prepared_batch - Diff a prepared left document against many
+ * @prep: handle from json_diff_prepare()
+ * @rights: documents to compare with the baseline
+ * @count: number of documents
+ * @diffs: receives json_diff_prepared(@prep, @rights[i]) in @diffs[i]
+ *
+ * With the prepared @threads option the documents are spread over that
+ * many threads; each document is then diffed serially. Arena diffs all
+ * end up in the prepared arena.
+ *
+ * Return: 0 on success, -1 if an argument is NULL
+ */
+int json_diff_prepared_batch(const struct json_diff_prepared *prep,
+                             const cJSON *const *rights, size_t count,
+                             cJSON **diffs);
+
+/**
+ * json_diff_prepared_free - Release a prepared document handle
+ * @prep: handle to release (may be NULL); the left document is not freed
+ */
+void json_diff_prepared_free(struct json_diff_prepared *prep);
+
+/* Opaque state of a document diffed version after version */
+struct json_diff_session;
+
+/**
+ * json_diff_session_new - Start diffing successive versions of a document
+ * @doc: first version, copied into the session
+ * @opts: diff options (can be NULL for defaults), copied; deltas are
+ *	always built with JSON_DIFF_OUTPUT_OWNED
+ *
+ * Return: session released with json_diff_session_free(), or NULL if
+ * @doc is NULL or memory runs out
+ */
+struct json_diff_session *
+json_diff_session_new(const cJSON *doc, const struct json_diff_options *opts);
+
+/**
+ * json_diff_session_next - Diff the next version against the previous one
+ * @s: session
+ * @next: new version; the session keeps a copy of what it needs
+ * @paths: JSON Pointers (RFC 6901, "" for the root) of everything that
+ *	changed since the previous version, or NULL if unknown
+ * @npaths: number of entries in @paths
+ *
+ * With @paths only the subtrees they name are compared, so the cost
+ * follows the size of the change rather than the document; anything
+ * outside them is taken to be unchanged. A path that steps into an array
+ * whose length changed diffs the whole array, and a malformed pointer,
+ * including a bad "~" escape, the whole document. Without @paths, or
+ * with path filters or max_depth in the options, the versions are diffed
+ * in full. Either way the session then patches its copy with the delta
+ * in place.
+ *
+ * The delta patches the previous version into @next like the json_diff()
+ * one, though its members may come in path order. Release it with
+ * json_diff_free() and the session's options.
+ *
+ * Return: delta, or NULL if nothing changed or on error (the session
+ * then restarts from a copy of @next)
+ */
+cJSON *json_diff_session_next(struct json_diff_session *s, const cJSON *next,
+                              const char *const *paths, size_t npaths);
+
+/**
+ * json_diff_session_doc - Current version held by a session
+ * @s: session
+ *
+ * Return: the session's copy of the last version, valid until the next
+ * json_diff_session_next() or json_diff_session_free()
+ */
+const cJSON *json_diff_session_doc(const struct json_diff_session *s);
+
+/**
+ * json_diff_session_free - Release a diff session
+ * @s: session to release (may be NULL)
+ */
+void json_diff_session_free(struct json_diff_session *s);
+
+/**
+ * json_diff_compose - Squash two consecutive deltas into one
+ * @d1: delta from version A to B (may be NULL for no change)
+ * @d2: delta from version B to C (may be NULL for no change)
+ * @out: receives the delta from A to C, NULL when the two cancel out;
+ *	release it with cJSON_Delete()
+ *
+ * Works on the deltas alone, in time linear in their size (with a log
+ * factor for array indices); no version of the document is built. Array
+ * deltas are combined by following every element the two deltas name to
+ * its final index, including moves. Values that only exist between the
+ * two deltas are recovered by patching what the deltas recorded. The
+ * inputs are left untouched and may be arena or borrowed diffs.
+ *
+ * Return: 0 on success, -1 if @d2 cannot follow @d1 (say, a nested diff
+ * of a value @d1 deleted), a delta is malformed or memory runs out
+ */
+int json_diff_compose(const cJSON *d1, const cJSON *d2, cJSON **out);
+
+/**
+ * enum json_diff_binary_flags - Flags of json_diff_encode_binary()
+ * @JSON_DIFF_BINARY_OMIT_OLD: leave out the old values of changes and
+ *	deletions; the encoding still patches forward, and decodes with null
+ *	in their place
+ */
+enum json_diff_binary_flags {
+	JSON_DIFF_BINARY_OMIT_OLD = 1 << 0,
+};
+
+/**
+ * json_diff_encode_binary - Serialize a delta in the compact binary format
+ * @diff: delta from json_diff() or any function producing one
+ * @flags: JSON_DIFF_BINARY_* flags
+ * @out: receives the encoding, released with free()
+ * @len: receives the length of @out in bytes
+ *
+ * Array indices are varints instead of "_12" style keys, every operation
+ * is a one byte tag without the [old, 0, 0] padding or "_t" markers, and
+ * each object key is stored once and referred to by number.
+ *
+ * Return: 0 on success, -1 if @diff is NULL or not a delta, @flags are
+ * unknown, it nests too deep or memory runs out
+ */
+int json_diff_encode_binary(const cJSON *diff, unsigned int flags,
+                            unsigned char **out, size_t *len);
+
+/**
+ * json_diff_decode_binary - Rebuild a delta from its binary encoding
+ * @buf: output of json_diff_encode_binary()
+ * @len: length of @buf
+ *
+ * Return: the delta, released with cJSON_Delete(), or NULL if @buf is
+ * malformed or memory runs out
+ */
+cJSON *json_diff_decode_binary(const unsigned char *buf, size_t len);
+
+/**
+ * json_patch_binary - Apply a binary encoded delta to a cJSON value
+ * @original: original JSON value (must not be NULL)
+ * @buf: output of json_diff_encode_binary()
+ * @len: length of @buf
+ *
+ * Same result as json_patch() with the decoded delta, but reads the
+ * operations straight from @buf: only the values that end up in the
+ * result are built, and skipped old values cost nothing.
+ *
+ * Return: patched JSON value, released with cJSON_Delete(), or NULL if
+ * @buf is malformed or memory runs out
+ */
+cJSON *json_patch_binary(const cJSON *original, const unsigned char *buf,
+                         size_t len);
+
 /**
  * json_value_equal - Compare two cJSON values for equality
  * @left: first value (can be NULL)
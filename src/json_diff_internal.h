@@ -0,0 +1,558 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+#ifndef JSON_DIFF_INTERNAL_H
+#define JSON_DIFF_INTERNAL_H
+
+#include "json_diff.h"
+#include "json_hash.h"
+#include "json_write.h"
+
+struct json_path_glob;
+struct key_index;
+
+/**
+ * struct json_diff_filter - Path filters of one call, compiled
+ * @include: include patterns split into segments
+ * @exclude: exclude patterns split into segments
+ * @ninclude: number of @include
+ * @nexclude: number of @exclude
+ * @max_depth: options' max_depth, 0 for no limit
+ * @mem: allocation holding the patterns
+ */
+struct json_diff_filter {
+	struct json_path_glob *include;
+	struct json_path_glob *exclude;
+	int ninclude;
+	int nexclude;
+	int max_depth;
+	void *mem;
+};
+
+/**
+ * struct json_diff_scope - Where a nested diff sits relative to the filters
+ * @include: bit i set while include pattern i matches the path so far
+ * @exclude: the same for exclude patterns
+ * @depth: nesting level, 0 at the root
+ * @selected: an include pattern matched the path or a prefix of it (or
+ *	there are no include patterns)
+ */
+struct json_diff_scope {
+	uint64_t include;
+	uint64_t exclude;
+	int depth;
+	bool selected;
+};
+
+struct json_diff_ctx;
+
+/**
+ * struct json_diff_sink - Receiver of a diff as edit operations
+ * @push: member @key of the object at hand is diffed next
+ * @pop: done with that member
+ * @change: the value at hand becomes @right; @left is NULL for an added
+ *	member, @right is NULL for a removed one
+ * @array: arrays @left and @right at hand differ by @delta, which lives
+ *	until the call returns; the sink diffs the elements @delta changes
+ *	in place with json_diff_sink_value() under @ctx
+ * @failed: set when nesting runs too deep; the sink may set it too
+ */
+struct json_diff_sink {
+	void (*push)(struct json_diff_sink *sink, const char *key);
+	void (*pop)(struct json_diff_sink *sink);
+	void (*change)(struct json_diff_sink *sink, const cJSON *left,
+	               const cJSON *right);
+	void (*array)(struct json_diff_sink *sink,
+	              const struct json_diff_ctx *ctx, const cJSON *left,
+	              const cJSON *right, const cJSON *delta);
+	bool failed;
+};
+
+/**
+ * struct json_diff_ctx - State shared by one top-level json_diff() call
+ * @opts: resolved options (never NULL)
+ * @hashes: subtree hash side table, NULL unless opts->hash_cache
+ * @scratch: call-local arena for temporary lookup tables, used as a stack
+ * @out: text sink for json_diff_write(), NULL when building nodes
+ * @sink: receiver of edit operations, NULL when building nodes
+ * @prep: tables of the left document from json_diff_prepare(), or NULL
+ * @task: resumable diff (json_diff_begin()) the call runs for, or NULL;
+ *	nested diffs of array elements are then queued on it, not recursed
+ * @filter: path filters while they still matter for the value being
+ *	diffed, NULL once nothing below it can be left out or cut off
+ * @scope: position of that value relative to @filter
+ *
+ * With @out set the delta is printed as it is found and no diff nodes
+ * exist: builders return NULL after writing their value, and whoever
+ * emits a member writes its key first. A member is only started once its
+ * values are known to differ, so the diff of a subtree is never empty.
+ * With @sink set the same holds, except that builders hand their op to
+ * the sink and member keys are pushed to it; only array deltas are built,
+ * one array at a time.
+ */
+struct json_diff_ctx {
+	const struct json_diff_options *opts;
+	const struct json_hash_cache *hashes;
+	struct json_diff_arena *scratch;
+	struct json_writer *out;
+	struct json_diff_sink *sink;
+	const struct json_diff_prepared *prep;
+	struct json_diff_task *task;
+	const struct json_diff_filter *filter;
+	struct json_diff_scope scope;
+};
+
+/*
+ * Diff node builders. With a non-NULL @arena nodes are carved from the arena
+ * and must never be passed to cJSON_Delete(); with NULL they are regular
+ * heap nodes. diff_delete() is a no-op for arena nodes.
+ */
+cJSON *diff_new_object(struct json_diff_arena *arena);
+cJSON *diff_new_array(struct json_diff_arena *arena);
+cJSON *diff_new_null(struct json_diff_arena *arena);
+cJSON *diff_new_bool(struct json_diff_arena *arena, bool value);
+cJSON *diff_new_number(struct json_diff_arena *arena, double value);
+cJSON *diff_new_string(struct json_diff_arena *arena, const char *value);
+bool diff_add_item(struct json_diff_arena *arena, cJSON *parent, cJSON *item);
+bool diff_add_item_to_object(struct json_diff_arena *arena, cJSON *parent,
+                             const char *key, cJSON *item);
+void diff_delete(struct json_diff_arena *arena, cJSON *item);
+
+/* A value slot of a delta: deep copy, or a reference in borrowed mode */
+cJSON *diff_value(const struct json_diff_ctx *ctx, const cJSON *v);
+
+
+/*
+ * create_{change,addition,deletion}_array() honouring the context's arena
+ * and output mode; diff_move_array() builds a move op ["", dest, 3]. In
+ * writer mode they print the op and return NULL, in sink mode they hand
+ * it to the sink. diff_change_array() writes a text diff [patch, 0, 2]
+ * for long strings when the options ask for one; diff_text_array()
+ * builds that op in @arena.
+ */
+cJSON *diff_change_array(const struct json_diff_ctx *ctx, const cJSON *old_val,
+                         const cJSON *new_val);
+cJSON *diff_addition_array(const struct json_diff_ctx *ctx,
+                           const cJSON *new_val);
+cJSON *diff_deletion_array(const struct json_diff_ctx *ctx,
+                           const cJSON *old_val);
+cJSON *diff_move_array(const struct json_diff_ctx *ctx, int dest);
+cJSON *diff_text_array(struct json_diff_arena *arena, const char *patch);
+
+/**
+ * json_diff_stats_clock - Monotonic time for struct json_diff_stats
+ * @stats: stats being recorded, or NULL
+ *
+ * Return: nanoseconds, 0 without @stats so untimed calls skip the clock
+ */
+uint64_t json_diff_stats_clock(const struct json_diff_stats *stats);
+
+/**
+ * json_diff_stats_add - Fold one set of stats into another
+ * @dst: stats to add to
+ * @src: stats of, e.g., a worker thread
+ */
+void json_diff_stats_add(struct json_diff_stats *dst,
+                         const struct json_diff_stats *src);
+
+/**
+ * json_diff_ctx_hash - Cached structural hash of a node
+ * @ctx: diff context
+ * @node: node of either input
+ * @hash: receives the hash
+ *
+ * Looks in the call's hash cache and the prepared baseline's.
+ *
+ * Return: true if @node was hashed up front
+ */
+bool json_diff_ctx_hash(const struct json_diff_ctx *ctx, const cJSON *node,
+                        uint64_t *hash);
+
+/**
+ * json_diff_ctx_equal - Equality check with hash-based early reject
+ * @ctx: diff context
+ * @left: first value
+ * @right: second value
+ *
+ * Return: same result as json_value_equal() with ctx's strictness
+ */
+bool json_diff_ctx_equal(const struct json_diff_ctx *ctx, const cJSON *left,
+                         const cJSON *right);
+
+/**
+ * json_diff_ctx_diff - Recursive diff entry point for nested values
+ * @ctx: diff context of the running top-level call
+ * @left: first JSON value
+ * @right: second JSON value
+ *
+ * Return: diff object or NULL if values are equal
+ */
+cJSON *json_diff_ctx_diff(const struct json_diff_ctx *ctx, const cJSON *left,
+                          const cJSON *right);
+
+/**
+ * json_diff_sink_run - Diff two values into a sink
+ * @left: first JSON value
+ * @right: second JSON value
+ * @opts: diff options (must not be NULL); array deltas live in opts->arena
+ * @sink: receiver of the operations
+ *
+ * Return: 1 if the values differ, 0 if they are equal, -1 if the path
+ * filters do not compile or nesting is too deep
+ */
+int json_diff_sink_run(const cJSON *left, const cJSON *right,
+                       const struct json_diff_options *opts,
+                       struct json_diff_sink *sink);
+
+/**
+ * json_diff_sink_value - Diff elements of an array handed to a sink
+ * @ctx: context the sink's @array was called with
+ * @key: array index of the elements in decimal
+ * @left: left element
+ * @right: right element
+ */
+void json_diff_sink_value(const struct json_diff_ctx *ctx, const char *key,
+                          const cJSON *left, const cJSON *right);
+
+/**
+ * json_diff_ctx_enter - Context for a member or element of the value
+ * @ctx: context of the value being diffed
+ * @key: member key, or array index in decimal
+ * @buf: storage for a context with the nested scope
+ *
+ * Return: @ctx itself without filters, @buf set up for the nested value,
+ * or NULL if the filters leave it out
+ */
+const struct json_diff_ctx *json_diff_ctx_enter(const struct json_diff_ctx *ctx,
+                                                const char *key,
+                                                struct json_diff_ctx *buf);
+
+/**
+ * json_diff_ctx_pruned - Do the filters leave out anything below the value
+ * @ctx: diff context
+ *
+ * Pruned values must not be compared whole; arrays pair their elements by
+ * position or identity instead of by value.
+ *
+ * Return: true if some member below may be left out
+ */
+bool json_diff_ctx_pruned(const struct json_diff_ctx *ctx);
+
+/**
+ * json_diff_scoped_equal - Equality of what the filters keep
+ * @ctx: diff context of @left and @right
+ * @left: first value
+ * @right: second value
+ *
+ * Like json_diff_ctx_equal(), but members the filters leave out are not
+ * looked at and array elements pair by position.
+ *
+ * Return: true if the diff of @left and @right would be empty
+ */
+bool json_diff_scoped_equal(const struct json_diff_ctx *ctx,
+                            const cJSON *left, const cJSON *right);
+
+/**
+ * json_diff_task_defer - Queue a nested element diff on a resumable diff
+ * @ctx: diff context with @ctx->task set
+ * @diff_obj: array delta being built
+ * @key: member key of the nested diff
+ * @left: left element
+ * @right: right element
+ *
+ * Adds a placeholder member at @key now so the delta keeps its order; the
+ * task later swaps in the diff of @left and @right, or drops the member
+ * when they are equal.
+ */
+void json_diff_task_defer(const struct json_diff_ctx *ctx, cJSON *diff_obj,
+                          const char *key, const cJSON *left,
+                          const cJSON *right);
+
+/**
+ * json_myers_array_diff_ctx - Array diff within a running diff context
+ * @left: first array
+ * @right: second array
+ * @ctx: diff context
+ *
+ * Return: jsondiffpatch array delta or NULL if arrays are equal
+ */
+cJSON *json_myers_array_diff_ctx(const cJSON *left, const cJSON *right,
+                                 const struct json_diff_ctx *ctx);
+
+/**
+ * json_patch_node - Apply @diff to @target, reusing it wherever possible
+ * @target: value to patch (consumed when a different node is returned)
+ * @diff: delta for this value
+ * @failed: set on allocation failure, excessive nesting or a text diff
+ *	that does not match its string
+ *
+ * The step json_patch_inplace() repeats at every level; @target may be
+ * linked into a parent, which the caller then points at the result.
+ *
+ * Return: the patched value, which is @target unless the delta replaces it
+ */
+cJSON *json_patch_node(cJSON *target, const cJSON *diff, bool *failed);
+
+/**
+ * struct json_patch_members - Member lookup while patching one object
+ * @object: object being patched
+ * @lookups: lookups made so far
+ * @keys: key index of @object, built at the JSON_PATCH_INDEX_MIN-th lookup
+ * @mem: memory of @keys
+ *
+ * A delta naming a few members is served by scanning @object; past that
+ * the keys are indexed once, so patching k members of an n-member object
+ * costs O(n + k) rather than O(n * k). Members must be replaced and
+ * deleted through the helpers below while @keys may exist. Members added
+ * afterwards are not indexed, as a delta names each key once.
+ */
+struct json_patch_members {
+	cJSON *object;
+	int lookups;
+	struct key_index *keys;
+	struct json_diff_arena mem;
+};
+
+void json_patch_members_init(struct json_patch_members *m, cJSON *object);
+
+/* Member @key of the object, NULL if it has none */
+cJSON *json_patch_members_get(struct json_patch_members *m, const char *key);
+
+/* Swap @val in for member @cur, handing over cur's key without a copy */
+void json_patch_members_replace(struct json_patch_members *m, cJSON *cur,
+                                cJSON *val);
+
+/* Remove and free member @cur */
+void json_patch_members_delete(struct json_patch_members *m, cJSON *cur);
+
+void json_patch_members_free(struct json_patch_members *m);
+
+/*
+ * Array deltas apply in jsondiffpatch order: deletions and move sources
+ * leave by original index, additions and move targets enter by ascending
+ * final index, then changes and nested diffs apply at final indices.
+ * patch_array_inplace(), the binary delta and JSON Patch output share the
+ * placement below; each reads its own delta format into it.
+ */
+enum { JSON_ARRAY_KEEP, JSON_ARRAY_DELETE, JSON_ARRAY_MOVE };
+
+/**
+ * struct json_array_insert - Element entering a patched array
+ * @index: final index
+ * @seq: delta order, keeps the sort stable
+ * @from: original index of a moved element, -1 for an addition
+ * @entry: delta entry of an addition, NULL for formats other than cJSON
+ */
+struct json_array_insert {
+	int index;
+	int seq;
+	int from;
+	const cJSON *entry;
+};
+
+/* Non-negative array delta index ("12", or "_12" with @skip 1), else -1 */
+int json_array_delta_index(const char *key, int skip);
+
+/**
+ * json_array_delta_scan - Removals and insertions of a cJSON array delta
+ * @diff: array delta
+ * @n: length of the array it applies to
+ * @gone: @n zeroed bytes; receives JSON_ARRAY_DELETE or JSON_ARRAY_MOVE
+ *	for each original element that leaves
+ * @ins: room for one entry per member of @diff; receives the additions
+ *	and move targets
+ *
+ * Return: number of @ins
+ */
+size_t json_array_delta_scan(const cJSON *diff, size_t n, unsigned char *gone,
+                             struct json_array_insert *ins);
+
+/**
+ * json_array_place - Final order of a patched array
+ * @gone: per original element, nonzero if it leaves
+ * @n: original length
+ * @ins: insertions, sorted here by final index
+ * @nins: number of @ins
+ * @place: room for @n + @nins entries; receives per final index the
+ *	original index of the element kept there, or -1 - j for @ins[j]
+ *
+ * Return: final length
+ */
+size_t json_array_place(const unsigned char *gone, size_t n,
+                        struct json_array_insert *ins, size_t nins,
+                        int *place);
+
+/**
+ * json_array_relink - Rebuild @array's children from a final order
+ * @array: patched array
+ * @orig: its original children
+ * @gone: as for json_array_place(); deleted elements are freed
+ * @n: number of @orig
+ * @final: children in final order
+ * @nf: number of @final
+ */
+void json_array_relink(cJSON *array, cJSON *const *orig,
+                       const unsigned char *gone, size_t n,
+                       cJSON *const *final, size_t nf);
+
+/**
+ * json_pointer_token - Decode one JSON Pointer (RFC 6901) reference token
+ * @p: the token's leading '/'; moved to the next '/' or @end
+ * @end: end of the pointer
+ * @buf: room for @end - *@p bytes; receives the token, NUL-terminated
+ *
+ * Return: false for a "~" not followed by "0" or "1"
+ */
+bool json_pointer_token(const char **p, const char *end, char *buf);
+
+/* Array index token: digits without leading zeros, -1 otherwise */
+int json_pointer_index(const char *tok);
+
+/**
+ * json_text_diff - Patch text turning one long string into another
+ * @left: old string
+ * @right: new string
+ * @opts: options; text_diff_min_length decides, the engine and edit cost
+ *	settings shape the script
+ *
+ * Return: malloc()ed diff-match-patch patch text for a [patch, 0, 2] op,
+ * or NULL when a whole [old, new] change should be written instead: one
+ * side is shorter than opts->text_diff_min_length, either is not valid
+ * UTF-8, the patch would be no shorter than @right, or memory ran out
+ */
+char *json_text_diff(const char *left, const char *right,
+                     const struct json_diff_options *opts);
+
+/**
+ * json_text_patch - Apply patch text from json_text_diff() or jsondiffpatch
+ * @text: string to patch
+ * @patch: diff-match-patch patch text
+ *
+ * Hunks must match @text exactly where they say they apply.
+ *
+ * Return: cJSON_malloc()ed result, NULL if @patch is malformed, does not
+ * match or memory ran out
+ */
+char *json_text_patch(const char *text, const char *patch);
+
+/* A text diff op [patch, 0, 2] */
+bool diff_is_text_op(const cJSON *d);
+
+/**
+ * json_text_patch_node - Apply patch text to a string node in place
+ * @target: string node; its valuestring is replaced
+ * @patch: diff-match-patch patch text
+ *
+ * Return: false if @target is not a string or json_text_patch() fails,
+ * leaving @target untouched
+ */
+bool json_text_patch_node(cJSON *target, const char *patch);
+
+/**
+ * json_diff_text - Diff two JSON texts with an owned result
+ * @left: NUL-terminated JSON text, at most JSMN_MAX_TEXT bytes
+ * @right: NUL-terminated JSON text, at most JSMN_MAX_TEXT bytes
+ * @opts: diff options (can be NULL); output is forced to owned
+ * @out: receives the diff, NULL if the values are equal
+ *
+ * Shared by json_diff_str() and json_diff_files(), which check their
+ * size limits first. Uses the token backend when it supports @opts.
+ *
+ * Return: 0 on success, -1 if either text does not parse
+ */
+int json_diff_text(const char *left, const char *right,
+                   const struct json_diff_options *opts, cJSON **out);
+
+/**
+ * json_diff_prepared_array - Element vectors of a prepared left array
+ * @prep: prepared baseline
+ * @array: array node of the baseline document
+ * @elems: receives the elements, in order
+ * @ids: receives the element identities (@elems itself when unkeyed)
+ * @count: receives the number of elements
+ *
+ * Return: true if @array belongs to @prep
+ */
+bool json_diff_prepared_array(const struct json_diff_prepared *prep,
+                              const cJSON *array, cJSON ***elems,
+                              cJSON ***ids, int *count);
+
+/**
+ * json_myers_element_ids - Identities of array elements
+ * @opts: options naming object_key or object_hash
+ * @elems: elements
+ * @n: number of elements
+ * @ids: receives the identity of each element (the element itself when
+ *	it has none)
+ */
+void json_myers_element_ids(const struct json_diff_options *opts,
+                            cJSON **elems, int n, cJSON **ids);
+
+/* Edit script segment of an array diff; positions index left and right */
+enum { MYERS_EQUAL = 0, MYERS_INS = 1, MYERS_DEL = 2 };
+
+struct myers_seg {
+	int type;
+	int a_start;
+	int b_start;
+	int len;
+};
+
+/**
+ * json_myers_script_ids - Edit script over element equivalence classes
+ * @ia: class id of every left element (equal ids mean equal elements)
+ * @N: number of left elements
+ * @ib: class id of every right element
+ * @M: number of right elements
+ * @opts: engine, edit cost budget and inexact flag to honour
+ * @segs: receives the malloc()ed script, in order and absolute positions
+ * @count: receives the number of segments
+ *
+ * Lets backends that do not hold cJSON trees share the SES engines.
+ *
+ * Return: 1 on success, 0 on allocation failure
+ */
+int json_myers_script_ids(const int *ia, int N, const int *ib, int M,
+                          const struct json_diff_options *opts,
+                          struct myers_seg **segs, int *count);
+
+/* Does @opts ask for include/exclude paths or a depth limit */
+bool json_diff_filtering(const struct json_diff_options *opts);
+
+/**
+ * json_diff_filter_init - Compile the path filters of @opts
+ * @f: filter to set up; release with json_diff_filter_free()
+ * @opts: options with the patterns, which must outlive @f
+ *
+ * Return: false on allocation failure
+ */
+bool json_diff_filter_init(struct json_diff_filter *f,
+                           const struct json_diff_options *opts);
+
+void json_diff_filter_free(struct json_diff_filter *f);
+
+/**
+ * json_diff_filter_root - Scope of the root value
+ * @f: compiled filter
+ * @root: receives the scope
+ *
+ * Return: false if an exclude pattern is "", which leaves out everything
+ */
+bool json_diff_filter_root(const struct json_diff_filter *f,
+                           struct json_diff_scope *root);
+
+/**
+ * json_diff_scope_step - Scope of a member or element
+ * @f: compiled filter
+ * @parent: scope of the object or array
+ * @key: member key, or array index in decimal
+ * @child: receives the scope of the member
+ *
+ * Return: false if the filters leave the member out
+ */
+bool json_diff_scope_step(const struct json_diff_filter *f,
+                          const struct json_diff_scope *parent,
+                          const char *key, struct json_diff_scope *child);
+
+/* Nothing at or below @scope is left out by the path patterns */
+bool json_diff_scope_whole(const struct json_diff_scope *scope);
+
+#endif /* JSON_DIFF_INTERNAL_H */
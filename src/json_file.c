@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: Apache-2.0
+#define _DEFAULT_SOURCE
+#include "jsmn_tree.h"
+#include "json_diff_internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * struct mapped_text - A file mapped as a NUL-terminated string
+ * @text: first byte of the file
+ * @map_len: bytes mapped at @text, at least one past the file's end
+ */
+struct mapped_text {
+	char *text;
+	size_t map_len;
+};
+
+/*
+ * Map @fd read-only. The tokenizer wants a NUL after the last byte: the
+ * kernel zero-fills the tail of the file's last page, and when the file
+ * ends exactly on a page boundary the mapping is placed in front of an
+ * anonymous zero page reserved for it.
+ */
+static int map_fd(int fd, size_t limit, struct mapped_text *m)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		return -1;
+	if (!S_ISREG(st.st_mode) || st.st_size <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ((uintmax_t)st.st_size > limit) {
+		errno = EFBIG;
+		return -1;
+	}
+
+	size_t len = (size_t)st.st_size;
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	void *base;
+	if (len % page) {
+		m->map_len = len;
+		base = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	} else {
+		m->map_len = len + page;
+		base = mmap(NULL, m->map_len, PROT_READ,
+		            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base != MAP_FAILED &&
+		    mmap(base, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+		        MAP_FAILED) {
+			int err = errno;
+			munmap(base, m->map_len);
+			errno = err;
+			base = MAP_FAILED;
+		}
+	}
+	if (base == MAP_FAILED)
+		return -1;
+	/* Tokenizing touches every page; start reading them in now */
+	posix_madvise(base, len, POSIX_MADV_WILLNEED);
+	m->text = base;
+	return 0;
+}
+
+static int map_text(const char *path, size_t limit, struct mapped_text *m)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	int ret = map_fd(fd, limit, m);
+	int err = errno;
+	close(fd);
+	errno = err;
+	return ret;
+}
+
+static void unmap_text(struct mapped_text *m)
+{
+	if (m->text)
+		munmap(m->text, m->map_len);
+	m->text = NULL;
+}
+
+int json_diff_files(const char *path_a, const char *path_b,
+                    const struct json_diff_options *opts, cJSON **out)
+{
+	struct mapped_text a = {0}, b = {0};
+	int ret = -1;
+
+	if (!out) {
+		errno = EINVAL;
+		return -1;
+	}
+	*out = NULL;
+	if (!path_a || !path_b) {
+		errno = EINVAL;
+		return -1;
+	}
+	size_t limit = opts && opts->max_input_size ? opts->max_input_size
+	                                            : JSMN_MAX_TEXT;
+	if (limit > JSMN_MAX_TEXT)
+		limit = JSMN_MAX_TEXT;
+
+	if (map_text(path_a, limit, &a) == 0 &&
+	    map_text(path_b, limit, &b) == 0) {
+		if (json_diff_text(a.text, b.text, opts, out) == 0)
+			ret = *out ? 1 : 0;
+		else
+			errno = EINVAL;
+	}
+	int err = errno;
+	unmap_text(&b);
+	unmap_text(&a);
+	errno = err;
+	return ret;
+}
@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "json_diff_internal.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Path filters of json_diff_options. A pattern is a dot-separated path
+ * like "data.*.prices" whose segments match one object key or array index
+ * each; '*' in a segment matches any run of characters. Patterns are split
+ * into segments once per call. A scope keeps a bit per pattern that has
+ * matched every segment down to it, so entering a member tests only the
+ * live patterns, and only against the member's own segment.
+ */
+
+struct json_path_seg {
+	const char *text;
+	size_t len;
+};
+
+struct json_path_glob {
+	const struct json_path_seg *segs;
+	int count;
+};
+
+static int glob_segments(const char *p)
+{
+	int n = 1;
+	for (; *p; p++)
+		n += *p == '.';
+	return n;
+}
+
+/* Split @p at its dots into @segs; "" has no segments at all */
+static int glob_split(const char *p, struct json_path_seg *segs)
+{
+	if (!*p)
+		return 0;
+	int n = 0;
+	for (;;) {
+		const char *dot = strchr(p, '.');
+		size_t len = dot ? (size_t)(dot - p) : strlen(p);
+		segs[n++] = (struct json_path_seg){p, len};
+		if (!dot)
+			return n;
+		p = dot + 1;
+	}
+}
+
+/* Does @seg match all of @s? '*' backtracks to its last position only */
+static bool seg_match(const struct json_path_seg *seg, const char *s,
+                      size_t n)
+{
+	const char *p = seg->text;
+	size_t pl = seg->len, pi = 0, si = 0, star = SIZE_MAX, mark = 0;
+	while (si < n) {
+		if (pi < pl && p[pi] == '*') {
+			star = pi++;
+			mark = si;
+		} else if (pi < pl && p[pi] == s[si]) {
+			pi++;
+			si++;
+		} else if (star != SIZE_MAX) {
+			pi = star + 1;
+			si = ++mark;
+		} else {
+			return false;
+		}
+	}
+	while (pi < pl && p[pi] == '*')
+		pi++;
+	return pi == pl;
+}
+
+bool json_diff_filtering(const struct json_diff_options *opts)
+{
+	return opts->include_count || opts->exclude_count ||
+	       opts->max_depth > 0;
+}
+
+bool json_diff_filter_init(struct json_diff_filter *f,
+                           const struct json_diff_options *opts)
+{
+	size_t ni = opts->include_paths ? opts->include_count : 0;
+	size_t ne = opts->exclude_paths ? opts->exclude_count : 0;
+	if (ni > JSON_DIFF_MAX_PATHS)
+		ni = JSON_DIFF_MAX_PATHS;
+	if (ne > JSON_DIFF_MAX_PATHS)
+		ne = JSON_DIFF_MAX_PATHS;
+	*f = (struct json_diff_filter){.ninclude = (int)ni,
+	                               .nexclude = (int)ne,
+	                               .max_depth = opts->max_depth > 0
+	                                                ? opts->max_depth
+	                                                : 0};
+
+	size_t nsegs = 0;
+	for (size_t i = 0; i < ni; i++)
+		if (opts->include_paths[i])
+			nsegs += (size_t)glob_segments(opts->include_paths[i]);
+	for (size_t i = 0; i < ne; i++)
+		if (opts->exclude_paths[i])
+			nsegs += (size_t)glob_segments(opts->exclude_paths[i]);
+	size_t globs = (ni + ne) * sizeof(struct json_path_glob);
+	f->mem = malloc(globs + nsegs * sizeof(struct json_path_seg) + 1);
+	if (!f->mem)
+		return false;
+	f->include = f->mem;
+	f->exclude = f->include + ni;
+
+	struct json_path_seg *segs =
+	    (struct json_path_seg *)(void *)((char *)f->mem + globs);
+	for (size_t i = 0; i < ni + ne; i++) {
+		const char *p = i < ni ? opts->include_paths[i]
+		                       : opts->exclude_paths[i - ni];
+		struct json_path_glob *g = &f->include[i];
+		if (!p) {
+			/* Matches nothing; json_diff_filter_root() skips it */
+			*g = (struct json_path_glob){NULL, -1};
+			continue;
+		}
+		g->segs = segs;
+		g->count = glob_split(p, segs);
+		segs += g->count;
+	}
+	return true;
+}
+
+void json_diff_filter_free(struct json_diff_filter *f)
+{
+	free(f->mem);
+	f->mem = NULL;
+}
+
+bool json_diff_filter_root(const struct json_diff_filter *f,
+                           struct json_diff_scope *root)
+{
+	*root = (struct json_diff_scope){.selected = !f->ninclude};
+	for (int i = 0; i < f->nexclude; i++) {
+		if (f->exclude[i].count < 0)
+			continue;
+		if (!f->exclude[i].count)
+			return false;
+		root->exclude |= UINT64_C(1) << i;
+	}
+	for (int i = 0; !root->selected && i < f->ninclude; i++) {
+		if (f->include[i].count < 0)
+			continue;
+		if (!f->include[i].count)
+			root->selected = true;
+		else
+			root->include |= UINT64_C(1) << i;
+	}
+	if (root->selected)
+		root->include = 0;
+	return true;
+}
+
+bool json_diff_scope_step(const struct json_diff_filter *f,
+                          const struct json_diff_scope *parent,
+                          const char *key, struct json_diff_scope *child)
+{
+	int level = parent->depth;
+	size_t len = strlen(key);
+	*child = (struct json_diff_scope){.depth = level + 1,
+	                                  .selected = parent->selected};
+	for (int i = 0; i < f->nexclude; i++) {
+		const struct json_path_glob *g = &f->exclude[i];
+		if (!(parent->exclude >> i & 1) ||
+		    !seg_match(&g->segs[level], key, len))
+			continue;
+		if (g->count == level + 1)
+			return false;
+		child->exclude |= UINT64_C(1) << i;
+	}
+	if (child->selected)
+		return true;
+	for (int i = 0; i < f->ninclude; i++) {
+		const struct json_path_glob *g = &f->include[i];
+		if (!(parent->include >> i & 1) ||
+		    !seg_match(&g->segs[level], key, len))
+			continue;
+		if (g->count == level + 1) {
+			child->selected = true;
+			child->include = 0;
+			return true;
+		}
+		child->include |= UINT64_C(1) << i;
+	}
+	return child->include != 0;
+}
+
+bool json_diff_scope_whole(const struct json_diff_scope *scope)
+{
+	return scope->selected && !scope->exclude;
+}
@@ -0,0 +1,301 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "json_hash.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* splitmix64 finalizer */
+static uint64_t mix64(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+static uint64_t hash_bytes(const char *s, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL; /* FNV-1a */
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 0x100000001b3ULL;
+	}
+	return mix64(h ^ len);
+}
+
+uint64_t json_hash_mix(uint64_t x)
+{
+	return mix64(x);
+}
+
+uint64_t json_hash_bytes(const char *s, size_t len)
+{
+	return hash_bytes(s, len);
+}
+
+uint64_t json_hash_key(const char *key)
+{
+	return hash_bytes(key, strlen(key));
+}
+
+static size_t slot_of(const cJSON *node, size_t mask)
+{
+	return (size_t)mix64((uint64_t)(uintptr_t)node) & mask;
+}
+
+static void cache_put(struct json_hash_cache *cache, const cJSON *node,
+                      uint64_t h, size_t len)
+{
+	size_t i = slot_of(node, cache->mask);
+	while (cache->nodes[i] && cache->nodes[i] != node)
+		i = (i + 1) & cache->mask;
+	if (!cache->nodes[i])
+		cache->count++;
+	cache->nodes[i] = node;
+	cache->hashes[i] = h;
+	cache->lengths[i] = len;
+}
+
+/*
+ * The tree walks below keep an explicit stack of the containers they are
+ * inside, on the C stack while shallow and on the heap beyond that, so
+ * document depth never turns into native recursion. Only when the heap
+ * stack cannot grow does a walk recurse on the subtree it is entering.
+ */
+#define WALK_LOCAL_DEPTH 32
+
+static bool walk_grow(void **stack, size_t *cap, size_t size, void *local)
+{
+	void *s = malloc(*cap * 2 * size);
+	if (!s)
+		return false;
+	memcpy(s, *stack, *cap * size);
+	if (*stack != local)
+		free(*stack);
+	*stack = s;
+	*cap *= 2;
+	return true;
+}
+
+static size_t count_nodes(const cJSON *node)
+{
+	/* Each level holds the next sibling still to be counted */
+	const cJSON *local[WALK_LOCAL_DEPTH];
+	void *stack = local;
+	size_t cap = WALK_LOCAL_DEPTH, depth = 0, n = 1;
+	if (node->child)
+		local[depth++] = node->child;
+	while (depth) {
+		const cJSON **level = (const cJSON **)stack;
+		const cJSON *cur = level[depth - 1];
+		if (!cur) {
+			depth--;
+			continue;
+		}
+		level[depth - 1] = cur->next;
+		n++;
+		if (!cur->child)
+			continue;
+		if (depth < cap ||
+		    walk_grow(&stack, &cap, sizeof(*local), local))
+			((const cJSON **)stack)[depth++] = cur->child;
+		else
+			n += count_nodes(cur) - 1;
+	}
+	if (stack != (void *)local)
+		free(stack);
+	return n;
+}
+
+static bool is_container(const cJSON *node)
+{
+	int type = node->type & 0xFF;
+	return type == cJSON_Array || type == cJSON_Object;
+}
+
+/* Hash of a scalar; @len receives the string length or SIZE_MAX */
+static uint64_t hash_leaf(const cJSON *node, bool strict, size_t *len)
+{
+	int type = node->type & 0xFF;
+	uint64_t h = mix64((uint64_t)(unsigned)type + 1);
+	*len = SIZE_MAX;
+	if (type == cJSON_Number && strict) {
+		double d = node->valuedouble;
+		uint64_t bits;
+		if (d == 0)
+			d = 0; /* -0.0 == 0.0 */
+		memcpy(&bits, &d, sizeof(bits));
+		h = mix64(h ^ bits);
+	} else if (type == cJSON_String && node->valuestring) {
+		*len = strlen(node->valuestring);
+		h ^= hash_bytes(node->valuestring, *len);
+	}
+	return h;
+}
+
+/*
+ * A container being hashed: array elements are chained in order, object
+ * members combined order-independently with their keys.
+ */
+struct hash_frame {
+	const cJSON *node;
+	const cJSON *child; /* next child to fold in */
+	uint64_t h, sum, n;
+};
+
+static struct hash_frame hash_open(const cJSON *node)
+{
+	uint64_t h = mix64((uint64_t)(unsigned)(node->type & 0xFF) + 1);
+	return (struct hash_frame){node, node->child, h, 0, 0};
+}
+
+static void hash_fold(struct hash_frame *f, const cJSON *ch, uint64_t ch_h)
+{
+	if ((f->node->type & 0xFF) == cJSON_Array) {
+		f->h = mix64(f->h + ch_h);
+	} else {
+		uint64_t kh =
+		    ch->string ? hash_bytes(ch->string, strlen(ch->string)) : 0;
+		f->sum += mix64(kh ^ ch_h);
+	}
+	f->n++;
+}
+
+static uint64_t hash_close(const struct hash_frame *f)
+{
+	if ((f->node->type & 0xFF) == cJSON_Array)
+		return mix64(f->h ^ f->n);
+	return mix64(f->h ^ f->sum ^ (f->n << 32));
+}
+
+/* Hash @root's subtree, recording every subtree in @cache if non-NULL */
+static uint64_t hash_tree(struct json_hash_cache *cache, bool strict,
+                          const cJSON *root)
+{
+	struct hash_frame local[WALK_LOCAL_DEPTH];
+	void *stack = local;
+	size_t cap = WALK_LOCAL_DEPTH, depth = 0;
+	const cJSON *node = root;
+	uint64_t h;
+	for (;;) {
+		/* Open the next container, or hash a leaf right away */
+		bool done = true;
+		if (!is_container(node)) {
+			size_t len;
+			h = hash_leaf(node, strict, &len);
+			if (cache)
+				cache_put(cache, node, h, len);
+		} else if (depth < cap || walk_grow(&stack, &cap,
+		                                    sizeof(*local), local)) {
+			((struct hash_frame *)stack)[depth++] = hash_open(node);
+			done = false;
+		} else {
+			h = hash_tree(cache, strict, node);
+		}
+		/* Fold finished nodes upwards until a container has more */
+		struct hash_frame *frames = (struct hash_frame *)stack;
+		for (;;) {
+			if (done && !depth)
+				goto out;
+			struct hash_frame *f = &frames[depth - 1];
+			if (done) {
+				hash_fold(f, f->child, h);
+				f->child = f->child->next;
+			}
+			if (f->child) {
+				node = f->child;
+				break;
+			}
+			h = hash_close(f);
+			if (cache)
+				cache_put(cache, f->node, h, SIZE_MAX);
+			depth--;
+			done = true;
+		}
+	}
+out:
+	if (stack != (void *)local)
+		free(stack);
+	return h;
+}
+
+uint64_t json_hash_value(const cJSON *node, bool strict)
+{
+	return hash_tree(NULL, strict, node);
+}
+
+uint64_t json_hash_node(const cJSON *node, const uint64_t *children,
+                        bool strict, size_t *len)
+{
+	if (!is_container(node))
+		return hash_leaf(node, strict, len);
+	struct hash_frame f = hash_open(node);
+	for (uint64_t n = 0; f.child; f.child = f.child->next)
+		hash_fold(&f, f.child, children[n++]);
+	*len = SIZE_MAX;
+	return hash_close(&f);
+}
+
+int json_hash_cache_build(struct json_hash_cache *cache, const cJSON *left,
+                          const cJSON *right, bool strict)
+{
+	memset(cache, 0, sizeof(*cache));
+	cache->strict = strict;
+	size_t n = (left ? count_nodes(left) : 0) +
+	           (right ? count_nodes(right) : 0);
+	size_t cap = 16;
+	while (cap < n * 2) {
+		if (cap > SIZE_MAX / 4)
+			return -1;
+		cap <<= 1;
+	}
+	cache->nodes = calloc(cap, sizeof(*cache->nodes));
+	cache->hashes = malloc(cap * sizeof(*cache->hashes));
+	cache->lengths = malloc(cap * sizeof(*cache->lengths));
+	if (!cache->nodes || !cache->hashes || !cache->lengths) {
+		json_hash_cache_free(cache);
+		return -1;
+	}
+	cache->mask = cap - 1;
+	if (left)
+		hash_tree(cache, strict, left);
+	if (right)
+		hash_tree(cache, strict, right);
+	return 0;
+}
+
+void json_hash_cache_free(struct json_hash_cache *cache)
+{
+	free(cache->nodes);
+	free(cache->hashes);
+	free(cache->lengths);
+	cache->nodes = NULL;
+	cache->hashes = NULL;
+	cache->lengths = NULL;
+	cache->mask = cache->count = 0;
+}
+
+bool json_hash_cache_lookup(const struct json_hash_cache *cache,
+                            const cJSON *node, uint64_t *hash, size_t *len)
+{
+	if (!cache || !cache->nodes || !node)
+		return false;
+	size_t i = slot_of(node, cache->mask);
+	while (cache->nodes[i]) {
+		if (cache->nodes[i] == node) {
+			*hash = cache->hashes[i];
+			*len = cache->lengths[i];
+			return true;
+		}
+		i = (i + 1) & cache->mask;
+	}
+	return false;
+}
+
+bool json_hash_cache_get(const struct json_hash_cache *cache,
+                         const cJSON *node, uint64_t *out)
+{
+	size_t len;
+	return json_hash_cache_lookup(cache, node, out, &len);
+}
@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+#ifndef JSON_HASH_H
+#define JSON_HASH_H
+
+#include <cjson/cJSON.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * struct json_hash_cache - Side table of structural subtree hashes
+ * @nodes: open-addressed keys (node pointers, NULL for empty slots)
+ * @hashes: hash for the node in the matching slot
+ * @lengths: byte length of a string node's value in the matching slot,
+ *	SIZE_MAX for other nodes
+ * @mask: table capacity minus one (capacity is a power of two)
+ * @count: number of occupied slots
+ * @strict: numbers were hashed by value (strict_equality)
+ *
+ * Hashes are a necessary condition for json_value_equal(): equal values
+ * always hash the same, so differing hashes reject without recursing.
+ * Object members are combined order-independently. Without strict
+ * equality numbers compare within a tolerance and only contribute their
+ * type to the hash. String lengths are kept as a by-product of hashing
+ * so equality checks on cached strings need no strlen().
+ */
+struct json_hash_cache {
+	const cJSON **nodes;
+	uint64_t *hashes;
+	size_t *lengths;
+	size_t mask;
+	size_t count;
+	bool strict;
+};
+
+/**
+ * json_hash_cache_build - Hash every subtree of @left and @right
+ * @cache: cache to fill (released with json_hash_cache_free())
+ * @left: first tree (may be NULL)
+ * @right: second tree (may be NULL)
+ * @strict: hash numbers for strict equality
+ *
+ * Return: 0 on success, -1 on allocation failure (cache left empty)
+ */
+int json_hash_cache_build(struct json_hash_cache *cache, const cJSON *left,
+                          const cJSON *right, bool strict);
+
+/**
+ * json_hash_cache_free - Release the side table
+ * @cache: cache to release
+ */
+void json_hash_cache_free(struct json_hash_cache *cache);
+
+/**
+ * json_hash_cache_get - Look up the hash of a cached node
+ * @cache: cache (may be NULL)
+ * @node: node to look up
+ * @out: receives the hash
+ *
+ * Return: true if @node was hashed during the pre-pass
+ */
+bool json_hash_cache_get(const struct json_hash_cache *cache,
+                         const cJSON *node, uint64_t *out);
+
+/**
+ * json_hash_cache_lookup - Look up the hash and string length of a node
+ * @cache: cache (may be NULL)
+ * @node: node to look up
+ * @hash: receives the hash
+ * @len: receives the string length, SIZE_MAX unless @node is a string
+ *
+ * Return: true if @node was hashed during the pre-pass
+ */
+bool json_hash_cache_lookup(const struct json_hash_cache *cache,
+                            const cJSON *node, uint64_t *hash, size_t *len);
+
+/**
+ * json_hash_value - Structural hash of one subtree without a cache
+ * @node: subtree to hash
+ * @strict: hash numbers for strict equality
+ *
+ * Return: the hash json_hash_cache_build() would record for @node
+ */
+uint64_t json_hash_value(const cJSON *node, bool strict);
+
+/**
+ * json_hash_node - Structural hash of a node from its children's hashes
+ * @node: node to hash
+ * @children: hash of each child of @node, in document order
+ * @strict: hash numbers for strict equality
+ * @len: receives the string length, SIZE_MAX unless @node is a string
+ *
+ * Lets a caller that visits children before parents hash a tree without
+ * recursing.
+ *
+ * Return: the hash json_hash_value() gives @node
+ */
+uint64_t json_hash_node(const cJSON *node, const uint64_t *children,
+                        bool strict, size_t *len);
+
+/**
+ * json_hash_mix - 64-bit finalizer used to combine hashes
+ * @x: value to mix
+ *
+ * Return: mixed value
+ */
+uint64_t json_hash_mix(uint64_t x);
+
+/**
+ * json_hash_bytes - Hash a byte string
+ * @s: bytes
+ * @len: number of bytes
+ *
+ * Return: the hash strings and keys contribute to structural hashes, so
+ * other backends can produce matching values
+ */
+uint64_t json_hash_bytes(const char *s, size_t len);
+
+/**
+ * json_hash_key - Hash an object key
+ * @key: NUL-terminated key
+ *
+ * Return: the same string hash used for object members in the cache
+ */
+uint64_t json_hash_key(const char *key);
+
+#endif /* JSON_HASH_H */
@@ -0,0 +1,549 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "json_diff_internal.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef MAX_JSON_DEPTH
+#define MAX_JSON_DEPTH 1024
+#endif
+
+#ifndef JSON_PATCH_TEXT_CHUNK
+#define JSON_PATCH_TEXT_CHUNK 4096
+#endif
+
+/* Longest number text cJSON reads, as there */
+#define NUMBER_TEXT_MAX 63
+
+/*
+ * Delta text is read front to back exactly once, as a pull parser over
+ * either a string or chunks from a callback. Object deltas are applied
+ * member by member while they are read: a nested object delta descends
+ * into the target, an operation builds at most the values it carries and
+ * anything that is not a delta is skipped without building a node. Array
+ * deltas cannot be applied that way, since jsondiffpatch removes before it
+ * inserts before it changes and the entries may come in any order; they,
+ * like deltas aimed at a value of another type, are gathered into a tree
+ * and handed to json_patch_node().
+ */
+
+/**
+ * struct text_in - Delta text being read
+ * @p: next unread byte
+ * @end: end of the bytes at hand
+ * @fn: source of further chunks, NULL for a string or at its end
+ * @user: opaque pointer handed to @fn
+ * @chunk: buffer @fn reads into
+ * @str: decoded strings, used as a stack: an object member's key stays
+ *	below whatever its value decodes
+ * @str_len: bytes in use in @str
+ * @str_cap: allocated size of @str
+ * @depth: nesting of the value being read
+ * @failed: the text is malformed, @fn failed or memory ran out
+ */
+struct text_in {
+	const char *p;
+	const char *end;
+	json_patch_read_fn fn;
+	void *user;
+	char *chunk;
+	char *str;
+	size_t str_len;
+	size_t str_cap;
+	int depth;
+	bool failed;
+};
+
+static bool in_fill(struct text_in *in)
+{
+	if (in->p < in->end)
+		return true;
+	if (!in->fn || in->failed)
+		return false;
+	ptrdiff_t n = in->fn(in->chunk, JSON_PATCH_TEXT_CHUNK, in->user);
+	if (n <= 0 || n > JSON_PATCH_TEXT_CHUNK) {
+		if (n)
+			in->failed = true;
+		in->fn = NULL;
+		return false;
+	}
+	in->p = in->chunk;
+	in->end = in->chunk + n;
+	return true;
+}
+
+/* Next byte without taking it, -1 at the end of the text */
+static int in_peek(struct text_in *in)
+{
+	return in_fill(in) ? (unsigned char)*in->p : -1;
+}
+
+static int in_next(struct text_in *in)
+{
+	int c = in_peek(in);
+	if (c < 0)
+		in->failed = true;
+	else
+		in->p++;
+	return c;
+}
+
+/* Skip whitespace (anything up to a space, as cJSON does), then peek */
+static int in_skip_ws(struct text_in *in)
+{
+	int c;
+	while ((c = in_peek(in)) >= 0 && c <= ' ')
+		in->p++;
+	return c;
+}
+
+static void in_expect(struct text_in *in, char c)
+{
+	if (in_skip_ws(in) != (unsigned char)c || in->failed)
+		in->failed = true;
+	else
+		in->p++;
+}
+
+static void in_word(struct text_in *in, const char *word)
+{
+	for (; *word; word++)
+		if (in_next(in) != (unsigned char)*word)
+			in->failed = true;
+}
+
+static void str_put(struct text_in *in, const char *s, size_t n)
+{
+	/* Empty runs may come before the buffer exists */
+	if (!n)
+		return;
+	if (in->str_cap - in->str_len < n) {
+		size_t cap = in->str_cap ? in->str_cap : 256;
+		while (cap - in->str_len < n)
+			cap *= 2;
+		char *grown = realloc(in->str, cap);
+		if (!grown) {
+			in->failed = true;
+			return;
+		}
+		in->str = grown;
+		in->str_cap = cap;
+	}
+	memcpy(in->str + in->str_len, s, n);
+	in->str_len += n;
+}
+
+static int hex4(struct text_in *in)
+{
+	int v = 0;
+	for (int i = 0; i < 4; i++) {
+		int c = in_next(in);
+		v <<= 4;
+		if (c >= '0' && c <= '9')
+			v |= c - '0';
+		else if (c >= 'a' && c <= 'f')
+			v |= c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			v |= c - 'A' + 10;
+		else
+			return -1;
+	}
+	return v;
+}
+
+/* A \u escape after its 'u', with the low surrogate it may need, as UTF-8 */
+static void read_utf16(struct text_in *in, bool keep)
+{
+	int first = hex4(in);
+	if (first < 0 || (first >= 0xDC00 && first <= 0xDFFF)) {
+		in->failed = true;
+		return;
+	}
+	unsigned long cp = (unsigned long)first;
+	if (first >= 0xD800 && first <= 0xDBFF) {
+		if (in_next(in) != '\\' || in_next(in) != 'u') {
+			in->failed = true;
+			return;
+		}
+		int second = hex4(in);
+		if (second < 0xDC00 || second > 0xDFFF) {
+			in->failed = true;
+			return;
+		}
+		cp = 0x10000 + (((unsigned long)first & 0x3FF) << 10) +
+		     ((unsigned long)second & 0x3FF);
+	}
+	if (!keep)
+		return;
+	static const unsigned char lead[] = {0, 0, 0xC0, 0xE0, 0xF0};
+	char utf8[4];
+	int n = cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+	for (int i = n - 1; i > 0; i--) {
+		utf8[i] = (char)(0x80 | (cp & 0x3F));
+		cp >>= 6;
+	}
+	utf8[0] = (char)(lead[n] | cp);
+	str_put(in, utf8, (size_t)n);
+}
+
+/*
+ * A string after its opening quote. With @keep it is decoded onto @str
+ * and NUL-terminated, starting at the returned offset; a caller done
+ * with it pops it by restoring @str_len. Without, it is only checked.
+ */
+static size_t read_string(struct text_in *in, bool keep)
+{
+	size_t start = in->str_len;
+	while (!in->failed) {
+		if (!in_fill(in)) {
+			in->failed = true;
+			break;
+		}
+		/* Plain bytes up to the next quote or escape in one go */
+		const char *run = in->p;
+		while (in->p < in->end && *in->p != '"' && *in->p != '\\')
+			in->p++;
+		if (keep)
+			str_put(in, run, (size_t)(in->p - run));
+		if (in->p == in->end)
+			continue;
+		if (*in->p++ == '"')
+			break;
+		char e;
+		switch (in_next(in)) {
+		case 'b': e = '\b'; break;
+		case 'f': e = '\f'; break;
+		case 'n': e = '\n'; break;
+		case 'r': e = '\r'; break;
+		case 't': e = '\t'; break;
+		case '"': e = '"'; break;
+		case '\\': e = '\\'; break;
+		case '/': e = '/'; break;
+		case 'u':
+			read_utf16(in, keep);
+			continue;
+		default:
+			in->failed = true;
+			continue;
+		}
+		if (keep)
+			str_put(in, &e, 1);
+	}
+	if (keep)
+		str_put(in, "", 1);
+	return start;
+}
+
+static double read_number(struct text_in *in)
+{
+	char buf[NUMBER_TEXT_MAX + 1];
+	size_t n = 0;
+	int c;
+	while ((c = in_peek(in)) >= 0 &&
+	       ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' ||
+	        c == 'e' || c == 'E')) {
+		if (n == NUMBER_TEXT_MAX) {
+			in->failed = true;
+			return 0;
+		}
+		buf[n++] = (char)c;
+		in->p++;
+	}
+	buf[n] = '\0';
+	char *ep;
+	double d = strtod(buf, &ep);
+	if (!n || ep != buf + n)
+		in->failed = true;
+	return d;
+}
+
+static void skip_value(struct text_in *in);
+static cJSON *build_value(struct text_in *in);
+
+/* Members or elements of a container up to @close, its opener taken */
+static void read_items(struct text_in *in, cJSON *container, char close)
+{
+	bool keyed = close == '}';
+	if (in_skip_ws(in) == (unsigned char)close) {
+		in->p++;
+		return;
+	}
+	while (!in->failed) {
+		size_t key = in->str_len;
+		if (keyed) {
+			in_expect(in, '"');
+			key = read_string(in, container != NULL);
+			in_expect(in, ':');
+		}
+		if (!container) {
+			skip_value(in);
+		} else {
+			cJSON *v = build_value(in);
+			bool ok = v && (keyed ? cJSON_AddItemToObject(
+			                            container, in->str + key, v)
+			                      : cJSON_AddItemToArray(container, v));
+			if (!ok) {
+				cJSON_Delete(v);
+				in->failed = true;
+			}
+			in->str_len = key;
+		}
+		int c = in_skip_ws(in);
+		in->p += c >= 0;
+		if (c == (unsigned char)close)
+			return;
+		if (c != ',')
+			in->failed = true;
+	}
+}
+
+/* Read one value; with @build return it as a new tree, else skip it */
+static cJSON *read_value(struct text_in *in, bool build)
+{
+	cJSON *v = NULL;
+	if (++in->depth > MAX_JSON_DEPTH) {
+		in->failed = true;
+		goto out;
+	}
+	int c = in_skip_ws(in);
+	switch (c) {
+	case '{':
+	case '[':
+		in->p++;
+		if (build && !(v = c == '{' ? cJSON_CreateObject()
+		                            : cJSON_CreateArray())) {
+			in->failed = true;
+			break;
+		}
+		read_items(in, v, c == '{' ? '}' : ']');
+		break;
+	case '"': {
+		in->p++;
+		size_t s = read_string(in, build);
+		if (build && !in->failed && !(v = cJSON_CreateString(in->str + s)))
+			in->failed = true;
+		in->str_len = s;
+		break;
+	}
+	case 't':
+	case 'f':
+	case 'n':
+		in_word(in, c == 't' ? "true" : c == 'f' ? "false" : "null");
+		if (build && !in->failed &&
+		    !(v = c == 'n' ? cJSON_CreateNull()
+		                   : cJSON_CreateBool(c == 't')))
+			in->failed = true;
+		break;
+	default:
+		if (c != '-' && (c < '0' || c > '9')) {
+			in->failed = true;
+			break;
+		}
+		double d = read_number(in);
+		if (build && !in->failed && !(v = cJSON_CreateNumber(d)))
+			in->failed = true;
+		break;
+	}
+out:
+	--in->depth;
+	if (in->failed) {
+		cJSON_Delete(v);
+		v = NULL;
+	}
+	return v;
+}
+
+static void skip_value(struct text_in *in)
+{
+	read_value(in, false);
+}
+
+static cJSON *build_value(struct text_in *in)
+{
+	return read_value(in, true);
+}
+
+/* The delta at hand applied to @target by way of a tree of it */
+static cJSON *apply_tree(struct text_in *in, cJSON *target)
+{
+	cJSON *d = build_value(in);
+	if (!d)
+		return target;
+	cJSON *result = json_patch_node(target, d, &in->failed);
+	cJSON_Delete(d);
+	return result;
+}
+
+static void apply_object(struct text_in *in, cJSON *object);
+
+/*
+ * Operation array for member @key of the object behind @m, as
+ * patch_object_inplace() reads it: [new] adds, [old, new] replaces,
+ * [patch, 0, 2] patches a string, other three elements delete and other
+ * shapes do nothing. Only the first three elements are built, the first
+ * one dropped as soon as a second shows it was the old value.
+ */
+static void apply_op(struct text_in *in, struct json_patch_members *m,
+                     size_t key)
+{
+	if (++in->depth > MAX_JSON_DEPTH) {
+		in->failed = true;
+		goto out;
+	}
+	in->p++;
+	cJSON *val = NULL, *patch = NULL;
+	size_t n = 0;
+	int c = in_skip_ws(in);
+	while (c != ']' && !in->failed) {
+		if (n++ < 3) {
+			cJSON *next = build_value(in);
+			/* A string followed by 0 may be patch text */
+			if (n == 2 && cJSON_IsString(val) &&
+			    cJSON_IsNumber(next) && next->valuedouble == 0)
+				patch = val;
+			else
+				cJSON_Delete(val);
+			val = next;
+		} else {
+			skip_value(in);
+		}
+		c = in_skip_ws(in);
+		if (c == ',')
+			in->p++;
+		else if (c != ']')
+			in->failed = true;
+	}
+	if (!in->failed)
+		in->p++;
+	if (in->failed || (n != 1 && n != 2 && n != 3)) {
+		cJSON_Delete(val);
+		cJSON_Delete(patch);
+		goto out;
+	}
+	cJSON *cur = json_patch_members_get(m, in->str + key);
+	if (n == 3) {
+		if (patch && cJSON_IsNumber(val) && val->valuedouble == 2) {
+			if (cur &&
+			    !json_text_patch_node(cur, patch->valuestring))
+				in->failed = true;
+		} else if (cur) {
+			json_patch_members_delete(m, cur);
+		}
+		cJSON_Delete(val);
+		cJSON_Delete(patch);
+		goto out;
+	}
+	cJSON_Delete(patch);
+	if (cur) {
+		json_patch_members_replace(m, cur, val);
+	} else if (!cJSON_AddItemToObject(m->object, in->str + key, val)) {
+		cJSON_Delete(val);
+		in->failed = true;
+	}
+out:
+	--in->depth;
+}
+
+/* Object delta at hand applied member by member to @object */
+static void apply_object(struct text_in *in, cJSON *object)
+{
+	struct json_patch_members members;
+	if (++in->depth > MAX_JSON_DEPTH) {
+		in->failed = true;
+		goto out;
+	}
+	in->p++;
+	if (in_skip_ws(in) == '}') {
+		in->p++;
+		goto out;
+	}
+	json_patch_members_init(&members, object);
+	while (!in->failed) {
+		in_expect(in, '"');
+		size_t key = read_string(in, true);
+		in_expect(in, ':');
+		int c = in_skip_ws(in);
+		if (in->failed)
+			break;
+		if (c == '[') {
+			apply_op(in, &members, key);
+		} else if (c == '{') {
+			cJSON *cur =
+			    json_patch_members_get(&members, in->str + key);
+			if (!cur) {
+				skip_value(in);
+			} else if (cJSON_IsObject(cur)) {
+				apply_object(in, cur);
+			} else {
+				cJSON *patched = apply_tree(in, cur);
+				if (patched != cur)
+					json_patch_members_replace(&members,
+					                           cur, patched);
+			}
+		} else {
+			/* Not a delta: the value is unchanged */
+			skip_value(in);
+		}
+		in->str_len = key;
+		c = in_skip_ws(in);
+		in->p += c >= 0;
+		if (c == '}')
+			break;
+		if (c != ',')
+			in->failed = true;
+	}
+	json_patch_members_free(&members);
+out:
+	--in->depth;
+}
+
+/* json_patch_inplace() with the delta read from @in */
+static cJSON *patch_text(struct text_in *in, cJSON *target)
+{
+	cJSON *result = target;
+	if (!target) {
+		in->failed = true;
+		goto out;
+	}
+	/* Skip a UTF-8 byte order mark, as cJSON_Parse() does */
+	if (in_peek(in) == 0xEF)
+		in_word(in, "\xEF\xBB\xBF");
+	int c = in_skip_ws(in);
+	if (c < 0)
+		goto out; /* no delta: equal values */
+	if (c == '{' && cJSON_IsObject(target))
+		apply_object(in, target);
+	else
+		result = apply_tree(in, target);
+	if (in_skip_ws(in) >= 0)
+		in->failed = true;
+out:
+	if (result != target)
+		cJSON_Delete(target);
+	free(in->str);
+	if (in->failed) {
+		cJSON_Delete(result);
+		return NULL;
+	}
+	return result;
+}
+
+cJSON *json_patch_str(cJSON *target, const char *delta)
+{
+	struct text_in in = {.failed = !delta};
+	if (delta) {
+		in.p = delta;
+		in.end = delta + strlen(delta);
+	}
+	return patch_text(&in, target);
+}
+
+cJSON *json_patch_stream(cJSON *target, json_patch_read_fn fn, void *user)
+{
+	struct text_in in = {.fn = fn, .user = user, .failed = !fn};
+	if (fn && !(in.chunk = malloc(JSON_PATCH_TEXT_CHUNK)))
+		in.failed = true;
+	cJSON *result = patch_text(&in, target);
+	free(in.chunk);
+	return result;
+}
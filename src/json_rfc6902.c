@@ -0,0 +1,643 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "json_diff_internal.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_MARKER "_t"
+
+/*
+ * JSON Patch (RFC 6902) output. The diff engine runs with a sink: object
+ * members turn into one operation each as it finds them, with their JSON
+ * Pointers grown and shrunk in a single buffer. Arrays cannot be written
+ * that way, since their operations must be valid when applied in order,
+ * as RFC 6902 requires. The engine hands over each array delta instead,
+ * built with borrowed values in a private arena, and it is laid out as
+ * removals from the highest original index down, then the moved elements
+ * parked at the end in the order they will be needed, then additions and
+ * moves into place by ascending final index, then changes at final
+ * indices, which go back through the engine.
+ */
+
+/**
+ * struct rfc_out - Operation list being emitted
+ * @sink: what the engine calls; its @failed is set when memory runs out
+ * @ctx: context whose options decide where values and nodes live
+ * @ops: the operation array
+ * @path: JSON Pointer of the value being diffed, NUL-terminated
+ * @len: length of @path
+ * @cap: allocated size of @path
+ */
+struct rfc_out {
+	struct json_diff_sink sink;
+	const struct json_diff_ctx *ctx;
+	cJSON *ops;
+	char *path;
+	size_t len;
+	size_t cap;
+};
+
+static void path_put(struct rfc_out *o, const char *s, size_t n)
+{
+	if (o->cap - o->len <= n) {
+		size_t cap = o->cap ? o->cap : 64;
+		while (cap - o->len <= n)
+			cap *= 2;
+		char *grown = realloc(o->path, cap);
+		if (!grown) {
+			o->sink.failed = true;
+			return;
+		}
+		o->path = grown;
+		o->cap = cap;
+	}
+	memcpy(o->path + o->len, s, n);
+	o->len += n;
+	o->path[o->len] = '\0';
+}
+
+/* Append "/" and @key escaped as a reference token */
+static void path_push_key(struct rfc_out *o, const char *key)
+{
+	path_put(o, "/", 1);
+	for (const char *s = key; *s; s++) {
+		const char *run = s;
+		while (*s && *s != '~' && *s != '/')
+			s++;
+		path_put(o, run, (size_t)(s - run));
+		if (!*s)
+			break;
+		path_put(o, *s == '~' ? "~0" : "~1", 2);
+	}
+}
+
+/* Append "/@index"; returns the old length */
+static size_t path_push_index(struct rfc_out *o, int index)
+{
+	char buf[16];
+	size_t at = o->len;
+	int n = snprintf(buf, sizeof(buf), "/%d", index);
+	path_put(o, buf, (size_t)n);
+	return at;
+}
+
+/* Copy of the current path, for a "from" member; NULL on failure */
+static char *path_copy(struct rfc_out *o)
+{
+	char *s = o->sink.failed ? NULL : malloc(o->len + 1);
+	if (s)
+		memcpy(s, o->path, o->len + 1);
+	return s;
+}
+
+static void path_pop(struct rfc_out *o, size_t at)
+{
+	o->len = at;
+	if (o->path)
+		o->path[at] = '\0';
+}
+
+static bool op_member(struct rfc_out *o, cJSON *op, const char *key,
+                      cJSON *v)
+{
+	struct json_diff_arena *arena = o->ctx->opts->arena;
+	if (v && diff_add_item_to_object(arena, op, key, v))
+		return true;
+	diff_delete(arena, v);
+	return false;
+}
+
+/*
+ * Append {"op": @name, "path": <path>} with "from": @from when non-NULL
+ * and "value": @value when non-NULL
+ */
+static void emit(struct rfc_out *o, const char *name, const char *from,
+                 const cJSON *value)
+{
+	struct json_diff_arena *arena = o->ctx->opts->arena;
+	if (o->sink.failed)
+		return;
+	cJSON *op = diff_new_object(arena);
+	bool ok = op &&
+	          op_member(o, op, "op", diff_new_string(arena, name)) &&
+	          (!from || op_member(o, op, "from",
+	                              diff_new_string(arena, from))) &&
+	          op_member(o, op, "path", diff_new_string(arena, o->path)) &&
+	          (!value || op_member(o, op, "value",
+	                               diff_value(o->ctx, value)));
+	if (!ok || !diff_add_item(arena, o->ops, op)) {
+		diff_delete(arena, op);
+		o->sink.failed = true;
+	}
+}
+
+/* Emit an operation on element @index of the array at hand */
+static void emit_at(struct rfc_out *o, const char *name, int index,
+                    const char *from, const cJSON *value)
+{
+	size_t at = path_push_index(o, index);
+	emit(o, name, from, value);
+	path_pop(o, at);
+}
+
+/* Emit a move of element @from of the array at hand to its child @to */
+static void emit_move(struct rfc_out *o, int from, const char *to)
+{
+	size_t at = path_push_index(o, from);
+	char *src = path_copy(o);
+	path_pop(o, at);
+	if (!src) {
+		o->sink.failed = true;
+		return;
+	}
+	path_put(o, to, strlen(to));
+	emit(o, "move", src, NULL);
+	path_pop(o, at);
+	free(src);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+	int x = *(const int *)a, y = *(const int *)b;
+	return (x > y) - (x < y);
+}
+
+/* Fenwick tree over original positions still in the array */
+static void bit_add(int *bit, int n, int i, int v)
+{
+	for (i++; i <= n; i += i & -i)
+		bit[i] += v;
+}
+
+static int bit_prefix(const int *bit, int i)
+{
+	int s = 0;
+	for (; i > 0; i -= i & -i)
+		s += bit[i];
+	return s;
+}
+
+/* Array delta @d turning @left into @right, written out as operations */
+static void rfc_array(struct json_diff_sink *sink,
+                      const struct json_diff_ctx *ctx, const cJSON *left,
+                      const cJSON *right, const cJSON *d)
+{
+	struct rfc_out *o = (struct rfc_out *)sink;
+	int n = cJSON_GetArraySize(left), nr = cJSON_GetArraySize(right);
+	int k = cJSON_GetArraySize(d);
+	const cJSON **orig = malloc(((size_t)n + 1) * sizeof(*orig));
+	const cJSON **next = malloc(((size_t)nr + 1) * sizeof(*next));
+	unsigned char *gone = calloc((size_t)n + 1, 1);
+	struct json_array_insert *ins = malloc(((size_t)k + 1) * sizeof(*ins));
+	int *place = malloc(((size_t)n + (size_t)k + 1) * sizeof(*place));
+	int *mod = malloc(((size_t)k + 1) * sizeof(*mod));
+	int *bit = calloc((size_t)n + 1, sizeof(*bit));
+	if (!orig || !next || !gone || !ins || !place || !mod || !bit) {
+		o->sink.failed = true;
+		goto out;
+	}
+	int i = 0;
+	for (const cJSON *e = left->child; e; e = e->next)
+		orig[i++] = e;
+	i = 0;
+	for (const cJSON *e = right->child; e; e = e->next)
+		next[i++] = e;
+
+	int nins = (int)json_array_delta_scan(d, (size_t)n, gone, ins);
+	int nf = (int)json_array_place(gone, (size_t)n, ins, (size_t)nins,
+	                               place);
+
+	/* Removals, highest index first so the others keep theirs */
+	for (i = n - 1; i >= 0; i--)
+		if (gone[i] == JSON_ARRAY_DELETE)
+			emit_at(o, "remove", i, NULL, NULL);
+
+	/* Park moved elements at the end in the order they are placed */
+	int survivors = 0;
+	for (i = 0; i < n; i++) {
+		if (gone[i] != JSON_ARRAY_DELETE)
+			bit_add(bit, n, i, 1);
+		if (!gone[i])
+			survivors++;
+	}
+	for (int j = 0; j < nins && !o->sink.failed; j++) {
+		if (ins[j].from < 0)
+			continue;
+		emit_move(o, bit_prefix(bit, ins[j].from), "/-");
+		bit_add(bit, n, ins[j].from, -1);
+	}
+
+	/* Additions and moves into place by ascending final index */
+	for (int f = 0; f < nf && !o->sink.failed; f++) {
+		if (place[f] >= 0) {
+			survivors--;
+			continue;
+		}
+		const struct json_array_insert *e = &ins[-1 - place[f]];
+		if (e->from < 0) {
+			emit_at(o, "add", f, NULL, e->entry->child);
+		} else if (survivors) {
+			/* Parked after the survivors still to come */
+			char to[16];
+			snprintf(to, sizeof(to), "/%d", f);
+			emit_move(o, f + survivors, to);
+		}
+	}
+
+	/* Changes at final indices, against the element that ended there */
+	int nmod = 0;
+	for (const cJSON *e = d->child; e; e = e->next) {
+		if (!e->string || e->string[0] == '_' ||
+		    (cJSON_IsArray(e) && cJSON_GetArraySize(e) == 1))
+			continue;
+		int index = json_array_delta_index(e->string, 0);
+		if (index >= 0 && index < nf && index < nr)
+			mod[nmod++] = index;
+	}
+	qsort(mod, (size_t)nmod, sizeof(*mod), cmp_int);
+	for (int j = 0; j < nmod && !o->sink.failed; j++) {
+		int f = mod[j], from = place[f];
+		if (from < 0)
+			from = ins[-1 - from].from;
+		if (from < 0)
+			continue;
+		size_t at = path_push_index(o, f);
+		if (!o->sink.failed)
+			json_diff_sink_value(ctx, o->path + at + 1, orig[from],
+			                     next[f]);
+		path_pop(o, at);
+	}
+
+out:
+	free(orig);
+	free(next);
+	free(gone);
+	free(ins);
+	free(place);
+	free(mod);
+	free(bit);
+}
+
+static void rfc_push(struct json_diff_sink *sink, const char *key)
+{
+	path_push_key((struct rfc_out *)sink, key);
+}
+
+/* Drop the last reference token; tokens hold no raw '/' */
+static void rfc_pop(struct json_diff_sink *sink)
+{
+	struct rfc_out *o = (struct rfc_out *)sink;
+	size_t at = o->len;
+	while (at && o->path[at - 1] != '/')
+		at--;
+	path_pop(o, at ? at - 1 : 0);
+}
+
+static void rfc_change(struct json_diff_sink *sink, const cJSON *left,
+                       const cJSON *right)
+{
+	struct rfc_out *o = (struct rfc_out *)sink;
+	if (!left)
+		emit(o, "add", NULL, right);
+	else if (!right)
+		emit(o, "remove", NULL, NULL);
+	else
+		emit(o, "replace", NULL, right);
+}
+
+cJSON *json_diff_rfc6902(const cJSON *left, const cJSON *right,
+                         const struct json_diff_options *opts)
+{
+	struct json_diff_options out_opts = {.strict_equality = true};
+	if (opts)
+		out_opts = *opts;
+	if (!left || !right)
+		return NULL;
+
+	/* Array deltas only live until their operations are written */
+	struct json_diff_arena scratch;
+	json_diff_arena_init(&scratch, 0);
+	struct json_diff_options delta_opts = out_opts;
+	delta_opts.arena = &scratch;
+	delta_opts.output = JSON_DIFF_OUTPUT_BORROWED;
+	delta_opts.forward_only = true;
+	delta_opts.text_diff_min_length = 0;
+
+	struct json_diff_ctx ctx = {.opts = &out_opts};
+	struct rfc_out o = {.sink = {.push = rfc_push,
+	                             .pop = rfc_pop,
+	                             .change = rfc_change,
+	                             .array = rfc_array},
+	                    .ctx = &ctx,
+	                    .ops = diff_new_array(out_opts.arena)};
+	path_put(&o, "", 0);
+	if (!o.ops)
+		o.sink.failed = true;
+	else if (!o.sink.failed &&
+	         json_diff_sink_run(left, right, &delta_opts, &o.sink) < 0)
+		o.sink.failed = true;
+	json_diff_arena_cleanup(&scratch);
+	free(o.path);
+	if (o.sink.failed) {
+		diff_delete(out_opts.arena, o.ops);
+		return NULL;
+	}
+	return o.ops;
+}
+
+/*
+ * Applying a JSON Patch. Each path is resolved from the root, except that
+ * the container an operation works in is remembered: a run of operations
+ * in the same object or array, which is what json_diff_rfc6902() writes,
+ * walks down to it once. Any change outside that container forgets it.
+ */
+
+/**
+ * struct rfc_doc - Document being patched
+ * @root: current root
+ * @parent: pointer of the remembered container, not NUL-terminated
+ * @parent_len: length of @parent
+ * @node: the remembered container, NULL if none
+ * @tok: decoded reference token
+ * @tok_cap: allocated size of @tok
+ * @failed: an operation failed or memory ran out
+ */
+struct rfc_doc {
+	cJSON *root;
+	const char *parent;
+	size_t parent_len;
+	cJSON *node;
+	char *tok;
+	size_t tok_cap;
+	bool failed;
+};
+
+bool json_pointer_token(const char **p, const char *end, char *buf)
+{
+	const char *s = *p + 1;
+	size_t n = 0;
+	for (; s < end && *s != '/'; s++) {
+		if (*s == '~') {
+			if (s + 1 == end || (s[1] != '0' && s[1] != '1'))
+				return false;
+			buf[n++] = s[1] == '0' ? '~' : '/';
+			s++;
+		} else {
+			buf[n++] = *s;
+		}
+	}
+	buf[n] = '\0';
+	*p = s;
+	return true;
+}
+
+int json_pointer_index(const char *tok)
+{
+	if (!*tok || (tok[0] == '0' && tok[1]))
+		return -1;
+	long v = 0;
+	for (; *tok; tok++) {
+		if (*tok < '0' || *tok > '9' || v > (INT_MAX - 9) / 10)
+			return -1;
+		v = v * 10 + (*tok - '0');
+	}
+	return (int)v;
+}
+
+/*
+ * Decode the reference token at *@p (a '/') into @doc->tok, up to @end,
+ * and step past it. Return: false for a bad "~" escape or out of memory
+ */
+static bool pointer_token(struct rfc_doc *doc, const char **p,
+                          const char *end)
+{
+	size_t need = (size_t)(end - *p);
+	if (need > doc->tok_cap) {
+		char *grown = realloc(doc->tok, need);
+		if (!grown)
+			return false;
+		doc->tok = grown;
+		doc->tok_cap = need;
+	}
+	return json_pointer_token(p, end, doc->tok);
+}
+
+/* Child of @node named by the decoded token, NULL if there is none */
+static cJSON *token_child(const struct rfc_doc *doc, const cJSON *node)
+{
+	if (cJSON_IsObject(node))
+		return cJSON_GetObjectItemCaseSensitive(node, doc->tok);
+	if (!cJSON_IsArray(node))
+		return NULL;
+	int i = json_pointer_index(doc->tok);
+	return i < 0 ? NULL : cJSON_GetArrayItem(node, i);
+}
+
+/* Node at pointer [@path, @end), NULL if it does not resolve */
+static cJSON *resolve(struct rfc_doc *doc, const char *path, const char *end)
+{
+	size_t len = (size_t)(end - path);
+	if (doc->node && len == doc->parent_len &&
+	    memcmp(path, doc->parent, len) == 0)
+		return doc->node;
+	cJSON *node = doc->root;
+	for (const char *p = path; node && p < end;) {
+		if (*p != '/' || !pointer_token(doc, &p, end))
+			return NULL;
+		node = token_child(doc, node);
+	}
+	return node;
+}
+
+/*
+ * Resolve the container of @path and decode its last token into @doc->tok.
+ * The container is remembered for the next operation.
+ */
+static cJSON *resolve_parent(struct rfc_doc *doc, const char *path)
+{
+	const char *last = strrchr(path, '/');
+	if (!last)
+		return NULL;
+	cJSON *parent = resolve(doc, path, last);
+	const char *end = last + strlen(last), *p = last;
+	if (!parent || !pointer_token(doc, &p, end))
+		return NULL;
+	doc->parent = path;
+	doc->parent_len = (size_t)(last - path);
+	doc->node = parent;
+	return parent;
+}
+
+/* Forget the remembered container unless @path is directly inside it */
+static void changed(struct rfc_doc *doc, const char *path)
+{
+	if (!doc->node)
+		return;
+	const char *last = strrchr(path, '/');
+	if (!last || (size_t)(last - path) != doc->parent_len ||
+	    memcmp(path, doc->parent, doc->parent_len) != 0)
+		doc->node = NULL;
+}
+
+/* Drop the member name a copied or moved node carries from its source */
+static void drop_name(cJSON *val)
+{
+	if (!(val->type & cJSON_StringIsConst))
+		cJSON_free(val->string);
+	val->string = NULL;
+	val->type &= ~cJSON_StringIsConst;
+}
+
+/* RFC 6902 "add" of @val (taken over either way) at @path */
+static bool add_at(struct rfc_doc *doc, const char *path, cJSON *val)
+{
+	drop_name(val);
+	if (!*path) {
+		cJSON_Delete(doc->root);
+		doc->root = val;
+		doc->node = NULL;
+		return true;
+	}
+	cJSON *parent = resolve_parent(doc, path);
+	bool ok = false;
+	if (cJSON_IsObject(parent)) {
+		struct json_patch_members m;
+		json_patch_members_init(&m, parent);
+		cJSON *cur = json_patch_members_get(&m, doc->tok);
+		if (cur) {
+			json_patch_members_replace(&m, cur, val);
+			ok = true;
+		} else {
+			ok = cJSON_AddItemToObject(parent, doc->tok, val);
+		}
+		json_patch_members_free(&m);
+	} else if (cJSON_IsArray(parent)) {
+		int i = strcmp(doc->tok, "-") == 0
+		            ? cJSON_GetArraySize(parent)
+		            : json_pointer_index(doc->tok);
+		if (i >= 0 && i <= cJSON_GetArraySize(parent))
+			ok = cJSON_InsertItemInArray(parent, i, val) ||
+			     (i == cJSON_GetArraySize(parent) &&
+			      cJSON_AddItemToArray(parent, val));
+	}
+	if (!ok)
+		cJSON_Delete(val);
+	return ok;
+}
+
+/* Detach the node at @path; NULL if there is none or it is the root */
+static cJSON *detach_at(struct rfc_doc *doc, const char *path)
+{
+	cJSON *parent = resolve_parent(doc, path);
+	cJSON *cur = parent ? token_child(doc, parent) : NULL;
+	return cur ? cJSON_DetachItemViaPointer(parent, cur) : NULL;
+}
+
+static bool replace_at(struct rfc_doc *doc, const char *path, cJSON *val)
+{
+	drop_name(val);
+	if (!*path)
+		return add_at(doc, path, val);
+	cJSON *parent = resolve_parent(doc, path);
+	cJSON *cur = parent ? token_child(doc, parent) : NULL;
+	if (!cur) {
+		cJSON_Delete(val);
+		return false;
+	}
+	if (cJSON_IsObject(parent)) {
+		struct json_patch_members m;
+		json_patch_members_init(&m, parent);
+		json_patch_members_replace(&m, cur, val);
+		json_patch_members_free(&m);
+	} else {
+		cJSON_ReplaceItemViaPointer(parent, cur, val);
+	}
+	return true;
+}
+
+/* Apply operation @op; Return: false if it fails */
+static bool apply_op(struct rfc_doc *doc, const cJSON *op)
+{
+	const char *name =
+	    cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(op, "op"));
+	const char *path =
+	    cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(op, "path"));
+	const char *from =
+	    cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(op, "from"));
+	const cJSON *value = cJSON_GetObjectItemCaseSensitive(op, "value");
+	if (!name || !path || (*path && *path != '/'))
+		return false;
+
+	if (strcmp(name, "test") == 0) {
+		const cJSON *cur = resolve(doc, path, path + strlen(path));
+		return cur && value && json_value_equal(cur, value, true);
+	}
+	if (strcmp(name, "add") == 0 || strcmp(name, "replace") == 0) {
+		cJSON *val = value ? cJSON_Duplicate(value, 1) : NULL;
+		if (!val)
+			return false;
+		changed(doc, path);
+		return name[0] == 'a' ? add_at(doc, path, val)
+		                      : replace_at(doc, path, val);
+	}
+	if (strcmp(name, "remove") == 0) {
+		changed(doc, path);
+		cJSON *cur = *path ? detach_at(doc, path) : NULL;
+		cJSON_Delete(cur);
+		return cur != NULL;
+	}
+	if (!from || (*from && *from != '/'))
+		return false;
+	if (strcmp(name, "copy") == 0) {
+		const cJSON *cur = resolve(doc, from, from + strlen(from));
+		cJSON *val = cur ? cJSON_Duplicate(cur, 1) : NULL;
+		if (!val)
+			return false;
+		changed(doc, path);
+		return add_at(doc, path, val);
+	}
+	if (strcmp(name, "move") == 0) {
+		size_t n = strlen(from);
+		if (strcmp(from, path) == 0)
+			return resolve(doc, from, from + n) != NULL;
+		/* Nothing moves into itself */
+		if (strncmp(path, from, n) == 0 && path[n] == '/')
+			return false;
+		changed(doc, from);
+		cJSON *cur = *from ? detach_at(doc, from) : NULL;
+		if (!cur)
+			return false;
+		changed(doc, path);
+		return add_at(doc, path, cur);
+	}
+	return false;
+}
+
+cJSON *json_patch_rfc6902_inplace(cJSON *target, const cJSON *patch)
+{
+	if (!target || !cJSON_IsArray(patch)) {
+		cJSON_Delete(target);
+		return NULL;
+	}
+	struct rfc_doc doc = {.root = target};
+	for (const cJSON *op = patch->child; op && !doc.failed; op = op->next)
+		if (!apply_op(&doc, op))
+			doc.failed = true;
+	free(doc.tok);
+	if (doc.failed) {
+		cJSON_Delete(doc.root);
+		return NULL;
+	}
+	return doc.root;
+}
+
+cJSON *json_patch_rfc6902(const cJSON *original, const cJSON *patch)
+{
+	if (!original || !patch)
+		return NULL;
+	cJSON *copy = cJSON_Duplicate(original, 1);
+	if (!copy)
+		return NULL;
+	return json_patch_rfc6902_inplace(copy, patch);
+}
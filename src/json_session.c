@@ -0,0 +1,298 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "json_diff_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_MARKER "_t"
+#define ARRAY_MARKER_VALUE "a"
+
+/**
+ * struct json_diff_session - Last version of a document being diffed
+ * @doc: private copy of the previous version, advanced by patching it
+ *	with each delta
+ * @opts: options of every diff, always with owned output
+ */
+struct json_diff_session {
+	cJSON *doc;
+	struct json_diff_options opts;
+};
+
+/**
+ * struct touched - A touched path resolved against both versions
+ * @path: JSON Pointer as given
+ * @len: bytes of @path leading to the pair; shorter than @path when a
+ *	step below it cannot be taken on both sides
+ * @left: node at @len in the previous version, NULL if only added
+ * @right: node at @len in the new version, NULL if removed
+ */
+struct touched {
+	const char *path;
+	size_t len;
+	const cJSON *left;
+	const cJSON *right;
+};
+
+/* Element @i of both arrays, provided they have the same length */
+static bool pair_elements(const cJSON **l, const cJSON **r, int i)
+{
+	const cJSON *a = (*l)->child, *b = (*r)->child;
+	const cJSON *ea = NULL, *eb = NULL;
+	for (int n = 0; a && b; a = a->next, b = b->next, n++) {
+		if (n == i) {
+			ea = a;
+			eb = b;
+		}
+	}
+	if (a || b || !ea)
+		return false;
+	*l = ea;
+	*r = eb;
+	return true;
+}
+
+/*
+ * Walk @t->path down both versions while each step exists on both sides.
+ * A key present on one side only ends the walk at that key; a type
+ * mismatch, a scalar or an array whose length changed ends it at the node
+ * above. Malformed pointers resolve to the root.
+ *
+ * Return: false if the path names nothing in either version
+ */
+static bool touched_resolve(const cJSON *doc, const cJSON *next, char *buf,
+                            struct touched *t)
+{
+	const cJSON *l = doc, *r = next;
+	const char *p = t->path, *end = p + strlen(p);
+	size_t at = 0;
+
+	/* A bad "~" escape anywhere counts, however far the walk gets */
+	for (const char *q = p; q < end;) {
+		if (*q != '/' || !json_pointer_token(&q, end, buf)) {
+			p = end;
+			break;
+		}
+	}
+	while (p < end) {
+		if ((l->type & 0xFF) != (r->type & 0xFF))
+			break;
+		if (cJSON_IsObject(l)) {
+			json_pointer_token(&p, end, buf);
+			const cJSON *lc, *rc;
+			lc = cJSON_GetObjectItemCaseSensitive(l, buf);
+			rc = cJSON_GetObjectItemCaseSensitive(r, buf);
+			if (!lc && !rc)
+				return false;
+			l = lc;
+			r = rc;
+			at = (size_t)(p - t->path);
+			if (!l || !r)
+				break;
+		} else if (cJSON_IsArray(l)) {
+			json_pointer_token(&p, end, buf);
+			int i = json_pointer_index(buf);
+			if (i < 0 || !pair_elements(&l, &r, i))
+				break;
+			at = (size_t)(p - t->path);
+		} else {
+			break;
+		}
+	}
+	t->len = at;
+	t->left = l;
+	t->right = r;
+	return true;
+}
+
+/* Order by resolved path with '/' first, so each prefix precedes its range */
+static int touched_cmp(const void *a, const void *b)
+{
+	const struct touched *x = a, *y = b;
+	size_t n = x->len < y->len ? x->len : y->len;
+	for (size_t i = 0; i < n; i++) {
+		unsigned char cx = (unsigned char)x->path[i];
+		unsigned char cy = (unsigned char)y->path[i];
+		if (cx != cy)
+			return cx == '/'   ? -1
+			       : cy == '/' ? 1
+			                   : (cx > cy) - (cx < cy);
+	}
+	return (x->len > y->len) - (x->len < y->len);
+}
+
+/* Whether @k's resolved path covers @t's */
+static bool touched_covers(const struct touched *k, const struct touched *t)
+{
+	return k->len <= t->len && memcmp(k->path, t->path, k->len) == 0 &&
+	       (k->len == t->len || t->path[k->len] == '/');
+}
+
+/* Mark wrapper @w as an array delta */
+static bool tag_array(struct json_diff_arena *arena, cJSON *w)
+{
+	cJSON *tag = diff_new_string(arena, ARRAY_MARKER_VALUE);
+	if (tag && diff_add_item_to_object(arena, w, ARRAY_MARKER, tag))
+		return true;
+	diff_delete(arena, tag);
+	return false;
+}
+
+/*
+ * Hang @d at @t's path in @root, creating the object and array delta
+ * wrappers on the way. Paths arrive sorted, so a wrapper's child for the
+ * current token, if any, is its last one.
+ */
+static bool graft(struct json_diff_arena *arena, const cJSON *doc,
+                  cJSON **root, const struct touched *t, char *buf, cJSON *d)
+{
+	if (!t->len) {
+		*root = d;
+		return true;
+	}
+	if (!*root) {
+		if (!(*root = diff_new_object(arena)))
+			return false;
+		if (cJSON_IsArray(doc) && !tag_array(arena, *root))
+			return false;
+	}
+
+	cJSON *w = *root;
+	const cJSON *node = doc;
+	const char *p = t->path, *end = t->path + t->len;
+	for (;;) {
+		json_pointer_token(&p, end, buf);
+		if (p == end)
+			return diff_add_item_to_object(arena, w, buf, d);
+		node = cJSON_IsArray(node)
+		           ? cJSON_GetArrayItem(node, json_pointer_index(buf))
+		           : cJSON_GetObjectItemCaseSensitive(node, buf);
+		cJSON *last = w->child ? w->child->prev : NULL;
+		if (last && last->string && strcmp(last->string, buf) == 0) {
+			w = last;
+			continue;
+		}
+		cJSON *c = diff_new_object(arena);
+		if (!c || !diff_add_item_to_object(arena, w, buf, c)) {
+			diff_delete(arena, c);
+			return false;
+		}
+		if (cJSON_IsArray(node) && !tag_array(arena, c))
+			return false;
+		w = c;
+	}
+}
+
+/* Delta covering only the touched paths, NULL if none of them changed */
+static cJSON *diff_touched(const struct json_diff_session *s,
+                           const cJSON *next, const char *const *paths,
+                           size_t npaths, bool *failed)
+{
+	size_t maxlen = 0;
+	for (size_t i = 0; i < npaths; i++) {
+		size_t n = paths[i] ? strlen(paths[i]) : 0;
+		if (n > maxlen)
+			maxlen = n;
+	}
+	struct touched *ts = malloc((npaths + 1) * sizeof(*ts));
+	char *buf = malloc(maxlen + 1);
+	if (!ts || !buf) {
+		free(ts);
+		free(buf);
+		*failed = true;
+		return NULL;
+	}
+
+	size_t n = 0;
+	for (size_t i = 0; i < npaths; i++) {
+		ts[n].path = paths[i] ? paths[i] : "";
+		if (touched_resolve(s->doc, next, buf, &ts[n]))
+			n++;
+	}
+	qsort(ts, n, sizeof(*ts), touched_cmp);
+
+	struct json_diff_arena scratch = {.head = NULL};
+	struct json_diff_ctx ctx = {.opts = &s->opts, .scratch = &scratch};
+	struct json_diff_arena *arena = s->opts.arena;
+	cJSON *root = NULL;
+	const struct touched *kept = NULL;
+	for (size_t i = 0; i < n && !*failed; i++) {
+		const struct touched *t = &ts[i];
+		if (kept && touched_covers(kept, t))
+			continue;
+		kept = t;
+		cJSON *d = !t->left    ? diff_addition_array(&ctx, t->right)
+		           : !t->right ? diff_deletion_array(&ctx, t->left)
+		                       : json_diff(t->left, t->right, &s->opts);
+		if (d && !graft(arena, s->doc, &root, t, buf, d)) {
+			diff_delete(arena, d);
+			*failed = true;
+		}
+	}
+	json_diff_arena_cleanup(&scratch);
+	free(buf);
+	free(ts);
+	if (*failed) {
+		diff_delete(arena, root);
+		return NULL;
+	}
+	return root;
+}
+
+struct json_diff_session *
+json_diff_session_new(const cJSON *doc, const struct json_diff_options *opts)
+{
+	if (!doc)
+		return NULL;
+	struct json_diff_session *s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	s->opts = opts ? *opts
+	               : (struct json_diff_options){.strict_equality = true};
+	/* Borrowed values would point into the copy the next patch rewrites */
+	s->opts.output = JSON_DIFF_OUTPUT_OWNED;
+	s->doc = cJSON_Duplicate(doc, 1);
+	if (!s->doc) {
+		free(s);
+		return NULL;
+	}
+	return s;
+}
+
+cJSON *json_diff_session_next(struct json_diff_session *s, const cJSON *next,
+                              const char *const *paths, size_t npaths)
+{
+	if (!s || !next)
+		return NULL;
+	if (!s->doc) {
+		s->doc = cJSON_Duplicate(next, 1);
+		return NULL;
+	}
+
+	bool failed = false;
+	/* Path filters count from the root, so they need the whole diff */
+	cJSON *d = paths && !json_diff_filtering(&s->opts)
+	               ? diff_touched(s, next, paths, npaths, &failed)
+	               : json_diff(s->doc, next, &s->opts);
+	if (d && !(s->doc = json_patch_inplace(s->doc, d)))
+		failed = true;
+	if (failed) {
+		/* Start over from @next rather than lose track of it */
+		cJSON_Delete(s->doc);
+		s->doc = cJSON_Duplicate(next, 1);
+		json_diff_free(d, &s->opts);
+		return NULL;
+	}
+	return d;
+}
+
+const cJSON *json_diff_session_doc(const struct json_diff_session *s)
+{
+	return s ? s->doc : NULL;
+}
+
+void json_diff_session_free(struct json_diff_session *s)
+{
+	if (!s)
+		return;
+	cJSON_Delete(s->doc);
+	free(s);
+}
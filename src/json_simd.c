@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "json_simd.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SIMD_X86 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SIMD_NEON 1
+#endif
+
+/* Tolerance of non-strict number equality, as in json_value_equal() */
+#define NUM_TOLERANCE 1e-9
+
+/* Below this memcmp() is as fast; above it every body can overlap its tail */
+#define MEM_MIN 32
+
+static size_t num_mismatch_scalar(const double *a, const double *b, size_t i,
+                                  size_t n, bool strict)
+{
+	for (; i < n; i++) {
+		if (strict ? !(a[i] == b[i])
+		           : !(fabs(a[i] - b[i]) < NUM_TOLERANCE))
+			return i;
+	}
+	return n;
+}
+
+#ifdef SIMD_X86
+static bool have_avx2(void)
+{
+#ifdef __AVX2__
+	return true;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+__attribute__((target("avx2"))) static int eq32(const unsigned char *a,
+                                                const unsigned char *b)
+{
+	__m256i x = _mm256_loadu_si256((const __m256i *)(const void *)a);
+	__m256i y = _mm256_loadu_si256((const __m256i *)(const void *)b);
+	return (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) ==
+	       0xFFFFFFFFu;
+}
+
+__attribute__((target("avx2"))) static bool
+mem_equal_avx2(const unsigned char *a, const unsigned char *b, size_t n)
+{
+	size_t i = 0;
+	for (; i + 128 <= n; i += 128) {
+		__m256i m = _mm256_set1_epi8(-1);
+		for (size_t j = i; j < i + 128; j += 32) {
+			__m256i x = _mm256_loadu_si256(
+			    (const __m256i *)(const void *)(a + j));
+			__m256i y = _mm256_loadu_si256(
+			    (const __m256i *)(const void *)(b + j));
+			m = _mm256_and_si256(m, _mm256_cmpeq_epi8(x, y));
+		}
+		if ((unsigned)_mm256_movemask_epi8(m) != 0xFFFFFFFFu)
+			return false;
+	}
+	for (; i + 32 <= n; i += 32) {
+		if (!eq32(a + i, b + i))
+			return false;
+	}
+	/* n >= MEM_MIN, so the last 32 bytes overlap what was compared */
+	return i == n || eq32(a + n - 32, b + n - 32);
+}
+
+__attribute__((target("avx2"))) static size_t
+num_mismatch_avx2(const double *a, const double *b, size_t n, bool strict)
+{
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	const __m256d eps = _mm256_set1_pd(NUM_TOLERANCE);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256d x = _mm256_loadu_pd(a + i), y = _mm256_loadu_pd(b + i);
+		__m256d diff = _mm256_andnot_pd(sign, _mm256_sub_pd(x, y));
+		__m256d bad = strict ? _mm256_cmp_pd(x, y, _CMP_NEQ_UQ)
+		                     : _mm256_cmp_pd(diff, eps, _CMP_NLT_UQ);
+		if (_mm256_movemask_pd(bad))
+			break;
+	}
+	return num_mismatch_scalar(a, b, i, n, strict);
+}
+
+static int eq16(const unsigned char *a, const unsigned char *b)
+{
+	__m128i x = _mm_loadu_si128((const __m128i *)(const void *)a);
+	__m128i y = _mm_loadu_si128((const __m128i *)(const void *)b);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xFFFF;
+}
+
+static bool mem_equal_sse2(const unsigned char *a, const unsigned char *b,
+                           size_t n)
+{
+	size_t i = 0;
+	for (; i + 64 <= n; i += 64) {
+		__m128i m = _mm_set1_epi8(-1);
+		for (size_t j = i; j < i + 64; j += 16) {
+			__m128i x = _mm_loadu_si128(
+			    (const __m128i *)(const void *)(a + j));
+			__m128i y = _mm_loadu_si128(
+			    (const __m128i *)(const void *)(b + j));
+			m = _mm_and_si128(m, _mm_cmpeq_epi8(x, y));
+		}
+		if (_mm_movemask_epi8(m) != 0xFFFF)
+			return false;
+	}
+	for (; i + 16 <= n; i += 16) {
+		if (!eq16(a + i, b + i))
+			return false;
+	}
+	return i == n || eq16(a + n - 16, b + n - 16);
+}
+
+static size_t num_mismatch_sse2(const double *a, const double *b, size_t n,
+                                bool strict)
+{
+	const __m128d sign = _mm_set1_pd(-0.0);
+	const __m128d eps = _mm_set1_pd(NUM_TOLERANCE);
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2) {
+		__m128d x = _mm_loadu_pd(a + i), y = _mm_loadu_pd(b + i);
+		__m128d diff = _mm_andnot_pd(sign, _mm_sub_pd(x, y));
+		__m128d bad = strict ? _mm_cmpneq_pd(x, y)
+		                     : _mm_cmpnlt_pd(diff, eps);
+		if (_mm_movemask_pd(bad))
+			break;
+	}
+	return num_mismatch_scalar(a, b, i, n, strict);
+}
+#endif /* SIMD_X86 */
+
+#ifdef SIMD_NEON
+static bool mem_equal_neon(const unsigned char *a, const unsigned char *b,
+                           size_t n)
+{
+	size_t i = 0;
+	for (; i + 64 <= n; i += 64) {
+		uint8x16_t m = vdupq_n_u8(0xFF);
+		for (size_t j = i; j < i + 64; j += 16)
+			m = vandq_u8(m, vceqq_u8(vld1q_u8(a + j),
+			                         vld1q_u8(b + j)));
+		if (vminvq_u8(m) != 0xFF)
+			return false;
+	}
+	for (; i + 16 <= n; i += 16) {
+		if (vminvq_u8(vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i))) !=
+		    0xFF)
+			return false;
+	}
+	return i == n || vminvq_u8(vceqq_u8(vld1q_u8(a + n - 16),
+	                                    vld1q_u8(b + n - 16))) == 0xFF;
+}
+
+static size_t num_mismatch_neon(const double *a, const double *b, size_t n,
+                                bool strict)
+{
+	const float64x2_t eps = vdupq_n_f64(NUM_TOLERANCE);
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2) {
+		float64x2_t x = vld1q_f64(a + i), y = vld1q_f64(b + i);
+		uint64x2_t ok = strict ? vceqq_f64(x, y)
+		                       : vcltq_f64(vabdq_f64(x, y), eps);
+		if ((vgetq_lane_u64(ok, 0) & vgetq_lane_u64(ok, 1)) !=
+		    UINT64_MAX)
+			break;
+	}
+	return num_mismatch_scalar(a, b, i, n, strict);
+}
+#endif /* SIMD_NEON */
+
+bool json_simd_mem_equal(const void *a, const void *b, size_t n)
+{
+	if (n < MEM_MIN)
+		return memcmp(a, b, n) == 0;
+#if defined(SIMD_X86)
+	if (have_avx2())
+		return mem_equal_avx2(a, b, n);
+	return mem_equal_sse2(a, b, n);
+#elif defined(SIMD_NEON)
+	return mem_equal_neon(a, b, n);
+#else
+	return memcmp(a, b, n) == 0;
+#endif
+}
+
+size_t json_simd_num_mismatch(const double *a, const double *b, size_t n,
+                              bool strict)
+{
+#if defined(SIMD_X86)
+	if (have_avx2())
+		return num_mismatch_avx2(a, b, n, strict);
+	return num_mismatch_sse2(a, b, n, strict);
+#elif defined(SIMD_NEON)
+	return num_mismatch_neon(a, b, n, strict);
+#else
+	return num_mismatch_scalar(a, b, 0, n, strict);
+#endif
+}
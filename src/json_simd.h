@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+#ifndef JSON_SIMD_H
+#define JSON_SIMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Comparison kernels for long strings and runs of numbers. Each has an
+ * AVX2 body picked at run time on x86-64, an SSE2 or NEON body where the
+ * target guarantees one, and a portable fallback; all give the same
+ * results.
+ */
+
+/* Runs gathered for json_simd_num_mismatch() by the tree walkers */
+#define JSON_SIMD_NUM_RUN 64
+
+/**
+ * json_simd_mem_equal - Byte equality of two buffers
+ * @a: first buffer
+ * @b: second buffer
+ * @n: bytes in each
+ *
+ * Like memcmp() == 0 without ordering the first difference. Never reads
+ * outside the @n bytes of either buffer.
+ *
+ * Return: true if the buffers hold the same bytes
+ */
+bool json_simd_mem_equal(const void *a, const void *b, size_t n);
+
+/**
+ * json_simd_num_mismatch - First pair of numbers that differ
+ * @a: first run
+ * @b: second run
+ * @n: numbers in each
+ * @strict: compare with == instead of within 1e-9
+ *
+ * Uses json_value_equal()'s number rules: NaN never matches, and -0.0
+ * matches 0.0.
+ *
+ * Return: index of the first unequal pair, @n if all are equal
+ */
+size_t json_simd_num_mismatch(const double *a, const double *b, size_t n,
+                              bool strict);
+
+#endif /* JSON_SIMD_H */
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: Apache-2.0
+#define _POSIX_C_SOURCE 200809L
+#include "json_diff_internal.h"
+#include <time.h>
+
+uint64_t json_diff_stats_clock(const struct json_diff_stats *stats)
+{
+	struct timespec ts;
+	if (!stats || clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void json_diff_stats_add(struct json_diff_stats *dst,
+                         const struct json_diff_stats *src)
+{
+	dst->calls += src->calls;
+	dst->total_ns += src->total_ns;
+	dst->parse_ns += src->parse_ns;
+	dst->hash_ns += src->hash_ns;
+	dst->index_ns += src->index_ns;
+	dst->script_ns += src->script_ns;
+	dst->equal_calls += src->equal_calls;
+	dst->key_indexes += src->key_indexes;
+	dst->arrays += src->arrays;
+	dst->fallbacks += src->fallbacks;
+	if (src->max_d > dst->max_d)
+		dst->max_d = src->max_d;
+	dst->bytes_allocated += src->bytes_allocated;
+	if (src->arena_high_water > dst->arena_high_water)
+		dst->arena_high_water = src->arena_high_water;
+	dst->nodes_emitted += src->nodes_emitted;
+	dst->bytes_written += src->bytes_written;
+}
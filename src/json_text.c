@@ -0,0 +1,691 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "json_diff_internal.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Text diffs of long strings, as jsondiffpatch's textDiff writes them:
+ * [patch, 0, 2] where patch is google-diff-match-patch patch text,
+ *
+ *	@@ -start1,length1 +start2,length2 @@
+ *	 context
+ *	-removed
+ *	+inserted
+ *
+ * with every line after its sign in encodeURI() form and positions
+ * counted in UTF-16 code units, as JavaScript counts them. A hunk's start
+ * is where it lands in the text as patched by the hunks before it.
+ *
+ * The edit script comes from the array engines in two passes: lines
+ * first, so long unchanged stretches cost one id each, then the code
+ * points of each run of changed lines. A run whose code points differ
+ * too much for JSON_TEXT_MAX_EDIT_COST stays a whole-line replacement.
+ */
+
+/* Code points of context around a hunk, diff-match-patch's Patch_Margin */
+#define TEXT_MARGIN 4
+
+#ifndef JSON_TEXT_MAX_EDIT_COST
+#define JSON_TEXT_MAX_EDIT_COST 4096
+#endif
+
+/* Growable byte buffer; @failed once an allocation fails */
+struct text_buf {
+	char *data;
+	size_t len;
+	size_t cap;
+	bool failed;
+};
+
+static void buf_put(struct text_buf *b, const char *s, size_t n)
+{
+	if (b->failed)
+		return;
+	if (b->cap - b->len <= n) {
+		size_t cap = b->cap ? b->cap : 256;
+		while (cap - b->len <= n)
+			cap *= 2;
+		char *grown = realloc(b->data, cap);
+		if (!grown) {
+			b->failed = true;
+			return;
+		}
+		b->data = grown;
+		b->cap = cap;
+	}
+	memcpy(b->data + b->len, s, n);
+	b->len += n;
+	b->data[b->len] = '\0';
+}
+
+/* Length of the well-formed UTF-8 sequence at @s, 0 if there is none */
+static size_t utf8_len(const unsigned char *s, const unsigned char *end)
+{
+	size_t n = end - s;
+	unsigned char c = s[0];
+	if (c < 0x80)
+		return 1;
+	if (c >= 0xC2 && c <= 0xDF)
+		return n >= 2 && (s[1] & 0xC0) == 0x80 ? 2 : 0;
+	if (c >= 0xE0 && c <= 0xEF) {
+		unsigned char lo = c == 0xE0 ? 0xA0 : 0x80;
+		unsigned char hi = c == 0xED ? 0x9F : 0xBF;
+		return n >= 3 && s[1] >= lo && s[1] <= hi &&
+		               (s[2] & 0xC0) == 0x80
+		           ? 3
+		           : 0;
+	}
+	if (c >= 0xF0 && c <= 0xF4) {
+		unsigned char lo = c == 0xF0 ? 0x90 : 0x80;
+		unsigned char hi = c == 0xF4 ? 0x8F : 0xBF;
+		return n >= 4 && s[1] >= lo && s[1] <= hi &&
+		               (s[2] & 0xC0) == 0x80 && (s[3] & 0xC0) == 0x80
+		           ? 4
+		           : 0;
+	}
+	return 0;
+}
+
+static bool utf8_valid(const char *s, size_t n)
+{
+	const unsigned char *p = (const unsigned char *)s, *end = p + n;
+	while (p < end) {
+		size_t k = utf8_len(p, end);
+		if (!k)
+			return false;
+		p += k;
+	}
+	return true;
+}
+
+/* UTF-16 code units of the byte: 1 for a lead byte, 2 for a 4-byte one */
+static size_t byte_units(unsigned char c)
+{
+	return ((c & 0xC0) != 0x80) + (c >= 0xF0);
+}
+
+static size_t utf16_units(const char *s, size_t n)
+{
+	size_t u = 0;
+	for (size_t i = 0; i < n; i++)
+		u += byte_units((unsigned char)s[i]);
+	return u;
+}
+
+/*
+ * Edit script over byte spans; equal spans have the same bytes on both
+ * sides, at @a in the old text and @b in the new one
+ */
+struct text_op {
+	int type;
+	size_t a;
+	size_t b;
+	size_t len;
+};
+
+struct text_ops {
+	struct text_op *v;
+	size_t n;
+	size_t cap;
+	bool failed;
+};
+
+/* Append an operation, extending the last one if it continues it */
+static void op_push(struct text_ops *l, int type, size_t a, size_t b,
+                    size_t len)
+{
+	if (!len || l->failed)
+		return;
+	struct text_op *last = l->n ? &l->v[l->n - 1] : NULL;
+	if (last && last->type == type &&
+	    (type == MYERS_INS || last->a + last->len == a) &&
+	    (type == MYERS_DEL || last->b + last->len == b)) {
+		last->len += len;
+		return;
+	}
+	if (l->n == l->cap) {
+		size_t cap = l->cap ? l->cap * 2 : 16;
+		struct text_op *grown = realloc(l->v, cap * sizeof(*grown));
+		if (!grown) {
+			l->failed = true;
+			return;
+		}
+		l->v = grown;
+		l->cap = cap;
+	}
+	l->v[l->n++] = (struct text_op){type, a, b, len};
+}
+
+/* Start offsets of the lines of @s[0, n), each keeping its '\n', then n */
+static size_t *line_starts(const char *s, size_t n, int *count)
+{
+	size_t lines = 1;
+	for (const char *p = s; (p = memchr(p, '\n', n - (p - s))); p++)
+		lines++;
+	if (lines > INT_MAX - 1)
+		return NULL;
+	size_t *starts = malloc((lines + 1) * sizeof(*starts));
+	if (!starts)
+		return NULL;
+	int k = 0;
+	starts[k++] = 0;
+	for (const char *p = s; (p = memchr(p, '\n', n - (p - s))); p++)
+		if ((size_t)(p + 1 - s) < n)
+			starts[k++] = (size_t)(p + 1 - s);
+	starts[k] = n;
+	*count = n ? k : 0;
+	return starts;
+}
+
+struct line_slot {
+	const char *s;
+	size_t len;
+	uint64_t hash;
+	int id;
+};
+
+/* FNV-1a over the line's bytes */
+static uint64_t line_hash(const char *s, size_t n)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < n; i++)
+		h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+	return h;
+}
+
+/* Number equal lines alike: ids[i] for line i of @s, split at @starts */
+static void line_ids(struct line_slot *tab, size_t mask, int *next,
+                     const char *s, const size_t *starts, int count,
+                     int *ids)
+{
+	for (int i = 0; i < count; i++) {
+		const char *line = s + starts[i];
+		size_t len = starts[i + 1] - starts[i];
+		uint64_t h = line_hash(line, len);
+		size_t k = (size_t)h & mask;
+		while (tab[k].s && !(tab[k].hash == h && tab[k].len == len &&
+		                     memcmp(tab[k].s, line, len) == 0))
+			k = (k + 1) & mask;
+		if (!tab[k].s)
+			tab[k] = (struct line_slot){line, len, h, (*next)++};
+		ids[i] = tab[k].id;
+	}
+}
+
+/* Code points of @s[0, n) as ids, and the offset each one starts at */
+static int code_points(const char *s, size_t n, int *ids, size_t *off)
+{
+	const unsigned char *p = (const unsigned char *)s, *end = p + n;
+	int k = 0;
+	while (p < end) {
+		size_t len = utf8_len(p, end);
+		uint32_t cp = len == 1 ? p[0] : p[0] & (0x7F >> len);
+		for (size_t i = 1; i < len; i++)
+			cp = (cp << 6) | (p[i] & 0x3F);
+		off[k] = (size_t)(p - (const unsigned char *)s);
+		ids[k++] = (int)cp;
+		p += len;
+	}
+	off[k] = n;
+	return k;
+}
+
+/* Script of changed run @a[a0, a1) to @b[b0, b1), code point by code point */
+static void region_script(const char *a, size_t a0, size_t a1, const char *b,
+                          size_t b0, size_t b1,
+                          const struct json_diff_options *opts,
+                          struct text_ops *ops)
+{
+	size_t na = a1 - a0, nb = b1 - b0;
+	int *ia = NULL, *ib = NULL;
+	size_t *oa = NULL, *ob = NULL;
+	struct myers_seg *segs = NULL;
+	int nsegs = 0;
+	bool inexact = false;
+	struct json_diff_options o = *opts;
+	o.stats = NULL;
+	o.inexact = &inexact;
+	if (o.max_edit_cost <= 0 || o.max_edit_cost > JSON_TEXT_MAX_EDIT_COST)
+		o.max_edit_cost = JSON_TEXT_MAX_EDIT_COST;
+
+	if (na && nb && na < INT_MAX && nb < INT_MAX) {
+		ia = malloc(na * sizeof(*ia));
+		ib = malloc(nb * sizeof(*ib));
+		oa = malloc((na + 1) * sizeof(*oa));
+		ob = malloc((nb + 1) * sizeof(*ob));
+	}
+	if (ia && ib && oa && ob) {
+		int n = code_points(a + a0, na, ia, oa);
+		int m = code_points(b + b0, nb, ib, ob);
+		if (!json_myers_script_ids(ia, n, ib, m, &o, &segs, &nsegs))
+			ops->failed = true;
+	}
+	if (!segs || inexact) {
+		/* Too far apart (or empty on one side): replace the run */
+		op_push(ops, MYERS_DEL, a0, b0, na);
+		op_push(ops, MYERS_INS, a1, b0, nb);
+	} else {
+		for (int i = 0; i < nsegs; i++) {
+			const struct myers_seg *s = &segs[i];
+			size_t pa = a0 + oa[s->a_start], pb = b0 + ob[s->b_start];
+			size_t len = s->type == MYERS_INS
+			                 ? ob[s->b_start + s->len] - ob[s->b_start]
+			                 : oa[s->a_start + s->len] - oa[s->a_start];
+			op_push(ops, s->type, pa, pb, len);
+		}
+	}
+	free(segs);
+	free(ia);
+	free(ib);
+	free(oa);
+	free(ob);
+}
+
+/* Edit script of @a to @b: lines, then code points of the changed runs */
+static void text_script(const char *a, size_t na, const char *b, size_t nb,
+                        const struct json_diff_options *opts,
+                        struct text_ops *ops)
+{
+	int nla = 0, nlb = 0, next = 0, nsegs = 0;
+	size_t *la = line_starts(a, na, &nla), *lb = line_starts(b, nb, &nlb);
+	size_t cap = 1;
+	while (la && lb && cap < 2 * ((size_t)nla + (size_t)nlb))
+		cap *= 2;
+	struct line_slot *tab = calloc(cap, sizeof(*tab));
+	int *ia = malloc(((size_t)nla + 1) * sizeof(*ia));
+	int *ib = malloc(((size_t)nlb + 1) * sizeof(*ib));
+	struct myers_seg *segs = NULL;
+	struct json_diff_options o = *opts;
+	o.stats = NULL;
+	if (!la || !lb || !tab || !ia || !ib) {
+		ops->failed = true;
+		goto out;
+	}
+	line_ids(tab, cap - 1, &next, a, la, nla, ia);
+	line_ids(tab, cap - 1, &next, b, lb, nlb, ib);
+	if (!json_myers_script_ids(ia, nla, ib, nlb, &o, &segs, &nsegs)) {
+		ops->failed = true;
+		goto out;
+	}
+
+	/* Runs of changed lines are refined before the next equal lines */
+	int pa = 0, pb = 0, ra = 0, rb = 0;
+	for (int i = 0; i <= nsegs && !ops->failed; i++) {
+		const struct myers_seg *s = i < nsegs ? &segs[i] : NULL;
+		if (s && s->type != MYERS_EQUAL) {
+			if (s->type == MYERS_DEL)
+				pa += s->len;
+			else
+				pb += s->len;
+			continue;
+		}
+		if (pa > ra || pb > rb)
+			region_script(a, la[ra], la[pa], b, lb[rb], lb[pb],
+			              opts, ops);
+		if (!s)
+			break;
+		op_push(ops, MYERS_EQUAL, la[pa], lb[pb],
+		        la[pa + s->len] - la[pa]);
+		ra = pa += s->len;
+		rb = pb += s->len;
+	}
+out:
+	free(segs);
+	free(la);
+	free(lb);
+	free(tab);
+	free(ia);
+	free(ib);
+}
+
+/* Number of code points in @s[0, n), counting no further than @max */
+static size_t cp_count(const char *s, size_t n, size_t max)
+{
+	size_t k = 0;
+	for (size_t i = 0; i < n && k <= max; i++)
+		k += ((unsigned char)s[i] & 0xC0) != 0x80;
+	return k;
+}
+
+/* Offset @count code points back from @pos in @s, no further than @lo */
+static size_t cp_back(const char *s, size_t pos, size_t lo, int count)
+{
+	while (count-- > 0 && pos > lo) {
+		pos--;
+		while (pos > lo && ((unsigned char)s[pos] & 0xC0) == 0x80)
+			pos--;
+	}
+	return pos;
+}
+
+/* Offset @count code points on from @pos in @s, no further than @hi */
+static size_t cp_forward(const char *s, size_t pos, size_t hi, int count)
+{
+	while (count-- > 0 && pos < hi) {
+		pos++;
+		while (pos < hi && ((unsigned char)s[pos] & 0xC0) == 0x80)
+			pos++;
+	}
+	return pos;
+}
+
+/* Characters encodeURI() leaves alone, besides ASCII letters and digits */
+static const char uri_marks[] = "-_.!~*'();/?:@&=+$,#";
+
+/* One patch line: @sign, then @s[0, n) as encodeURI() with spaces kept */
+static void put_line(struct text_buf *out, char sign, const char *s,
+                     size_t n)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	buf_put(out, &sign, 1);
+	while (n) {
+		size_t run = 0;
+		while (run < n) {
+			unsigned char c = (unsigned char)s[run];
+			if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+			      (c >= '0' && c <= '9') || c == ' ' ||
+			      (c < 0x80 && strchr(uri_marks, c))))
+				break;
+			run++;
+		}
+		buf_put(out, s, run);
+		if (run < n) {
+			unsigned char c = (unsigned char)s[run];
+			char esc[3] = {'%', hex[c >> 4], hex[c & 15]};
+			buf_put(out, esc, 3);
+			run++;
+		}
+		s += run;
+		n -= run;
+	}
+	buf_put(out, "\n", 1);
+}
+
+/* Hunk coordinates the way diff-match-patch prints them */
+static void put_coords(struct text_buf *out, char sign, size_t start,
+                       size_t len)
+{
+	char tmp[64];
+	if (len == 0)
+		snprintf(tmp, sizeof(tmp), "%c%zu,0", sign, start);
+	else if (len == 1)
+		snprintf(tmp, sizeof(tmp), "%c%zu", sign, start + 1);
+	else
+		snprintf(tmp, sizeof(tmp), "%c%zu,%zu", sign, start + 1, len);
+	buf_put(out, tmp, strlen(tmp));
+}
+
+/*
+ * Patch text of @ops: every change with up to TEXT_MARGIN code points of
+ * context each side; changes less than twice that apart share a hunk
+ */
+static void write_hunks(const char *a, const char *b,
+                        const struct text_ops *ops, struct text_buf *out)
+{
+	size_t done_b = 0, units_b = 0;
+	for (size_t i = 0; i < ops->n && !out->failed;) {
+		if (ops->v[i].type == MYERS_EQUAL) {
+			i++;
+			continue;
+		}
+		/* Leading context from the equal run before the change */
+		const struct text_op *eq = i ? &ops->v[i - 1] : NULL;
+		size_t pre = eq ? eq->b + eq->len -
+		                      cp_back(b, eq->b + eq->len, eq->b,
+		                              TEXT_MARGIN)
+		                : 0;
+		size_t end = i;
+		size_t post = 0;
+		for (; end < ops->n; end++) {
+			const struct text_op *op = &ops->v[end];
+			if (op->type != MYERS_EQUAL)
+				continue;
+			if (end + 1 < ops->n &&
+			    cp_count(b + op->b, op->len, 2 * TEXT_MARGIN) <=
+			        2 * TEXT_MARGIN)
+				continue;
+			post = cp_forward(b, op->b, op->b + op->len,
+			                  TEXT_MARGIN) -
+			       op->b;
+			break;
+		}
+
+		size_t start = ops->v[i].b - pre;
+		size_t len1 = 0, len2 = 0;
+		units_b += utf16_units(b + done_b, start - done_b);
+		len1 = len2 = utf16_units(b + start, pre);
+		for (size_t k = i; k < end; k++) {
+			const struct text_op *op = &ops->v[k];
+			size_t u = op->type == MYERS_INS
+			               ? utf16_units(b + op->b, op->len)
+			               : utf16_units(a + op->a, op->len);
+			len1 += op->type != MYERS_INS ? u : 0;
+			len2 += op->type != MYERS_DEL ? u : 0;
+		}
+		if (post) {
+			size_t u = utf16_units(b + ops->v[end].b, post);
+			len1 += u;
+			len2 += u;
+		}
+
+		buf_put(out, "@@ ", 3);
+		put_coords(out, '-', units_b, len1);
+		buf_put(out, " ", 1);
+		put_coords(out, '+', units_b, len2);
+		buf_put(out, " @@\n", 4);
+		if (pre)
+			put_line(out, ' ', b + start, pre);
+		for (size_t k = i; k < end; k++) {
+			const struct text_op *op = &ops->v[k];
+			if (op->type == MYERS_EQUAL)
+				put_line(out, ' ', b + op->b, op->len);
+			else if (op->type == MYERS_DEL)
+				put_line(out, '-', a + op->a, op->len);
+			else
+				put_line(out, '+', b + op->b, op->len);
+		}
+		if (post)
+			put_line(out, ' ', b + ops->v[end].b, post);
+		done_b = start;
+		i = end;
+	}
+}
+
+char *json_text_diff(const char *left, const char *right,
+                     const struct json_diff_options *opts)
+{
+	size_t min = opts->text_diff_min_length;
+	if (!min || !left || !right || memchr(left, '\0', min) ||
+	    memchr(right, '\0', min))
+		return NULL;
+	size_t na = strlen(left), nb = strlen(right);
+	if (!utf8_valid(left, na) || !utf8_valid(right, nb))
+		return NULL;
+
+	struct text_ops ops = {0};
+	struct text_buf out = {0};
+	text_script(left, na, right, nb, opts, &ops);
+	if (!ops.failed)
+		write_hunks(left, right, &ops, &out);
+	free(ops.v);
+	/* Not worth it unless the patch is shorter than the new text */
+	if (ops.failed || out.failed || !out.len || out.len >= nb) {
+		free(out.data);
+		return NULL;
+	}
+	return out.data;
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/*
+ * Next byte of the encodeURI() text at *@p, before @eol; -1 if malformed.
+ * Escaped reserved characters stay escaped, as decodeURI() leaves them.
+ */
+static int uri_byte(const char **p, const char *eol)
+{
+	const char *s = *p;
+	*p = s + 1;
+	if (*s != '%')
+		return (unsigned char)*s;
+	if (eol - s < 3 || hex_digit(s[1]) < 0 || hex_digit(s[2]) < 0)
+		return -1;
+	int c = hex_digit(s[1]) * 16 + hex_digit(s[2]);
+	if (!c)
+		return -1;
+	if (c < 0x80 && strchr(";/?:@&=+$,#", c))
+		return '%';
+	*p = s + 3;
+	return c;
+}
+
+static bool read_size(const char **p, size_t *v)
+{
+	const char *s = *p;
+	*v = 0;
+	if (*s < '0' || *s > '9')
+		return false;
+	for (; *s >= '0' && *s <= '9'; s++) {
+		if (*v > (SIZE_MAX - 9) / 10)
+			return false;
+		*v = *v * 10 + (size_t)(*s - '0');
+	}
+	*p = s;
+	return true;
+}
+
+/* "@@ -a[,b] +c[,d] @@": the hunk's position in the text patched so far */
+static bool read_header(const char **p, size_t *start)
+{
+	const char *s = *p;
+	size_t v, len = 1;
+	if (strncmp(s, "@@ -", 4) != 0)
+		return false;
+	s += 4;
+	if (!read_size(&s, &v) || (*s == ',' && (s++, !read_size(&s, &v))) ||
+	    strncmp(s, " +", 2) != 0)
+		return false;
+	s += 2;
+	if (!read_size(&s, start))
+		return false;
+	if (*s == ',') {
+		s++;
+		if (!read_size(&s, &len))
+			return false;
+	}
+	if (strncmp(s, " @@", 3) != 0)
+		return false;
+	s += 3;
+	if (*s && *s != '\n')
+		return false;
+	/* Zero-length hunks print a 0-based start, the others 1-based */
+	if (len) {
+		if (!*start)
+			return false;
+		--*start;
+	}
+	*p = s + (*s == '\n');
+	return true;
+}
+
+/*
+ * Apply @patch to @text into @out, or only measure the result when @out
+ * is NULL. Return: length of the result, or SIZE_MAX if @patch is
+ * malformed or does not match @text exactly
+ */
+static size_t apply_hunks(const char *text, const char *patch, char *out)
+{
+	const char *src = text;
+	size_t len = 0, units = 0;
+	for (const char *p = patch; *p;) {
+		size_t start;
+		if (!read_header(&p, &start) || start < units)
+			return SIZE_MAX;
+		/* Unchanged text up to the hunk */
+		for (; units < start; src++) {
+			if (!*src)
+				return SIZE_MAX;
+			units += byte_units((unsigned char)*src);
+			if (out)
+				out[len] = *src;
+			len++;
+		}
+		while (*p && *p != '@') {
+			const char *eol = strchr(p, '\n');
+			if (!eol)
+				eol = p + strlen(p);
+			char sign = *p;
+			if (sign != ' ' && sign != '-' && sign != '+' &&
+			    eol != p)
+				return SIZE_MAX;
+			for (const char *s = p + (eol != p); s < eol;) {
+				int c = uri_byte(&s, eol);
+				if (c < 0 ||
+				    (sign != '+' && (unsigned char)*src != c))
+					return SIZE_MAX;
+				if (sign != '+')
+					src++;
+				if (sign == '-')
+					continue;
+				units += byte_units((unsigned char)c);
+				if (out)
+					out[len] = (char)c;
+				len++;
+			}
+			p = *eol ? eol + 1 : eol;
+		}
+	}
+	size_t rest = strlen(src);
+	if (out) {
+		memcpy(out + len, src, rest);
+		out[len + rest] = '\0';
+	}
+	return len + rest;
+}
+
+char *json_text_patch(const char *text, const char *patch)
+{
+	if (!text || !patch)
+		return NULL;
+	size_t len = apply_hunks(text, patch, NULL);
+	char *out = len == SIZE_MAX ? NULL : cJSON_malloc(len + 1);
+	if (out)
+		apply_hunks(text, patch, out);
+	return out;
+}
+
+bool diff_is_text_op(const cJSON *d)
+{
+	const cJSON *v0 = cJSON_IsArray(d) ? d->child : NULL;
+	const cJSON *v1 = v0 ? v0->next : NULL;
+	const cJSON *v2 = v1 ? v1->next : NULL;
+	return v2 && !v2->next && cJSON_IsString(v0) && cJSON_IsNumber(v1) &&
+	       v1->valuedouble == 0 && cJSON_IsNumber(v2) &&
+	       v2->valuedouble == 2;
+}
+
+bool json_text_patch_node(cJSON *target, const char *patch)
+{
+	if (!cJSON_IsString(target) || !target->valuestring)
+		return false;
+	char *s = json_text_patch(target->valuestring, patch);
+	if (!s)
+		return false;
+	if (!(target->type & cJSON_IsReference))
+		cJSON_free(target->valuestring);
+	target->type &= ~cJSON_IsReference;
+	target->valuestring = s;
+	return true;
+}
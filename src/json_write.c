@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "json_write.h"
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+void json_writer_init(struct json_writer *w, json_diff_write_fn fn,
+                      void *data)
+{
+	w->fn = fn;
+	w->data = data;
+	w->len = 0;
+	w->total = 0;
+	w->last = '\0';
+	w->failed = false;
+}
+
+int json_writer_flush(struct json_writer *w)
+{
+	if (!w->failed && w->len && w->fn(w->buf, w->len, w->data) != 0)
+		w->failed = true;
+	w->len = 0;
+	return w->failed ? -1 : 0;
+}
+
+void json_write_raw(struct json_writer *w, const char *s, size_t n)
+{
+	if (w->failed || !n)
+		return;
+	w->total += n;
+	w->last = s[n - 1];
+	while (n) {
+		if (w->len == sizeof(w->buf) && json_writer_flush(w) != 0)
+			return;
+		size_t room = sizeof(w->buf) - w->len;
+		size_t chunk = n < room ? n : room;
+		memcpy(w->buf + w->len, s, chunk);
+		w->len += chunk;
+		s += chunk;
+		n -= chunk;
+	}
+}
+
+static void write_string(struct json_writer *w, const char *s)
+{
+	json_write_raw(w, "\"", 1);
+	const char *run = s ? s : "";
+	for (const char *p = run; s && *p; p++) {
+		unsigned char c = (unsigned char)*p;
+		const char *esc = NULL;
+		char ubuf[8];
+		switch (c) {
+		case '"': esc = "\\\""; break;
+		case '\\': esc = "\\\\"; break;
+		case '\b': esc = "\\b"; break;
+		case '\f': esc = "\\f"; break;
+		case '\n': esc = "\\n"; break;
+		case '\r': esc = "\\r"; break;
+		case '\t': esc = "\\t"; break;
+		default:
+			if (c < 32) {
+				snprintf(ubuf, sizeof(ubuf), "\\u%04x", c);
+				esc = ubuf;
+			}
+			break;
+		}
+		if (!esc)
+			continue;
+		json_write_raw(w, run, (size_t)(p - run));
+		json_write_raw(w, esc, strlen(esc));
+		run = p + 1;
+	}
+	json_write_raw(w, run, strlen(run));
+	json_write_raw(w, "\"", 1);
+}
+
+void json_write_key(struct json_writer *w, const char *key)
+{
+	if (w->last != '{')
+		json_write_raw(w, ",", 1);
+	write_string(w, key);
+	json_write_raw(w, ":", 1);
+}
+
+void json_write_number(struct json_writer *w, double d)
+{
+	char tmp[32];
+	double test = 0.0;
+	/* valueint as cJSON_CreateNumber() saturates it */
+	int vi = d >= INT_MAX ? INT_MAX : d <= (double)INT_MIN ? INT_MIN : (int)d;
+
+	if (isnan(d) || isinf(d)) {
+		snprintf(tmp, sizeof(tmp), "null");
+	} else if (d == (double)vi) {
+		snprintf(tmp, sizeof(tmp), "%d", vi);
+	} else {
+		snprintf(tmp, sizeof(tmp), "%1.15g", d);
+		if (sscanf(tmp, "%lg", &test) != 1 || test != d)
+			snprintf(tmp, sizeof(tmp), "%1.17g", d);
+	}
+	json_write_raw(w, tmp, strlen(tmp));
+}
+
+void json_write_value(struct json_writer *w, const cJSON *v)
+{
+	if (!v) {
+		json_write_raw(w, "null", 4);
+		return;
+	}
+	switch (v->type & 0xFF) {
+	case cJSON_False:
+		json_write_raw(w, "false", 5);
+		break;
+	case cJSON_True:
+		json_write_raw(w, "true", 4);
+		break;
+	case cJSON_Number:
+		json_write_number(w, v->valuedouble);
+		break;
+	case cJSON_String:
+		write_string(w, v->valuestring);
+		break;
+	case cJSON_Array:
+		json_write_raw(w, "[", 1);
+		for (const cJSON *ch = v->child; ch; ch = ch->next) {
+			json_write_value(w, ch);
+			if (ch->next)
+				json_write_raw(w, ",", 1);
+		}
+		json_write_raw(w, "]", 1);
+		break;
+	case cJSON_Object:
+		json_write_raw(w, "{", 1);
+		for (const cJSON *ch = v->child; ch; ch = ch->next) {
+			json_write_key(w, ch->string ? ch->string : "");
+			json_write_value(w, ch);
+		}
+		json_write_raw(w, "}", 1);
+		break;
+	default:
+		json_write_raw(w, "null", 4);
+		break;
+	}
+}
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+#ifndef JSON_WRITE_H
+#define JSON_WRITE_H
+
+#include "json_diff.h"
+
+#ifndef JSON_WRITER_BUF_SIZE
+#define JSON_WRITER_BUF_SIZE 4096
+#endif
+
+/**
+ * struct json_writer - Buffered JSON text output to a callback
+ * @fn: sink receiving each flushed chunk
+ * @data: opaque pointer handed to @fn
+ * @len: bytes pending in @buf
+ * @total: bytes produced so far, flushed or not
+ * @last: last byte produced, decides whether a key needs a comma
+ * @failed: @fn reported an error or the producer gave up; further
+ *	output is dropped
+ * @buf: pending output
+ *
+ * Output is unformatted, byte for byte what cJSON_PrintUnformatted()
+ * prints for the same tree.
+ */
+struct json_writer {
+	json_diff_write_fn fn;
+	void *data;
+	size_t len;
+	size_t total;
+	char last;
+	bool failed;
+	char buf[JSON_WRITER_BUF_SIZE];
+};
+
+/**
+ * json_writer_init - Prepare a writer
+ * @w: writer to initialise
+ * @fn: output callback
+ * @data: opaque pointer for @fn
+ */
+void json_writer_init(struct json_writer *w, json_diff_write_fn fn,
+                      void *data);
+
+/**
+ * json_writer_flush - Hand pending output to the callback
+ * @w: writer
+ *
+ * Return: 0 on success, -1 if the writer has failed
+ */
+int json_writer_flush(struct json_writer *w);
+
+/**
+ * json_write_raw - Append raw bytes
+ * @w: writer
+ * @s: bytes to append
+ * @n: number of bytes
+ */
+void json_write_raw(struct json_writer *w, const char *s, size_t n);
+
+/**
+ * json_write_key - Start an object member
+ * @w: writer
+ * @key: member name
+ *
+ * Emits the separating comma unless the member opens its object.
+ */
+void json_write_key(struct json_writer *w, const char *key);
+
+/**
+ * json_write_value - Serialize a value
+ * @w: writer
+ * @v: value to print, NULL prints null
+ *
+ * Raw nodes print as null, matching the copies json_diff() puts in a delta.
+ */
+void json_write_value(struct json_writer *w, const cJSON *v);
+
+/**
+ * json_write_number - Serialize a number the way cJSON does
+ * @w: writer
+ * @d: value
+ */
+void json_write_number(struct json_writer *w, double d);
+
+#endif /* JSON_WRITE_H */
@@ -1,11 +1,17 @@
 // SPDX-License-Identifier: Apache-2.0
 #define __STDC_WANT_LIB_EXT1__ 1
 #include "myers.h"
+#include "json_diff_internal.h"
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stddef.h>
+#include <stdint.h>
+#ifdef JSON_DIFF_THREADS
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
 
 #ifndef ARRAY_MARKER
 #define ARRAY_MARKER "_t"
@@ -14,232 +20,810 @@
 #define ARRAY_MARKER_VALUE "a"
 #endif
 
-struct seg { int type; int a_start; int b_start; int len; };
+struct seg_list { struct myers_seg *segs; int count; int cap; };
+
+/*
+ * The two sequences an edit script is computed over: cJSON elements
+ * compared with the context's equality, or precomputed equivalence class
+ * ids (@ia/@ib non-NULL) compared as integers.
+ */
+struct ses_seq {
+    cJSON **A, **B;
+    const int *ia, *ib;
+    const struct json_diff_ctx *ctx;
+    struct json_diff_stats *stats; /* search vectors are counted here */
+};
 
-static int ensure_seg_capacity(struct seg **segs, int *cap, int need)
+static inline void ses_count_bytes(const struct ses_seq *s, size_t bytes)
 {
-    if (*cap >= need) return 1;
-    int nc = *cap ? *cap : 16;
-    while (nc < need) {
-        if (nc > INT_MAX / 2) return 0;
-        nc *= 2;
-    }
-    struct seg *ns = (struct seg *)realloc(*segs, (size_t)nc * sizeof(**segs));
-    if (!ns) return 0;
-    *segs = ns; *cap = nc; return 1;
+    if (s->stats) s->stats->bytes_allocated += bytes;
 }
 
-/* Merge add+del pairs of objects into nested diffs (jsondiffpatch arrays-of-objects rule) */
-static void transform_array_object_changes(cJSON *diff_obj,
-                                           const struct json_diff_options *opts)
+static inline bool ses_eq(const struct ses_seq *s, int i, int j)
 {
-    if (!diff_obj) return;
-    int cap = 8, count = 0;
-    int *idxs = (int *)malloc((size_t)cap * sizeof(int));
-    if (!idxs) return;
-    for (cJSON *ch = diff_obj->child; ch; ch = ch->next) {
-        const char *k = ch->string;
-        if (!k || k[0] == '_' || strcmp(k, ARRAY_MARKER) == 0)
-            continue;
-        if (!cJSON_IsArray(ch) || cJSON_GetArraySize(ch) != 1)
-            continue;
-        cJSON *v0 = cJSON_GetArrayItem(ch, 0);
-        if (!v0 || !cJSON_IsObject(v0))
-            continue;
-        char *endptr = NULL;
-        long idx = strtol(k, &endptr, 10);
-        if (endptr == k || *endptr != '\0' || idx < 0 || idx > INT_MAX)
-            continue;
-        if (count == cap) {
-            int newcap = cap * 2;
-            int *tmp = (int *)realloc(idxs, (size_t)newcap * sizeof(int));
-            if (!tmp) { free(idxs); return; }
-            idxs = tmp; cap = newcap;
-        }
-        idxs[count++] = (int)idx;
-    }
+    if (s->ia) return s->ia[i] == s->ib[j];
+    return json_diff_ctx_equal(s->ctx, s->A[i], s->B[j]);
+}
 
-    char keybuf[32], delbuf[32];
-    for (int i = 0; i < count; i++) {
-#ifdef __STDC_LIB_EXT1__
-        snprintf_s(keybuf, sizeof(keybuf), "%d", idxs[i]);
-        snprintf_s(delbuf, sizeof(delbuf), "_%d", idxs[i]);
-#else
-        snprintf(keybuf, sizeof(keybuf), "%d", idxs[i]);
-        snprintf(delbuf, sizeof(delbuf), "_%d", idxs[i]);
+/*
+ * Common prefix / suffix scans. Comparing large records is what makes
+ * them expensive, so with opts->threads they are split into blocks that
+ * threads claim in ascending order; a mismatch lowers the shared bound
+ * and everyone stops once past it. Every offset below the final bound has
+ * been compared, so the result is the serial one.
+ */
+#ifndef MYERS_PARALLEL_MIN
+#define MYERS_PARALLEL_MIN 4096
 #endif
-        cJSON *add = cJSON_GetObjectItem(diff_obj, keybuf);
-        cJSON *del = cJSON_GetObjectItem(diff_obj, delbuf);
-        if (!add || !del || !cJSON_IsArray(add) || cJSON_GetArraySize(add) != 1)
-            continue;
-        cJSON *new_obj = cJSON_GetArrayItem(add, 0);
-        if (!new_obj || !cJSON_IsObject(new_obj)) continue;
-        if (!cJSON_IsArray(del) || cJSON_GetArraySize(del) != 3) continue;
-        cJSON *old_obj = cJSON_GetArrayItem(del, 0);
-        cJSON *z1 = cJSON_GetArrayItem(del, 1);
-        cJSON *z2 = cJSON_GetArrayItem(del, 2);
-        if (!old_obj || !cJSON_IsObject(old_obj)) continue;
-        if (!z1 || !z2 || !cJSON_IsNumber(z1) || !cJSON_IsNumber(z2)) continue;
-        if (z1->valuedouble != 0 || z2->valuedouble != 0) continue;
-
-        cJSON *nested = json_diff(old_obj, new_obj, opts);
-        cJSON_DeleteItemFromObject(diff_obj, delbuf);
-        cJSON_DeleteItemFromObject(diff_obj, keybuf);
-        if (nested) {
-            cJSON_AddItemToObject(diff_obj, keybuf, nested);
+#define MYERS_SCAN_BLOCK 256
+
+/* Offset k compares A[a0 + k] with B[b0 + k], or counts back from the ends */
+struct ses_scan {
+    const struct ses_seq *s;
+    int a0, b0, len;
+    bool backward;
+#ifdef JSON_DIFF_THREADS
+    atomic_int next;
+    atomic_int bound;
+    atomic_ullong compared;
+#endif
+};
+
+static inline bool scan_eq(const struct ses_scan *sc, int k)
+{
+    if (sc->backward) return ses_eq(sc->s, sc->a0 - k, sc->b0 - k);
+    return ses_eq(sc->s, sc->a0 + k, sc->b0 + k);
+}
+
+#ifdef JSON_DIFF_THREADS
+static void *scan_worker(void *arg)
+{
+    struct ses_scan *sc = (struct ses_scan *)arg;
+    unsigned long long compared = 0;
+    for (;;) {
+        int k = atomic_fetch_add(&sc->next, MYERS_SCAN_BLOCK);
+        int end = sc->len - k < MYERS_SCAN_BLOCK ? sc->len : k + MYERS_SCAN_BLOCK;
+        for (; k < end && k < atomic_load_explicit(&sc->bound, memory_order_relaxed); k++) {
+            compared++;
+            if (scan_eq(sc, k)) continue;
+            int cur = atomic_load(&sc->bound);
+            while (k < cur && !atomic_compare_exchange_weak(&sc->bound, &cur, k))
+                ;
+            break;
         }
+        if (k >= sc->len || k >= atomic_load(&sc->bound)) break;
     }
-    free(idxs);
+    atomic_fetch_add(&sc->compared, compared);
+    return NULL;
 }
+#endif
 
-/* Public SES-based array diff */
-cJSON *json_myers_array_diff(const cJSON *left, const cJSON *right,
-                             const struct json_diff_options *opts)
+/* Length of the run of equal pairs starting at offset 0 */
+static int ses_scan_run(struct ses_scan *sc)
 {
-    int N = cJSON_GetArraySize(left);
-    int M = cJSON_GetArraySize(right);
-    if (N == M) {
-        bool all_equal = true;
-        for (int i = 0; i < N; i++) {
-            if (!json_value_equal(cJSON_GetArrayItem(left, i), cJSON_GetArrayItem(right, i), opts->strict_equality)) {
-                all_equal = false; break;
-            }
-        }
-        if (all_equal) return NULL;
+#ifdef JSON_DIFF_THREADS
+    int threads = sc->s->ctx ? sc->s->ctx->opts->threads : 0;
+    if (threads > 1 && sc->len >= MYERS_PARALLEL_MIN) {
+        pthread_t tids[64];
+        int started = 0;
+        if (threads > 64) threads = 64;
+        /* The threads must not share the stats; their comparisons are summed instead */
+        const struct ses_seq *s = sc->s;
+        struct json_diff_stats *st = s->ctx->opts->stats;
+        struct json_diff_options opts = *s->ctx->opts;
+        struct json_diff_ctx ctx = *s->ctx;
+        struct ses_seq seq = *s;
+        opts.stats = NULL;
+        ctx.opts = &opts;
+        seq.ctx = &ctx;
+        sc->s = &seq;
+        atomic_init(&sc->next, 0);
+        atomic_init(&sc->bound, sc->len);
+        atomic_init(&sc->compared, 0);
+        for (int i = 1; i < threads; i++)
+            if (pthread_create(&tids[started], NULL, scan_worker, sc) == 0) started++;
+        scan_worker(sc);
+        for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+        sc->s = s;
+        if (st) st->equal_calls += atomic_load(&sc->compared);
+        return atomic_load(&sc->bound);
     }
+#endif
+    int k = 0;
+    while (k < sc->len && scan_eq(sc, k)) k++;
+    return k;
+}
 
-    cJSON **A = (cJSON **)malloc((size_t)N * sizeof(cJSON *));
-    cJSON **B = (cJSON **)malloc((size_t)M * sizeof(cJSON *));
-    if ((N && !A) || (M && !B)) { free(A); free(B); return NULL; }
-    for (int i=0;i<N;i++) A[i]=cJSON_GetArrayItem(left,i);
-    for (int j=0;j<M;j++) B[j]=cJSON_GetArrayItem(right,j);
+struct hashed_pos { uint64_t hash; int pos; };
 
-    int lcp = 0;
-    while (lcp < N && lcp < M && json_value_equal(A[lcp], B[lcp], opts->strict_equality)) lcp++;
-    int lcs = 0;
-    while (lcs < (N - lcp) && lcs < (M - lcp) && json_value_equal(A[N-1-lcs], B[M-1-lcs], opts->strict_equality)) lcs++;
+static int cmp_hashed_pos(const void *x, const void *y)
+{
+    const struct hashed_pos *a = (const struct hashed_pos *)x;
+    const struct hashed_pos *b = (const struct hashed_pos *)y;
+    if (a->hash != b->hash) return a->hash < b->hash ? -1 : 1;
+    return (a->pos > b->pos) - (a->pos < b->pos);
+}
 
-    cJSON **A2 = A + lcp;
-    cJSON **B2 = B + lcp;
-    int N2 = N - lcp - lcs;
-    int M2 = M - lcp - lcs;
+static uint64_t node_hash(const struct json_diff_ctx *ctx, const cJSON *v)
+{
+    uint64_t h;
+    if (json_diff_ctx_hash(ctx, v, &h)) return h;
+    return json_hash_value(v, ctx->opts->strict_equality);
+}
 
-    if (N2 == 0 && M2 == 0) { free(A); free(B); return NULL; }
-    if (N2 == 0 && M2 > 0) {
-        cJSON *diff_obj = cJSON_CreateObject(); if (!diff_obj) { free(A); free(B); return NULL; }
-        char keybuf[32]; int count = lcp;
-        for (int r = 0; r < M2; r++) {
-            snprintf(keybuf, sizeof(keybuf), "%d", count);
-            cJSON *ia = create_addition_array(B2[r]);
-            if (ia) cJSON_AddItemToObject(diff_obj, keybuf, ia);
-            count++;
-        }
-        transform_array_object_changes(diff_obj, opts);
-        cJSON_AddStringToObject(diff_obj, ARRAY_MARKER, ARRAY_MARKER_VALUE);
-        free(A); free(B);
-        return diff_obj;
-    }
-    if (M2 == 0 && N2 > 0) {
-        cJSON *diff_obj = cJSON_CreateObject(); if (!diff_obj) { free(A); free(B); return NULL; }
-        char keybuf[32]; int deletedCount = lcp;
-        for (int r = 0; r < N2; r++) {
-            snprintf(keybuf, sizeof(keybuf), "_%d", deletedCount);
-            cJSON *da = create_deletion_array(A2[r]);
-            if (da) cJSON_AddItemToObject(diff_obj, keybuf, da);
-            deletedCount++;
+static int ensure_seg_capacity(struct myers_seg **segs, int *cap, int need)
+{
+    if (*cap >= need) return 1;
+    int nc = *cap ? *cap : 16;
+    while (nc < need) {
+        if (nc > INT_MAX / 2) return 0;
+        nc *= 2;
+    }
+    struct myers_seg *ns = (struct myers_seg *)realloc(*segs, (size_t)nc * sizeof(**segs));
+    if (!ns) return 0;
+    *segs = ns; *cap = nc; return 1;
+}
+
+/* Append a segment, coalescing with the previous one when contiguous */
+static int seg_push(struct seg_list *l, int type, int a_start, int b_start, int len)
+{
+    if (len <= 0) return 1;
+    if (l->count > 0) {
+        struct myers_seg *last = &l->segs[l->count - 1];
+        if (last->type == type) {
+            int a_end = last->a_start + (type == MYERS_INS ? 0 : last->len);
+            int b_end = last->b_start + (type == MYERS_DEL ? 0 : last->len);
+            if (a_end == a_start && b_end == b_start) { last->len += len; return 1; }
         }
-        transform_array_object_changes(diff_obj, opts);
-        cJSON_AddStringToObject(diff_obj, ARRAY_MARKER, ARRAY_MARKER_VALUE);
-        free(A); free(B);
-        return diff_obj;
     }
+    if (!ensure_seg_capacity(&l->segs, &l->cap, l->count + 1)) return 0;
+    l->segs[l->count++] = (struct myers_seg){type, a_start, b_start, len};
+    return 1;
+}
 
-    int max = N2 + M2, off = max, vlen = 2*max+1;
+/*
+ * Classic Myers SES keeping a snapshot of V for every D so the path can be
+ * walked back afterwards.  O((N+M)*D) memory.  Gives up with -1 once D
+ * would pass @limit.
+ */
+static int ses_trace(const struct ses_seq *s, int a0, int N2, int b0, int M2,
+                     int limit, struct seg_list *out)
+{
+    int max = N2 + M2;
+    if (limit > max) limit = max;
+    /* Step d only touches diagonals -d..d, so V spans the budget at most */
+    int off = limit, vlen = 2*limit+1;
     int *V = (int *)calloc((size_t)vlen, sizeof(int));
-    if (!V) { free(A); free(B); return NULL; }
+    if (!V) return 0;
     int **trace = (int **)malloc((size_t)(max+1) * sizeof(int*));
-    if (!trace) { free(V); free(A); free(B); return NULL; }
+    if (!trace) { free(V); return 0; }
     for (int d=0; d<=max; d++) trace[d]=NULL;
+    ses_count_bytes(s, (size_t)vlen*sizeof(int) + (size_t)(max+1)*sizeof(int*));
 
-    int D_found = -1;
+    /* trace[d] holds V as it was after step d-1 (the input to step d) */
+    int D_found = -1, over = 0;
     for (int d=0; d<=max; d++) {
+        if (d > limit) { over = 1; break; }
         int *Vd = (int *)malloc((size_t)vlen*sizeof(int)); if(!Vd){ D_found=-1; break; }
         for (int t=0;t<vlen;t++) Vd[t]=V[t];
         trace[d]=Vd;
+        ses_count_bytes(s, (size_t)vlen*sizeof(int));
         for (int k=-d; k<=d; k+=2) {
             int x;
             if (k==-d || (k!=d && V[k-1+off] < V[k+1+off])) x = V[k+1+off]; else x = V[k-1+off]+1;
             int y = x - k;
-            while (x < N2 && y < M2 && json_value_equal(A2[x], B2[y], opts->strict_equality)) { x++; y++; }
+            while (x < N2 && y < M2 && ses_eq(s, a0 + x, b0 + y)) { x++; y++; }
             V[k+off]=x;
             if (x>=N2 && y>=M2) { D_found=d; break; }
         }
         if (D_found!=-1) break;
     }
 
-    enum { SEG_EQUAL=0, SEG_INS=1, SEG_DEL=2 };
-    struct seg *segs=NULL; int segs_count=0, segs_cap=0;
+    int ok = D_found >= 0;
+    /* Walk back collecting segments in reverse, then flip them */
+    struct seg_list rev = {NULL, 0, 0};
     int x=N2, y=M2;
-    for (int d=D_found; d>0; d--) {
-        int *Vprev = trace[d-1];
+    for (int d=D_found; ok && d>0; d--) {
+        int *Vprev = trace[d];
         int k = x - y;
         int prev_k = (k == -d || (k != d && Vprev[k-1+off] < Vprev[k+1+off])) ? k+1 : k-1;
         int x_prev = Vprev[prev_k+off];
         int y_prev = x_prev - prev_k;
-        int x_mid = x_prev, y_mid = y_prev;
-        int seg_type, a_start=0,b_start=0,len=1;
-        if (prev_k == k+1) { seg_type=SEG_DEL; a_start=x_prev; b_start=y_prev; x_mid=x_prev+1; y_mid=y_prev; }
-        else { seg_type=SEG_INS; a_start=x_prev; b_start=y_prev; x_mid=x_prev; y_mid=y_prev+1; }
-        int eq_len = x - x_mid;
-        if (eq_len>0) { if (!ensure_seg_capacity(&segs,&segs_cap,segs_count+1)) { /* OOM */ } else { segs[segs_count++] = (struct seg){SEG_EQUAL,x_mid,y_mid,eq_len}; } }
-        if (!ensure_seg_capacity(&segs,&segs_cap,segs_count+1)) { /* OOM */ } else { segs[segs_count++] = (struct seg){seg_type,a_start,b_start,len}; }
+        int x_mid, y_mid, seg_type;
+        if (prev_k == k+1) { seg_type=MYERS_INS; x_mid=x_prev; y_mid=y_prev+1; }
+        else { seg_type=MYERS_DEL; x_mid=x_prev+1; y_mid=y_prev; }
+        if (!seg_push(&rev, MYERS_EQUAL, x_mid, y_mid, x - x_mid)) ok = 0;
+        if (ok && !seg_push(&rev, seg_type, x_prev, y_prev, 1)) ok = 0;
         x = x_prev; y = y_prev;
     }
-    for (int l=0,r=segs_count-1; l<r; l++,r--){ struct seg tmp=segs[l]; segs[l]=segs[r]; segs[r]=tmp; }
+    if (ok && !seg_push(&rev, MYERS_EQUAL, 0, 0, x)) ok = 0;
+    for (int i = rev.count - 1; ok && i >= 0; i--) {
+        struct myers_seg sg = rev.segs[i];
+        if (!seg_push(out, sg.type, sg.a_start, sg.b_start, sg.len)) ok = 0;
+    }
 
-    cJSON *diff_obj = cJSON_CreateObject();
-    if (!diff_obj){ for(int d=0; d<=max; d++) free(trace[d]); free(trace); free(V); free(A); free(B); free(segs); return NULL; }
-    int count = lcp, deletedCount = lcp; char keybuf[32];
-    int ia_ptr = 0, ib_ptr = 0;
-    int si = 0;
-    while (si < segs_count) {
-        struct seg s = segs[si];
-        if (s.type == SEG_EQUAL) { si++; continue; }
-        if (s.type == SEG_DEL) {
-            for (int r = 0; r < s.len; r++) {
-                snprintf(keybuf, sizeof(keybuf), "_%d", deletedCount);
-                if (ia_ptr < N2) {
-                    cJSON *da = create_deletion_array(A2[ia_ptr]);
-                    if (da) cJSON_AddItemToObject(diff_obj, keybuf, da);
-                    ia_ptr++;
-                }
-                deletedCount++;
+    free(rev.segs);
+    for (int d = 0; d <= max; d++) free(trace[d]);
+    free(trace); free(V);
+    return over ? -1 : ok;
+}
+
+/*
+ * Find the middle snake of A[a0,a0+N) x B[b0,b0+M) (Myers 1986, section 4b),
+ * in coordinates relative to a0/b0.
+ * Vf/Vb are indexed around @off and must cover +-((N+M+1)/2 + 1).
+ * Returns the length D of the shortest edit script, or -1 if it is longer
+ * than @limit.
+ */
+static int middle_snake(const struct ses_seq *s, int a0, int N, int b0, int M,
+                        int *Vf, int *Vb, int off, int limit,
+                        int *sx, int *sy, int *ex, int *ey)
+{
+    int delta = N - M;
+    bool odd = (delta & 1) != 0;
+    int dmax = (N + M + 1) / 2;
+    if (dmax > limit / 2 + 1) dmax = limit / 2 + 1;
+    Vf[off+1] = 0;
+    Vb[off+1] = 0;
+    for (int d = 0; d <= dmax; d++) {
+        for (int k = -d; k <= d; k += 2) {
+            int x = (k == -d || (k != d && Vf[off+k-1] < Vf[off+k+1])) ? Vf[off+k+1] : Vf[off+k-1] + 1;
+            int y = x - k, x0 = x, y0 = y;
+            while (x < N && y < M && ses_eq(s, a0 + x, b0 + y)) { x++; y++; }
+            Vf[off+k] = x;
+            int c = delta - k;
+            if (odd && c >= -(d-1) && c <= d-1 && Vf[off+k] + Vb[off+c] >= N) {
+                if (2*d - 1 > limit) return -1;
+                *sx = x0; *sy = y0; *ex = x; *ey = y;
+                return 2*d - 1;
             }
-            si++;
+        }
+        for (int k = -d; k <= d; k += 2) {
+            int x = (k == -d || (k != d && Vb[off+k-1] < Vb[off+k+1])) ? Vb[off+k+1] : Vb[off+k-1] + 1;
+            int y = x - k, x0 = x, y0 = y;
+            while (x < N && y < M && ses_eq(s, a0 + N-1-x, b0 + M-1-y)) { x++; y++; }
+            Vb[off+k] = x;
+            int c = delta - k;
+            if (!odd && c >= -d && c <= d && Vb[off+k] + Vf[off+c] >= N) {
+                if (2*d > limit) return -1;
+                *sx = N - x; *sy = M - y; *ex = N - x0; *ey = M - y0;
+                return 2*d;
+            }
+        }
+    }
+    return -1;
+}
+
+/*
+ * Divide-and-conquer SES over A[a0,a1) x B[b0,b1); linear space.  Only the
+ * outermost snake can run over @limit (-1): the halves cost no more.
+ */
+static int ses_linear_rec(const struct ses_seq *s, int a0, int a1, int b0, int b1,
+                          int *Vf, int *Vb, int off, int limit, struct seg_list *out)
+{
+    int pre = 0;
+    while (a0 + pre < a1 && b0 + pre < b1 && ses_eq(s, a0+pre, b0+pre)) pre++;
+    if (!seg_push(out, MYERS_EQUAL, a0, b0, pre)) return 0;
+    a0 += pre; b0 += pre;
+    int suf = 0;
+    while (a1 - suf > a0 && b1 - suf > b0 && ses_eq(s, a1-1-suf, b1-1-suf)) suf++;
+    a1 -= suf; b1 -= suf;
+
+    if (a0 == a1) {
+        if (!seg_push(out, MYERS_INS, a0, b0, b1 - b0)) return 0;
+    } else if (b0 == b1) {
+        if (!seg_push(out, MYERS_DEL, a0, b0, a1 - a0)) return 0;
+    } else {
+        int sx, sy, ex, ey;
+        if (middle_snake(s, a0, a1 - a0, b0, b1 - b0, Vf, Vb, off, limit,
+                         &sx, &sy, &ex, &ey) < 0)
+            return -1;
+        int r = ses_linear_rec(s, a0, a0 + sx, b0, b0 + sy, Vf, Vb, off, limit, out);
+        if (r <= 0) return r;
+        if (!seg_push(out, MYERS_EQUAL, a0 + sx, b0 + sy, ex - sx)) return 0;
+        r = ses_linear_rec(s, a0 + ex, a1, b0 + ey, b1, Vf, Vb, off, limit, out);
+        if (r <= 0) return r;
+    }
+    return seg_push(out, MYERS_EQUAL, a1, b1, suf);
+}
+
+/* Segments come out in absolute positions, unlike ses_trace() */
+static int ses_linear(const struct ses_seq *s, int a0, int N2, int b0, int M2,
+                      int limit, struct seg_list *out)
+{
+    int off = (N2 + M2 + 1) / 2 + 1, vlen = 2*off + 1;
+    int *Vf = (int *)malloc((size_t)vlen * sizeof(int));
+    int *Vb = (int *)malloc((size_t)vlen * sizeof(int));
+    ses_count_bytes(s, 2 * (size_t)vlen * sizeof(int));
+    int ok = Vf && Vb ? ses_linear_rec(s, a0, a0 + N2, b0, b0 + M2, Vf, Vb, off, limit, out) : 0;
+    free(Vf); free(Vb);
+    return ok;
+}
+
+struct anchor { int a, b; };
+
+static int cmp_anchor(const void *x, const void *y)
+{
+    const struct anchor *p = (const struct anchor *)x, *q = (const struct anchor *)y;
+    return (p->a > q->a) - (p->a < q->a);
+}
+
+static uint64_t ses_hash(const struct ses_seq *s, bool left, int i)
+{
+    if (s->ia) return (uint64_t)(unsigned)(left ? s->ia[i] : s->ib[i]);
+    return node_hash(s->ctx, left ? s->A[i] : s->B[i]);
+}
+
+/* Hash and position of A[a0,a0+n) (or B), sorted by hash */
+static struct hashed_pos *ses_hashed(const struct ses_seq *s, bool left, int a0, int n)
+{
+    struct hashed_pos *h = (struct hashed_pos *)malloc((size_t)(n ? n : 1) * sizeof(*h));
+    if (!h) return NULL;
+    for (int i = 0; i < n; i++) h[i] = (struct hashed_pos){ses_hash(s, left, a0 + i), a0 + i};
+    qsort(h, (size_t)n, sizeof(*h), cmp_hashed_pos);
+    return h;
+}
+
+/*
+ * Cheap fallback once the Myers budget runs out (patience diff): pair the
+ * elements that occur exactly once on each side, keep the longest chain
+ * of such pairs in order on both sides, grow each anchor into the equal
+ * run around it and replace everything between.  O((N+M) log(N+M)) and
+ * valid, but not minimal; with no anchors the middle is replaced whole.
+ */
+static int ses_anchored(const struct ses_seq *s, int a0, int N2, int b0, int M2,
+                        struct seg_list *out)
+{
+    struct hashed_pos *ha = ses_hashed(s, true, a0, N2);
+    struct hashed_pos *hb = ses_hashed(s, false, b0, M2);
+    int cap = N2 < M2 ? N2 : M2;
+    struct anchor *an = (struct anchor *)malloc((size_t)(cap + 1) * sizeof(*an));
+    int *tail = (int *)malloc((size_t)(cap + 1) * sizeof(int));
+    int *prev = (int *)malloc((size_t)(cap + 1) * sizeof(int));
+    int ok = ha && hb && an && tail && prev;
+    ses_count_bytes(s, (size_t)(N2 + M2) * sizeof(*ha) +
+                       (size_t)(cap + 1) * (sizeof(*an) + 2 * sizeof(int)));
+
+    /* Hashes that occur once per side, confirmed by an equality check */
+    int na = 0;
+    for (int i = 0, j = 0; ok && i < N2 && j < M2;) {
+        if (ha[i].hash != hb[j].hash) {
+            if (ha[i].hash < hb[j].hash) i++; else j++;
             continue;
         }
-        if (s.type == SEG_INS) {
-            for (int r = 0; r < s.len; r++) {
-                snprintf(keybuf, sizeof(keybuf), "%d", count);
-                if (ib_ptr < M2) {
-                    cJSON *iaa = create_addition_array(B2[ib_ptr]);
-                    if (iaa) cJSON_AddItemToObject(diff_obj, keybuf, iaa);
-                    ib_ptr++;
+        uint64_t h = ha[i].hash;
+        int ei = i, ej = j;
+        while (ei < N2 && ha[ei].hash == h) ei++;
+        while (ej < M2 && hb[ej].hash == h) ej++;
+        if (ei - i == 1 && ej - j == 1 && ses_eq(s, ha[i].pos, hb[j].pos))
+            an[na++] = (struct anchor){ha[i].pos, hb[j].pos};
+        i = ei; j = ej;
+    }
+    if (ok && na > 1) qsort(an, (size_t)na, sizeof(*an), cmp_anchor);
+
+    /* Longest chain increasing in b as well (patience sorting) */
+    int len = 0;
+    for (int i = 0; ok && i < na; i++) {
+        int lo = 0, hi = len;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (an[tail[mid]].b < an[i].b) lo = mid + 1; else hi = mid;
+        }
+        prev[i] = lo ? tail[lo - 1] : -1;
+        tail[lo] = i;
+        if (lo == len) len++;
+    }
+    /* Thread the chain forward through @prev, reusing @tail */
+    for (int k = len ? tail[len - 1] : -1, i = len; ok && k >= 0; k = prev[k]) tail[--i] = k;
+
+    int x = a0, y = b0, a1 = a0 + N2, b1 = b0 + M2;
+    for (int i = 0; ok && i < len; i++) {
+        int a = an[tail[i]].a, b = an[tail[i]].b;
+        if (a < x || b < y) continue; /* inside the previous run */
+        while (a > x && b > y && ses_eq(s, a - 1, b - 1)) { a--; b--; }
+        int e = 1;
+        while (a + e < a1 && b + e < b1 && ses_eq(s, a + e, b + e)) e++;
+        ok = seg_push(out, MYERS_DEL, x, y, a - x) && seg_push(out, MYERS_INS, a, y, b - y) &&
+             seg_push(out, MYERS_EQUAL, a, b, e);
+        x = a + e; y = b + e;
+    }
+    ok = ok && seg_push(out, MYERS_DEL, x, y, a1 - x) && seg_push(out, MYERS_INS, a1, y, b1 - y);
+    free(ha); free(hb); free(an); free(tail); free(prev);
+    return ok;
+}
+
+/*
+ * Full edit script of A[0,N) x B[0,M) in absolute positions: common prefix
+ * and suffix are trimmed first and come back as equal runs around the
+ * engine's script for the middle.  Past opts->max_edit_cost the middle
+ * falls back to ses_anchored() and *opts->inexact is raised.
+ */
+static int build_script(const struct ses_seq *seq, int N, int M,
+                        const struct json_diff_options *opts, struct seg_list *sl)
+{
+    struct ses_seq counted = *seq;
+    const struct ses_seq *s = &counted;
+    struct json_diff_stats *st = counted.stats = opts->stats;
+    uint64_t t0 = json_diff_stats_clock(st);
+    struct ses_scan pre = {.s = s, .len = N < M ? N : M};
+    int lcp = ses_scan_run(&pre);
+    struct ses_scan suf = {.s = s, .a0 = N - 1, .b0 = M - 1,
+                           .len = (N < M ? N : M) - lcp, .backward = true};
+    int lcs = ses_scan_run(&suf);
+    int N2 = N - lcp - lcs;
+    int M2 = M - lcp - lcs;
+
+    int ok = seg_push(sl, MYERS_EQUAL, 0, 0, lcp);
+    if (!ok || (N2 == 0 && M2 == 0))
+        ;
+    else if (N2 == 0)
+        ok = seg_push(sl, MYERS_INS, lcp, lcp, M2);
+    else if (M2 == 0)
+        ok = seg_push(sl, MYERS_DEL, lcp, lcp, N2);
+    else {
+        int limit = opts->max_edit_cost > 0 ? opts->max_edit_cost : INT_MAX;
+        /* Trace segments are relative to the trimmed middle */
+        int rel = 0;
+        struct seg_list mid = {NULL, 0, 0};
+        if (opts->array_engine == JSON_DIFF_ARRAY_LINEAR) {
+            ok = ses_linear(s, lcp, N2, lcp, M2, limit, &mid);
+        } else {
+            ok = ses_trace(s, lcp, N2, lcp, M2, limit, &mid);
+            rel = lcp;
+        }
+        if (ok < 0) {
+            mid.count = 0;
+            rel = 0;
+            ok = ses_anchored(s, lcp, N2, lcp, M2, &mid);
+            if (opts->inexact) *opts->inexact = true;
+            if (st) st->fallbacks++;
+        }
+        for (int i = 0; ok && i < mid.count; i++)
+            ok = seg_push(sl, mid.segs[i].type, mid.segs[i].a_start + rel,
+                          mid.segs[i].b_start + rel, mid.segs[i].len);
+        free(mid.segs);
+    }
+    ok = ok && seg_push(sl, MYERS_EQUAL, N - lcs, M - lcs, lcs);
+    if (st) {
+        uint64_t d = 0;
+        for (int i = 0; ok && i < sl->count; i++)
+            if (sl->segs[i].type != MYERS_EQUAL) d += (uint64_t)sl->segs[i].len;
+        st->script_ns += json_diff_stats_clock(st) - t0;
+        st->arrays++;
+        if (d > st->max_d) st->max_d = d;
+    }
+    return ok;
+}
+
+int json_myers_script_ids(const int *ia, int N, const int *ib, int M,
+                          const struct json_diff_options *opts,
+                          struct myers_seg **segs, int *count)
+{
+    struct ses_seq s = {NULL, NULL, ia, ib, NULL, NULL};
+    struct seg_list sl = {NULL, 0, 0};
+    if (!build_script(&s, N, M, opts, &sl)) {
+        free(sl.segs);
+        return 0;
+    }
+    *segs = sl.segs;
+    *count = sl.count;
+    return 1;
+}
+
+/* Emit one delta member; in writer mode the op prints itself after the key */
+static void add_member(const struct json_diff_ctx *ctx, cJSON *diff_obj, const char *key, cJSON *op)
+{
+    if (op) diff_add_item_to_object(ctx->opts->arena, diff_obj, key, op);
+}
+
+static void add_deletion(const struct json_diff_ctx *ctx, cJSON *diff_obj, const cJSON *v, int index)
+{
+    char keybuf[32];
+    snprintf(keybuf, sizeof(keybuf), "_%d", index);
+    if (ctx->out) json_write_key(ctx->out, keybuf);
+    add_member(ctx, diff_obj, keybuf, diff_deletion_array(ctx, v));
+}
+
+static void add_addition(const struct json_diff_ctx *ctx, cJSON *diff_obj, const cJSON *v, int index)
+{
+    char keybuf[32];
+    snprintf(keybuf, sizeof(keybuf), "%d", index);
+    if (ctx->out) json_write_key(ctx->out, keybuf);
+    add_member(ctx, diff_obj, keybuf, diff_addition_array(ctx, v));
+}
+
+/* Nested diff of two matched elements at their new index, if they differ */
+static void add_nested(const struct json_diff_ctx *ctx, cJSON *diff_obj, const cJSON *ov, const cJSON *nv, int index)
+{
+    char keybuf[32];
+    snprintf(keybuf, sizeof(keybuf), "%d", index);
+    struct json_diff_ctx buf;
+    const struct json_diff_ctx *sub = json_diff_ctx_enter(ctx, keybuf, &buf);
+    if (!sub) return;
+    if (ctx->task) {
+        json_diff_task_defer(sub, diff_obj, keybuf, ov, nv);
+        return;
+    }
+    if (ctx->out) {
+        if (json_diff_scoped_equal(sub, ov, nv)) return;
+        json_write_key(ctx->out, keybuf);
+    }
+    add_member(ctx, diff_obj, keybuf, json_diff_ctx_diff(sub, ov, nv));
+}
+
+/* "_from": ["", to, 3], plus the record's own diff at "to" when keyed */
+static void add_move(const struct json_diff_ctx *ctx, cJSON *diff_obj, cJSON **A, cJSON **B,
+                     bool keyed, int from, int to)
+{
+    char keybuf[32];
+    snprintf(keybuf, sizeof(keybuf), "_%d", from);
+    if (ctx->out) json_write_key(ctx->out, keybuf);
+    add_member(ctx, diff_obj, keybuf, diff_move_array(ctx, to));
+    if (keyed) add_nested(ctx, diff_obj, A[from], B[to], to);
+}
+
+/* Probe limit per insertion, bounds the common non-strict number bucket */
+#define MOVE_PROBE_LIMIT 32
+
+/*
+ * Move pass: pair each inserted element with an unused deleted element of
+ * equal value (equal identity via @IA/@IB) found by structural hash.
+ * move_to[a] receives the insertion index for a paired deletion, -1
+ * otherwise; moved_in[b] marks paired insertions. Patch semantics make any
+ * pairing of equal values valid, so the greedy choice needs no ordering.
+ *
+ * Return: 0 on allocation failure (no moves recorded)
+ */
+static int find_moves(cJSON **IA, cJSON **IB, const struct myers_seg *segs, int nsegs,
+                      const struct json_diff_ctx *ctx, int *move_to, bool *moved_in)
+{
+    int nd = 0;
+    for (int i = 0; i < nsegs; i++)
+        if (segs[i].type == MYERS_DEL) nd += segs[i].len;
+    if (!nd) return 1;
+    struct hashed_pos *dels = (struct hashed_pos *)malloc((size_t)nd * sizeof(*dels));
+    if (!dels) return 0;
+    nd = 0;
+    for (int i = 0; i < nsegs; i++) {
+        for (int j = 0; segs[i].type == MYERS_DEL && j < segs[i].len; j++) {
+            int a = segs[i].a_start + j;
+            dels[nd].hash = node_hash(ctx, IA[a]);
+            dels[nd++].pos = a;
+        }
+    }
+    qsort(dels, (size_t)nd, sizeof(*dels), cmp_hashed_pos);
+
+    for (int i = 0; i < nsegs; i++) {
+        for (int j = 0; segs[i].type == MYERS_INS && j < segs[i].len; j++) {
+            int b = segs[i].b_start + j;
+            uint64_t h = node_hash(ctx, IB[b]);
+            int lo = 0, hi = nd;
+            while (lo < hi) {
+                int mid = lo + (hi - lo) / 2;
+                if (dels[mid].hash < h) lo = mid + 1; else hi = mid;
+            }
+            for (int k = lo, probes = 0; k < nd && dels[k].hash == h && probes < MOVE_PROBE_LIMIT; k++) {
+                int a = dels[k].pos;
+                if (move_to[a] >= 0) continue;
+                probes++;
+                if (json_diff_ctx_equal(ctx, IA[a], IB[b])) {
+                    move_to[a] = b;
+                    moved_in[b] = true;
+                    break;
                 }
-                count++;
             }
+        }
+    }
+    free(dels);
+    return 1;
+}
+
+/*
+ * Turn an edit script into a jsondiffpatch array delta.  Deletion keys are
+ * indices into @left ("_i"), insertion keys indices into @right ("i").
+ * Within one replace hunk (deletions directly followed by insertions) an
+ * object replaced by an object at the same hunk offset is emitted as a
+ * nested diff instead (jsondiffpatch arrays-of-objects rule); pairing only
+ * inside a hunk keeps the matching monotonic, so the delta stays patchable.
+ *
+ * With element identities (@KA/@KB non-NULL) the script was computed over
+ * identities, so equal runs may pair records whose content changed; those
+ * get nested diffs at their new index. Two records with identities never
+ * pair by position: a different identity is a different record.
+ *
+ * With detect_moves, deleted and inserted elements that find_moves()
+ * pairs become move ops first; hunk pairing only sees what is left.
+ */
+static cJSON *emit_array_diff(cJSON **A, int N, cJSON **B, int M, cJSON **KA, cJSON **KB,
+                              const struct myers_seg *segs, int nsegs,
+                              const struct json_diff_ctx *ctx)
+{
+    struct json_diff_arena *arena = ctx->opts->arena;
+    cJSON *diff_obj = NULL;
+    if (ctx->out) json_write_raw(ctx->out, "{", 1);
+    else if (!(diff_obj = diff_new_object(arena))) return NULL;
+    int *move_to = NULL;
+    bool *moved_in = NULL;
+    int *left_rest = (int *)malloc((size_t)(N ? N : 1) * sizeof(int));
+    int *right_rest = (int *)malloc((size_t)(M ? M : 1) * sizeof(int));
+    bool ok = left_rest && right_rest;
+    if (ok && ctx->opts->detect_moves && N && M) {
+        move_to = (int *)malloc((size_t)N * sizeof(int));
+        moved_in = (bool *)calloc((size_t)M, sizeof(bool));
+        if (move_to) for (int i = 0; i < N; i++) move_to[i] = -1;
+        ok = move_to && moved_in &&
+             find_moves(KA ? KA : A, KB ? KB : B, segs, nsegs, ctx, move_to, moved_in);
+    }
+    if (!ok) {
+        free(move_to); free(moved_in); free(left_rest); free(right_rest);
+        if (ctx->out) ctx->out->failed = true;
+        diff_delete(arena, diff_obj);
+        return NULL;
+    }
+    int si = 0;
+    while (si < nsegs) {
+        if (segs[si].type == MYERS_EQUAL) {
+            for (int j = 0; KA && j < segs[si].len; j++)
+                add_nested(ctx, diff_obj, A[segs[si].a_start + j], B[segs[si].b_start + j],
+                           segs[si].b_start + j);
             si++;
             continue;
         }
+        /* Collect the hunk, minus elements that moved */
+        int dl = 0, il = 0;
+        for (; si < nsegs && segs[si].type != MYERS_EQUAL; si++) {
+            for (int j = 0; j < segs[si].len; j++) {
+                if (segs[si].type == MYERS_DEL) {
+                    int a = segs[si].a_start + j;
+                    if (move_to && move_to[a] >= 0) add_move(ctx, diff_obj, A, B, KA != NULL, a, move_to[a]);
+                    else left_rest[dl++] = a;
+                } else {
+                    int b = segs[si].b_start + j;
+                    if (!moved_in || !moved_in[b]) right_rest[il++] = b;
+                }
+            }
+        }
+        int paired = dl < il ? dl : il;
+        for (int j = 0; j < paired; j++) {
+            int a = left_rest[j], b = right_rest[j];
+            cJSON *ov = A[a], *nv = B[b];
+            bool keyed = KA && KA[a] != ov && KB[b] != nv;
+            if (cJSON_IsObject(ov) && cJSON_IsObject(nv) && !keyed) {
+                add_nested(ctx, diff_obj, ov, nv, b);
+                continue;
+            }
+            add_deletion(ctx, diff_obj, ov, a);
+            add_addition(ctx, diff_obj, nv, b);
+        }
+        for (int j = paired; j < dl; j++) add_deletion(ctx, diff_obj, A[left_rest[j]], left_rest[j]);
+        for (int j = paired; j < il; j++) add_addition(ctx, diff_obj, B[right_rest[j]], right_rest[j]);
+    }
+    free(move_to); free(moved_in); free(left_rest); free(right_rest);
+    if (ctx->out) {
+        json_write_key(ctx->out, ARRAY_MARKER);
+        json_write_raw(ctx->out, "\"" ARRAY_MARKER_VALUE "\"}", sizeof(ARRAY_MARKER_VALUE) + 2);
+        return NULL;
     }
-    while (ia_ptr < N2) { snprintf(keybuf, sizeof(keybuf), "_%d", deletedCount); cJSON *da = create_deletion_array(A2[ia_ptr]); if (da) cJSON_AddItemToObject(diff_obj, keybuf, da); ia_ptr++; deletedCount++; }
-    while (ib_ptr < M2) { snprintf(keybuf, sizeof(keybuf), "%d", count); cJSON *iaa = create_addition_array(B2[ib_ptr]); if (iaa) cJSON_AddItemToObject(diff_obj, keybuf, iaa); ib_ptr++; count++; }
+    if (!diff_obj->child) { diff_delete(arena, diff_obj); return NULL; }
+    diff_add_item_to_object(arena, diff_obj, ARRAY_MARKER, diff_new_string(arena, ARRAY_MARKER_VALUE));
+    return diff_obj;
+}
 
-    for (int d = 0; d <= max; d++) free(trace[d]);
-    free(trace); free(V); free(A); free(B); free(segs);
+/* Identity of an array element: object_hash(), else the object_key path */
+static cJSON *element_identity(const struct json_diff_options *opts, cJSON *item)
+{
+    if (opts->object_hash) {
+        const cJSON *id = opts->object_hash(item, opts->object_hash_data);
+        return id ? (cJSON *)(uintptr_t)id : item;
+    }
+    if (!cJSON_IsObject(item)) return item;
+    const cJSON *cur = item;
+    const char *p = opts->object_key;
+    char part[256];
+    while (cur && *p) {
+        const char *dot = strchr(p, '.');
+        size_t len = dot ? (size_t)(dot - p) : strlen(p);
+        if (len >= sizeof(part)) return item;
+        memcpy(part, p, len);
+        part[len] = '\0';
+        cur = cJSON_IsObject(cur) ? cJSON_GetObjectItemCaseSensitive(cur, part) : NULL;
+        p += len + (dot ? 1 : 0);
+    }
+    return cur ? (cJSON *)(uintptr_t)cur : item;
+}
+
+void json_myers_element_ids(const struct json_diff_options *opts, cJSON **elems, int n,
+                            cJSON **ids)
+{
+    for (int i = 0; i < n; i++) ids[i] = element_identity(opts, elems[i]);
+}
+
+/* SES-based array diff inside a running diff context */
+cJSON *json_myers_array_diff_ctx(const cJSON *left, const cJSON *right,
+                                 const struct json_diff_ctx *ctx)
+{
+    const struct json_diff_options *opts = ctx->opts;
+    int N = 0;
+    int M = cJSON_GetArraySize(right);
+
+    bool keyed = opts->object_hash || (opts->object_key && *opts->object_key);
+    /* Path filters leave parts of the elements out, so values never match whole */
+    bool pruned = json_diff_ctx_pruned(ctx);
+    /* A prepared baseline already holds the left vectors and their size */
+    cJSON **A = NULL, **KA = NULL;
+    bool prepared = ctx->prep && json_diff_prepared_array(ctx->prep, left, &A, &KA, &N);
+    if (!prepared) {
+        N = cJSON_GetArraySize(left);
+        A = (cJSON **)malloc((size_t)N * sizeof(cJSON *));
+        KA = keyed ? (cJSON **)malloc((size_t)N * sizeof(cJSON *)) : A;
+    }
+    cJSON **B = (cJSON **)malloc((size_t)M * sizeof(cJSON *));
+    cJSON **KB = keyed ? (cJSON **)malloc((size_t)M * sizeof(cJSON *)) : B;
+    if (opts->stats)
+        opts->stats->bytes_allocated += ((size_t)(prepared ? 0 : N) + (size_t)M) *
+                                        (keyed ? 2 : 1) * sizeof(cJSON *);
+    if ((N && (!A || !KA)) || (M && (!B || !KB))) {
+        if (!prepared) { if (keyed) free(KA); free(A); }
+        if (keyed) free(KB);
+        free(B);
+        if (ctx->out) ctx->out->failed = true;
+        return NULL;
+    }
+    int n = 0, m = 0;
+    for (cJSON *it = left->child; !prepared && it && n < N; it = it->next) A[n++] = it;
+    for (cJSON *it = right->child; it && m < M; it = it->next) B[m++] = it;
 
-    transform_array_object_changes(diff_obj, opts);
-    bool non_marker = false; for (cJSON *it = diff_obj->child; it; it = it->next) { if (strcmp(it->string, ARRAY_MARKER) != 0) { non_marker = true; break; } }
-    if (non_marker) { cJSON_AddStringToObject(diff_obj, ARRAY_MARKER, ARRAY_MARKER_VALUE); return diff_obj; }
-    cJSON_Delete(diff_obj); return NULL;
+    /*
+     * Equal arrays: the unkeyed script finds that in its prefix scan, a
+     * keyed one only compares identities there, so check whole elements
+     */
+    if (keyed && N == M && !pruned) {
+        struct ses_seq whole = {A, B, NULL, NULL, ctx, NULL};
+        struct ses_scan all = {.s = &whole, .len = N};
+        if (ses_scan_run(&all) == N) {
+            if (!prepared) { free(KA); free(A); }
+            free(KB); free(B);
+            return NULL;
+        }
+    }
+    /* Records are matched by identity; content is diffed afterwards */
+    for (int i = 0; keyed && !prepared && i < N; i++) KA[i] = element_identity(opts, A[i]);
+    for (int j = 0; keyed && j < M; j++) KB[j] = element_identity(opts, B[j]);
+
+    struct ses_seq seq = {KA, KB, NULL, NULL, ctx, NULL};
+    struct seg_list sl = {NULL, 0, 0};
+    int ok;
+    /* Unkeyed under filters: pair by position, each element its own identity */
+    bool by_pos = pruned && !keyed;
+    if (by_pos) {
+        int common = N < M ? N : M;
+        ok = seg_push(&sl, MYERS_EQUAL, 0, 0, common) &&
+             seg_push(&sl, MYERS_DEL, common, common, N - common) &&
+             seg_push(&sl, MYERS_INS, N, common, M - common);
+    } else {
+        ok = build_script(&seq, N, M, opts, &sl);
+    }
+
+    cJSON *diff_obj = NULL;
+    if (ok)
+        diff_obj = emit_array_diff(A, N, B, M, keyed || by_pos ? KA : NULL,
+                                   keyed || by_pos ? KB : NULL, sl.segs, sl.count, ctx);
+    else if (ctx->out)
+        ctx->out->failed = true;
+    free(sl.segs);
+    if (!prepared) { if (keyed) free(KA); free(A); }
+    if (keyed) free(KB);
+    free(B);
+    return diff_obj;
+}
+/* Public SES-based array diff */
+cJSON *json_myers_array_diff(const cJSON *left, const cJSON *right,
+                             const struct json_diff_options *opts)
+{
+    struct json_diff_options default_opts = {.strict_equality = true};
+    struct json_diff_arena scratch = {.head = NULL};
+    struct json_diff_ctx ctx = {.opts = opts ? opts : &default_opts, .scratch = &scratch};
+    cJSON *res = json_myers_array_diff_ctx(left, right, &ctx);
+    json_diff_arena_cleanup(&scratch);
+    return res;
 }
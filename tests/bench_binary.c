@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: Apache-2.0
+#define _GNU_SOURCE
+#include "src/json_diff.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define RECORDS 20000
+
+static double get_time_ms(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static cJSON *record(int id, int version)
+{
+	cJSON *r = cJSON_CreateObject();
+	char name[32];
+	snprintf(name, sizeof(name), "user-%d-v%d", id, version);
+	cJSON_AddNumberToObject(r, "id", id);
+	cJSON_AddStringToObject(r, "name", name);
+	cJSON_AddNumberToObject(r, "score", id * 0.5 + version);
+	cJSON *tags = cJSON_AddArrayToObject(r, "tags");
+	for (int t = 0; t < 3; t++)
+		cJSON_AddItemToArray(tags, cJSON_CreateNumber(id % 7 + t));
+	return r;
+}
+
+/*
+ * Two versions of a record list: one in nine records dropped, one in five
+ * edited and new records spliced in, so the delta mixes deletions (and
+ * their old values), changes and additions under array indices.
+ */
+static void build_inputs(cJSON **left, cJSON **right)
+{
+	*left = cJSON_CreateArray();
+	*right = cJSON_CreateArray();
+	for (int i = 0; i < RECORDS; i++) {
+		cJSON_AddItemToArray(*left, record(i, 0));
+		if (i % 9 == 4)
+			continue;
+		cJSON_AddItemToArray(*right, record(i, i % 5 == 0));
+		if (i % 13 == 0)
+			cJSON_AddItemToArray(*right, record(RECORDS + i, 0));
+	}
+}
+
+int main(void)
+{
+	cJSON *left, *right;
+	build_inputs(&left, &right);
+	struct json_diff_options opts = {.strict_equality = true,
+	                                 .object_key = "id"};
+	cJSON *d = json_diff(left, right, &opts);
+	if (!d) {
+		fputs("json_diff failed\n", stderr);
+		return 1;
+	}
+
+	const int iterations = 20;
+	char *text = NULL;
+	double t0 = get_time_ms();
+	for (int i = 0; i < iterations; i++) {
+		free(text);
+		text = cJSON_PrintUnformatted(d);
+	}
+	double t1 = get_time_ms();
+	for (int i = 0; i < iterations; i++)
+		cJSON_Delete(cJSON_Parse(text));
+	double t2 = get_time_ms();
+	size_t text_len = strlen(text);
+	printf("Delta as JSON text: %zu bytes, print = %.3f us/iter, "
+	       "parse = %.3f us/iter\n",
+	       text_len, (t1 - t0) * 1000.0 / iterations,
+	       (t2 - t1) * 1000.0 / iterations);
+
+	const struct {
+		const char *name;
+		unsigned int flags;
+	} modes[] = {{"binary", 0},
+	             {"binary, no old values", JSON_DIFF_BINARY_OMIT_OLD}};
+	for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+		unsigned char *bin = NULL;
+		size_t len = 0;
+		t0 = get_time_ms();
+		for (int i = 0; i < iterations; i++) {
+			free(bin);
+			if (json_diff_encode_binary(d, modes[m].flags, &bin,
+			                            &len) != 0) {
+				fputs("json_diff_encode_binary failed\n",
+				      stderr);
+				return 1;
+			}
+		}
+		t1 = get_time_ms();
+		for (int i = 0; i < iterations; i++)
+			cJSON_Delete(json_diff_decode_binary(bin, len));
+		t2 = get_time_ms();
+		double encode = (t1 - t0) / iterations;
+		double decode = (t2 - t1) / iterations;
+		printf("Delta as %s: %zu bytes (%.1f%% of text), encode = "
+		       "%.3f us/iter (%.1f MB/s), decode = %.3f us/iter "
+		       "(%.1f MB/s)\n",
+		       modes[m].name, len, 100.0 * len / text_len,
+		       encode * 1000.0, len / (encode * 1000.0),
+		       decode * 1000.0, len / (decode * 1000.0));
+
+		t0 = get_time_ms();
+		for (int i = 0; i < iterations; i++) {
+			cJSON *p = json_patch_binary(left, bin, len);
+			if (!p) {
+				fputs("json_patch_binary failed\n", stderr);
+				return 1;
+			}
+			cJSON_Delete(p);
+		}
+		t1 = get_time_ms();
+		printf("json_patch_binary (%s): avg = %.3f us/iter\n",
+		       modes[m].name, (t1 - t0) * 1000.0 / iterations);
+		free(bin);
+	}
+
+	t0 = get_time_ms();
+	for (int i = 0; i < iterations; i++)
+		cJSON_Delete(json_patch(left, d));
+	t1 = get_time_ms();
+	printf("json_patch (tree): avg = %.3f us/iter\n",
+	       (t1 - t0) * 1000.0 / iterations);
+
+	free(text);
+	cJSON_Delete(d);
+	cJSON_Delete(left);
+	cJSON_Delete(right);
+	return 0;
+}
@@ -37,6 +37,14 @@ static char *read_file(const char *filename)
 	return buf;
 }
 
+/* Stand-in for a socket: count the bytes and drop them */
+static int count_sink(const char *data, size_t len, void *user)
+{
+	(void)data;
+	*(size_t *)user += len;
+	return 0;
+}
+
 static double get_time_ms(void)
 {
 	struct timeval tv;
@@ -78,27 +86,65 @@ int main(void)
 	// Set up arena-based allocations for diff
 	struct json_diff_arena arena;
 	json_diff_arena_init(&arena, 1 << 20); // 1MB initial arena
-	struct json_diff_options opts = {.strict_equality = true,
-	                                 .arena = &arena};
+	const struct {
+		const char *name;
+		enum json_diff_array_engine engine;
+	} engines[] = {{"trace", JSON_DIFF_ARRAY_TRACE},
+	               {"linear", JSON_DIFF_ARRAY_LINEAR}};
 
-	// Warm-up iterations
-	for (int i = 0; i < 5; i++) {
-		cJSON *d = json_diff(left, right, &opts);
-		(void)d;
+	for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+		struct json_diff_options opts = {.strict_equality = true,
+		                                 .arena = &arena,
+		                                 .array_engine =
+		                                     engines[e].engine};
+
+		// Warm-up iterations
+		for (int i = 0; i < 5; i++) {
+			json_diff_arena_reset(&arena);
+			cJSON *d = json_diff(left, right, &opts);
+			(void)d;
+		}
+
+		const int iterations = 50;
+		double t0 = get_time_ms();
+		for (int i = 0; i < iterations; i++) {
+			json_diff_arena_reset(&arena);
+			cJSON *d = json_diff(left, right, &opts);
+			(void)d;
+		}
+		double t1 = get_time_ms();
+
+		double total = t1 - t0;
+		// Display total time in ms and average per iteration in
+		// microseconds
+		printf("Medium diff benchmark (%s): total = %.3f ms, avg = "
+		       "%.3f us/iter\n",
+		       engines[e].name, total, (total * 1000.0) / iterations);
 	}
 
-	const int iterations = 50;
+	/* Delta as text: build a tree and print it, or stream it */
+	const int text_iterations = 50;
+	struct json_diff_options heap_opts = {.strict_equality = true};
+	size_t printed = 0, streamed = 0;
 	double t0 = get_time_ms();
-	for (int i = 0; i < iterations; i++) {
-		cJSON *d = json_diff(left, right, &opts);
-		(void)d;
+	for (int i = 0; i < text_iterations; i++) {
+		cJSON *d = json_diff(left, right, &heap_opts);
+		char *text = d ? cJSON_PrintUnformatted(d) : NULL;
+		printed += text ? strlen(text) : 0;
+		free(text);
+		cJSON_Delete(d);
 	}
 	double t1 = get_time_ms();
-
-	double total = t1 - t0;
-	// Display total time in ms and average per iteration in microseconds
-	printf("Medium diff benchmark: total = %.3f ms, avg = %.3f us/iter\n",
-	       total, (total * 1000.0) / iterations);
+	for (int i = 0; i < text_iterations; i++)
+		json_diff_write(left, right, &heap_opts, count_sink, &streamed);
+	double t2 = get_time_ms();
+	printf("Medium diff to text (json_diff + print): avg = %.3f us/iter\n",
+	       (t1 - t0) * 1000.0 / text_iterations);
+	printf("Medium diff to text (json_diff_write): avg = %.3f us/iter "
+	       "(%zu bytes, %s)\n",
+	       (t2 - t1) * 1000.0 / text_iterations,
+	       streamed / text_iterations,
+	       printed == streamed ? "same length" : "LENGTH MISMATCH");
 
 	cJSON_Delete(left);
 	cJSON_Delete(right);
@@ -46,20 +46,24 @@ static char *read_file(const char *path)
 
 int main(void)
 {
-	const char *paths[] = {"profile-data/cdc.json",
-	                       "profile-data/edg.json"};
+	const char *paths[][2] = {
+	    {"profile-data/cdc.json", "profile-data/edg.json"},
+	    {"../profile-data/cdc.json", "../profile-data/edg.json"}};
 	char *bufs[2] = {0};
-	for (int i = 0; i < 2; i++) {
-		bufs[i] = read_file(paths[i]);
-		if (!bufs[i]) {
-			fputs("Failed to read '", stderr);
-			fputs(paths[i], stderr);
-			fputs("'\n", stderr);
-			for (int j = 0; j < i; j++) {
-				free(bufs[j]);
-			}
-			return 1;
-		}
+	for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+		bufs[0] = read_file(paths[i][0]);
+		bufs[1] = read_file(paths[i][1]);
+		if (bufs[0] && bufs[1])
+			break;
+		free(bufs[0]);
+		free(bufs[1]);
+		bufs[0] = bufs[1] = NULL;
+	}
+	if (!bufs[0] || !bufs[1]) {
+		fputs("Failed to load input files in profile-data/ or "
+		      "../profile-data/\n",
+		      stderr);
+		return 1;
 	}
 	int iterations = 50;
 	// Warm-up
@@ -80,6 +84,25 @@ int main(void)
 	printf("Parse benchmark: total = %.3f ms, avg = %.3f ms/iter\n",
 	       t1 - t0, (t1 - t0) / iterations);
 
+	/* Parse + diff through cJSON trees vs. the token path */
+	t0 = get_time_ms();
+	for (int i = 0; i < iterations; i++) {
+		cJSON *a = cJSON_Parse(bufs[0]);
+		cJSON *b = cJSON_Parse(bufs[1]);
+		cJSON_Delete(json_diff(a, b, NULL));
+		cJSON_Delete(a);
+		cJSON_Delete(b);
+	}
+	t1 = get_time_ms();
+	printf("Parse + diff (cJSON): total = %.3f ms, avg = %.3f ms/iter\n",
+	       t1 - t0, (t1 - t0) / iterations);
+	t0 = get_time_ms();
+	for (int i = 0; i < iterations; i++)
+		cJSON_Delete(json_diff_str(bufs[0], bufs[1], NULL));
+	t1 = get_time_ms();
+	printf("json_diff_str (tokens): total = %.3f ms, avg = %.3f ms/iter\n",
+	       t1 - t0, (t1 - t0) / iterations);
+
 	free(bufs[0]);
 	free(bufs[1]);
 	return 0;
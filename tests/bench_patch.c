@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: Apache-2.0
+#define _GNU_SOURCE
+#include "src/json_diff.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define ARRAY_LEN 50000
+
+static double get_time_ms(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+/*
+ * Array delta with tens of thousands of operations: every fourth element
+ * deleted, some moved, insertions and replacements spread over the result.
+ */
+static cJSON *build_delta(void)
+{
+	cJSON *delta = cJSON_CreateObject();
+	char key[32];
+	int kept = 0;
+	for (int i = 0; i < ARRAY_LEN; i++) {
+		snprintf(key, sizeof(key), "_%d", i);
+		if (i % 4 == 0) {
+			cJSON *del = cJSON_CreateArray();
+			cJSON_AddItemToArray(del, cJSON_CreateNumber(i));
+			cJSON_AddItemToArray(del, cJSON_CreateNumber(0));
+			cJSON_AddItemToArray(del, cJSON_CreateNumber(0));
+			cJSON_AddItemToObject(delta, key, del);
+		} else if (i % 997 == 1) {
+			cJSON *mv = cJSON_CreateArray();
+			cJSON_AddItemToArray(mv, cJSON_CreateString(""));
+			cJSON_AddItemToArray(mv, cJSON_CreateNumber(i / 2));
+			cJSON_AddItemToArray(mv, cJSON_CreateNumber(3));
+			cJSON_AddItemToObject(delta, key, mv);
+		} else {
+			kept++;
+		}
+	}
+	for (int j = 0; j < kept; j++) {
+		snprintf(key, sizeof(key), "%d", j);
+		if (j % 5 == 0) {
+			cJSON *add = cJSON_CreateArray();
+			cJSON_AddItemToArray(add, cJSON_CreateNumber(-j));
+			cJSON_AddItemToObject(delta, key, add);
+		} else if (j % 7 == 1) {
+			cJSON *chg = cJSON_CreateArray();
+			cJSON_AddItemToArray(chg, cJSON_CreateNumber(0));
+			cJSON_AddItemToArray(chg, cJSON_CreateNumber(j));
+			cJSON_AddItemToObject(delta, key, chg);
+		}
+	}
+	cJSON_AddStringToObject(delta, "_t", "a");
+	return delta;
+}
+
+int main(void)
+{
+	cJSON *array = cJSON_CreateArray();
+	for (int i = 0; i < ARRAY_LEN; i++)
+		cJSON_AddItemToArray(array, cJSON_CreateNumber(i));
+	cJSON *delta = build_delta();
+	int ops = cJSON_GetArraySize(delta) - 1;
+
+	const int iterations = 20;
+	double t0 = get_time_ms();
+	for (int i = 0; i < iterations; i++) {
+		cJSON *p = json_patch(array, delta);
+		if (!p) {
+			fputs("json_patch failed\n", stderr);
+			return 1;
+		}
+		cJSON_Delete(p);
+	}
+	double t1 = get_time_ms();
+	printf("Array patch benchmark (%d elements, %d ops): total = %.3f ms, "
+	       "avg = %.3f us/iter\n",
+	       ARRAY_LEN, ops, t1 - t0, (t1 - t0) * 1000.0 / iterations);
+
+	/* In place on a fresh copy each round; the copy is timed separately */
+	double copy = 0, apply = 0;
+	for (int i = 0; i < iterations; i++) {
+		double c0 = get_time_ms();
+		cJSON *target = cJSON_Duplicate(array, 1);
+		double c1 = get_time_ms();
+		cJSON *p = json_patch_inplace(target, delta);
+		double c2 = get_time_ms();
+		if (!p) {
+			fputs("json_patch_inplace failed\n", stderr);
+			return 1;
+		}
+		cJSON_Delete(p);
+		copy += c1 - c0;
+		apply += c2 - c1;
+	}
+	printf("Array patch benchmark (in place): avg = %.3f us/iter "
+	       "(+ %.3f us/iter to copy the target)\n",
+	       apply * 1000.0 / iterations, copy * 1000.0 / iterations);
+
+	cJSON_Delete(array);
+	cJSON_Delete(delta);
+	return 0;
+}
@@ -0,0 +1,720 @@
+// SPDX-License-Identifier: Apache-2.0
+#define _GNU_SOURCE
+#include "src/json_diff.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Benchmark harness: reproducible synthetic datasets plus the profile-data
+ * sets when present, each timed for diff, patch and a text round-trip.
+ * Every (dataset, operation) pair runs in a child process so its peak RSS
+ * is its own; the child reports back through a pipe. With --json the
+ * results are printed as one JSON document, and --compare checks them
+ * against an earlier one.
+ */
+
+#define DEFAULT_ITERATIONS 25
+#define DEFAULT_SEED 20240601u
+#define DEFAULT_THRESHOLD 10.0
+
+enum bench_op { OP_DIFF, OP_PATCH, OP_ROUNDTRIP, OP_COUNT };
+
+static const char *const op_names[OP_COUNT] = {"diff", "patch", "roundtrip"};
+
+struct bench_args {
+	int iterations; /* 0: the dataset's own default */
+	uint64_t seed;
+	const char *filter;
+	const char *data_dir;
+	const char *label;
+	const char *compare;
+	double threshold;
+	bool json;
+};
+
+/* What a child sends back; the parent adds the peak RSS */
+struct bench_result {
+	char dataset[32];
+	int op;
+	int iterations;
+	bool ok;
+	uint64_t median_ns, p99_ns, min_ns;
+	uint64_t allocs, alloc_bytes, work_bytes;
+	uint64_t input_bytes, delta_bytes;
+	long base_rss_kib, peak_rss_kib;
+};
+
+/* splitmix64: the same seed gives the same documents everywhere */
+static uint64_t rng_next(uint64_t *s)
+{
+	uint64_t z = (*s += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+static int rng_below(uint64_t *s, int n)
+{
+	return (int)(rng_next(s) % (uint64_t)n);
+}
+
+static double rng_double(uint64_t *s)
+{
+	return (double)(rng_next(s) >> 11) * 0x1.0p-53;
+}
+
+/* 50k members of mixed types; 1% changed, 0.5% deleted, 0.5% added */
+static void gen_wide(uint64_t seed, cJSON **left, cJSON **right)
+{
+	enum { KEYS = 50000 };
+	char key[32], val[32];
+	*left = cJSON_CreateObject();
+	for (int i = 0; i < KEYS; i++) {
+		snprintf(key, sizeof(key), "k%d", i);
+		snprintf(val, sizeof(val), "value-%d", i);
+		switch (i % 4) {
+		case 0:
+			cJSON_AddNumberToObject(*left, key, i);
+			break;
+		case 1:
+			cJSON_AddStringToObject(*left, key, val);
+			break;
+		case 2:
+			cJSON_AddBoolToObject(*left, key, i % 3 == 0);
+			break;
+		default: {
+			cJSON *o = cJSON_AddObjectToObject(*left, key);
+			cJSON_AddNumberToObject(o, "a", i);
+			cJSON_AddStringToObject(o, "b", val);
+		}
+		}
+	}
+	*right = cJSON_Duplicate(*left, 1);
+	for (int i = 0; i < KEYS / 100; i++) {
+		snprintf(key, sizeof(key), "k%d", rng_below(&seed, KEYS));
+		cJSON_ReplaceItemInObject(*right, key,
+		                          cJSON_CreateNumber(-i - 1));
+	}
+	for (int i = 0; i < KEYS / 200; i++) {
+		snprintf(key, sizeof(key), "k%d", rng_below(&seed, KEYS));
+		cJSON_DeleteItemFromObject(*right, key);
+		snprintf(key, sizeof(key), "new%d", i);
+		cJSON_AddStringToObject(*right, key, "added");
+	}
+}
+
+/* 64 chains of 250 nested objects; a few leaves and tags changed */
+static void gen_deep(uint64_t seed, cJSON **left, cJSON **right)
+{
+	enum { BRANCHES = 64, DEPTH = 250 };
+	char key[32];
+	*left = cJSON_CreateObject();
+	for (int b = 0; b < BRANCHES; b++) {
+		cJSON *node = cJSON_CreateObject();
+		cJSON_AddNumberToObject(node, "leaf", b);
+		for (int d = DEPTH - 1; d >= 0; d--) {
+			cJSON *up = cJSON_CreateObject();
+			snprintf(key, sizeof(key), "t%d-%d", b, d);
+			cJSON_AddNumberToObject(up, "level", d);
+			cJSON_AddStringToObject(up, "tag", key);
+			cJSON_AddItemToObject(up, "next", node);
+			node = up;
+		}
+		snprintf(key, sizeof(key), "b%d", b);
+		cJSON_AddItemToObject(*left, key, node);
+	}
+	*right = cJSON_Duplicate(*left, 1);
+	for (int i = 0; i < BRANCHES / 4; i++) {
+		snprintf(key, sizeof(key), "b%d", rng_below(&seed, BRANCHES));
+		cJSON *node = cJSON_GetObjectItem(*right, key);
+		int stop = rng_below(&seed, DEPTH + 1);
+		for (int d = 0; d < stop; d++)
+			node = cJSON_GetObjectItem(node, "next");
+		if (stop == DEPTH)
+			cJSON_ReplaceItemInObject(node, "leaf",
+			                          cJSON_CreateNumber(-1));
+		else
+			cJSON_ReplaceItemInObject(node, "tag",
+			                          cJSON_CreateString("edited"));
+	}
+}
+
+/* 100k strings with 32 scattered insertions, deletions and replacements */
+static void gen_edits(uint64_t seed, cJSON **left, cJSON **right)
+{
+	enum { ITEMS = 100000, EDITS = 32 };
+	char val[32];
+	*left = cJSON_CreateArray();
+	for (int i = 0; i < ITEMS; i++) {
+		snprintf(val, sizeof(val), "item-%d", i);
+		cJSON_AddItemToArray(*left, cJSON_CreateString(val));
+	}
+	*right = cJSON_Duplicate(*left, 1);
+	for (int i = 0; i < EDITS; i++) {
+		int at = rng_below(&seed, cJSON_GetArraySize(*right));
+		snprintf(val, sizeof(val), "edit-%d", i);
+		switch (i % 3) {
+		case 0:
+			cJSON_DeleteItemFromArray(*right, at);
+			break;
+		case 1:
+			cJSON_InsertItemInArray(*right, at,
+			                        cJSON_CreateString(val));
+			break;
+		default:
+			cJSON_ReplaceItemInArray(*right, at,
+			                         cJSON_CreateString(val));
+		}
+	}
+}
+
+/* 20k records keyed by "id"; 2% moved elsewhere, 0.5% edited */
+static void gen_reorder(uint64_t seed, cJSON **left, cJSON **right)
+{
+	enum { RECORDS = 20000 };
+	char val[32];
+	*left = cJSON_CreateArray();
+	for (int i = 0; i < RECORDS; i++) {
+		cJSON *r = cJSON_CreateObject();
+		snprintf(val, sizeof(val), "user-%d", i);
+		cJSON_AddNumberToObject(r, "id", i);
+		cJSON_AddStringToObject(r, "name", val);
+		cJSON_AddNumberToObject(r, "score", i % 97);
+		cJSON_AddItemToArray(*left, r);
+	}
+	*right = cJSON_Duplicate(*left, 1);
+	for (int i = 0; i < RECORDS / 50; i++) {
+		cJSON *r = cJSON_DetachItemFromArray(
+		    *right, rng_below(&seed, RECORDS));
+		cJSON_InsertItemInArray(*right, rng_below(&seed, RECORDS - 1),
+		                        r);
+	}
+	for (int i = 0; i < RECORDS / 200; i++) {
+		cJSON *r = cJSON_GetArrayItem(*right,
+		                              rng_below(&seed, RECORDS));
+		cJSON_ReplaceItemInObject(r, "score", cJSON_CreateNumber(-1));
+	}
+}
+
+/* 32 series of 16k doubles; every other series has 0.5% of it nudged */
+static void gen_numbers(uint64_t seed, cJSON **left, cJSON **right)
+{
+	enum { SERIES = 32, POINTS = 16384 };
+	char key[32];
+	*left = cJSON_CreateObject();
+	for (int s = 0; s < SERIES; s++) {
+		cJSON *a = cJSON_CreateArray();
+		for (int i = 0; i < POINTS; i++)
+			cJSON_AddItemToArray(
+			    a, cJSON_CreateNumber(rng_double(&seed) * 1000));
+		snprintf(key, sizeof(key), "series%d", s);
+		cJSON_AddItemToObject(*left, key, a);
+	}
+	*right = cJSON_Duplicate(*left, 1);
+	for (int s = 1; s < SERIES; s += 2) {
+		snprintf(key, sizeof(key), "series%d", s);
+		cJSON *a = cJSON_GetObjectItem(*right, key);
+		for (int i = 0; i < POINTS / 200; i++) {
+			cJSON *e = cJSON_GetArrayItem(a,
+			                              rng_below(&seed, POINTS));
+			cJSON_SetNumberValue(e, e->valuedouble + 0.5);
+		}
+	}
+}
+
+struct dataset {
+	const char *name;
+	void (*gen)(uint64_t seed, cJSON **left, cJSON **right);
+	const char *files[2]; /* under the data directory, without @gen */
+	struct json_diff_options opts;
+	int iterations;
+};
+
+static const struct dataset datasets[] = {
+    {"wide", gen_wide, {NULL, NULL}, {.strict_equality = true},
+     DEFAULT_ITERATIONS},
+    {"deep", gen_deep, {NULL, NULL}, {.strict_equality = true},
+     DEFAULT_ITERATIONS},
+    {"array-edits", gen_edits, {NULL, NULL}, {.strict_equality = true},
+     DEFAULT_ITERATIONS},
+    {"reorder", gen_reorder, {NULL, NULL},
+     {.strict_equality = true, .object_key = "id", .detect_moves = true},
+     DEFAULT_ITERATIONS},
+    {"numbers", gen_numbers, {NULL, NULL}, {.strict_equality = true},
+     DEFAULT_ITERATIONS},
+    {"profile-medium", NULL, {"cdc.json", "edg.json"},
+     {.strict_equality = true}, DEFAULT_ITERATIONS},
+    {"profile-big", NULL, {"ModernAtomic.json", "LegacyAtomic.json"},
+     {.strict_equality = true}, 3},
+};
+
+#define DATASET_COUNT (sizeof(datasets) / sizeof(datasets[0]))
+
+static char *read_file(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+	char *buf = NULL;
+	long len = -1;
+	if (fseek(f, 0, SEEK_END) == 0)
+		len = ftell(f);
+	if (len >= 0 && fseek(f, 0, SEEK_SET) == 0)
+		buf = malloc((size_t)len + 1);
+	if (buf) {
+		size_t n = fread(buf, 1, (size_t)len, f);
+		buf[n] = '\0';
+	}
+	fclose(f);
+	return buf;
+}
+
+/* Meson sets MESON_SOURCE_ROOT for run targets */
+static const char *find_data_dir(const struct bench_args *args)
+{
+	static char dir[4096];
+	if (args->data_dir)
+		return args->data_dir;
+	const char *root = getenv("MESON_SOURCE_ROOT");
+	if (root) {
+		snprintf(dir, sizeof(dir), "%s/profile-data", root);
+		return dir;
+	}
+	if (access("profile-data", F_OK) == 0)
+		return "profile-data";
+	return "../profile-data";
+}
+
+static bool dataset_available(const struct bench_args *args,
+                              const struct dataset *ds)
+{
+	if (ds->gen)
+		return true;
+	char path[4096];
+	for (int i = 0; i < 2; i++) {
+		snprintf(path, sizeof(path), "%s/%s", find_data_dir(args),
+		         ds->files[i]);
+		if (access(path, R_OK) != 0)
+			return false;
+	}
+	return true;
+}
+
+struct inputs {
+	cJSON *left, *right;
+	char *left_text, *right_text;
+};
+
+static bool load_inputs(const struct bench_args *args,
+                        const struct dataset *ds, struct inputs *in)
+{
+	memset(in, 0, sizeof(*in));
+	if (ds->gen) {
+		ds->gen(args->seed, &in->left, &in->right);
+		in->left_text = cJSON_PrintUnformatted(in->left);
+		in->right_text = cJSON_PrintUnformatted(in->right);
+	} else {
+		char path[4096];
+		char **text[2] = {&in->left_text, &in->right_text};
+		for (int i = 0; i < 2; i++) {
+			snprintf(path, sizeof(path), "%s/%s",
+			         find_data_dir(args), ds->files[i]);
+			*text[i] = read_file(path);
+		}
+		if (in->left_text && in->right_text) {
+			in->left = cJSON_Parse(in->left_text);
+			in->right = cJSON_Parse(in->right_text);
+		}
+	}
+	return in->left && in->right && in->left_text && in->right_text;
+}
+
+static void free_inputs(struct inputs *in)
+{
+	cJSON_Delete(in->left);
+	cJSON_Delete(in->right);
+	free(in->left_text);
+	free(in->right_text);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* ru_maxrss is in KiB on Linux and in bytes on macOS */
+static long maxrss_kib(long maxrss)
+{
+#ifdef __APPLE__
+	return maxrss / 1024;
+#else
+	return maxrss;
+#endif
+}
+
+static long self_rss_kib(void)
+{
+	struct rusage ru;
+	return getrusage(RUSAGE_SELF, &ru) == 0 ? maxrss_kib(ru.ru_maxrss) : 0;
+}
+
+/* cJSON allocations, counted during one untimed pass per operation */
+static uint64_t hook_allocs, hook_bytes;
+
+static void *counting_malloc(size_t size)
+{
+	hook_allocs++;
+	hook_bytes += size;
+	return malloc(size);
+}
+
+static void count_cjson_allocs(bool on)
+{
+	cJSON_Hooks hooks = {counting_malloc, free};
+	hook_allocs = hook_bytes = 0;
+	/* cJSON falls back to malloc + copy in place of realloc meanwhile */
+	cJSON_InitHooks(on ? &hooks : NULL);
+}
+
+/*
+ * One pass of @op; the timed part excludes freeing results and checking
+ * the round-trip. Return: false if the operation failed
+ */
+static bool run_once(enum bench_op op, const struct inputs *in,
+                     const struct json_diff_options *opts,
+                     const cJSON *delta, uint64_t *ns)
+{
+	uint64_t t0 = now_ns();
+	cJSON *res = NULL;
+	bool ok = true;
+	switch (op) {
+	case OP_DIFF:
+		res = json_diff(in->left, in->right, opts);
+		*ns = now_ns() - t0;
+		ok = res != NULL;
+		break;
+	case OP_PATCH:
+		res = json_patch(in->left, delta);
+		*ns = now_ns() - t0;
+		ok = res != NULL;
+		break;
+	default: {
+		cJSON *d = json_diff_str(in->left_text, in->right_text, opts);
+		char *text = d ? cJSON_PrintUnformatted(d) : NULL;
+		cJSON *parsed = text ? cJSON_Parse(text) : NULL;
+		res = parsed ? json_patch(in->left, parsed) : NULL;
+		*ns = now_ns() - t0;
+		ok = res && json_value_equal(res, in->right, true);
+		cJSON_Delete(parsed);
+		free(text);
+		cJSON_Delete(d);
+	}
+	}
+	cJSON_Delete(res);
+	return ok;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static bool bench_child(const struct bench_args *args,
+                        const struct dataset *ds, enum bench_op op,
+                        struct bench_result *res)
+{
+	struct inputs in;
+	memset(res, 0, sizeof(*res));
+	snprintf(res->dataset, sizeof(res->dataset), "%s", ds->name);
+	res->op = op;
+	if (!load_inputs(args, ds, &in)) {
+		free_inputs(&in);
+		return false;
+	}
+	struct json_diff_options opts = ds->opts;
+	opts.max_input_size = strlen(in.left_text) + strlen(in.right_text);
+	res->input_bytes = opts.max_input_size;
+
+	cJSON *delta = json_diff(in.left, in.right, &opts);
+	char *delta_text = delta ? cJSON_PrintUnformatted(delta) : NULL;
+	res->delta_bytes = delta_text ? strlen(delta_text) : 0;
+	free(delta_text);
+	res->base_rss_kib = self_rss_kib();
+
+	/* The counting pass doubles as warm-up */
+	struct json_diff_stats stats;
+	memset(&stats, 0, sizeof(stats));
+	struct json_diff_options counted = opts;
+	counted.stats = &stats;
+	uint64_t ns;
+	count_cjson_allocs(true);
+	res->ok = delta && run_once(op, &in, &counted, delta, &ns);
+	res->allocs = hook_allocs;
+	res->alloc_bytes = hook_bytes;
+	res->work_bytes = op == OP_PATCH ? 0 : stats.bytes_allocated;
+	count_cjson_allocs(false);
+
+	int n = args->iterations > 0 ? args->iterations : ds->iterations;
+	uint64_t *samples = malloc((size_t)n * sizeof(*samples));
+	for (int i = 0; res->ok && samples && i < n; i++)
+		res->ok = run_once(op, &in, &opts, delta, &samples[i]);
+	if (res->ok && samples) {
+		qsort(samples, (size_t)n, sizeof(*samples), cmp_u64);
+		res->iterations = n;
+		res->min_ns = samples[0];
+		res->median_ns = samples[n / 2];
+		if (n % 2 == 0)
+			res->median_ns =
+			    (samples[n / 2 - 1] + res->median_ns) / 2;
+		/* Nearest rank */
+		res->p99_ns = samples[(99 * n + 99) / 100 - 1];
+	}
+	free(samples);
+	cJSON_Delete(delta);
+	free_inputs(&in);
+	return res->ok;
+}
+
+/* Run one measurement in a child so its peak RSS is its own */
+static bool bench_isolated(const struct bench_args *args,
+                           const struct dataset *ds, enum bench_op op,
+                           struct bench_result *res)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+		return false;
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		bool ok = bench_child(args, ds, op, res);
+		ssize_t n = write(fds[1], res, sizeof(*res));
+		_exit(ok && n == (ssize_t)sizeof(*res) ? 0 : 1);
+	}
+	close(fds[1]);
+	size_t got = 0;
+	while (got < sizeof(*res)) {
+		ssize_t n = read(fds[0], (char *)res + got, sizeof(*res) - got);
+		if (n <= 0)
+			break;
+		got += (size_t)n;
+	}
+	close(fds[0]);
+	int status;
+	struct rusage ru;
+	if (wait4(pid, &status, 0, &ru) != pid || got != sizeof(*res))
+		return false;
+	res->peak_rss_kib = maxrss_kib(ru.ru_maxrss);
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0 && res->ok;
+}
+
+static cJSON *result_json(const struct bench_result *r)
+{
+	cJSON *o = cJSON_CreateObject();
+	cJSON_AddStringToObject(o, "dataset", r->dataset);
+	cJSON_AddStringToObject(o, "op", op_names[r->op]);
+	cJSON_AddNumberToObject(o, "iterations", r->iterations);
+	cJSON_AddNumberToObject(o, "median_ns", (double)r->median_ns);
+	cJSON_AddNumberToObject(o, "p99_ns", (double)r->p99_ns);
+	cJSON_AddNumberToObject(o, "min_ns", (double)r->min_ns);
+	cJSON_AddNumberToObject(o, "cjson_allocs", (double)r->allocs);
+	cJSON_AddNumberToObject(o, "cjson_alloc_bytes",
+	                        (double)r->alloc_bytes);
+	cJSON_AddNumberToObject(o, "work_bytes", (double)r->work_bytes);
+	cJSON_AddNumberToObject(o, "input_bytes", (double)r->input_bytes);
+	cJSON_AddNumberToObject(o, "delta_bytes", (double)r->delta_bytes);
+	cJSON_AddNumberToObject(o, "base_rss_kib", (double)r->base_rss_kib);
+	cJSON_AddNumberToObject(o, "peak_rss_kib", (double)r->peak_rss_kib);
+	return o;
+}
+
+static void print_row(const struct bench_result *r)
+{
+	printf("%-15s %-9s %5d %11.3f %11.3f %10" PRIu64 " %10.1f %10.1f "
+	       "%9.1f\n",
+	       r->dataset, op_names[r->op], r->iterations,
+	       r->median_ns / 1e6, r->p99_ns / 1e6, r->allocs,
+	       r->alloc_bytes / 1024.0, r->work_bytes / 1024.0,
+	       r->peak_rss_kib / 1024.0);
+}
+
+/*
+ * Compare medians with a --json document from an earlier run.
+ * Return: number of results slower than the threshold, -1 on error
+ */
+static int compare_results(const struct bench_args *args, const cJSON *now)
+{
+	char *text = read_file(args->compare);
+	cJSON *base = text ? cJSON_Parse(text) : NULL;
+	free(text);
+	const cJSON *old = cJSON_GetObjectItem(base, "results");
+	if (!cJSON_IsArray(old)) {
+		fprintf(stderr, "Cannot read results from '%s'\n",
+		        args->compare);
+		cJSON_Delete(base);
+		return -1;
+	}
+	int regressions = 0;
+	FILE *out = args->json ? stderr : stdout;
+	fprintf(out, "\nAgainst %s (threshold %.1f%%):\n", args->compare,
+	        args->threshold);
+	const cJSON *r, *o;
+	cJSON_ArrayForEach(r, cJSON_GetObjectItem(now, "results"))
+	{
+		const char *ds = cJSON_GetStringValue(
+		    cJSON_GetObjectItem(r, "dataset"));
+		const char *op =
+		    cJSON_GetStringValue(cJSON_GetObjectItem(r, "op"));
+		cJSON_ArrayForEach(o, old)
+		{
+			const char *ods = cJSON_GetStringValue(
+			    cJSON_GetObjectItem(o, "dataset"));
+			const char *oop = cJSON_GetStringValue(
+			    cJSON_GetObjectItem(o, "op"));
+			if (ods && oop && !strcmp(ds, ods) && !strcmp(op, oop))
+				break;
+		}
+		double was = cJSON_GetNumberValue(
+		    cJSON_GetObjectItem(o, "median_ns"));
+		if (!o || !(was > 0))
+			continue;
+		double is = cJSON_GetNumberValue(
+		    cJSON_GetObjectItem(r, "median_ns"));
+		double change = (is / was - 1) * 100;
+		bool slower = change > args->threshold;
+		regressions += slower;
+		fprintf(out, "%-15s %-9s %11.3f -> %11.3f ms %+7.1f%%%s\n", ds,
+		        op, was / 1e6, is / 1e6, change,
+		        slower ? "  REGRESSION" : "");
+	}
+	cJSON_Delete(base);
+	return regressions;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+	        "Usage: %s [options]\n"
+	        "  -n, --iterations N  timed runs per operation (default: %d, "
+	        "3 for profile-big)\n"
+	        "  --seed N            seed of the synthetic datasets\n"
+	        "  --filter NAME       only datasets whose name contains "
+	        "NAME\n"
+	        "  --data DIR          profile-data directory\n"
+	        "  --json              machine-readable output\n"
+	        "  --label TEXT        label stored in the JSON output\n"
+	        "  --compare FILE      compare medians with an earlier "
+	        "--json run\n"
+	        "  --threshold PCT     slowdown counted as a regression "
+	        "(default: %.0f)\n",
+	        prog, DEFAULT_ITERATIONS, DEFAULT_THRESHOLD);
+}
+
+static bool parse_args(int argc, char **argv, struct bench_args *args)
+{
+	for (int i = 1; i < argc; i++) {
+		const char *a = argv[i];
+		const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+		if (!strcmp(a, "--json")) {
+			args->json = true;
+			continue;
+		}
+		if (!v)
+			return false;
+		i++;
+		if (!strcmp(a, "-n") || !strcmp(a, "--iterations"))
+			args->iterations = atoi(v);
+		else if (!strcmp(a, "--seed"))
+			args->seed = strtoull(v, NULL, 0);
+		else if (!strcmp(a, "--filter"))
+			args->filter = v;
+		else if (!strcmp(a, "--data"))
+			args->data_dir = v;
+		else if (!strcmp(a, "--label"))
+			args->label = v;
+		else if (!strcmp(a, "--compare"))
+			args->compare = v;
+		else if (!strcmp(a, "--threshold"))
+			args->threshold = atof(v);
+		else
+			return false;
+	}
+	return args->iterations >= 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_args args = {.seed = DEFAULT_SEED,
+	                          .threshold = DEFAULT_THRESHOLD};
+	if (!parse_args(argc, argv, &args)) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	cJSON *doc = cJSON_CreateObject();
+	cJSON_AddStringToObject(doc, "benchmark", "json_diff_c");
+	if (args.label)
+		cJSON_AddStringToObject(doc, "label", args.label);
+	cJSON_AddNumberToObject(doc, "seed", (double)args.seed);
+	cJSON_AddNumberToObject(doc, "timestamp", (double)time(NULL));
+	cJSON *results = cJSON_AddArrayToObject(doc, "results");
+
+	if (!args.json)
+		printf("%-15s %-9s %5s %11s %11s %10s %10s %10s %9s\n",
+		       "dataset", "op", "iters", "median ms", "p99 ms",
+		       "allocs", "alloc KiB", "work KiB", "RSS MiB");
+	int failed = 0;
+	for (size_t d = 0; d < DATASET_COUNT; d++) {
+		const struct dataset *ds = &datasets[d];
+		if (args.filter && !strstr(ds->name, args.filter))
+			continue;
+		if (!dataset_available(&args, ds)) {
+			fprintf(stderr,
+			        "Skipping %s: %s and %s not found in %s\n",
+			        ds->name, ds->files[0], ds->files[1],
+			        find_data_dir(&args));
+			continue;
+		}
+		for (int op = 0; op < OP_COUNT; op++) {
+			struct bench_result r;
+			if (!bench_isolated(&args, ds, op, &r)) {
+				fprintf(stderr, "%s %s failed\n", ds->name,
+				        op_names[op]);
+				failed++;
+				continue;
+			}
+			cJSON_AddItemToArray(results, result_json(&r));
+			if (!args.json)
+				print_row(&r);
+		}
+	}
+
+	int regressions = args.compare ? compare_results(&args, doc) : 0;
+	if (args.json) {
+		char *text = cJSON_Print(doc);
+		if (text)
+			puts(text);
+		free(text);
+	}
+	cJSON_Delete(doc);
+	if (failed || regressions < 0)
+		return 1;
+	return regressions ? 3 : 0;
+}
@@ -649,7 +649,7 @@ static void test_deleted_key_patch(void)
 static void test_numeric_type_equality(void)
 {
 	cJSON *obj1, *obj2, *diff;
-	struct json_diff_options opts;
+	struct json_diff_options opts = {0};
 
 	printf("Testing numeric type equality...\n");
 
@@ -734,6 +734,1945 @@ static void test_array_patch_shift_inside(void)
 	printf("Array patch shift inside test passed!\n");
 }
 
+static void test_array_patch_insert_middle(void)
+{
+	printf("Testing array patch insert in middle...\n");
+	cJSON *a = cJSON_Parse("[1,2,3]");
+	cJSON *b = cJSON_Parse("[1,4,2,3]");
+	cJSON *diff = json_diff(a, b, NULL);
+	assert(diff);
+	cJSON *patched = json_patch(a, diff);
+	assert(patched && json_value_equal(patched, b, true));
+	cJSON_Delete(patched);
+	cJSON_Delete(diff);
+	cJSON_Delete(a);
+	cJSON_Delete(b);
+	printf("Array patch insert in middle test passed!\n");
+}
+
+static void test_hash_cache_diff(void)
+{
+	printf("Testing diff with hash cache...\n");
+	char *s1 = read_file("tests/big_json1.json");
+	char *s2 = read_file("tests/big_json2.json");
+	cJSON *a = cJSON_Parse(s1);
+	cJSON *b = cJSON_Parse(s2);
+	assert(a && b);
+
+	struct json_diff_options plain = {.strict_equality = true};
+	struct json_diff_options cached = {.strict_equality = true,
+	                                   .hash_cache = true};
+	cJSON *d1 = json_diff(a, b, &plain);
+	cJSON *d2 = json_diff(a, b, &cached);
+	assert(d1 && d2 && json_value_equal(d1, d2, true));
+	cJSON *patched = json_patch(a, d2);
+	assert(patched && json_value_equal(patched, b, false));
+	cJSON_Delete(patched);
+	cJSON_Delete(d1);
+	cJSON_Delete(d2);
+
+	/* Key order does not matter, key case and number values do */
+	cJSON *x = cJSON_Parse("[{\"a\":1,\"b\":[1,2]},{\"K\":1}]");
+	cJSON *y = cJSON_Parse("[{\"b\":[1,2],\"a\":1},{\"k\":1}]");
+	assert(x && y);
+	d1 = json_diff(x, y, &cached);
+	assert(d1 && cJSON_GetObjectItem(d1, "1") &&
+	       !cJSON_GetObjectItem(d1, "0"));
+	cJSON_Delete(d1);
+
+	/* Loose number equality still holds with hashing enabled */
+	struct json_diff_options loose = {.strict_equality = false,
+	                                  .hash_cache = true};
+	cJSON *n1 = cJSON_Parse("[{\"v\":1.0000000001}]");
+	cJSON *n2 = cJSON_Parse("[{\"v\":1}]");
+	assert(n1 && n2 && json_diff(n1, n2, &loose) == NULL);
+
+	cJSON_Delete(n1);
+	cJSON_Delete(n2);
+	cJSON_Delete(x);
+	cJSON_Delete(y);
+	cJSON_Delete(a);
+	cJSON_Delete(b);
+	free(s1);
+	free(s2);
+	printf("Hash cache diff test passed!\n");
+}
+
+static void test_arena_diff_reset(void)
+{
+	printf("Testing arena-backed diff and reset...\n");
+	char *s1 = read_file("tests/big_json1.json");
+	char *s2 = read_file("tests/big_json2.json");
+	cJSON *a = cJSON_Parse(s1);
+	cJSON *b = cJSON_Parse(s2);
+	assert(a && b);
+
+	struct json_diff_arena arena;
+	json_diff_arena_init(&arena, 1 << 20);
+	struct json_diff_options opts = {.strict_equality = true,
+	                                 .arena = &arena};
+	struct json_diff_options heap = {.strict_equality = true};
+
+	cJSON *d1 = json_diff(a, b, &opts);
+	assert(d1 && arena.offset > 0);
+	size_t used = arena.offset;
+
+	/* Heap diffs are unaffected while an arena diff is alive */
+	cJSON *d2 = json_diff(a, b, &heap);
+	assert(d2 && json_value_equal(d1, d2, true));
+	assert(arena.offset == used);
+	cJSON *patched = json_patch(a, d1);
+	assert(patched && json_value_equal(patched, b, false));
+	cJSON_Delete(patched);
+	cJSON_Delete(d2);
+
+	/* Reset rewinds the arena and the chunks are reused as is */
+	size_t chunks = arena.chunk_count;
+	json_diff_arena_reset(&arena);
+	assert(arena.offset == 0 && arena.high_water == used);
+	d1 = json_diff(a, b, &opts);
+	assert(d1 && arena.offset == used && arena.chunk_count == chunks);
+
+	json_diff_arena_cleanup(&arena);
+	cJSON_Delete(a);
+	cJSON_Delete(b);
+	free(s1);
+	free(s2);
+	printf("Arena diff test passed!\n");
+}
+
+static void test_arena_growth(void)
+{
+	printf("Testing arena growth across chunks...\n");
+	/* Tiny chunks force many chunk and large-block allocations */
+	struct json_diff_arena arena;
+	json_diff_arena_init(&arena, 1);
+	struct json_diff_options opts = {.strict_equality = true,
+	                                 .arena = &arena};
+
+	cJSON *l = cJSON_CreateObject();
+	cJSON *r = cJSON_CreateObject();
+	char key[32];
+	char big[4096];
+	memset(big, 'x', sizeof(big) - 1);
+	big[sizeof(big) - 1] = '\0';
+	for (int i = 0; i < 2000; i++) {
+		snprintf(key, sizeof(key), "k%d", i);
+		cJSON_AddNumberToObject(l, key, i);
+		if (i % 100 == 0)
+			cJSON_AddStringToObject(r, key, big);
+		else
+			cJSON_AddNumberToObject(r, key, i + 1);
+	}
+	cJSON *d = json_diff(l, r, &opts);
+	assert(d);
+	assert(arena.chunk_count > 1 && arena.large_count > 0);
+	assert(arena.high_water >= arena.offset && arena.offset > 0);
+
+	/* Nodes from the first chunk are still intact after growth */
+	cJSON *patched = json_patch(l, d);
+	assert(patched && json_value_equal(patched, r, true));
+	cJSON_Delete(patched);
+
+	size_t chunks = arena.chunk_count;
+	json_diff_arena_reset(&arena);
+	assert(arena.large_count == 0 && arena.chunk_count == chunks);
+	json_diff_arena_cleanup(&arena);
+	assert(arena.chunk_count == 0 && arena.capacity == 0);
+
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	printf("Arena growth test passed!\n");
+}
+
+static void test_object_key_order(void)
+{
+	printf("Testing object diff key order...\n");
+	cJSON *l = cJSON_Parse("{\"z\":1,\"a\":1,\"m\":{\"q\":1,\"p\":1}}");
+	cJSON *r = cJSON_Parse(
+	    "{\"y\":0,\"m\":{\"p\":2,\"q\":2},\"z\":2,\"b\":0}");
+	assert(l && r);
+	cJSON *d = json_diff(l, r, NULL);
+	assert(d);
+
+	/* Left-side keys in left order, then right-only keys in right order */
+	const char *expect[] = {"z", "a", "m", "y", "b"};
+	const cJSON *ch = d->child;
+	for (size_t i = 0; i < sizeof(expect) / sizeof(expect[0]); i++) {
+		assert(ch && strcmp(ch->string, expect[i]) == 0);
+		ch = ch->next;
+	}
+	assert(!ch);
+	ch = cJSON_GetObjectItem(d, "m")->child;
+	assert(strcmp(ch->string, "q") == 0 &&
+	       strcmp(ch->next->string, "p") == 0);
+	cJSON_Delete(d);
+
+	/* Wide objects go through the same index */
+	cJSON *wl = cJSON_CreateObject();
+	cJSON *wr = cJSON_CreateObject();
+	char key[32];
+	for (int i = 0; i < 20000; i++) {
+		snprintf(key, sizeof(key), "card%d", i);
+		cJSON_AddNumberToObject(wl, key, i);
+		int j = 19999 - i;
+		snprintf(key, sizeof(key), "card%d", j);
+		cJSON_AddNumberToObject(wr, key, j % 7 ? j : -1);
+	}
+	cJSON_AddNumberToObject(wr, "extra", 1);
+	d = json_diff(wl, wr, NULL);
+	assert(d && strcmp(d->child->string, "card0") == 0);
+	cJSON *patched = json_patch(wl, d);
+	assert(patched && json_value_equal(patched, wr, true));
+	cJSON_Delete(patched);
+	cJSON_Delete(d);
+
+	cJSON_Delete(wl);
+	cJSON_Delete(wr);
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	printf("Object key order test passed!\n");
+}
+
+/* Deltas naming many members of one object go through the key index */
+static void test_patch_wide_object(void)
+{
+	printf("Testing wide object patch...\n");
+	cJSON *l = cJSON_CreateObject(), *r = cJSON_CreateObject();
+	cJSON *ln = cJSON_AddObjectToObject(l, "nested");
+	cJSON *rn = cJSON_AddObjectToObject(r, "nested");
+	assert(ln && rn);
+	char key[16];
+	for (int i = 0; i < 300; i++) {
+		snprintf(key, sizeof(key), "k%d", i);
+		cJSON_AddNumberToObject(l, key, i);
+		cJSON_AddNumberToObject(ln, key, i);
+		/* Every third key changes, every third is deleted */
+		if (i % 3 == 0) {
+			cJSON_AddNumberToObject(r, key, -i - 1);
+			cJSON_AddStringToObject(rn, key, "x");
+		} else if (i % 3 == 2) {
+			cJSON_AddNumberToObject(r, key, i);
+			cJSON_AddNumberToObject(rn, key, i);
+		}
+	}
+	for (int i = 0; i < 100; i++) {
+		snprintf(key, sizeof(key), "n%d", i);
+		cJSON_AddNumberToObject(r, key, i);
+		cJSON_AddNumberToObject(rn, key, i);
+	}
+	cJSON *d = json_diff(l, r, NULL);
+	assert(d && cJSON_GetArraySize(d) > 300);
+
+	cJSON *res = json_patch(l, d);
+	assert(res && json_value_equal(res, r, true));
+	cJSON_Delete(res);
+	res = json_patch_inplace(cJSON_Duplicate(l, 1), d);
+	assert(res && json_value_equal(res, r, true));
+	cJSON_Delete(res);
+
+	char *text = cJSON_PrintUnformatted(d);
+	assert(text);
+	res = json_patch_str(cJSON_Duplicate(l, 1), text);
+	assert(res && json_value_equal(res, r, true));
+	cJSON_Delete(res);
+	free(text);
+
+	unsigned char *bin = NULL;
+	size_t blen = 0;
+	assert(json_diff_encode_binary(d, 0, &bin, &blen) == 0);
+	res = json_patch_binary(l, bin, blen);
+	assert(res && json_value_equal(res, r, true));
+	cJSON_Delete(res);
+	free(bin);
+
+	cJSON_Delete(d);
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	printf("Wide object patch test passed!\n");
+}
+
+static void test_borrowed_output(void)
+{
+	printf("Testing borrowed and owned diff output...\n");
+	const char *ls = "{\"keep\":1,\"gone\":{\"deep\":[1,2,3]},"
+	                 "\"arr\":[[1],{\"a\":\"x\"}],\"s\":\"old\"}";
+	const char *rs = "{\"keep\":1,\"arr\":[[1],[2,3]],\"s\":\"new\","
+	                 "\"add\":{\"n\":[null]}}";
+	cJSON *l = cJSON_Parse(ls);
+	cJSON *r = cJSON_Parse(rs);
+	assert(l && r);
+
+	struct json_diff_options owned = {.strict_equality = true};
+	struct json_diff_options borrowed = {
+	    .strict_equality = true, .output = JSON_DIFF_OUTPUT_BORROWED};
+	cJSON *d1 = json_diff(l, r, &owned);
+	cJSON *d2 = json_diff(l, r, &borrowed);
+	assert(d1 && d2 && json_value_equal(d1, d2, true));
+
+	/* Borrowed values point straight into the inputs */
+	cJSON *gone = cJSON_GetArrayItem(cJSON_GetObjectItem(d2, "gone"), 0);
+	assert(gone && (gone->type & cJSON_IsReference) &&
+	       gone->child == cJSON_GetObjectItem(l, "gone")->child);
+	cJSON *s_new = cJSON_GetArrayItem(cJSON_GetObjectItem(d2, "s"), 1);
+	assert(s_new->valuestring ==
+	       cJSON_GetObjectItem(r, "s")->valuestring);
+	/* Owned values share nothing */
+	gone = cJSON_GetArrayItem(cJSON_GetObjectItem(d1, "gone"), 0);
+	assert(!(gone->type & cJSON_IsReference) &&
+	       gone->child != cJSON_GetObjectItem(l, "gone")->child);
+
+	/* Nested containers survive the round trip in both modes */
+	cJSON *p1 = json_patch(l, d1);
+	cJSON *p2 = json_patch(l, d2);
+	assert(p1 && json_value_equal(p1, r, true));
+	assert(p2 && json_value_equal(p2, r, true));
+	cJSON_Delete(p1);
+	cJSON_Delete(p2);
+	json_diff_free(d2, &borrowed);
+
+	/* Owned diffs outlive their inputs, as json_diff_str() relies on */
+	cJSON_Delete(r);
+	r = cJSON_Parse(rs);
+	p1 = json_patch(l, d1);
+	assert(p1 && json_value_equal(p1, r, true));
+	cJSON_Delete(p1);
+	json_diff_free(d1, &owned);
+
+	cJSON *ds = json_diff_str(ls, rs, &borrowed);
+	assert(ds);
+	p1 = json_patch(l, ds);
+	assert(p1 && json_value_equal(p1, r, true));
+	cJSON_Delete(p1);
+	json_diff_free(ds, NULL);
+
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	printf("Borrowed output test passed!\n");
+}
+
+/* json_diff_write() sink failing after @budget bytes */
+struct limited_sink {
+	size_t budget;
+	size_t seen;
+};
+
+static int limited_write(const char *data, size_t len, void *user)
+{
+	struct limited_sink *sink = user;
+	(void)data;
+	sink->seen += len;
+	return sink->seen > sink->budget;
+}
+
+static void test_diff_write(void)
+{
+	printf("Testing streaming diff writer...\n");
+	cJSON *l = cJSON_Parse("{\"s\":\"a\\\"b\\n\\u0001\",\"f\":0.1,"
+	                       "\"list\":[{\"id\":1},2,3,{\"k\":[true]}],"
+	                       "\"same\":{\"x\":[1,2]},\"gone\":null}");
+	cJSON *r = cJSON_Parse("{\"s\":\"tab\\there\",\"f\":1e300,"
+	                       "\"list\":[0,{\"id\":2},3,{\"k\":[false]}],"
+	                       "\"same\":{\"x\":[1,2]},\"new\":[\"v\"]}");
+	assert(l && r);
+	struct json_diff_options opts = {.strict_equality = true,
+	                                 .detect_moves = true};
+	cJSON *d = json_diff(l, r, &opts);
+	char *expected = cJSON_PrintUnformatted(d);
+	assert(d && expected);
+
+	/* Same text as printing the tree, and it patches */
+	size_t needed = 0;
+	assert(json_diff_write_buf(l, r, &opts, NULL, 0, &needed) == 1);
+	assert(needed == strlen(expected));
+	char *buf = malloc(needed + 1);
+	assert(buf);
+	assert(json_diff_write_buf(l, r, &opts, buf, needed + 1, NULL) == 1);
+	assert(strcmp(buf, expected) == 0);
+	cJSON *parsed = cJSON_Parse(buf);
+	cJSON *patched = json_patch(l, parsed);
+	assert(patched && json_value_equal(patched, r, true));
+
+	/* Short buffers are cut off and terminated */
+	char small[8];
+	assert(json_diff_write_buf(l, r, &opts, small, sizeof(small),
+	                           &needed) == 1);
+	assert(needed == strlen(expected) && strlen(small) == 7 &&
+	       strncmp(small, expected, 7) == 0);
+
+	/* Equal values write nothing */
+	assert(json_diff_write_buf(l, l, &opts, small, sizeof(small),
+	                           &needed) == 0);
+	assert(needed == 0 && small[0] == '\0');
+
+	/* A failing sink aborts the write */
+	struct limited_sink sink = {.budget = 0};
+	assert(json_diff_write(l, r, &opts, limited_write, &sink) == -1);
+
+	cJSON_Delete(patched);
+	cJSON_Delete(parsed);
+	free(buf);
+	free(expected);
+	cJSON_Delete(d);
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	printf("Streaming diff writer test passed!\n");
+}
+
+/* json_diff_str() must produce what json_diff() does on the parsed inputs */
+static void assert_str_diff_matches(const char *ls, const char *rs,
+                                    const struct json_diff_options *opts)
+{
+	cJSON *l = cJSON_Parse(ls);
+	cJSON *r = cJSON_Parse(rs);
+	assert(l && r);
+	cJSON *expected = json_diff(l, r, opts);
+	cJSON *d = json_diff_str(ls, rs, opts);
+	if (!expected) {
+		assert(!d);
+	} else {
+		char *e = cJSON_PrintUnformatted(expected);
+		char *got = cJSON_PrintUnformatted(d);
+		assert(e && got && strcmp(e, got) == 0);
+		cJSON *patched = json_patch(l, d);
+		assert(patched && json_value_equal(patched, r,
+		                                   !opts || opts->strict_equality));
+		cJSON_Delete(patched);
+		free(e);
+		free(got);
+	}
+	cJSON_Delete(d);
+	cJSON_Delete(expected);
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+}
+
+static void test_diff_str_tokens(void)
+{
+	printf("Testing token-based string diff...\n");
+	struct json_diff_options moves = {.strict_equality = true,
+	                                  .detect_moves = true};
+	struct json_diff_options keyed = {.strict_equality = true,
+	                                  .object_key = "id"};
+	struct json_diff_options loose = {.strict_equality = false};
+
+	assert_str_diff_matches("{\"a\":1,\"b\":[1,2]}", "{\"a\":1,\"b\":[1,2]}",
+	                        NULL);
+	assert_str_diff_matches("\xEF\xBB\xBF{\"s\":\"caf\\u00e9\",\"n\":1e2}",
+	                        "{\"s\":\"caf\xC3\xA9\",\"n\":100} trailing",
+	                        NULL);
+	assert_str_diff_matches("{\"k\\\"ey\":\"a\\\\b\",\"x\":[true,null]}",
+	                        "{\"x\":[false,null],\"k\\\"ey\":\"a\\tb\","
+	                        "\"\\ud83d\\ude00\":{}}",
+	                        NULL);
+
+	/* Duplicate keys: both paths diff every left member, first match */
+	cJSON *ddup = json_diff_str("{\"d\":1,\"d\":2}", "{\"d\":3}", NULL);
+	char *pdup = cJSON_PrintUnformatted(ddup);
+	assert(pdup && strcmp(pdup, "{\"d\":[1,3],\"d\":[2,3]}") == 0);
+	free(pdup);
+	cJSON_Delete(ddup);
+
+	assert_str_diff_matches("[{\"id\":1,\"v\":1},2,{\"id\":3}]",
+	                        "[{\"id\":1,\"v\":2},{\"id\":4},2]", NULL);
+	assert_str_diff_matches("[1,2,3,[4],{\"o\":5}]",
+	                        "[{\"o\":5},3,[4],1,2]", &moves);
+	assert_str_diff_matches("[{\"id\":1,\"v\":1},{\"id\":2},{\"id\":3}]",
+	                        "[{\"id\":3,\"v\":0},{\"id\":1,\"v\":2},{\"x\":1}]",
+	                        &keyed);
+	assert_str_diff_matches("{\"f\":1.0000000001,\"g\":[1]}",
+	                        "{\"f\":1,\"g\":[1,2]}", &loose);
+
+	/* Malformed input is rejected like cJSON_Parse() does */
+	assert(!json_diff_str("{\"a\":}", "{}", NULL));
+	assert(!json_diff_str("{}", "[\"\\x\"]", NULL));
+	printf("Token-based string diff test passed!\n");
+}
+
+static void write_text_file(const char *path, const char *text, size_t pad)
+{
+	FILE *f = fopen(path, "w");
+	assert(f);
+	fputs(text, f);
+	for (size_t i = 0; i < pad; i++)
+		fputc(' ', f);
+	fclose(f);
+}
+
+static void test_diff_files(void)
+{
+	printf("Testing file diff...\n");
+	const char *pa = "test_diff_files_a.json";
+	const char *pb = "test_diff_files_b.json";
+	const char *ls = "{\"a\":[1,2,3],\"s\":\"x\"}";
+	const char *rs = "{\"a\":[1,3],\"s\":\"y\",\"n\":null}";
+	cJSON *expected = json_diff_str(ls, rs, NULL);
+	assert(expected);
+
+	/* The second file ends exactly on a page boundary: no NUL to borrow */
+	write_text_file(pa, ls, 0);
+	write_text_file(pb, rs, 4096 - strlen(rs));
+	cJSON *d = NULL;
+	assert(json_diff_files(pa, pb, NULL, &d) == 1);
+	assert(d && json_value_equal(d, expected, true));
+	cJSON_Delete(d);
+
+	assert(json_diff_files(pa, pa, NULL, &d) == 0 && !d);
+
+	/* Limits come from the options, over the 1 MiB json_diff_str() cap */
+	struct json_diff_options small = {.strict_equality = true,
+	                                  .max_input_size = 64};
+	errno = 0;
+	assert(json_diff_files(pa, pb, &small, &d) == -1 && !d);
+	assert(errno == EFBIG);
+
+	errno = 0;
+	assert(json_diff_files(pa, "test_diff_files_missing.json", NULL,
+	                       &d) == -1);
+	assert(errno == ENOENT);
+
+	write_text_file(pb, "{\"a\":", 0);
+	errno = 0;
+	assert(json_diff_files(pa, pb, NULL, &d) == -1 && errno == EINVAL);
+
+	remove(pa);
+	remove(pb);
+	cJSON_Delete(expected);
+	printf("File diff test passed!\n");
+}
+
+static void test_parallel_object_diff(void)
+{
+	printf("Testing parallel object diff...\n");
+	cJSON *l = cJSON_CreateObject();
+	cJSON *r = cJSON_CreateObject();
+	char key[32];
+	for (int i = 0; i < 500; i++) {
+		snprintf(key, sizeof(key), "card%d", i);
+		cJSON *lv = cJSON_CreateObject();
+		cJSON_AddNumberToObject(lv, "n", i);
+		cJSON_AddItemToObject(lv, "list", cJSON_Parse("[1,2,3]"));
+		cJSON *rv = cJSON_Duplicate(lv, 1);
+		if (i % 3 == 0)
+			cJSON_ReplaceItemInObject(rv, "n", cJSON_CreateNumber(-i));
+		if (i % 7 == 0)
+			cJSON_DeleteItemFromArray(cJSON_GetObjectItem(rv, "list"),
+			                          1);
+		if (i % 11 != 5)
+			cJSON_AddItemToObject(l, key, lv);
+		else
+			cJSON_Delete(lv);
+		if (i % 13 != 4)
+			cJSON_AddItemToObject(r, key, rv);
+		else
+			cJSON_Delete(rv);
+	}
+	cJSON_AddItemToObject(r, "extra", cJSON_CreateString("x"));
+
+	struct json_diff_options serial = {.strict_equality = true};
+	cJSON *expected = json_diff(l, r, &serial);
+	char *es = cJSON_PrintUnformatted(expected);
+	assert(es);
+
+	/* Same delta, member order included, on the heap and in an arena */
+	struct json_diff_options par = {.strict_equality = true, .threads = 4};
+	cJSON *d = json_diff(l, r, &par);
+	char *ds = cJSON_PrintUnformatted(d);
+	assert(ds && strcmp(es, ds) == 0);
+	free(ds);
+	cJSON_Delete(d);
+
+	struct json_diff_arena arena;
+	json_diff_arena_init(&arena, 0);
+	par.arena = &arena;
+	par.hash_cache = true;
+	d = json_diff(l, r, &par);
+	ds = cJSON_PrintUnformatted(d);
+	assert(ds && strcmp(es, ds) == 0);
+	free(ds);
+	json_diff_arena_reset(&arena);
+	assert(arena.offset == 0);
+	json_diff_arena_cleanup(&arena);
+
+	free(es);
+	cJSON_Delete(expected);
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	printf("Parallel object diff test passed!\n");
+}
+
+static void test_prepared_diff(void)
+{
+	printf("Testing prepared baseline diffs...\n");
+	cJSON *base = cJSON_Parse(
+	    "{\"a\":1,\"dup\":1,\"dup\":2,\"o\":{\"x\":[1,2,3],\"y\":\"s\"},"
+	    "\"list\":[{\"id\":1,\"v\":1},{\"id\":2,\"v\":2},{\"id\":3}],"
+	    "\"nums\":[1,2,3,4,5]}");
+	const char *texts[] = {
+	    "{\"a\":1,\"dup\":1,\"dup\":2,\"o\":{\"x\":[1,2,3],\"y\":\"s\"},"
+	    "\"list\":[{\"id\":1,\"v\":1},{\"id\":2,\"v\":2},{\"id\":3}],"
+	    "\"nums\":[1,2,3,4,5]}",
+	    "{\"a\":2,\"dup\":3,\"o\":{\"x\":[1,3],\"z\":null},"
+	    "\"list\":[{\"id\":3},{\"id\":1,\"v\":9}],\"nums\":[5,4,3,2,1],"
+	    "\"new\":true,\"new\":false}",
+	    "{\"list\":[{\"id\":2,\"v\":2},{\"id\":4}],\"o\":[],\"nums\":[]}",
+	    "[1,2,3]",
+	};
+	enum { NR = sizeof(texts) / sizeof(texts[0]) };
+	cJSON *rights[NR];
+	for (int i = 0; i < NR; i++) {
+		rights[i] = cJSON_Parse(texts[i]);
+		assert(rights[i]);
+	}
+
+	struct json_diff_arena arena;
+	json_diff_arena_init(&arena, 0);
+	struct json_diff_options variants[] = {
+	    {.strict_equality = true},
+	    {.strict_equality = true, .object_key = "id", .detect_moves = true},
+	    {.strict_equality = true, .hash_cache = true, .detect_moves = true,
+	     .array_engine = JSON_DIFF_ARRAY_LINEAR},
+	    {.strict_equality = true, .object_key = "id", .arena = &arena,
+	     .threads = 3},
+	    {.strict_equality = false, .object_key = "id", .hash_cache = true},
+	};
+	for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+		const struct json_diff_options *o = &variants[v];
+		struct json_diff_prepared *prep = json_diff_prepare(base, o);
+		assert(prep);
+		cJSON *batch[NR];
+		assert(json_diff_prepared_batch(
+		           prep, (const cJSON *const *)rights, NR, batch) == 0);
+		for (int i = 0; i < NR; i++) {
+			cJSON *want = json_diff(base, rights[i], o);
+			cJSON *got = json_diff_prepared(prep, rights[i]);
+			char *ws = want ? cJSON_PrintUnformatted(want) : NULL;
+			char *gs = got ? cJSON_PrintUnformatted(got) : NULL;
+			char *bs = batch[i] ? cJSON_PrintUnformatted(batch[i])
+			                    : NULL;
+			assert(!ws == !gs && !ws == !bs);
+			assert(!ws || (strcmp(ws, gs) == 0 &&
+			               strcmp(ws, bs) == 0));
+			assert(ws || i == 0);
+			free(ws);
+			free(gs);
+			free(bs);
+			json_diff_free(want, o);
+			json_diff_free(got, o);
+			json_diff_free(batch[i], o);
+		}
+		json_diff_prepared_free(prep);
+	}
+	json_diff_arena_cleanup(&arena);
+
+	assert(!json_diff_prepare(NULL, NULL));
+	json_diff_prepared_free(NULL);
+	for (int i = 0; i < NR; i++)
+		cJSON_Delete(rights[i]);
+	cJSON_Delete(base);
+	printf("Prepared baseline diff test passed!\n");
+}
+
+/* Step @s to @next and check the delta takes @prev there */
+static void assert_session_step(struct json_diff_session *s,
+                                const cJSON *next, const char *const *paths,
+                                size_t npaths)
+{
+	cJSON *prev = cJSON_Duplicate(json_diff_session_doc(s), 1);
+	cJSON *d = json_diff_session_next(s, next, paths, npaths);
+	assert(!d == json_value_equal(prev, next, true));
+	cJSON *p = d ? json_patch(prev, d) : cJSON_Duplicate(prev, 1);
+	assert(p && json_value_equal(p, next, true));
+	assert(json_value_equal(json_diff_session_doc(s), next, true));
+	cJSON_Delete(p);
+	cJSON_Delete(d);
+	cJSON_Delete(prev);
+}
+
+static void test_diff_session(void)
+{
+	printf("Testing diff sessions...\n");
+	cJSON *v = cJSON_Parse(
+	    "{\"a\":{\"b\":1,\"c\":[1,2]},\"gone\":true,\"k/x\":0,"
+	    "\"list\":[{\"id\":1,\"v\":1},{\"id\":2,\"v\":2}],\"arr\":[1,2,3]}");
+	struct json_diff_session *s = json_diff_session_new(v, NULL);
+	assert(s && json_value_equal(json_diff_session_doc(s), v, true));
+
+	/* Keyed, nested, added, removed and escaped members */
+	cJSON_ReplaceItemInObject(cJSON_GetObjectItem(v, "a"), "b",
+	                          cJSON_CreateNumber(5));
+	cJSON_DeleteItemFromObject(v, "gone");
+	cJSON_AddItemToObject(v, "new", cJSON_Parse("{\"z\":[1]}"));
+	cJSON_ReplaceItemInObject(v, "k/x", cJSON_CreateNumber(1));
+	cJSON_ReplaceItemInObject(
+	    cJSON_GetArrayItem(cJSON_GetObjectItem(v, "list"), 1), "v",
+	    cJSON_CreateString("two"));
+	const char *p1[] = {"/a/b", "/gone", "/new", "/k~1x", "/list/1/v",
+	                    "/a/b", "/nothing/here"};
+	assert_session_step(s, v, p1, sizeof(p1) / sizeof(p1[0]));
+
+	/* Resizing an array diffs all of it; a covering path wins */
+	cJSON_AddItemToArray(cJSON_GetObjectItem(v, "arr"),
+	                     cJSON_CreateNumber(4));
+	cJSON_ReplaceItemInArray(cJSON_GetObjectItem(v, "list"), 0,
+	                         cJSON_CreateNumber(0));
+	const char *p2[] = {"/arr/3", "/list/0", "/list", "/list/0/id"};
+	assert_session_step(s, v, p2, sizeof(p2) / sizeof(p2[0]));
+
+	/* Unknown changes, nothing touched, the root */
+	cJSON_ReplaceItemInObject(v, "a", cJSON_CreateString("flat"));
+	assert_session_step(s, v, NULL, 0);
+	cJSON *d = json_diff_session_next(s, v, p1, 0);
+	assert(!d);
+	cJSON *w = cJSON_Parse("[1,{\"x\":2}]");
+	const char *root[] = {"", "/a"};
+	assert_session_step(s, w, root, 2);
+	cJSON_ReplaceItemInObject(cJSON_GetArrayItem(w, 1), "x",
+	                          cJSON_CreateNumber(3));
+	const char *p3[] = {"/1/x"};
+	assert_session_step(s, w, p3, 1);
+
+	/* A bad "~" escape diffs the whole document */
+	cJSON_ReplaceItemInArray(w, 0, cJSON_CreateNumber(5));
+	const char *bad[] = {"/1/x~"};
+	assert_session_step(s, w, bad, 1);
+	cJSON_ReplaceItemInObject(cJSON_GetArrayItem(w, 1), "x",
+	                          cJSON_CreateNumber(4));
+	bad[0] = "/1/~2x";
+	assert_session_step(s, w, bad, 1);
+
+	json_diff_session_free(s);
+	json_diff_session_free(NULL);
+	assert(!json_diff_session_new(NULL, NULL));
+	cJSON_Delete(w);
+	cJSON_Delete(v);
+	printf("Diff session test passed!\n");
+}
+
+static void test_diff_compose(void)
+{
+	printf("Testing delta composition...\n");
+	const char *versions[] = {
+	    "{\"a\":1,\"gone\":[1],\"o\":{\"x\":1},"
+	    "\"l\":[1,2,3,4,5,{\"id\":1,\"v\":1}]}",
+	    "{\"a\":2,\"o\":{\"x\":1,\"y\":2},"
+	    "\"l\":[5,1,2,9,3,4,{\"id\":1,\"v\":2}],\"new\":{\"n\":1}}",
+	    "{\"a\":2,\"gone\":[2],\"o\":{\"y\":3},"
+	    "\"l\":[2,5,9,3,{\"id\":1,\"v\":3},4,7],\"new\":{\"n\":2}}",
+	    "{\"a\":1,\"gone\":[1],\"o\":[],\"l\":[7,4,5],\"new\":null}",
+	};
+	enum { NV = sizeof(versions) / sizeof(versions[0]) };
+	cJSON *v[NV];
+	for (int i = 0; i < NV; i++) {
+		v[i] = cJSON_Parse(versions[i]);
+		assert(v[i]);
+	}
+	struct json_diff_options opts = {
+	    .strict_equality = true, .object_key = "id", .detect_moves = true};
+
+	/* Squash the chain one delta at a time; the result patches v0 */
+	cJSON *acc = NULL;
+	for (int i = 1; i < NV; i++) {
+		cJSON *d = json_diff(v[i - 1], v[i], &opts);
+		char *before = cJSON_PrintUnformatted(d);
+		cJSON *c = NULL;
+		assert(json_diff_compose(acc, d, &c) == 0 && c);
+		char *after = cJSON_PrintUnformatted(d);
+		assert(strcmp(before, after) == 0);
+		cJSON *p = json_patch(v[0], c);
+		assert(p && json_value_equal(p, v[i], true));
+		cJSON_Delete(p);
+		free(before);
+		free(after);
+		cJSON_Delete(d);
+		cJSON_Delete(acc);
+		acc = c;
+	}
+	cJSON_Delete(acc);
+
+	/* A delta and its undo cancel out, element moves included */
+	cJSON *fwd = json_diff(v[1], v[2], &opts);
+	cJSON *back = json_diff(v[2], v[1], &opts);
+	cJSON *c = NULL;
+	assert(json_diff_compose(fwd, back, &c) == 0 && !c);
+	assert(json_diff_compose(NULL, NULL, &c) == 0 && !c);
+
+	/* Deleted, then diffed as if still there */
+	cJSON *d1 = cJSON_Parse("{\"o\":[{\"x\":1},0,0]}");
+	cJSON *d2 = cJSON_Parse("{\"o\":{\"x\":[1,2]}}");
+	assert(json_diff_compose(d1, d2, &c) == -1 && !c);
+	assert(json_diff_compose(d2, d1, &c) == 0 && c);
+	char *s = cJSON_PrintUnformatted(c);
+	assert(strcmp(s, "{\"o\":[{\"x\":1},0,0]}") == 0);
+	free(s);
+	cJSON_Delete(c);
+	assert(json_diff_compose(fwd, back, NULL) == -1);
+
+	cJSON_Delete(d1);
+	cJSON_Delete(d2);
+	cJSON_Delete(fwd);
+	cJSON_Delete(back);
+	for (int i = 0; i < NV; i++)
+		cJSON_Delete(v[i]);
+	printf("Delta composition test passed!\n");
+}
+
+static void test_binary_delta(void)
+{
+	printf("Testing binary delta encoding...\n");
+	cJSON *l = cJSON_Parse("{\"n\":1,\"f\":-0.5,\"big\":1e300,"
+	                       "\"s\":\"caf\\u00e9\",\"gone\":{\"deep\":[1]},"
+	                       "\"l\":[1,2,3,4,{\"id\":7,\"v\":1}],"
+	                       "\"o\":{\"x\":[true,null]}}");
+	cJSON *r = cJSON_Parse("{\"n\":-123456789,\"f\":0.25,\"big\":2e300,"
+	                       "\"s\":\"tea\",\"l\":[4,1,9,3,{\"id\":7,"
+	                       "\"v\":2}],\"o\":{\"x\":[false],\"y\":{}},"
+	                       "\"new\":[\"a\",{\"n\":1}]}");
+	assert(l && r);
+	struct json_diff_options opts = {
+	    .strict_equality = true, .object_key = "id", .detect_moves = true};
+	cJSON *d = json_diff(l, r, &opts);
+	assert(d);
+	char *text = cJSON_PrintUnformatted(d);
+
+	unsigned char *bin = NULL, *slim = NULL;
+	size_t len = 0, slim_len = 0;
+	assert(json_diff_encode_binary(d, 0, &bin, &len) == 0 && bin);
+	assert(len < strlen(text));
+	assert(json_diff_encode_binary(d, JSON_DIFF_BINARY_OMIT_OLD, &slim,
+	                               &slim_len) == 0);
+	assert(slim_len < len);
+
+	/* Lossless round trip, and the same patch either way */
+	cJSON *back = json_diff_decode_binary(bin, len);
+	assert(back && json_value_equal(back, d, true));
+	cJSON *p = json_patch_binary(l, bin, len);
+	assert(p && json_value_equal(p, r, true));
+	cJSON_Delete(p);
+	p = json_patch_binary(l, slim, slim_len);
+	assert(p && json_value_equal(p, r, true));
+	cJSON_Delete(p);
+	cJSON_Delete(back);
+
+	/* Without old values the decoded delta holds nulls and still patches */
+	back = json_diff_decode_binary(slim, slim_len);
+	assert(back);
+	assert(cJSON_IsNull(cJSON_GetArrayItem(
+	    cJSON_GetObjectItem(back, "gone"), 0)));
+	p = json_patch(l, back);
+	assert(p && json_value_equal(p, r, true));
+	cJSON_Delete(p);
+	cJSON_Delete(back);
+
+	/* Every truncation is rejected */
+	for (size_t n = 0; n < len; n++) {
+		assert(!json_diff_decode_binary(bin, n));
+		assert(!json_patch_binary(l, bin, n));
+	}
+	bin[0] = 'X';
+	assert(!json_diff_decode_binary(bin, len));
+
+	/* Not a delta */
+	cJSON *bad = cJSON_Parse("{\"a\":[1,2,3,4]}");
+	unsigned char *none = NULL;
+	assert(json_diff_encode_binary(bad, 0, &none, &len) == -1 && !none);
+	assert(json_diff_encode_binary(NULL, 0, &none, &len) == -1);
+	assert(json_diff_encode_binary(d, 0x80, &none, &len) == -1);
+
+	cJSON_Delete(bad);
+	free(bin);
+	free(slim);
+	free(text);
+	cJSON_Delete(d);
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	printf("Binary delta encoding test passed!\n");
+}
+
+static void test_forward_only(void)
+{
+	printf("Testing forward only diffs...\n");
+	const char *lt = "{\"gone\":{\"big\":[1,2,3]},\"n\":1,\"t\":\"x\","
+	                 "\"l\":[{\"k\":1},2,3,[4]],\"o\":{\"s\":\"old\"}}";
+	const char *rt = "{\"n\":2,\"t\":[],\"l\":[2,3,5],"
+	                 "\"o\":{\"s\":\"new\"},\"add\":true}";
+	cJSON *l = cJSON_Parse(lt), *r = cJSON_Parse(rt);
+	assert(l && r);
+	struct json_diff_options opts = {.strict_equality = true,
+	                                 .forward_only = true};
+	cJSON *d = json_diff(l, r, &opts);
+	assert(d);
+
+	/* Old values are placeholders; new ones are kept */
+	cJSON *gone = cJSON_GetObjectItem(d, "gone");
+	assert(cJSON_GetArraySize(gone) == 3 &&
+	       cJSON_IsNull(cJSON_GetArrayItem(gone, 0)));
+	cJSON *n = cJSON_GetObjectItem(d, "n");
+	assert(cJSON_IsNull(cJSON_GetArrayItem(n, 0)) &&
+	       cJSON_GetArrayItem(n, 1)->valuedouble == 2);
+	cJSON *l0 = cJSON_GetObjectItem(cJSON_GetObjectItem(d, "l"), "_0");
+	assert(cJSON_IsNull(cJSON_GetArrayItem(l0, 0)));
+	cJSON *p = json_patch(l, d);
+	assert(p && json_value_equal(p, r, true));
+	cJSON_Delete(p);
+
+	/* Same text from the writer, the token backend and borrowed output */
+	char *tree = cJSON_PrintUnformatted(d);
+	assert(!strstr(tree, "big") && !strstr(tree, "old"));
+	char buf[512];
+	assert(json_diff_write_buf(l, r, &opts, buf, sizeof(buf), NULL) == 1);
+	assert(strcmp(buf, tree) == 0);
+	cJSON *ds = json_diff_str(lt, rt, &opts);
+	assert(ds && json_value_equal(ds, d, true));
+	opts.output = JSON_DIFF_OUTPUT_BORROWED;
+	cJSON *db = json_diff(l, r, &opts);
+	char *borrowed = cJSON_PrintUnformatted(db);
+	assert(strcmp(borrowed, tree) == 0);
+
+	free(borrowed);
+	json_diff_free(db, &opts);
+	cJSON_Delete(ds);
+	free(tree);
+	cJSON_Delete(d);
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	printf("Forward only diff test passed!\n");
+}
+
+/* Whether every equality path (tree, hash cache, tokens) sees @l == @r */
+static bool equal_everywhere(const cJSON *l, const cJSON *r, bool strict)
+{
+	bool eq = json_value_equal(l, r, strict);
+	struct json_diff_options opts = {.strict_equality = strict,
+	                                 .hash_cache = true};
+	cJSON *d = json_diff(l, r, &opts);
+	assert(!d == eq);
+	cJSON_Delete(d);
+	char *lt = cJSON_PrintUnformatted(l), *rt = cJSON_PrintUnformatted(r);
+	d = json_diff_str(lt, rt, &opts);
+	assert(!d == eq);
+	cJSON_Delete(d);
+	free(lt);
+	free(rt);
+	return eq;
+}
+
+static cJSON *number_array(const double *v, int n)
+{
+	cJSON *a = cJSON_CreateArray();
+	for (int i = 0; i < n; i++)
+		cJSON_AddItemToArray(a, cJSON_CreateNumber(v[i]));
+	return a;
+}
+
+static void test_equal_fast_paths(void)
+{
+	printf("Testing long string and numeric array equality...\n");
+	const int lens[] = {1, 15, 16, 31, 32, 33, 63, 64, 65, 127, 128, 129,
+	                    200, 1000};
+	for (size_t li = 0; li < sizeof(lens) / sizeof(lens[0]); li++) {
+		int len = lens[li];
+		char *a = malloc((size_t)len + 1), *b = malloc((size_t)len + 1);
+		assert(a && b);
+		for (int i = 0; i < len; i++)
+			a[i] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ+/"[i % 28];
+		a[len] = '\0';
+		const int at[] = {0, len / 2, len - 1};
+		cJSON *l = cJSON_CreateString(a);
+		cJSON *r = cJSON_CreateString(a);
+		assert(equal_everywhere(l, r, true));
+		cJSON_Delete(r);
+		for (size_t k = 0; k < 3; k++) {
+			memcpy(b, a, (size_t)len + 1);
+			b[at[k]] = '=';
+			r = cJSON_CreateString(b);
+			assert(!equal_everywhere(l, r, true));
+			cJSON_Delete(r);
+		}
+		/* A prefix differs only in length */
+		memcpy(b, a, (size_t)len - 1);
+		b[len - 1] = '\0';
+		r = cJSON_CreateString(b);
+		assert(!equal_everywhere(l, r, true));
+		cJSON_Delete(r);
+		cJSON_Delete(l);
+
+		/* Numbers: changed, within tolerance and signed zero */
+		double *v = malloc((size_t)len * sizeof(*v));
+		assert(v);
+		for (int i = 0; i < len; i++)
+			v[i] = i % 7 == 3 ? 0.0 : i * 0.25 - 3;
+		for (size_t k = 0; k < 3; k++) {
+			l = number_array(v, len);
+			r = number_array(v, len);
+			assert(equal_everywhere(l, r, true));
+			cJSON *e = cJSON_GetArrayItem(r, at[k]);
+			cJSON_SetNumberValue(e, e->valuedouble + 1e-12);
+			assert(!equal_everywhere(l, r, true));
+			assert(equal_everywhere(l, r, false));
+			cJSON_SetNumberValue(e, e->valuedouble + 1);
+			assert(!equal_everywhere(l, r, false));
+			double was = v[at[k]];
+			cJSON_SetNumberValue(e, was == 0 ? -0.0 : was);
+			assert(equal_everywhere(l, r, true));
+			/* A string in the run is compared on its own */
+			cJSON_ReplaceItemInArray(r, at[k],
+			                         cJSON_CreateString("x"));
+			assert(!equal_everywhere(l, r, false));
+			cJSON_ReplaceItemInArray(l, at[k],
+			                         cJSON_CreateString("x"));
+			assert(equal_everywhere(l, r, true));
+			cJSON_Delete(l);
+			cJSON_Delete(r);
+		}
+
+		/* NaN matches nothing, its copy included */
+		l = number_array(v, len);
+		cJSON_SetNumberValue(cJSON_GetArrayItem(l, len - 1), NAN);
+		r = cJSON_Duplicate(l, 1);
+		assert(!json_value_equal(l, r, true));
+		assert(!json_value_equal(l, r, false));
+		cJSON_Delete(l);
+		cJSON_Delete(r);
+		free(v);
+		free(a);
+		free(b);
+	}
+	printf("Long string and numeric array equality test passed!\n");
+}
+
+static uint64_t count_nodes(const cJSON *n)
+{
+	uint64_t c = 0;
+	for (; n; n = n->next)
+		c += 1 + count_nodes(n->child);
+	return c;
+}
+
+static void test_diff_stats(void)
+{
+	printf("Testing diff stats...\n");
+	const char *lt = "{\"a\":[1,2,3,4],\"o\":{\"x\":1,\"y\":\"s\"},"
+	                 "\"list\":[{\"id\":1,\"v\":1},{\"id\":2,\"v\":2}]}";
+	const char *rt = "{\"a\":[1,5,3,4,6],\"o\":{\"x\":2,\"y\":\"s\"},"
+	                 "\"list\":[{\"id\":2,\"v\":3},{\"id\":1,\"v\":1}]}";
+	cJSON *l = cJSON_Parse(lt), *r = cJSON_Parse(rt);
+	assert(l && r);
+	struct json_diff_stats st;
+	memset(&st, 0, sizeof(st));
+	struct json_diff_options opts = {.strict_equality = true,
+	                                 .object_key = "id", .stats = &st};
+	cJSON *d = json_diff(l, r, &opts);
+	assert(d);
+	assert(st.calls == 1 && st.equal_calls > 0);
+	/* The root, "o" and the changed record; the equal one is skipped */
+	assert(st.key_indexes == 3 && st.arrays == 2);
+	/* [1,2,3,4] -> [1,5,3,4,6]: one deletion and two insertions */
+	assert(st.max_d == 3 && st.fallbacks == 0);
+	assert(st.nodes_emitted == 1 + count_nodes(d->child));
+	assert(st.bytes_allocated > 0 && st.bytes_written == 0);
+	assert(st.parse_ns == 0);
+
+	/* Counts add up across calls, the maximum depth does not */
+	struct json_diff_stats once = st;
+	cJSON *d2 = json_diff(l, r, &opts);
+	assert(d2 && st.calls == 2 && st.arrays == 4 && st.max_d == 3);
+	assert(st.nodes_emitted == 2 * once.nodes_emitted);
+	assert(st.total_ns >= once.total_ns);
+	cJSON_Delete(d2);
+
+	/* Streamed text is counted in bytes written */
+	memset(&st, 0, sizeof(st));
+	size_t needed = 0;
+	assert(json_diff_write_buf(l, r, &opts, NULL, 0, &needed) == 1);
+	assert(st.calls == 1 && st.bytes_written == needed);
+
+	/* Both text paths record their parse phase */
+	struct json_diff_options text_opts[] = {
+	    {.strict_equality = true, .stats = &st},
+	    {.strict_equality = true, .hash_cache = true, .stats = &st},
+	};
+	for (size_t v = 0; v < 2; v++) {
+		memset(&st, 0, sizeof(st));
+		cJSON *ds = json_diff_str(lt, rt, &text_opts[v]);
+		assert(ds && st.calls == 1 && st.equal_calls > 0);
+		assert(st.parse_ns > 0 && st.total_ns >= st.parse_ns);
+		assert(st.nodes_emitted == 1 + count_nodes(ds->child));
+		cJSON_Delete(ds);
+	}
+
+	/* A budget that runs out is a fallback */
+	cJSON *la = cJSON_Parse("[1,2,3,4,5,6,7,8]");
+	cJSON *ra = cJSON_Parse("[8,7,6,5,4,3,2,1]");
+	bool inexact = false;
+	struct json_diff_options capped = {.strict_equality = true,
+	                                   .max_edit_cost = 2,
+	                                   .inexact = &inexact, .stats = &st};
+	memset(&st, 0, sizeof(st));
+	cJSON *da = json_diff(la, ra, &capped);
+	assert(da && inexact && st.arrays == 1 && st.fallbacks == 1);
+	cJSON_Delete(da);
+	cJSON_Delete(la);
+	cJSON_Delete(ra);
+
+	/* Worker threads report into the caller's stats once joined */
+	enum { NR = 8 };
+	cJSON *rights[NR];
+	for (int i = 0; i < NR; i++) {
+		rights[i] = cJSON_Duplicate(r, 1);
+		cJSON_AddNumberToObject(rights[i], "n", i);
+	}
+	struct json_diff_options par = {.strict_equality = true,
+	                                .object_key = "id", .threads = 3,
+	                                .stats = &st};
+	memset(&st, 0, sizeof(st));
+	struct json_diff_prepared *prep = json_diff_prepare(l, &par);
+	assert(prep);
+	cJSON *batch[NR];
+	assert(json_diff_prepared_batch(prep, (const cJSON *const *)rights,
+	                                NR, batch) == 0);
+	assert(st.calls == NR && st.arrays == 2 * NR && st.max_d == 3);
+	uint64_t emitted = 0;
+	for (int i = 0; i < NR; i++) {
+		emitted += 1 + count_nodes(batch[i]->child);
+		cJSON_Delete(batch[i]);
+		cJSON_Delete(rights[i]);
+	}
+	assert(st.nodes_emitted == emitted);
+	json_diff_prepared_free(prep);
+
+	/* No stats pointer, no change in the result */
+	opts.stats = NULL;
+	cJSON *plain = json_diff(l, r, &opts);
+	char *ps = cJSON_PrintUnformatted(plain);
+	char *ds = cJSON_PrintUnformatted(d);
+	assert(ps && ds && strcmp(ps, ds) == 0);
+	free(ps);
+	free(ds);
+	cJSON_Delete(plain);
+	cJSON_Delete(d);
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	printf("Diff stats test passed!\n");
+}
+
+/* Run a resumable diff to the end in steps of @budget */
+static cJSON *diff_in_steps(const cJSON *l, const cJSON *r,
+                            const struct json_diff_options *opts,
+                            size_t budget, int *steps)
+{
+	struct json_diff_task *t = json_diff_begin(l, r, opts);
+	assert(t);
+	int rc;
+	*steps = 0;
+	while ((rc = json_diff_step(t, budget)) == 1)
+		(*steps)++;
+	assert(rc == 0);
+	assert(json_diff_step(t, budget) == 0);
+	return json_diff_end(t);
+}
+
+static void test_resumable_diff(void)
+{
+	printf("Testing resumable diff...\n");
+	cJSON *l = cJSON_Parse(
+	    "{\"a\":[1,2,3,4],\"o\":{\"x\":1,\"y\":[\"s\",{\"k\":1}]},"
+	    "\"gone\":true,\"list\":[{\"id\":1,\"v\":1},{\"id\":2,\"v\":2},"
+	    "{\"id\":3,\"v\":[1,{\"w\":2}]}]}");
+	cJSON *r = cJSON_Parse(
+	    "{\"a\":[1,5,3,4,6],\"o\":{\"x\":2,\"y\":[\"s\",{\"k\":2}]},"
+	    "\"list\":[{\"id\":3,\"v\":[1,{\"w\":3}]},{\"id\":1,\"v\":1},"
+	    "{\"id\":2,\"v\":3}],\"new\":null}");
+	assert(l && r);
+
+	/* Every budget gives the json_diff() delta */
+	struct json_diff_arena arena;
+	json_diff_arena_init(&arena, 0);
+	struct json_diff_options variants[] = {
+	    {.strict_equality = true},
+	    {.strict_equality = true, .object_key = "id"},
+	    {.strict_equality = true, .object_key = "id",
+	     .detect_moves = true},
+	    {.strict_equality = true, .hash_cache = true},
+	    {.strict_equality = false, .detect_moves = true},
+	    {.strict_equality = true, .arena = &arena,
+	     .output = JSON_DIFF_OUTPUT_BORROWED},
+	};
+	const size_t budgets[] = {0, 1, 5};
+	for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+		cJSON *d = json_diff(l, r, &variants[v]);
+		assert(d);
+		char *want = cJSON_PrintUnformatted(d);
+		for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]);
+		     b++) {
+			int steps;
+			cJSON *s = diff_in_steps(l, r, &variants[v],
+			                         budgets[b], &steps);
+			assert(budgets[b] != 0 || steps == 0);
+			assert(budgets[b] != 1 || steps > 10);
+			char *got = cJSON_PrintUnformatted(s);
+			assert(want && got && strcmp(want, got) == 0);
+			free(got);
+			json_diff_free(s, &variants[v]);
+		}
+		free(want);
+		json_diff_free(d, &variants[v]);
+	}
+	json_diff_arena_cleanup(&arena);
+
+	/* Equal values finish without a delta */
+	cJSON *same = cJSON_Duplicate(l, 1);
+	int steps;
+	assert(diff_in_steps(l, same, NULL, 2, &steps) == NULL);
+	cJSON_Delete(same);
+
+	/* A task dropped halfway releases what it built */
+	struct json_diff_task *t = json_diff_begin(l, r, NULL);
+	assert(t && json_diff_step(t, 3) == 1);
+	assert(json_diff_end(t) == NULL);
+	assert(json_diff_step(NULL, 1) == -1 && json_diff_end(NULL) == NULL);
+
+	/* Nesting json_diff() turns down is diffed level by level */
+	enum { DEEP = 5000 };
+	cJSON *dl = cJSON_CreateNumber(1), *dr = cJSON_CreateNumber(2);
+	for (int i = 0; i < DEEP; i++) {
+		cJSON *pl, *pr;
+		if (i % 2) {
+			pl = cJSON_CreateArray();
+			pr = cJSON_CreateArray();
+			cJSON_AddItemToArray(pl, dl);
+			cJSON_AddItemToArray(pr, dr);
+		} else {
+			pl = cJSON_CreateObject();
+			pr = cJSON_CreateObject();
+			cJSON_AddItemToObject(pl, "k", dl);
+			cJSON_AddItemToObject(pr, "k", dr);
+		}
+		dl = pl;
+		dr = pr;
+	}
+	assert(json_diff(dl, dr, NULL) == NULL);
+	cJSON *dd = diff_in_steps(dl, dr, NULL, 1000, &steps);
+	assert(dd && steps > 0);
+	const cJSON *at = dd;
+	for (int i = DEEP - 1; i >= 0; i--) {
+		/* Arrays pair their one object element as a nested diff */
+		at = cJSON_GetObjectItemCaseSensitive(at, i % 2 ? "0" : "k");
+		assert(at);
+	}
+	assert(cJSON_IsArray(at) && cJSON_GetArraySize(at) == 2);
+	assert(cJSON_GetArrayItem(at, 1)->valuedouble == 2);
+	cJSON_Delete(dd);
+	cJSON_Delete(dl);
+	cJSON_Delete(dr);
+
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	printf("Resumable diff test passed!\n");
+}
+
+/* Wide objects compare in step, or through a key index out of order */
+static void test_equal_wide_objects(void)
+{
+	printf("Testing wide object equality...\n");
+	cJSON *l = cJSON_CreateObject(), *fwd = cJSON_CreateObject();
+	cJSON *rev = cJSON_CreateObject();
+	char key[16];
+	for (int i = 0; i < 200; i++) {
+		snprintf(key, sizeof(key), "k%d", i);
+		cJSON_AddItemToObject(l, key, i % 50 ? cJSON_CreateNumber(i)
+		                                      : cJSON_CreateObject());
+		cJSON_AddItemToObject(fwd, key, i % 50 ? cJSON_CreateNumber(i)
+		                                        : cJSON_CreateObject());
+		snprintf(key, sizeof(key), "k%d", 199 - i);
+		cJSON_AddItemToObject(rev, key,
+		                      (199 - i) % 50 ? cJSON_CreateNumber(199 - i)
+		                                     : cJSON_CreateObject());
+	}
+	cJSON_AddNumberToObject(cJSON_GetObjectItem(l, "k50"), "x", 1);
+	cJSON_AddNumberToObject(cJSON_GetObjectItem(fwd, "k50"), "x", 1);
+	cJSON_AddNumberToObject(cJSON_GetObjectItem(rev, "k50"), "x", 1);
+	assert(json_value_equal(l, fwd, true));
+	assert(json_value_equal(l, rev, true));
+	assert(json_value_equal(rev, l, true));
+
+	/* Inside arrays, so diffs compare them whole, also in steps */
+	cJSON *la = cJSON_CreateArray(), *ra = cJSON_CreateArray();
+	cJSON_AddItemToArray(la, cJSON_Duplicate(l, 1));
+	cJSON_AddItemToArray(ra, rev);
+	assert(equal_everywhere(la, ra, true));
+	struct json_diff_options opts = {.strict_equality = true};
+	int steps;
+	assert(!diff_in_steps(la, ra, &opts, 7, &steps) && steps > 10);
+
+	/* A nested change late in the walk, then a key swapped for another */
+	cJSON_ReplaceItemInObject(cJSON_GetObjectItem(rev, "k50"), "x",
+	                          cJSON_CreateNumber(2));
+	assert(!json_value_equal(l, rev, true));
+	cJSON_ReplaceItemInObject(cJSON_GetObjectItem(rev, "k50"), "x",
+	                          cJSON_CreateNumber(1));
+	cJSON_DeleteItemFromObject(rev, "k3");
+	cJSON_AddNumberToObject(rev, "other", 3);
+	assert(!equal_everywhere(la, ra, true));
+	cJSON *d = diff_in_steps(la, ra, &opts, 7, &steps);
+	assert(d);
+	cJSON_Delete(d);
+
+	cJSON_Delete(la);
+	cJSON_Delete(ra);
+	cJSON_Delete(l);
+	cJSON_Delete(fwd);
+	printf("Wide object equality test passed!\n");
+}
+
+static void test_patch_inplace(void)
+{
+	printf("Testing in-place patch...\n");
+	cJSON *l = cJSON_Parse("{\"big\":{\"x\":[1,2,3]},\"n\":1,"
+	                       "\"list\":[{\"id\":1},{\"id\":2},3],"
+	                       "\"gone\":true}");
+	cJSON *r = cJSON_Parse("{\"big\":{\"x\":[1,2,3]},\"n\":2,"
+	                       "\"list\":[0,{\"id\":1},{\"id\":5}],"
+	                       "\"new\":[\"a\"]}");
+	assert(l && r);
+	cJSON *d = json_diff(l, r, NULL);
+	assert(d);
+
+	cJSON *target = cJSON_Duplicate(l, 1);
+	cJSON *big = cJSON_GetObjectItem(target, "big");
+	cJSON *list = cJSON_GetObjectItem(target, "list");
+	cJSON *first = cJSON_GetArrayItem(list, 0);
+	cJSON *res = json_patch_inplace(target, d);
+	assert(res == target && json_value_equal(res, r, true));
+	/* Untouched subtrees and containers are the same nodes */
+	assert(cJSON_GetObjectItem(res, "big") == big);
+	assert(cJSON_GetObjectItem(res, "list") == list);
+	assert(cJSON_GetArrayItem(list, 1) == first);
+	/* Replaced members keep their position */
+	assert(strcmp(res->child->next->string, "n") == 0);
+	cJSON_Delete(res);
+
+	/* Root replacement hands back a new node and frees the target */
+	cJSON *root = cJSON_Parse("[\"old\",\"new\"]");
+	res = json_patch_inplace(cJSON_CreateNumber(1), root);
+	assert(res && cJSON_IsString(res) &&
+	       strcmp(res->valuestring, "new") == 0);
+	cJSON_Delete(res);
+	cJSON_Delete(root);
+
+	/* Arena diffs can be applied; values are copied out of them */
+	struct json_diff_arena arena;
+	json_diff_arena_init(&arena, 0);
+	struct json_diff_options opts = {.strict_equality = true,
+	                                 .arena = &arena};
+	cJSON *ad = json_diff(l, r, &opts);
+	res = json_patch_inplace(cJSON_Duplicate(l, 1), ad);
+	json_diff_arena_cleanup(&arena);
+	assert(res && json_value_equal(res, r, true));
+	cJSON_Delete(res);
+
+	cJSON_Delete(d);
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	printf("In-place patch test passed!\n");
+}
+
+/* Delta text handed out a few bytes at a time */
+struct text_chunks {
+	const char *text;
+	size_t pos, step;
+	bool fail;
+};
+
+static ptrdiff_t read_chunks(char *buf, size_t size, void *user)
+{
+	struct text_chunks *c = user;
+	if (c->fail && c->pos)
+		return -1;
+	size_t n = strlen(c->text + c->pos);
+	if (n > c->step)
+		n = c->step;
+	if (n > size)
+		n = size;
+	memcpy(buf, c->text + c->pos, n);
+	c->pos += n;
+	return (ptrdiff_t)n;
+}
+
+static void test_patch_text(void)
+{
+	printf("Testing patch from delta text...\n");
+	cJSON *l = cJSON_Parse(
+	    "{\"big\":{\"x\":[1,2,3]},\"n\":1,\"s\":\"caf\\u00e9 \\\"q\\\"\","
+	    "\"list\":[{\"id\":1,\"v\":[1]},{\"id\":2},3],\"gone\":{\"a\":1},"
+	    "\"o\":{\"p\":{\"q\":true,\"r\":null}},\"t\":[1]}");
+	cJSON *r = cJSON_Parse(
+	    "{\"big\":{\"x\":[1,2,3]},\"n\":2.5,\"s\":\"\\ud83d\\ude00\\n\","
+	    "\"list\":[0,{\"id\":2},{\"id\":1,\"v\":[1,2]}],\"new\":[\"a\"],"
+	    "\"o\":{\"p\":{\"q\":false}},\"t\":{\"k\":1}}");
+	assert(l && r);
+
+	struct json_diff_options variants[] = {
+	    {.strict_equality = true},
+	    {.strict_equality = true, .object_key = "id",
+	     .detect_moves = true},
+	    {.strict_equality = true, .forward_only = true},
+	};
+	const size_t steps[] = {1, 7, 4096};
+	for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+		size_t needed;
+		assert(json_diff_write_buf(l, r, &variants[v], NULL, 0,
+		                           &needed) == 1);
+		char *text = malloc(needed + 1);
+		assert(text && json_diff_write_buf(l, r, &variants[v], text,
+		                                   needed + 1, NULL) == 1);
+
+		/* Untouched subtrees stay the same nodes, as in place */
+		cJSON *target = cJSON_Duplicate(l, 1);
+		cJSON *big = cJSON_GetObjectItem(target, "big");
+		cJSON *res = json_patch_str(target, text);
+		assert(res == target && json_value_equal(res, r, true));
+		assert(cJSON_GetObjectItem(res, "big") == big);
+		cJSON_Delete(res);
+
+		for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+			struct text_chunks c = {text, 0, steps[i], false};
+			res = json_patch_stream(cJSON_Duplicate(l, 1),
+			                        read_chunks, &c);
+			assert(res && json_value_equal(res, r, true));
+			cJSON_Delete(res);
+		}
+		free(text);
+	}
+
+	/* No delta text leaves the target as it is */
+	cJSON *target = cJSON_Duplicate(l, 1);
+	assert(json_patch_str(target, " \n") == target);
+	cJSON_Delete(target);
+
+	/* Root replacement and a BOM */
+	cJSON *res = json_patch_str(cJSON_CreateNumber(1),
+	                            "\xEF\xBB\xBF[1,{\"a\":[\"x\"]}]");
+	cJSON *want = cJSON_Parse("{\"a\":[\"x\"]}");
+	assert(res && json_value_equal(res, want, true));
+	cJSON_Delete(want);
+	cJSON_Delete(res);
+
+	/* Broken text and failed reads free the target */
+	const char *bad[] = {"{\"n\":[1,2]", "{\"n\":[1,2]} x", "{\"n\" [1]}",
+	                     "{\"s\":[\"\\x\"]}", "{\"n\":[1e]}"};
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+		assert(json_patch_str(cJSON_Duplicate(l, 1), bad[i]) == NULL);
+	struct text_chunks c = {"{\"n\":[1,2]}", 0, 3, true};
+	assert(json_patch_stream(cJSON_Duplicate(l, 1), read_chunks, &c) ==
+	       NULL);
+	assert(json_patch_str(NULL, "{}") == NULL);
+
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	printf("Patch from delta text test passed!\n");
+}
+
+static void test_rfc6902(void)
+{
+	printf("Testing JSON Patch (RFC 6902)...\n");
+	cJSON *l = cJSON_Parse(
+	    "{\"n\":1,\"a/b\":{\"m~n\":[1,2,3]},\"gone\":true,"
+	    "\"list\":[{\"id\":1,\"v\":[1]},{\"id\":2},{\"id\":3},4,5,6],"
+	    "\"o\":{\"p\":{\"q\":true}},\"t\":[1]}");
+	cJSON *r = cJSON_Parse(
+	    "{\"n\":2,\"a/b\":{\"m~n\":[3,1]},\"new\":[\"x\"],"
+	    "\"list\":[0,{\"id\":3},6,{\"id\":1,\"v\":[1,2]},5,{\"id\":2}],"
+	    "\"o\":{\"p\":{\"q\":false}},\"t\":{\"k\":1}}");
+	assert(l && r);
+
+	struct json_diff_arena arena;
+	json_diff_arena_init(&arena, 0);
+	struct json_diff_options variants[] = {
+	    {.strict_equality = true},
+	    {.strict_equality = true, .object_key = "id",
+	     .detect_moves = true},
+	    {.strict_equality = true, .detect_moves = true, .arena = &arena,
+	     .output = JSON_DIFF_OUTPUT_BORROWED},
+	};
+	for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+		cJSON *ops = json_diff_rfc6902(l, r, &variants[v]);
+		assert(cJSON_IsArray(ops) && cJSON_GetArraySize(ops) > 0);
+		cJSON *res = json_patch_rfc6902(l, ops);
+		assert(res && json_value_equal(res, r, true));
+		cJSON_Delete(res);
+		json_diff_free(ops, &variants[v]);
+	}
+	json_diff_arena_cleanup(&arena);
+
+	/* Shuffled arrays, with moves and with plain removals/additions */
+	for (int round = 0; round < 50; round++) {
+		cJSON *a = cJSON_CreateArray(), *b = cJSON_CreateArray();
+		int perm[12];
+		for (int i = 0; i < 12; i++)
+			perm[i] = i;
+		for (int i = 11; i > 0; i--) {
+			int j = (round * 7 + i * 13) % (i + 1), t = perm[i];
+			perm[i] = perm[j];
+			perm[j] = t;
+		}
+		for (int i = 0; i < 12; i++) {
+			cJSON_AddItemToArray(a, cJSON_CreateNumber(i));
+			if (perm[i] % 5 != round % 5)
+				cJSON_AddItemToArray(b, cJSON_CreateNumber(perm[i]));
+			if (i % 4 == round % 4)
+				cJSON_AddItemToArray(b, cJSON_CreateNumber(100 + i));
+		}
+		for (int moves = 0; moves < 2; moves++) {
+			struct json_diff_options o = {.strict_equality = true,
+			                              .detect_moves = moves};
+			cJSON *ops = json_diff_rfc6902(a, b, &o);
+			cJSON *res = json_patch_rfc6902(a, ops);
+			assert(res && json_value_equal(res, b, true));
+			cJSON_Delete(res);
+			cJSON_Delete(ops);
+		}
+		cJSON_Delete(a);
+		cJSON_Delete(b);
+	}
+
+	/* Equal values give no operations */
+	cJSON *ops = json_diff_rfc6902(l, l, NULL);
+	assert(cJSON_IsArray(ops) && cJSON_GetArraySize(ops) == 0);
+	cJSON_Delete(ops);
+
+	/* Keys are escaped as RFC 6901 reference tokens */
+	ops = json_diff_rfc6902(l, r, NULL);
+	char *text = cJSON_PrintUnformatted(ops);
+	assert(text && strstr(text, "\"/a~1b/m~0n/"));
+	free(text);
+	cJSON_Delete(ops);
+
+	/* Changes inside a moved element are diffed member by member */
+	ops = json_diff_rfc6902(l, r, &variants[1]);
+	text = cJSON_PrintUnformatted(ops);
+	assert(text &&
+	       strstr(text, "{\"op\":\"add\",\"path\":\"/list/3/v/1\""));
+	free(text);
+	cJSON_Delete(ops);
+
+	/* Path filters hold for the operations too */
+	const char *skip[] = {"o", "list"};
+	struct json_diff_options filtered = {.strict_equality = true,
+	                                     .exclude_paths = skip,
+	                                     .exclude_count = 2};
+	ops = json_diff_rfc6902(l, r, &filtered);
+	text = cJSON_PrintUnformatted(ops);
+	assert(text && !strstr(text, "\"/o/") && !strstr(text, "\"/list") &&
+	       strstr(text, "\"/n\""));
+	free(text);
+	cJSON_Delete(ops);
+
+	/* Examples from RFC 6902, appendix A */
+	const struct {
+		const char *doc, *patch, *expect;
+	} cases[] = {
+	    {"{\"foo\":[\"bar\",\"baz\"]}",
+	     "[{\"op\":\"add\",\"path\":\"/foo/1\",\"value\":\"qux\"}]",
+	     "{\"foo\":[\"bar\",\"qux\",\"baz\"]}"},
+	    {"{\"foo\":{\"bar\":\"baz\",\"waldo\":\"fred\"},"
+	     "\"qux\":{\"corge\":\"grault\"}}",
+	     "[{\"op\":\"move\",\"from\":\"/foo/waldo\","
+	     "\"path\":\"/qux/thud\"}]",
+	     "{\"foo\":{\"bar\":\"baz\"},"
+	     "\"qux\":{\"corge\":\"grault\",\"thud\":\"fred\"}}"},
+	    {"{\"foo\":[\"all\",\"grass\",\"cows\",\"eat\"]}",
+	     "[{\"op\":\"move\",\"from\":\"/foo/1\",\"path\":\"/foo/3\"}]",
+	     "{\"foo\":[\"all\",\"cows\",\"eat\",\"grass\"]}"},
+	    {"{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}",
+	     "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"qux\"},"
+	     "{\"op\":\"test\",\"path\":\"/foo/1\",\"value\":2}]",
+	     "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}"},
+	    {"{\"foo\":\"bar\"}",
+	     "[{\"op\":\"add\",\"path\":\"/child\","
+	     "\"value\":{\"grandchild\":{}}}]",
+	     "{\"foo\":\"bar\",\"child\":{\"grandchild\":{}}}"},
+	    {"{\"foo\":[\"bar\"]}",
+	     "[{\"op\":\"add\",\"path\":\"/foo/-\",\"value\":[\"abc\"]}]",
+	     "{\"foo\":[\"bar\",[\"abc\"]]}"},
+	    {"{\"/\":9,\"~1\":10}",
+	     "[{\"op\":\"test\",\"path\":\"/~01\",\"value\":10},"
+	     "{\"op\":\"copy\",\"from\":\"/~1\",\"path\":\"/x\"},"
+	     "{\"op\":\"remove\",\"path\":\"/~1\"}]",
+	     "{\"~1\":10,\"x\":9}"},
+	    {"{\"foo\":1}", "[{\"op\":\"replace\",\"path\":\"\",\"value\":[2]}]",
+	     "[2]"},
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		cJSON *doc = cJSON_Parse(cases[i].doc);
+		cJSON *patch = cJSON_Parse(cases[i].patch);
+		cJSON *want = cJSON_Parse(cases[i].expect);
+		assert(doc && patch && want);
+		cJSON *res = json_patch_rfc6902_inplace(doc, patch);
+		assert(res && json_value_equal(res, want, true));
+		cJSON_Delete(res);
+		cJSON_Delete(patch);
+		cJSON_Delete(want);
+	}
+
+	/* Failures free the target */
+	const char *bad[] = {
+	    "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"bar\"}]",
+	    "[{\"op\":\"add\",\"path\":\"/baz/bat\",\"value\":\"qux\"}]",
+	    "[{\"op\":\"remove\",\"path\":\"/foo/01\"}]",
+	    "[{\"op\":\"add\",\"path\":\"/foo/3\",\"value\":1}]",
+	    "[{\"op\":\"replace\",\"path\":\"/~2\",\"value\":1}]",
+	    "[{\"op\":\"move\",\"from\":\"/foo\",\"path\":\"/foo/0\"}]",
+	    "[{\"op\":\"remove\",\"path\":\"foo\"}]",
+	    "[{\"op\":\"frobnicate\",\"path\":\"/foo\"}]",
+	    "[{\"op\":\"add\",\"path\":\"/foo/-\"}]",
+	};
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		cJSON *patch = cJSON_Parse(bad[i]);
+		assert(patch);
+		cJSON *doc = cJSON_Parse("{\"baz\":\"qux\",\"foo\":[1,2]}");
+		assert(json_patch_rfc6902_inplace(doc, patch) == NULL);
+		cJSON_Delete(patch);
+	}
+
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	printf("JSON Patch (RFC 6902) test passed!\n");
+}
+
+static void test_text_diff(void)
+{
+	printf("Testing text diffs of long strings...\n");
+	/* A document body: lines with multi-byte and reserved characters */
+	size_t cap = 64 * 1024, len = 0;
+	char *body = malloc(cap), *edited = malloc(cap);
+	assert(body && edited);
+	for (int i = 0; len + 128 < cap; i++)
+		len += (size_t)snprintf(body + len, cap - len,
+		                        "%d: caf\xC3\xA9 \xF0\x9F\x98\x80 100%% "
+		                        "a/b?c=d&e+f #%d \"q\"\n",
+		                        i, i);
+	memcpy(edited, body, len + 1);
+	memcpy(strstr(edited + len / 2, "\xC3\xA9"), "\xC3\xA8", 2);
+	memcpy(strstr(edited, "caf"), "cof", 3);
+
+	cJSON *l = cJSON_CreateObject(), *r = cJSON_CreateObject();
+	assert(l && r);
+	cJSON_AddStringToObject(l, "body", body);
+	cJSON_AddStringToObject(r, "body", edited);
+	cJSON_AddStringToObject(l, "title", "short title");
+	cJSON_AddStringToObject(r, "title", "short title!");
+	cJSON *la = cJSON_AddArrayToObject(l, "parts");
+	cJSON *ra = cJSON_AddArrayToObject(r, "parts");
+	cJSON *lp = cJSON_CreateObject(), *rp = cJSON_CreateObject();
+	cJSON_AddNumberToObject(lp, "id", 1);
+	cJSON_AddNumberToObject(rp, "id", 1);
+	cJSON_AddStringToObject(lp, "text", body);
+	cJSON_AddStringToObject(rp, "text", edited);
+	cJSON_AddItemToArray(la, lp);
+	cJSON_AddItemToArray(ra, rp);
+
+	struct json_diff_arena arena;
+	json_diff_arena_init(&arena, 0);
+	struct json_diff_options variants[] = {
+	    {.strict_equality = true, .text_diff_min_length = 60,
+	     .object_key = "id"},
+	    {.strict_equality = true, .text_diff_min_length = 60,
+	     .object_key = "id", .forward_only = true},
+	    {.strict_equality = true, .text_diff_min_length = 60,
+	     .object_key = "id", .arena = &arena,
+	     .output = JSON_DIFF_OUTPUT_BORROWED},
+	};
+	for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+		cJSON *d = json_diff(l, r, &variants[v]);
+		assert(d);
+		/* Long strings carry a small patch, short ones change whole */
+		const cJSON *op = cJSON_GetObjectItem(d, "body");
+		assert(cJSON_GetArraySize(op) == 3 &&
+		       cJSON_IsString(op->child) &&
+		       strlen(op->child->valuestring) < 200 &&
+		       cJSON_GetArrayItem(op, 2)->valuedouble == 2);
+		assert(cJSON_GetArraySize(cJSON_GetObjectItem(d, "title")) == 2);
+		const cJSON *el = cJSON_GetObjectItem(
+		    cJSON_GetObjectItem(cJSON_GetObjectItem(d, "parts"), "0"),
+		    "text");
+		assert(cJSON_GetArraySize(el) == 3);
+
+		cJSON *res = json_patch(l, d);
+		assert(res && json_value_equal(res, r, true));
+		cJSON_Delete(res);
+
+		/* Binary round trip, and the same delta from the writer */
+		unsigned char *bin = NULL;
+		size_t blen = 0;
+		assert(json_diff_encode_binary(d, 0, &bin, &blen) == 0);
+		cJSON *back = json_diff_decode_binary(bin, blen);
+		assert(back && json_value_equal(back, d, true));
+		res = json_patch_binary(l, bin, blen);
+		assert(res && json_value_equal(res, r, true));
+		cJSON_Delete(res);
+		cJSON_Delete(back);
+		free(bin);
+
+		size_t needed;
+		assert(json_diff_write_buf(l, r, &variants[v], NULL, 0,
+		                           &needed) == 1);
+		char *text = malloc(needed + 1);
+		assert(text && json_diff_write_buf(l, r, &variants[v], text,
+		                                   needed + 1, NULL) == 1);
+		cJSON *parsed = cJSON_Parse(text);
+		assert(parsed && json_value_equal(parsed, d, true));
+		res = json_patch_str(cJSON_Duplicate(l, 1), text);
+		assert(res && json_value_equal(res, r, true));
+		cJSON_Delete(res);
+		cJSON_Delete(parsed);
+		free(text);
+		json_diff_free(d, &variants[v]);
+	}
+	json_diff_arena_cleanup(&arena);
+
+	/* json_diff_str() writes the same delta */
+	char *lt = cJSON_PrintUnformatted(l), *rt = cJSON_PrintUnformatted(r);
+	struct json_diff_options opts = {.strict_equality = true,
+	                                 .object_key = "id",
+	                                 .text_diff_min_length = 60,
+	                                 .max_input_size = 1 << 20};
+	cJSON *d = json_diff(l, r, &opts), *ds = json_diff_str(lt, rt, &opts);
+	assert(d && ds && json_value_equal(d, ds, true));
+	cJSON_Delete(ds);
+	free(lt);
+	free(rt);
+
+	/* A text diff only applies to the string it was made from */
+	cJSON *other = cJSON_Duplicate(l, 1);
+	cJSON_ReplaceItemInObject(other, "body", cJSON_CreateString(edited));
+	assert(json_patch(other, d) == NULL);
+	cJSON_Delete(other);
+	cJSON_Delete(d);
+
+	/* Off, below the threshold, or not UTF-8: a whole change */
+	opts.text_diff_min_length = 0;
+	d = json_diff(l, r, &opts);
+	assert(cJSON_GetArraySize(cJSON_GetObjectItem(d, "body")) == 2);
+	cJSON_Delete(d);
+	opts.text_diff_min_length = len + 1;
+	d = json_diff(l, r, &opts);
+	assert(cJSON_GetArraySize(cJSON_GetObjectItem(d, "body")) == 2);
+	cJSON_Delete(d);
+	opts.text_diff_min_length = 60;
+	edited[0] = '\xFF';
+	cJSON_ReplaceItemInObject(r, "body", cJSON_CreateString(edited));
+	d = json_diff(l, r, &opts);
+	assert(cJSON_GetArraySize(cJSON_GetObjectItem(d, "body")) == 2);
+	cJSON_Delete(d);
+
+	/* Patch text as jsondiffpatch writes it (wider context) */
+	cJSON *s = cJSON_CreateString(
+	    "The quick brown fox jumps over the lazy dog.");
+	cJSON *jdp = cJSON_Parse(
+	    "[\"@@ -1,11 +1,12 @@\\n Th\\n-e\\n+at\\n  quick b\\n"
+	    "@@ -22,18 +22,17 @@\\n jump\\n-s\\n+ed\\n  over \\n-the\\n+a\\n"
+	    "  laz\\n\",0,2]");
+	cJSON *res = json_patch(s, jdp);
+	assert(res && strcmp(res->valuestring,
+	                     "That quick brown fox jumped over a lazy dog.") == 0);
+	cJSON_Delete(res);
+	/* ... and as an array element */
+	cJSON *arr = cJSON_CreateArray(), *ad = cJSON_CreateObject();
+	cJSON_AddItemToArray(arr, cJSON_Duplicate(s, 1));
+	cJSON_AddStringToObject(ad, "_t", "a");
+	cJSON_AddItemToObject(ad, "0", jdp);
+	res = json_patch(arr, ad);
+	assert(res && strcmp(res->child->valuestring,
+	                     "That quick brown fox jumped over a lazy dog.") == 0);
+	cJSON_Delete(res);
+	cJSON_Delete(ad);
+	cJSON_Delete(arr);
+
+	/* Malformed or mismatching patch text fails the patch */
+	const char *bad[] = {
+	    "[\"@@ -1,3 +1,3 @@\\n-Thx\\n+abc\\n\",0,2]",
+	    "[\"@@ -1,3 +1,3 @@\\n*The\\n\",0,2]",
+	    "[\"@@ -1,3 +1,3\\n The\\n\",0,2]",
+	    "[\"@@ -1,3 +1,3 @@\\n+%G0\\n\",0,2]",
+	    "[\"@@ -99,1 +99,1 @@\\n-x\\n\",0,2]",
+	};
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		cJSON *p = cJSON_Parse(bad[i]);
+		assert(p && json_patch(s, p) == NULL);
+		cJSON_Delete(p);
+	}
+	cJSON_Delete(s);
+
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+	free(body);
+	free(edited);
+	printf("Text diff test passed!\n");
+}
+
+/*
+ * Diff @lt against @rt with path filters and expect @want (NULL for no
+ * delta) from the tree, token, writer, resumable and prepared paths alike
+ */
+static void check_filtered(const char *lt, const char *rt,
+                           const struct json_diff_options *opts,
+                           const char *want)
+{
+	cJSON *l = cJSON_Parse(lt), *r = cJSON_Parse(rt);
+	cJSON *w = want ? cJSON_Parse(want) : NULL;
+	assert(l && r && (w || !want));
+	cJSON *d = json_diff(l, r, opts);
+	assert(want ? d && json_value_equal(d, w, true) : !d);
+
+	cJSON *ds = json_diff_str(lt, rt, opts);
+	assert(want ? ds && json_value_equal(ds, w, true) : !ds);
+	cJSON_Delete(ds);
+
+	char buf[1024];
+	int rc = json_diff_write_buf(l, r, opts, buf, sizeof(buf), NULL);
+	assert(rc == (want ? 1 : 0));
+	if (want) {
+		cJSON *parsed = cJSON_Parse(buf);
+		assert(parsed && json_value_equal(parsed, w, true));
+		cJSON_Delete(parsed);
+	}
+
+	int steps;
+	cJSON *dt = diff_in_steps(l, r, opts, 1, &steps);
+	assert(want ? dt && json_value_equal(dt, w, true) : !dt);
+	cJSON_Delete(dt);
+
+	struct json_diff_prepared *prep = json_diff_prepare(l, opts);
+	assert(prep);
+	cJSON *dp = json_diff_prepared(prep, r);
+	assert(want ? dp && json_value_equal(dp, w, true) : !dp);
+	cJSON_Delete(dp);
+	json_diff_prepared_free(prep);
+
+	/* What the filters keep patches into the right side */
+	if (d) {
+		cJSON *res = json_patch(l, d);
+		assert(res);
+		cJSON_Delete(res);
+	}
+	cJSON_Delete(d);
+	cJSON_Delete(w);
+	cJSON_Delete(l);
+	cJSON_Delete(r);
+}
+
+static void test_path_filters(void)
+{
+	printf("Testing path filters and depth limits...\n");
+	const char *l =
+	    "{\"data\":{\"a\":{\"prices\":[1,2],\"name\":\"x\",\"big\":{\"k\":1}},"
+	    "\"b\":{\"prices\":[3],\"name\":\"y\"}},\"meta\":{\"v\":1},"
+	    "\"items\":[{\"p\":1,\"q\":1},{\"p\":2,\"q\":2}]}";
+	const char *r =
+	    "{\"data\":{\"a\":{\"prices\":[1,3],\"name\":\"z\",\"big\":{\"k\":2}},"
+	    "\"b\":{\"prices\":[3],\"name\":\"w\"},\"c\":{\"prices\":[4]}},"
+	    "\"meta\":{\"v\":2},"
+	    "\"items\":[{\"p\":1,\"q\":9},{\"p\":5,\"q\":2},{\"p\":6}]}";
+
+	/* Only the prices; a record that appears on the way comes whole */
+	const char *prices[] = {"data.*.prices"};
+	struct json_diff_options o = {.strict_equality = true,
+	                              .include_paths = prices,
+	                              .include_count = 1};
+	check_filtered(l, r, &o,
+	               "{\"data\":{\"a\":{\"prices\":{\"_1\":[2,0,0],\"1\":[3],"
+	               "\"_t\":\"a\"}},\"c\":[{\"prices\":[4]}]}}");
+	o.hash_cache = true;
+	check_filtered(l, r, &o,
+	               "{\"data\":{\"a\":{\"prices\":{\"_1\":[2,0,0],\"1\":[3],"
+	               "\"_t\":\"a\"}},\"c\":[{\"prices\":[4]}]}}");
+	o.hash_cache = false;
+
+	/* Arrays on the way pair elements by position, not by value */
+	const char *item_p[] = {"items.*.p"};
+	o.include_paths = item_p;
+	check_filtered(l, r, &o,
+	               "{\"items\":{\"1\":{\"p\":[2,5]},\"2\":[{\"p\":6}],"
+	               "\"_t\":\"a\"}}");
+
+	/* Exclusions, with a glob inside a segment */
+	const char *skip[] = {"data.*.nam*", "meta", "items", "data.a.big"};
+	o = (struct json_diff_options){.strict_equality = true,
+	                               .exclude_paths = skip,
+	                               .exclude_count = 4};
+	check_filtered(l, r, &o,
+	               "{\"data\":{\"a\":{\"prices\":{\"_1\":[2,0,0],\"1\":[3],"
+	               "\"_t\":\"a\"}},\"c\":[{\"prices\":[4]}]}}");
+	/* ... winning over an inclusion */
+	o.include_paths = prices;
+	o.include_count = 1;
+	const char *no_a[] = {"data.a"};
+	o.exclude_paths = no_a;
+	o.exclude_count = 1;
+	check_filtered(l, r, &o, "{\"data\":{\"c\":[{\"prices\":[4]}]}}");
+	const char *all[] = {""};
+	o.exclude_paths = all;
+	check_filtered(l, r, &o, NULL);
+
+	/* Past max_depth containers change whole */
+	o = (struct json_diff_options){.strict_equality = true,
+	                               .max_depth = 2};
+	check_filtered(
+	    "{\"a\":{\"b\":{\"c\":1},\"d\":[1]},\"e\":[{\"x\":{\"y\":1}}]}",
+	    "{\"a\":{\"b\":{\"c\":2},\"d\":[1]},\"e\":[{\"x\":{\"y\":2}}]}",
+	    &o,
+	    "{\"a\":{\"b\":[{\"c\":1},{\"c\":2}]},"
+	    "\"e\":{\"0\":[{\"x\":{\"y\":1}},{\"x\":{\"y\":2}}],"
+	    "\"_t\":\"a\"}}");
+	o.include_paths = prices;
+	o.include_count = 1;
+	o.max_depth = 1;
+	check_filtered(l, r, &o,
+	               "{\"data\":[{\"a\":{\"prices\":[1,2],\"name\":\"x\","
+	               "\"big\":{\"k\":1}},\"b\":{\"prices\":[3],"
+	               "\"name\":\"y\"}},{\"a\":{\"prices\":[1,3],"
+	               "\"name\":\"z\",\"big\":{\"k\":2}},\"b\":{\"prices\":"
+	               "[3],\"name\":\"w\"},\"c\":{\"prices\":[4]}}]}");
+	/* Differences only where the filters do not look: nothing */
+	check_filtered("{\"data\":{\"a\":{\"prices\":[1],\"n\":1}}}",
+	               "{\"data\":{\"a\":{\"prices\":[1],\"n\":2}}}", &o, NULL);
+	printf("Path filter test passed!\n");
+}
+
+static void test_array_patch_moves(void)
+{
+	printf("Testing array patch with moves...\n");
+	/* jsondiffpatch: move sources leave, then targets enter in order */
+	const struct {
+		const char *orig, *delta, *expect;
+	} cases[] = {
+	    {"[1,2,3]", "{\"_t\":\"a\",\"_2\":[\"\",0,3]}", "[3,1,2]"},
+	    {"[1,2,3,4]",
+	     "{\"_t\":\"a\",\"_0\":[\"\",3,3],\"_1\":[2,0,0],"
+	     "\"1\":[9]}",
+	     "[3,9,4,1]"},
+	    {"[{\"a\":1},2]",
+	     "{\"_t\":\"a\",\"_0\":[\"\",1,3],\"1\":{\"a\":[1,5]}}",
+	     "[2,{\"a\":5}]"},
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		cJSON *o = cJSON_Parse(cases[i].orig);
+		cJSON *d = cJSON_Parse(cases[i].delta);
+		cJSON *e = cJSON_Parse(cases[i].expect);
+		assert(o && d && e);
+		cJSON *p = json_patch(o, d);
+		assert(p && json_value_equal(p, e, true));
+		cJSON_Delete(p);
+		p = json_patch_inplace(o, d);
+		assert(p && json_value_equal(p, e, true));
+		cJSON_Delete(p);
+		cJSON_Delete(d);
+		cJSON_Delete(e);
+	}
+	printf("Array patch moves test passed!\n");
+}
+
 static void test_bigger_diff(void)
 {
 	char *s1 = read_file("tests/big_json1.json");
@@ -835,6 +2774,32 @@ int main(void)
 	test_deleted_key_patch();
 	test_numeric_type_equality();
 	test_array_patch_shift_inside();
+	test_array_patch_insert_middle();
+	test_hash_cache_diff();
+	test_arena_diff_reset();
+	test_arena_growth();
+	test_object_key_order();
+	test_patch_wide_object();
+	test_borrowed_output();
+	test_patch_inplace();
+	test_patch_text();
+	test_rfc6902();
+	test_text_diff();
+	test_path_filters();
+	test_array_patch_moves();
+	test_diff_write();
+	test_diff_str_tokens();
+	test_diff_files();
+	test_parallel_object_diff();
+	test_prepared_diff();
+	test_diff_session();
+	test_diff_compose();
+	test_binary_delta();
+	test_forward_only();
+	test_equal_fast_paths();
+	test_diff_stats();
+	test_resumable_diff();
+	test_equal_wide_objects();
 	test_bigger_diff();
 	test_bigger_patch();
 
@@ -5,13 +5,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-static void assert_no_diff(const char *a, const char *b)
+static const enum json_diff_array_engine engines[] = {
+    JSON_DIFF_ARRAY_TRACE, JSON_DIFF_ARRAY_LINEAR};
+
+static void assert_no_diff_engine(const char *a, const char *b,
+                                  enum json_diff_array_engine engine)
 {
 	cJSON *ja = cJSON_Parse(a);
 	cJSON *jb = cJSON_Parse(b);
 	assert(ja && jb);
-	struct json_diff_options opts = {.strict_equality = true,
-	                                 .arena = NULL};
+	struct json_diff_options opts = {
+	    .strict_equality = true, .arena = NULL, .array_engine = engine};
 	cJSON *d = json_myers_array_diff(ja, jb, &opts);
 	if (d) {
 		char *s = cJSON_Print(d);
@@ -23,20 +27,28 @@ static void assert_no_diff(const char *a, const char *b)
 	cJSON_Delete(jb);
 }
 
-static void assert_diff_eq(const char *a, const char *b, const char *expected)
+static void assert_no_diff(const char *a, const char *b)
+{
+	for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++)
+		assert_no_diff_engine(a, b, engines[i]);
+}
+
+static void assert_diff_eq_engine(const char *a, const char *b,
+                                  const char *expected,
+                                  enum json_diff_array_engine engine)
 {
 	cJSON *ja = cJSON_Parse(a);
 	cJSON *jb = cJSON_Parse(b);
 	cJSON *je = cJSON_Parse(expected);
 	assert(ja && jb && je);
-	struct json_diff_options opts = {.strict_equality = true,
-	                                 .arena = NULL};
+	struct json_diff_options opts = {
+	    .strict_equality = true, .arena = NULL, .array_engine = engine};
 	cJSON *d = json_myers_array_diff(ja, jb, &opts);
 	if (!json_value_equal(d, je, false)) {
 		char *got = cJSON_Print(d);
 		char *exp = cJSON_Print(je);
-		fprintf(stderr, "Diff mismatch\nGot: %s\nExp: %s\n",
-		        got ? got : "NULL", exp ? exp : "NULL");
+		fprintf(stderr, "Diff mismatch (engine %d)\nGot: %s\nExp: %s\n",
+		        (int)engine, got ? got : "NULL", exp ? exp : "NULL");
 		free(got);
 		free(exp);
 	}
@@ -47,6 +59,244 @@ static void assert_diff_eq(const char *a, const char *b, const char *expected)
 	cJSON_Delete(je);
 }
 
+static void assert_diff_eq(const char *a, const char *b, const char *expected)
+{
+	for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++)
+		assert_diff_eq_engine(a, b, expected, engines[i]);
+}
+
+/* Diff with @opts must equal @expected on both engines */
+static void assert_diff_eq_opts(const char *a, const char *b,
+                                const struct json_diff_options *base,
+                                const char *expected)
+{
+	cJSON *ja = cJSON_Parse(a);
+	cJSON *jb = cJSON_Parse(b);
+	cJSON *je = cJSON_Parse(expected);
+	assert(ja && jb && je);
+	for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+		struct json_diff_options opts = *base;
+		opts.array_engine = engines[i];
+		cJSON *d = json_myers_array_diff(ja, jb, &opts);
+		if (!d || !json_value_equal(d, je, true)) {
+			char *s = d ? cJSON_PrintUnformatted(d) : NULL;
+			fprintf(stderr, "Diff mismatch, got: %s\n", s ? s : "NULL");
+			free(s);
+			assert(0);
+		}
+		cJSON_Delete(d);
+	}
+	cJSON_Delete(ja);
+	cJSON_Delete(jb);
+	cJSON_Delete(je);
+}
+
+/* Keyed diff must match @expected and patch @a into @b on both engines */
+static void assert_keyed_diff_eq(const char *a, const char *b,
+                                 const struct json_diff_options *base,
+                                 const char *expected)
+{
+	cJSON *ja = cJSON_Parse(a);
+	cJSON *jb = cJSON_Parse(b);
+	cJSON *je = cJSON_Parse(expected);
+	assert(ja && jb && je);
+	for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+		struct json_diff_options opts = *base;
+		opts.array_engine = engines[i];
+		cJSON *d = json_myers_array_diff(ja, jb, &opts);
+		if (!d || !json_value_equal(d, je, true)) {
+			char *s = d ? cJSON_PrintUnformatted(d) : NULL;
+			fprintf(stderr, "Keyed diff mismatch, got: %s\n",
+			        s ? s : "NULL");
+			free(s);
+			assert(0);
+		}
+		cJSON *patched = json_patch(ja, d);
+		assert(patched && json_value_equal(patched, jb, true));
+		cJSON_Delete(patched);
+		cJSON_Delete(d);
+	}
+	cJSON_Delete(ja);
+	cJSON_Delete(jb);
+	cJSON_Delete(je);
+}
+
+static const cJSON *name_hash(const cJSON *item, void *data)
+{
+	(void)data;
+	return cJSON_GetObjectItemCaseSensitive(item, "name");
+}
+
+/* Delta must carry @moves move ops and round-trip on both engines */
+static void assert_moves(const char *a, const char *b,
+                         const struct json_diff_options *base, int moves)
+{
+	cJSON *ja = cJSON_Parse(a);
+	cJSON *jb = cJSON_Parse(b);
+	assert(ja && jb);
+	for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+		struct json_diff_options opts = *base;
+		opts.array_engine = engines[i];
+		cJSON *d = json_myers_array_diff(ja, jb, &opts);
+		assert(d);
+		int found = 0;
+		for (cJSON *op = d->child; op; op = op->next) {
+			if (op->string[0] == '_' && cJSON_IsArray(op) &&
+			    cJSON_IsString(op->child) &&
+			    op->child->valuestring[0] == '\0')
+				found++;
+		}
+		assert(found == moves);
+		cJSON *patched = json_patch(ja, d);
+		assert(patched && json_value_equal(patched, jb, true));
+		cJSON_Delete(patched);
+		cJSON_Delete(d);
+	}
+	cJSON_Delete(ja);
+	cJSON_Delete(jb);
+}
+
+/* Both engines must agree on edit distance and round-trip through patch */
+static void assert_engines_roundtrip(int n)
+{
+	cJSON *ja = cJSON_CreateArray();
+	cJSON *jb = cJSON_CreateArray();
+	assert(ja && jb);
+	for (int i = 0; i < n; i++) {
+		cJSON_AddItemToArray(ja, cJSON_CreateNumber(i % 7));
+		if (i % 11 != 3)
+			cJSON_AddItemToArray(jb, cJSON_CreateNumber(i % 7));
+		if (i % 13 == 5)
+			cJSON_AddItemToArray(jb, cJSON_CreateNumber(100 + i));
+	}
+	int ops[2] = {0, 0};
+	for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+		struct json_diff_options opts = {.strict_equality = true,
+		                                 .array_engine = engines[e]};
+		cJSON *d = json_myers_array_diff(ja, jb, &opts);
+		assert(d);
+		ops[e] = cJSON_GetArraySize(d);
+		cJSON *patched = json_patch(ja, d);
+		assert(patched && json_value_equal(patched, jb, true));
+		cJSON_Delete(patched);
+		cJSON_Delete(d);
+	}
+	assert(ops[0] == ops[1]);
+	cJSON_Delete(ja);
+	cJSON_Delete(jb);
+}
+
+/* Threaded prefix/suffix scans must give the serial delta */
+static void assert_parallel_scan(int n, int change_at, const char *key)
+{
+	cJSON *ja = cJSON_CreateArray();
+	cJSON *jb = cJSON_CreateArray();
+	assert(ja && jb);
+	for (int i = 0; i < n; i++) {
+		cJSON *o = cJSON_CreateObject();
+		cJSON_AddNumberToObject(o, "id", i);
+		cJSON_AddStringToObject(o, "name", "record");
+		cJSON_AddItemToArray(ja, o);
+		o = cJSON_Duplicate(o, 1);
+		if (i == change_at)
+			cJSON_ReplaceItemInObject(o, "name",
+			                          cJSON_CreateString("changed"));
+		cJSON_AddItemToArray(jb, o);
+	}
+	struct json_diff_options serial = {.strict_equality = true,
+	                                   .object_key = key};
+	for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+		serial.array_engine = engines[e];
+		struct json_diff_options par = serial;
+		par.threads = 4;
+		cJSON *want = json_myers_array_diff(ja, jb, &serial);
+		cJSON *got = json_myers_array_diff(ja, jb, &par);
+		assert(change_at < 0 ? !want && !got
+		                     : want && got &&
+		                           json_value_equal(want, got, true));
+		cJSON_Delete(want);
+		cJSON_Delete(got);
+	}
+	cJSON_Delete(ja);
+	cJSON_Delete(jb);
+}
+
+/*
+ * Edit cost budget: arrays within it get the minimal delta, others the
+ * anchored fallback, which must still patch and is flagged as inexact
+ */
+static void assert_bounded(int n)
+{
+	cJSON *ja = cJSON_CreateArray();
+	cJSON *jb = cJSON_CreateArray();
+	cJSON *jc = cJSON_CreateArray();
+	assert(ja && jb && jc);
+	for (int i = 0; i < n; i++) {
+		cJSON_AddItemToArray(ja, cJSON_CreateNumber(i));
+		/* Every 50th element replaced, every 97th repeated */
+		cJSON_AddItemToArray(jb,
+		                     cJSON_CreateNumber(i % 50 ? i : -i - 1));
+		if (i % 97 == 0)
+			cJSON_AddItemToArray(jb, cJSON_CreateNumber(i % 7));
+		cJSON_AddItemToArray(jc, cJSON_CreateNumber(n + i));
+	}
+	for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+		bool inexact = false;
+		struct json_diff_options exact = {.strict_equality = true,
+		                                  .array_engine = engines[e]};
+		struct json_diff_options bounded = exact;
+		bounded.max_edit_cost = 64;
+		bounded.inexact = &inexact;
+
+		/* Within budget: same delta, not flagged */
+		cJSON *small = cJSON_Duplicate(ja, 1);
+		cJSON_DeleteItemFromArray(small, n / 2);
+		cJSON *want = json_myers_array_diff(ja, small, &exact);
+		cJSON *got = json_myers_array_diff(ja, small, &bounded);
+		assert(want && got && json_value_equal(want, got, true));
+		assert(!inexact);
+		cJSON_Delete(want);
+		cJSON_Delete(got);
+		cJSON_Delete(small);
+
+		/* Scattered edits: anchors keep the unchanged runs */
+		want = json_myers_array_diff(ja, jb, &exact);
+		got = json_myers_array_diff(ja, jb, &bounded);
+		assert(got && inexact);
+		assert(cJSON_GetArraySize(got) < 2 * cJSON_GetArraySize(want));
+		cJSON *patched = json_patch(ja, got);
+		assert(patched && json_value_equal(patched, jb, true));
+		cJSON_Delete(patched);
+		cJSON_Delete(want);
+		cJSON_Delete(got);
+
+		/* Nothing in common: the array is replaced element by element */
+		inexact = false;
+		got = json_myers_array_diff(ja, jc, &bounded);
+		assert(got && inexact && cJSON_GetArraySize(got) == 2 * n + 1);
+		patched = json_patch(ja, got);
+		assert(patched && json_value_equal(patched, jc, true));
+		cJSON_Delete(patched);
+		cJSON_Delete(got);
+
+		/* The token backend honours the same budget */
+		char *ta = cJSON_PrintUnformatted(ja);
+		char *tb = cJSON_PrintUnformatted(jb);
+		inexact = false;
+		got = json_diff_str(ta, tb, &bounded);
+		assert(got && inexact);
+		patched = json_patch(ja, got);
+		assert(patched && json_value_equal(patched, jb, true));
+		cJSON_Delete(patched);
+		cJSON_Delete(got);
+		free(ta);
+		free(tb);
+	}
+	cJSON_Delete(ja);
+	cJSON_Delete(jb);
+	cJSON_Delete(jc);
+}
+
 int main(void)
 {
 	// Empty sequences
@@ -88,6 +338,77 @@ int main(void)
 	               "{\"0\":[{\"1\":2}],\"_0\":[1,0,0],\"_1\":[{\"1\":1},0,"
 	               "0],\"_t\":\"a\"}");
 
+	// Edits separated by an unchanged element keep their own indices
+	assert_diff_eq("[1,2,3,4,5]", "[1,9,3,8,5]",
+	               "{\"1\":[9],\"_1\":[2,0,0],\"3\":[8],\"_3\":[4,0,0],"
+	               "\"_t\":\"a\"}");
+
+	// Insert and delete on either side of a kept run
+	assert_diff_eq("[1,2,3,4]", "[0,2,3,4,5]",
+	               "{\"0\":[0],\"_0\":[1,0,0],\"4\":[5],\"_t\":\"a\"}");
+
+	assert_engines_roundtrip(500);
+
+	// Records matched by key: insert before, field change diffed in place
+	struct json_diff_options by_id = {.strict_equality = true,
+	                                  .object_key = "id"};
+	assert_keyed_diff_eq(
+	    "[{\"id\":1,\"v\":1},{\"id\":2,\"v\":2}]",
+	    "[{\"id\":0,\"v\":0},{\"id\":1,\"v\":1},{\"id\":2,\"v\":3}]",
+	    &by_id,
+	    "{\"0\":[{\"id\":0,\"v\":0}],\"2\":{\"v\":[2,3]},\"_t\":\"a\"}");
+
+	// A different key is a different record, even at the same position
+	assert_keyed_diff_eq(
+	    "[{\"id\":1,\"v\":1}]", "[{\"id\":2,\"v\":1}]", &by_id,
+	    "{\"_0\":[{\"id\":1,\"v\":1},0,0],\"0\":[{\"id\":2,\"v\":1}],"
+	    "\"_t\":\"a\"}");
+
+	// Nested key path; elements without the key match by value
+	struct json_diff_options by_path = {.strict_equality = true,
+	                                    .object_key = "meta.id"};
+	assert_keyed_diff_eq(
+	    "[7,{\"meta\":{\"id\":\"x\"},\"n\":1}]",
+	    "[7,{\"meta\":{\"id\":\"x\"},\"n\":2},8]", &by_path,
+	    "{\"1\":{\"n\":[1,2]},\"2\":[8],\"_t\":\"a\"}");
+
+	// Callback identity overrides the key path
+	struct json_diff_options by_name = {.strict_equality = true,
+	                                    .object_key = "id",
+	                                    .object_hash = name_hash};
+	assert_keyed_diff_eq(
+	    "[{\"name\":\"a\",\"id\":1},{\"name\":\"b\",\"id\":2}]",
+	    "[{\"name\":\"b\",\"id\":3}]", &by_name,
+	    "{\"_0\":[{\"name\":\"a\",\"id\":1},0,0],\"0\":{\"id\":[2,3]},"
+	    "\"_t\":\"a\"}");
+
+	// Reorders become moves instead of delete + add
+	struct json_diff_options moves = {.strict_equality = true,
+	                                  .detect_moves = true};
+	assert_diff_eq_opts("[1,2,3,4]", "[4,1,2,3]", &moves,
+	                    "{\"_3\":[\"\",0,3],\"_t\":\"a\"}");
+	assert_moves("[{\"k\":[1,2]},\"x\",3,{\"k\":[3]}]",
+	             "[{\"k\":[3]},3,\"x\",{\"k\":[1,2]}]", &moves, 3);
+	// Unmatched values stay plain deletions and additions
+	assert_moves("[1,2,3]", "[3,4,1]", &moves, 1);
+
+	// Keyed records move and carry their field diff
+	struct json_diff_options keyed_moves = {.strict_equality = true,
+	                                        .object_key = "id",
+	                                        .detect_moves = true};
+	assert_moves("[{\"id\":1,\"v\":1},{\"id\":2},{\"id\":3}]",
+	             "[{\"id\":3},{\"id\":2},{\"id\":1,\"v\":2}]",
+	             &keyed_moves, 2);
+
+	// Threaded scans: equal, change at the head, the middle, the tail
+	assert_parallel_scan(20000, -1, NULL);
+	assert_parallel_scan(20000, -1, "id");
+	assert_parallel_scan(20000, 0, NULL);
+	assert_parallel_scan(20000, 12345, NULL);
+	assert_parallel_scan(20000, 19999, "id");
+
+	assert_bounded(5000);
+
 	printf("Myers array diff tests passed\n");
 	return 0;
 }